@@ -42,26 +42,28 @@ void comp_bar_update(comp_progress_bar* bar)
         bar->first = 0;
     else
     {
-        printf("\033[1A");
-        printf("\r");
-        printf("\033[K");
+        fprintf(stderr, "\033[1A");
+        fprintf(stderr, "\r");
+        fprintf(stderr, "\033[K");
     }
-    printf("%s\n", bar->title);
+    fprintf(stderr, "%s\n", bar->title);
     int cnt = MAX_BAR_WIDTH * bar->progress / 100;
-    printf("\033[K");
-    printf("[");
+    fprintf(stderr, "\033[K");
+    fprintf(stderr, "[");
     for(int i = 0; i < cnt; i++)
-        printf("%c", i == cnt - 1 ? '>' : '=');
+        fprintf(stderr, "%c", i == cnt - 1 ? '>' : '=');
     for (int i = 0; i < MAX_BAR_WIDTH - cnt; i++)
-        printf(" ");
-    printf("]");
-    printf("[%zu%%] %c", bar->progress, r[bar->progress % 4]);
-    fflush(stdout);
+        fprintf(stderr, " ");
+    fprintf(stderr, "]");
+    fprintf(stderr, "[%zu%%] %c", bar->progress, r[bar->progress % 4]);
+    fflush(stderr);
 }
 
 void comp_bar_add(comp_progress_bar* bar, size_t delta)
 {
     bar->complete += delta;
+    if(bar->total == 0)
+        return;
     u_int32_t p = bar->complete * 100 / bar->total;
     if(p > bar->progress)
     {
@@ -0,0 +1,407 @@
+//
+// Created by zr on 23-2-15.
+//
+#include "bwt.h"
+#include "internal/sais.h"
+#include "marker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BWT_RUNA 0
+#define BWT_RUNB 1
+#define BWT_ESCAPE 0xFF
+
+static int encode(comp_bwt_ctx_t*, comp_bitstream_t*, comp_bitstream_t*);
+static int decode(comp_bwt_ctx_t*, comp_bitstream_t*, comp_bitstream_t*);
+
+comp_bwt_ctx_t* comp_bwt_init(comp_progress_bar* bar, size_t block_size)
+{
+    comp_bwt_ctx_t* bwt = (comp_bwt_ctx_t*) calloc(1, sizeof(comp_bwt_ctx_t));
+    if(!bwt) return NULL;
+    size_t threads = comp_threadpool_default_size();
+    bwt->threads = threads < BWT_THREADS ? (int) threads : BWT_THREADS;
+    if(bwt->threads < 1)
+        bwt->threads = 1;
+    comp_bwt_set_block_size(bwt, block_size);
+    bwt->bar = bar;
+    bwt->bwt_encode = encode;
+    bwt->bwt_decode = decode;
+    return bwt;
+}
+
+/* 块越大压缩率越高，但排序和逆变换的内存和耗时也越多。超出范围时使用 BWT_BLOCK_SIZE */
+void comp_bwt_set_block_size(comp_bwt_ctx_t* bwt, size_t block_size)
+{
+    if(block_size < BWT_BLOCK_MIN || block_size > BWT_BLOCK_MAX)
+        block_size = BWT_BLOCK_SIZE;
+    if(block_size != bwt->block_size)
+    {
+        free(bwt->in_buf);
+        bwt->in_buf = NULL;
+    }
+    bwt->block_size = block_size;
+}
+
+void comp_bwt_free(comp_bwt_ctx_t* bwt)
+{
+    if(!bwt) return;
+    comp_threadpool_destroy(bwt->pool);
+    for(int i = 0; i < BWT_THREADS; i++)
+    {
+        if(bwt->jobs[i].huff)
+            comp_huffman_free(bwt->jobs[i].huff);
+        comp_bar_free(bwt->jobs[i].bar);
+        free(bwt->jobs[i].enc);
+    }
+    free(bwt->in_buf);
+    free(bwt);
+}
+
+/* 零游程用 RUNA/RUNB 的双射二进制表示，RUNA 为 1 * 权，RUNB 为 2 * 权，权从1开始逐位翻倍 */
+static size_t bwt_put_run(u_char* out, size_t m, size_t run)
+{
+    size_t z = run - 1;
+    while(1)
+    {
+        out[m++] = (z & 1) ? BWT_RUNB : BWT_RUNA;
+        if(z < 2)
+            break;
+        z = (z - 2) >> 1;
+    }
+    return m;
+}
+
+/* MTF + 零游程编码。MTF序号 j(1-255) 写成 j + 1，254 和 255 写成 BWT_ESCAPE 后跟 0/1，
+ * out 至少 2 * n 字节 */
+static size_t bwt_mtf_encode(const u_char* in, size_t n, u_char* out)
+{
+    u_char order[256];
+    for(int i = 0; i < 256; i++)
+        order[i] = (u_char) i;
+    size_t m = 0, run = 0;
+    for(size_t i = 0; i < n; i++)
+    {
+        u_char c = in[i];
+        if(order[0] == c)
+        {
+            run++;
+            continue;
+        }
+        if(run)
+        {
+            m = bwt_put_run(out, m, run);
+            run = 0;
+        }
+        int j = 1;
+        while(order[j] != c)
+            j++;
+        memmove(order + 1, order, j);
+        order[0] = c;
+        if(j < BWT_ESCAPE - 1)
+            out[m++] = (u_char) (j + 1);
+        else
+        {
+            out[m++] = BWT_ESCAPE;
+            out[m++] = (u_char) (j - (BWT_ESCAPE - 1));
+        }
+    }
+    if(run)
+        m = bwt_put_run(out, m, run);
+    return m;
+}
+
+/* bwt_mtf_encode 的逆变换，结果必须正好是 n 字节 */
+static int bwt_mtf_decode(const u_char* in, size_t m, u_char* out, size_t n)
+{
+    u_char order[256];
+    for(int i = 0; i < 256; i++)
+        order[i] = (u_char) i;
+    size_t k = 0, run = 0, weight = 1;
+    for(size_t i = 0; i < m; i++)
+    {
+        u_char b = in[i];
+        if(b == BWT_RUNA || b == BWT_RUNB)
+        {
+            run += (b + 1) * weight;
+            weight <<= 1;
+            if(run > n - k)
+                return -1;
+            continue;
+        }
+        if(run)
+        {
+            memset(out + k, order[0], run);
+            k += run;
+            run = 0;
+            weight = 1;
+        }
+        int j = b - 1;
+        if(b == BWT_ESCAPE)
+        {
+            if(++i >= m || in[i] > 1)
+                return -1;
+            j = BWT_ESCAPE - 1 + in[i];
+        }
+        if(k >= n)
+            return -1;
+        u_char c = order[j];
+        memmove(order + 1, order, j);
+        order[0] = c;
+        out[k++] = c;
+    }
+    memset(out + k, order[0], run);
+    k += run;
+    return k == n ? 0 : -1;
+}
+
+/* 正变换。把结束符看作最小的字符，n + 1 个轮转排序后取最后一列，结束符所在的行号记为 primary，
+ * 最后一列去掉结束符后写入 last */
+static int bwt_forward(const u_char* in, size_t n, u_char* last, u_int32_t* primary)
+{
+    int* sa = (int*) malloc(sizeof(int) * (n + 1));
+    if(!sa || comp_sais(in, sa, (int) n) < 0)
+    {
+        free(sa);
+        return -1;
+    }
+    //第0行是以结束符开头的轮转，最后一个字符是 in[n - 1]
+    last[0] = in[n - 1];
+    for(size_t i = 1, j = 1; i <= n; i++)
+    {
+        if(sa[i] == 0)
+            *primary = (u_int32_t) i;
+        else
+            last[j++] = in[sa[i] - 1];
+    }
+    free(sa);
+    return 0;
+}
+
+/* 逆变换。由最后一列得到LF映射(每行左移一位后的行号)，从第0行出发，由后向前恢复原串 */
+static int bwt_inverse(const u_char* last, size_t n, u_int32_t primary, u_char* out)
+{
+    u_int32_t count[256] = {0}, start[256];
+    for(size_t i = 0; i < n; i++)
+        count[last[i]]++;
+    //第0行以结束符开头，其余字符从第1行开始
+    u_int32_t sum = 1;
+    for(int c = 0; c < 256; c++)
+    {
+        start[c] = sum;
+        sum += count[c];
+    }
+    u_int32_t* lf = (u_int32_t*) malloc(sizeof(u_int32_t) * (n + 1));
+    if(!lf) return -1;
+    for(size_t r = 0; r <= n; r++)
+        lf[r] = r == primary ? 0 : start[last[r < primary ? r : r - 1]]++;
+    u_int32_t r = 0;
+    for(size_t k = n; k-- > 0;)
+    {
+        if(r == primary)
+            break;
+        out[k] = last[r < primary ? r : r - 1];
+        r = lf[r];
+    }
+    free(lf);
+    return r == primary ? 0 : -1;
+}
+
+static void bwt_encode_job(void* arg)
+{
+    comp_bwt_job_t* job = (comp_bwt_job_t*) arg;
+    size_t n = job->raw_len;
+    u_char* last = (u_char*) malloc(n);
+    u_char* mtf = (u_char*) malloc(2 * n);
+    job->err = -1;
+    job->enc = NULL;
+    job->enc_len = 0;
+    if(last && mtf && bwt_forward(job->raw, n, last, &job->primary) == 0)
+    {
+        size_t m = bwt_mtf_encode(last, n, mtf);
+        comp_bitstream_t* in = comp_bitstream_init(fmemopen(mtf, m, "rb"));
+        comp_bitstream_t* out = comp_bitstream_init(open_memstream(&job->enc, &job->enc_len));
+        if(in && out)
+            job->err = job->huff->huffman_encode(job->huff, in, out);
+        comp_bitstream_destroy(in);
+        comp_bitstream_destroy(out);
+    }
+    free(last);
+    free(mtf);
+}
+
+static void bwt_decode_job(void* arg)
+{
+    comp_bwt_job_t* job = (comp_bwt_job_t*) arg;
+    size_t n = job->raw_len;
+    const u_char* enc = (const u_char*) job->enc;
+    job->err = -1;
+    //先检查MTF数据的长度，损坏的数据不会让huffman解码分配过多内存
+    if(job->enc_len < 5 || enc[0] != HUFFMAN_O1_HEADER_MARKER ||
+       ((u_int32_t) enc[1] << 24 | enc[2] << 16 | enc[3] << 8 | enc[4]) > 2 * n)
+        return;
+    char* mtf = NULL;
+    size_t m = 0;
+    comp_bitstream_t* in = comp_bitstream_init(fmemopen(job->enc, job->enc_len, "rb"));
+    comp_bitstream_t* out = comp_bitstream_init(open_memstream(&mtf, &m));
+    int err = in && out ? job->huff->huffman_decode(job->huff, in, out) : -1;
+    comp_bitstream_destroy(in);
+    comp_bitstream_destroy(out);
+    u_char* last = (u_char*) malloc(n);
+    if(err == 0 && last && bwt_mtf_decode((const u_char*) mtf, m, last, n) == 0)
+        job->err = bwt_inverse(last, n, job->primary, job->raw);
+    free(mtf);
+    free(last);
+}
+
+/* 并行执行前 count 个任务，只有一个任务或单线程时在当前线程执行 */
+static int bwt_run(comp_bwt_ctx_t* bwt, int count, comp_task_f fn)
+{
+    for(int i = 0; i < count; i++)
+    {
+        comp_bwt_job_t* job = &bwt->jobs[i];
+        job->ctx = bwt;
+        if(!job->bar && !(job->bar = comp_bar_init("", 0)))
+            return -1;
+        if(!job->huff && !(job->huff = comp_huffman_init(job->bar, HUFFMAN_O1_MAX_CODE_LEN, 1)))
+            return -1;
+    }
+    if(count > 1 && !bwt->pool)
+        bwt->pool = comp_threadpool_init(bwt->threads);
+    for(int i = 0; i < count; i++)
+        if(count == 1 || !bwt->pool || comp_threadpool_submit(bwt->pool, fn, &bwt->jobs[i]) < 0)
+            fn(&bwt->jobs[i]);
+    if(count > 1 && bwt->pool)
+        comp_threadpool_wait(bwt->pool);
+    for(int i = 0; i < count; i++)
+        if(bwt->jobs[i].err < 0)
+            return -1;
+    return 0;
+}
+
+static void bwt_release(comp_bwt_ctx_t* bwt, int count)
+{
+    for(int i = 0; i < count; i++)
+    {
+        free(bwt->jobs[i].enc);
+        bwt->jobs[i].enc = NULL;
+    }
+}
+
+/*
+ +----------+------------+------------------------------------------+
+ |  标识符  | 0x42       | 之后是若干块                             |
+ +----------+------------+------------------------------------------+
+ | 原始长度 | uint32_t   | n，为0表示结束                           |
+ +----------+------------+------------------------------------------+
+ |  行号    | uint32_t   | primary                                  |
+ +----------+------------+------------------------------------------+
+ | 数据长度 | uint32_t   | m                                        |
+ +----------+------------+------------------------------------------+
+ | 编码数据 | m          | MTF/RLE 数据的一阶上下文huffman编码      |
+ +----------+------------+------------------------------------------+
+ 每次读入 threads 块的数据并行变换，数据不足时平均分成若干块，避免最后剩下很小的一块
+ */
+int encode(comp_bwt_ctx_t* bwt, comp_bitstream_t* in_stream, comp_bitstream_t* out_stream)
+{
+    size_t cap = bwt->block_size * bwt->threads;
+    if(!bwt->in_buf && !(bwt->in_buf = (u_char*) malloc(cap)))
+        return -1;
+    comp_bitstream_write_char(out_stream, BWT_HEADER_MARKER);
+    while(1)
+    {
+        size_t n = 0, r;
+        while(n < cap && (r = fread(bwt->in_buf + n, 1, cap - n, in_stream->fp)) > 0)
+            n += r;
+        if(n == 0)
+            break;
+        int count = (int) ((n + bwt->block_size - 1) / bwt->block_size);
+        size_t len = (n + count - 1) / count;
+        for(int i = 0; i < count; i++)
+        {
+            bwt->jobs[i].raw = bwt->in_buf + i * len;
+            bwt->jobs[i].raw_len = i == count - 1 ? n - i * len : len;
+        }
+        int err = bwt_run(bwt, count, bwt_encode_job);
+        for(int i = 0; i < count && err == 0; i++)
+        {
+            comp_bwt_job_t* job = &bwt->jobs[i];
+            comp_bitstream_write_int(out_stream, (int) job->raw_len);
+            comp_bitstream_write_int(out_stream, (int) job->primary);
+            comp_bitstream_write_int(out_stream, (int) job->enc_len);
+            err = comp_bitstream_write(out_stream, job->enc, job->enc_len);
+            comp_bar_add(bwt->bar, job->raw_len);
+        }
+        bwt_release(bwt, count);
+        if(err < 0)
+            return -1;
+        if(n < cap)
+            break;
+    }
+    return comp_bitstream_write_int(out_stream, 0);
+}
+
+int decode(comp_bwt_ctx_t* bwt, comp_bitstream_t* in_stream, comp_bitstream_t* out_stream)
+{
+    char marker;
+    if(comp_bitstream_read_char(in_stream, &marker) < 0 || (u_char) marker != BWT_HEADER_MARKER)
+        return -1;
+    comp_bar_add(bwt->bar, 1);
+    int end = 0, err = 0;
+    while(!end && err == 0)
+    {
+        //读入一批块，逆变换是并行的
+        int count = 0, raw_len, primary, enc_len;
+        size_t total = 0;
+        while(count < bwt->threads)
+        {
+            if(comp_bitstream_read_int(in_stream, &raw_len) < 0)
+            {
+                err = -1;
+                break;
+            }
+            if(raw_len == 0)
+            {
+                comp_bar_add(bwt->bar, 4);
+                end = 1;
+                break;
+            }
+            comp_bwt_job_t* job = &bwt->jobs[count];
+            if(raw_len < 0 || raw_len > BWT_BLOCK_MAX ||
+               comp_bitstream_read_int(in_stream, &primary) < 0 || primary <= 0 || primary > raw_len ||
+               comp_bitstream_read_int(in_stream, &enc_len) < 0 || enc_len <= 0 ||
+               (size_t) enc_len > BWT_ENC_MAX((size_t) raw_len) ||
+               !(job->enc = (char*) malloc(enc_len)))
+            {
+                err = -1;
+                break;
+            }
+            count++;
+            job->raw_len = raw_len;
+            job->primary = primary;
+            job->enc_len = enc_len;
+            total += raw_len;
+            if(comp_bitstream_read(in_stream, job->enc, enc_len) < 0)
+            {
+                err = -1;
+                break;
+            }
+        }
+        u_char* out = count && err == 0 ? (u_char*) malloc(total) : NULL;
+        if(count && err == 0 && !out)
+            err = -1;
+        if(out)
+        {
+            for(int i = 0, off = 0; i < count; off += (int) bwt->jobs[i++].raw_len)
+                bwt->jobs[i].raw = out + off;
+            err = bwt_run(bwt, count, bwt_decode_job);
+            if(err == 0)
+                err = comp_bitstream_write(out_stream, (const char*) out, total);
+            for(int i = 0; i < count && err == 0; i++)
+                comp_bar_add(bwt->bar, 12 + bwt->jobs[i].enc_len);
+        }
+        free(out);
+        bwt_release(bwt, count);
+    }
+    return err;
+}
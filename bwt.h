@@ -0,0 +1,57 @@
+//
+// Created by zr on 23-2-15.
+// 块排序压缩：BWT + MTF + 零游程编码，最后用一阶上下文huffman编码
+//
+#ifndef COMPRESS_BWT_H
+#define COMPRESS_BWT_H
+#include "internal/bitstream.h"
+#include "internal/threadpool.h"
+#include "huffman.h"
+#include "bar.h"
+#include <sys/types.h>
+
+#define BWT_BLOCK_MIN (16 * 1024)
+#define BWT_BLOCK_MAX (1024 * 1024)
+#define BWT_BLOCK_SIZE (900 * 1024)     // 默认的BWT块大小
+#define BWT_THREADS 8                   // 最多同时变换的块数
+#define BWT_ENC_MAX(n) (3 * (n) + 8192) // 一块编码数据长度的上限
+
+struct comp_bwt_ctx_s;
+
+/* 一个BWT块的变换任务，压缩时 raw -> enc，解压时 enc -> raw */
+struct comp_bwt_job_s
+{
+    struct comp_bwt_ctx_s* ctx;
+    u_char* raw;
+    size_t raw_len;
+    u_int32_t primary;              // 原串在排序后的轮转中的行号
+    char* enc;                      // huffman编码后的 MTF/RLE 数据
+    size_t enc_len;
+    comp_huffman_ctx_t* huff;       // 每个任务独立的huffman上下文和进度条(不显示)
+    comp_progress_bar* bar;
+    int err;
+};
+
+typedef struct comp_bwt_job_s comp_bwt_job_t;
+typedef int (*comp_bwt_encode_f) (struct comp_bwt_ctx_s*, comp_bitstream_t*, comp_bitstream_t*);
+typedef int (*comp_bwt_decode_f) (struct comp_bwt_ctx_s*, comp_bitstream_t*, comp_bitstream_t*);
+
+struct comp_bwt_ctx_s
+{
+    size_t block_size;              // 压缩时BWT块的大小
+    int threads;
+    comp_threadpool_t* pool;        // 一次有多个块时才创建
+    comp_bwt_job_t jobs[BWT_THREADS];
+    u_char* in_buf;                 // 压缩时一批块的原始数据
+    comp_progress_bar* bar;
+    comp_bwt_encode_f bwt_encode;
+    comp_bwt_decode_f bwt_decode;
+};
+
+typedef struct comp_bwt_ctx_s comp_bwt_ctx_t;
+
+comp_bwt_ctx_t* comp_bwt_init(comp_progress_bar*, size_t);
+void comp_bwt_set_block_size(comp_bwt_ctx_t*, size_t);
+void comp_bwt_free(comp_bwt_ctx_t*);
+
+#endif //COMPRESS_BWT_H
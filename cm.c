@@ -0,0 +1,467 @@
+//
+// Created by zr on 23-2-16.
+//
+#include "cm.h"
+#include "marker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CM_LIMIT 30                // 计数上限，越小越适应数据的变化
+#define CM_MATCH_MAX 32             // 新匹配向前比较的最大长度
+#define CM_BAR_STEP (64 * 1024)
+
+static int encode(comp_cm_ctx_t*, comp_bitstream_t*, comp_bitstream_t*);
+static int decode(comp_cm_ctx_t*, comp_bitstream_t*, comp_bitstream_t*);
+
+/* 哈希上下文的阶数(前面多少个字节)，更长的重复由匹配模型预测 */
+static const int cm_orders[CM_ORDERS] = {1, 2, 3, 4, 6, 8, 12};
+
+/* 概率表更新的步长 1 / (n + 1.5)，n 为该项已更新的次数 */
+static int cm_dt[1024];
+
+/* 一次编码/解码过程的状态，模型本身在 comp_cm_ctx_t 中 */
+struct cm_state_s
+{
+    comp_cm_ctx_t* cm;
+    int bits;
+    u_int32_t c0;                   // 当前字节已编码的位，最前面补1
+    int bit_pos;
+    u_int64_t c8;                   // 最近的8个字节
+    u_int64_t c16;                  // 再往前的8个字节
+    u_int32_t hash[CM_ORDERS];      // 各阶上下文在字节边界的哈希
+    u_int32_t idx[CM_ORDERS];       // 当前位在各上下文表中的位置
+    u_int32_t pos;                  // 已处理的字节数
+    u_int32_t match_ptr;            // 匹配模型预测的下一个字节在历史数据中的位置
+    u_int32_t match_len;
+    int match_idx;                  // 当前位在 match_sm 中的位置，-1表示没有匹配
+    int x[CM_INPUTS];
+    int32_t* w;
+    int pr_mix;
+    int apm_idx;
+    int pr;
+    u_int32_t x1, x2, xd;           // 算术编码器的区间和解码时读入的值
+    u_char* buf;                    // 压缩时为输出，解压时为输入
+    size_t len;
+    size_t cap;
+    size_t rpos;                    // 解压时已读的长度
+};
+
+typedef struct cm_state_s cm_state_t;
+
+/* 把对数几率(放大256倍，-2047 - 2047)转换为12位概率 */
+static int cm_squash(int d)
+{
+    static const int t[33] = {1, 2, 3, 6, 10, 16, 27, 45, 73, 120, 194, 310, 488, 747, 1101, 1546,
+                              2047, 2549, 2994, 3348, 3607, 3785, 3901, 3975, 4024, 4050, 4068, 4079,
+                              4085, 4089, 4092, 4093, 4094};
+    if(d > 2047) return 4095;
+    if(d < -2047) return 1;
+    int w = d & 127;
+    d = (d >> 7) + 16;
+    return (t[d] * (128 - w) + t[d + 1] * w + 64) >> 7;
+}
+
+comp_cm_ctx_t* comp_cm_init(comp_progress_bar* bar, int table_bits)
+{
+    comp_cm_ctx_t* cm = (comp_cm_ctx_t*) calloc(1, sizeof(comp_cm_ctx_t));
+    if(!cm) return NULL;
+    if(table_bits < CM_TABLE_BITS_MIN || table_bits > CM_TABLE_BITS_MAX)
+        table_bits = CM_TABLE_BITS;
+    cm->table_bits = table_bits;
+    //stretch 是 squash 的反函数
+    for(int x = -2047, p = 0; x <= 2047; x++)
+        for(int v = cm_squash(x); p <= v; p++)
+            cm->stretch[p] = (int16_t) x;
+    for(int p = cm_squash(2047) + 1; p < 4096; p++)
+        cm->stretch[p] = 2047;
+    for(int i = 0; i < 1024; i++)
+        cm_dt[i] = 16384 / (i + i + 3);
+    cm->bar = bar;
+    cm->cm_encode = encode;
+    cm->cm_decode = decode;
+    return cm;
+}
+
+/* 由模型内存上限(字节)计算上下文表大小的对数，不超过上限的最大值 */
+int comp_cm_table_bits(size_t memory)
+{
+    size_t fixed = ((size_t) 1 << CM_HISTORY_BITS) + (sizeof(u_int32_t) << CM_MATCH_BITS) +
+                   sizeof(u_int16_t) * CM_APM_SIZE;
+    int bits = CM_TABLE_BITS_MIN;
+    while(bits < CM_TABLE_BITS_MAX && fixed + CM_ORDERS * (sizeof(u_int32_t) << (bits + 1)) <= memory)
+        bits++;
+    return bits;
+}
+
+static void cm_free_model(comp_cm_ctx_t* cm)
+{
+    for(int i = 0; i < CM_ORDERS; i++)
+    {
+        free(cm->tables[i]);
+        cm->tables[i] = NULL;
+    }
+    cm->model_bits = 0;
+}
+
+void comp_cm_free(comp_cm_ctx_t* cm)
+{
+    if(!cm) return;
+    cm_free_model(cm);
+    free(cm->weights);
+    free(cm->apm);
+    free(cm->history);
+    free(cm->match_table);
+    free(cm);
+}
+
+/* 按需分配模型并恢复初始状态，每次编码/解码都从空模型开始，各块可以独立解码 */
+static int cm_reset(comp_cm_ctx_t* cm, int bits)
+{
+    if(cm->model_bits != bits)
+    {
+        cm_free_model(cm);
+        for(int i = 0; i < CM_ORDERS; i++)
+            if(!(cm->tables[i] = (u_int32_t*) malloc(sizeof(u_int32_t) << bits)))
+            {
+                cm_free_model(cm);
+                return -1;
+            }
+        cm->model_bits = bits;
+    }
+    if(!cm->weights)
+        cm->weights = (int32_t*) malloc(sizeof(int32_t) * CM_WEIGHT_SETS * CM_INPUTS);
+    if(!cm->apm)
+        cm->apm = (u_int16_t*) malloc(sizeof(u_int16_t) * CM_APM_SIZE);
+    if(!cm->history)
+        cm->history = (u_char*) malloc((size_t) 1 << CM_HISTORY_BITS);
+    if(!cm->match_table)
+        cm->match_table = (u_int32_t*) malloc(sizeof(u_int32_t) << CM_MATCH_BITS);
+    if(!cm->weights || !cm->apm || !cm->history || !cm->match_table)
+        return -1;
+    //概率0.5，计数0
+    for(int i = 0; i < CM_ORDERS; i++)
+        for(size_t j = 0; j < ((size_t) 1 << bits); j++)
+            cm->tables[i][j] = 1U << 31;
+    for(int i = 0; i < 256; i++)
+        cm->order0[i] = 1U << 31;
+    for(int i = 0; i < 64; i++)
+        cm->match_sm[i] = 1U << 31;
+    for(int i = 0; i < CM_WEIGHT_SETS * CM_INPUTS; i++)
+        cm->weights[i] = 1 << 14;
+    for(int i = 0; i < CM_APM_SIZE; i++)
+        cm->apm[i] = (u_int16_t) (cm_squash((i % 33 - 16) * 128) * 16);
+    memset(cm->match_table, 0, sizeof(u_int32_t) << CM_MATCH_BITS);
+    return 0;
+}
+
+static inline void cm_sm_update(u_int32_t* t, int bit)
+{
+    u_int32_t e = *t;
+    int n = (int) (e & 1023), p = (int) (e >> 10);
+    if(n < CM_LIMIT)
+        e++;
+    e += (u_int32_t) ((int64_t) (((bit << 22) - p) >> 3) * cm_dt[n]) & 0xfffffc00;
+    *t = e;
+}
+
+/* 字节边界：更新历史数据、匹配模型和各阶上下文的哈希 */
+static void cm_byte_update(cm_state_t* s, int byte)
+{
+    comp_cm_ctx_t* cm = s->cm;
+    u_int32_t hmask = (1U << CM_HISTORY_BITS) - 1;
+    s->c16 = s->c16 << 8 | s->c8 >> 56;
+    s->c8 = s->c8 << 8 | (u_int64_t) byte;
+    cm->history[s->pos & hmask] = (u_char) byte;
+    s->pos++;
+    //逐位预测时不符的匹配已经清零，剩下的整个字节都符合
+    if(s->match_len > 0)
+    {
+        s->match_len++;
+        s->match_ptr++;
+    }
+    if(s->pos >= CM_MATCH_MIN)
+    {
+        u_int32_t h = (u_int32_t) (((s->c8 & 0xFFFFFFFFFFFFULL) * 0x9E3779B97F4A7C15ULL) >> (64 - CM_MATCH_BITS));
+        u_int32_t cand = cm->match_table[h];
+        if(s->match_len == 0 && cand > 0 && s->pos - cand < hmask)
+        {
+            u_int32_t l = 0;
+            while(l < CM_MATCH_MAX && l < cand &&
+                  cm->history[(cand - 1 - l) & hmask] == cm->history[(s->pos - 1 - l) & hmask])
+                l++;
+            if(l >= CM_MATCH_MIN)
+            {
+                s->match_len = l;
+                s->match_ptr = cand;
+            }
+        }
+        cm->match_table[h] = s->pos;
+    }
+    for(int i = 0; i < CM_ORDERS; i++)
+    {
+        int k = cm_orders[i];
+        u_int64_t lo = k >= 8 ? s->c8 : s->c8 & ((1ULL << (8 * k)) - 1);
+        u_int64_t hi = k > 8 ? s->c16 & ((1ULL << (8 * (k - 8))) - 1) : 0;
+        u_int64_t v = (lo + (u_int64_t) (i + 1)) * 0x9E3779B97F4A7C15ULL ^ hi * 0xD6E8FEB86659FD93ULL;
+        s->hash[i] = (u_int32_t) ((v ^ v >> 29) * 0xBF58476D1CE4E5B9ULL >> 32);
+    }
+}
+
+static void cm_state_init(cm_state_t* s, comp_cm_ctx_t* cm, int bits)
+{
+    memset(s, 0, sizeof(cm_state_t));
+    s->cm = cm;
+    s->bits = bits;
+    s->c0 = 1;
+    s->x2 = 0xFFFFFFFF;
+    s->match_idx = -1;
+    //开头的上下文按全是0计算
+    cm_byte_update(s, 0);
+    s->pos = 0;
+    s->c8 = 0;
+}
+
+/* 预测下一位为1的概率(12位) */
+static int cm_predict(cm_state_t* s)
+{
+    comp_cm_ctx_t* cm = s->cm;
+    const int16_t* st = cm->stretch;
+    u_int32_t mix = s->c0 * 0x2545F491U;
+    for(int i = 0; i < CM_ORDERS; i++)
+    {
+        s->idx[i] = ((s->hash[i] ^ mix) * 0x9E3779B1U) >> (32 - s->bits);
+        s->x[i] = st[cm->tables[i][s->idx[i]] >> 20];
+    }
+    s->x[CM_ORDERS] = st[cm->order0[s->c0] >> 20];
+    s->match_idx = -1;
+    s->x[CM_ORDERS + 1] = 0;
+    if(s->match_len > 0)
+    {
+        int expected = cm->history[s->match_ptr & ((1U << CM_HISTORY_BITS) - 1)];
+        if((u_int32_t) ((expected | 256) >> (8 - s->bit_pos)) == s->c0)
+        {
+            int bit = (expected >> (7 - s->bit_pos)) & 1;
+            int len = s->match_len > 15 ? 15 : (int) s->match_len;
+            s->match_idx = len << 1 | bit;
+            s->x[CM_ORDERS + 1] = st[cm->match_sm[s->match_idx] >> 20];
+        }
+        else
+            s->match_len = 0;
+    }
+    s->x[CM_ORDERS + 2] = 256;
+    //权重按匹配状态(没有/较短/较长)和当前字节已编码的位选择
+    s->w = cm->weights + ((s->match_idx < 0 ? 0 : s->match_len < 16 ? 1 : 2) * 256 + s->c0) * CM_INPUTS;
+    int64_t dot = 0;
+    for(int i = 0; i < CM_INPUTS; i++)
+        dot += (int64_t) s->x[i] * s->w[i];
+    int d = (int) (dot >> 16);
+    s->pr_mix = cm_squash(d < -2047 ? -2047 : d > 2047 ? 2047 : d);
+    //APM：在相邻两个桶之间插值，只更新较近的一个
+    int a = st[s->pr_mix] + 2048, wt = a & 127;
+    u_int32_t base = (s->c0 | (u_int32_t) (s->c8 & 0xFF) << 8) * 33 + (a >> 7);
+    int pa = (cm->apm[base] * (128 - wt) + cm->apm[base + 1] * wt) >> 11;
+    s->apm_idx = (int) (base + (wt >> 6));
+    int pr = (s->pr_mix + 3 * pa) >> 2;
+    s->pr = pr < 1 ? 1 : pr > 4095 ? 4095 : pr;
+    return s->pr;
+}
+
+static void cm_update(cm_state_t* s, int bit)
+{
+    comp_cm_ctx_t* cm = s->cm;
+    for(int i = 0; i < CM_ORDERS; i++)
+        cm_sm_update(&cm->tables[i][s->idx[i]], bit);
+    cm_sm_update(&cm->order0[s->c0], bit);
+    if(s->match_idx >= 0)
+        cm_sm_update(&cm->match_sm[s->match_idx], bit);
+    int err = (bit << 12) - s->pr_mix;
+    for(int i = 0; i < CM_INPUTS; i++)
+        s->w[i] += (s->x[i] * err) >> 11;
+    int target = bit ? 65535 : 0;
+    cm->apm[s->apm_idx] += (target - cm->apm[s->apm_idx]) >> 6;
+    s->c0 = s->c0 << 1 | bit;
+    if(++s->bit_pos == 8)
+    {
+        cm_byte_update(s, (int) (s->c0 & 0xFF));
+        s->c0 = 1;
+        s->bit_pos = 0;
+    }
+}
+
+static int cm_put(cm_state_t* s, u_char c)
+{
+    if(s->len == s->cap)
+    {
+        size_t cap = s->cap * 2;
+        u_char* bigger = (u_char*) realloc(s->buf, cap);
+        if(!bigger)
+            return -1;
+        s->buf = bigger;
+        s->cap = cap;
+    }
+    s->buf[s->len++] = c;
+    return 0;
+}
+
+/* 二进制算术编码，p 为该位是1的概率(12位) */
+static int cm_encode_bit(cm_state_t* s, int bit, int p)
+{
+    u_int32_t xmid = s->x1 + ((s->x2 - s->x1) >> 12) * (u_int32_t) p;
+    if(bit)
+        s->x2 = xmid;
+    else
+        s->x1 = xmid + 1;
+    while(((s->x1 ^ s->x2) & 0xFF000000) == 0)
+    {
+        if(cm_put(s, (u_char) (s->x2 >> 24)) < 0)
+            return -1;
+        s->x1 <<= 8;
+        s->x2 = s->x2 << 8 | 255;
+    }
+    return 0;
+}
+
+static inline u_char cm_get(cm_state_t* s)
+{
+    //读到数据末尾之后补0，由调用者检查是否读过头
+    return s->rpos < s->len ? s->buf[s->rpos++] : (s->rpos++, 0);
+}
+
+static int cm_decode_bit(cm_state_t* s, int p)
+{
+    u_int32_t xmid = s->x1 + ((s->x2 - s->x1) >> 12) * (u_int32_t) p;
+    int bit = s->xd <= xmid;
+    if(bit)
+        s->x2 = xmid;
+    else
+        s->x1 = xmid + 1;
+    while(((s->x1 ^ s->x2) & 0xFF000000) == 0)
+    {
+        s->x1 <<= 8;
+        s->x2 = s->x2 << 8 | 255;
+        s->xd = s->xd << 8 | cm_get(s);
+    }
+    return bit;
+}
+
+/*
+ +----------+------------+------------------------------------------+
+ |  标识符  | 0x43       |                                          |
+ +----------+------------+------------------------------------------+
+ |  表大小  | u_char     | 每个上下文表大小的对数，解压需要同样的内存 |
+ +----------+------------+------------------------------------------+
+ | 原始长度 | uint32_t   | n，为0表示结束，之后是若干帧             |
+ +----------+------------+------------------------------------------+
+ | 数据长度 | uint32_t   | m                                        |
+ +----------+------------+------------------------------------------+
+ | 编码数据 | m          | 算术编码数据，最后4字节为结束时的区间下界 |
+ +----------+------------+------------------------------------------+
+ 同一次编码的各帧共用模型
+ */
+int encode(comp_cm_ctx_t* cm, comp_bitstream_t* in_stream, comp_bitstream_t* out_stream)
+{
+    int bits = cm->table_bits;
+    u_char* in = (u_char*) malloc(CM_FRAME_SIZE);
+    if(!in || cm_reset(cm, bits) < 0)
+    {
+        free(in);
+        return -1;
+    }
+    comp_bitstream_write_char(out_stream, CM_HEADER_MARKER);
+    comp_bitstream_write_char(out_stream, (char) bits);
+    cm_state_t s;
+    cm_state_init(&s, cm, bits);
+    size_t n;
+    int err = 0;
+    while(err == 0 && (n = fread(in, 1, CM_FRAME_SIZE, in_stream->fp)) > 0)
+    {
+        s.x1 = 0;
+        s.x2 = 0xFFFFFFFF;
+        s.len = 0;
+        s.cap = n / 2 + 1024;
+        if(!(s.buf = (u_char*) malloc(s.cap)))
+        {
+            err = -1;
+            break;
+        }
+        for(size_t i = 0; i < n && err == 0; i++)
+        {
+            for(int j = 7; j >= 0 && err == 0; j--)
+            {
+                int bit = (in[i] >> j) & 1;
+                err = cm_encode_bit(&s, bit, cm_predict(&s));
+                cm_update(&s, bit);
+            }
+            if((i + 1) % CM_BAR_STEP == 0)
+                comp_bar_add(cm->bar, CM_BAR_STEP);
+        }
+        for(int j = 3; j >= 0 && err == 0; j--)
+            err = cm_put(&s, (u_char) (s.x1 >> (8 * j)));
+        if(err == 0)
+        {
+            comp_bitstream_write_int(out_stream, (int) n);
+            comp_bitstream_write_int(out_stream, (int) s.len);
+            err = comp_bitstream_write(out_stream, (const char*) s.buf, s.len);
+            comp_bar_add(cm->bar, n % CM_BAR_STEP);
+        }
+        free(s.buf);
+    }
+    free(in);
+    if(err < 0)
+        return -1;
+    return comp_bitstream_write_int(out_stream, 0);
+}
+
+int decode(comp_cm_ctx_t* cm, comp_bitstream_t* in_stream, comp_bitstream_t* out_stream)
+{
+    char marker, bits;
+    if(comp_bitstream_read_char(in_stream, &marker) < 0 || (u_char) marker != CM_HEADER_MARKER ||
+       comp_bitstream_read_char(in_stream, &bits) < 0 || bits < CM_TABLE_BITS_MIN || bits > CM_TABLE_BITS_MAX ||
+       cm_reset(cm, bits) < 0)
+        return -1;
+    comp_bar_add(cm->bar, 2);
+    u_char* out = (u_char*) malloc(CM_FRAME_SIZE);
+    if(!out) return -1;
+    cm_state_t s;
+    cm_state_init(&s, cm, bits);
+    int n, m, err = -1;
+    while(comp_bitstream_read_int(in_stream, &n) == 0)
+    {
+        if(n == 0)
+        {
+            comp_bar_add(cm->bar, 4);
+            err = 0;
+            break;
+        }
+        //每位最多12位编码数据
+        if(n < 0 || n > CM_FRAME_SIZE || comp_bitstream_read_int(in_stream, &m) < 0 ||
+           m < 4 || m > 12 * n + 8 || !(s.buf = (u_char*) malloc(m)))
+            break;
+        if(comp_bitstream_read(in_stream, (char*) s.buf, m) < 0)
+        {
+            free(s.buf);
+            break;
+        }
+        s.len = m;
+        s.rpos = 0;
+        s.x1 = 0;
+        s.x2 = 0xFFFFFFFF;
+        s.xd = 0;
+        for(int j = 0; j < 4; j++)
+            s.xd = s.xd << 8 | cm_get(&s);
+        for(int i = 0; i < n; i++)
+        {
+            for(int j = 0; j < 8; j++)
+                cm_update(&s, cm_decode_bit(&s, cm_predict(&s)));
+            out[i] = (u_char) s.c8;
+        }
+        int ok = s.rpos <= s.len + 4;
+        free(s.buf);
+        if(!ok || comp_bitstream_write(out_stream, (const char*) out, n) < 0)
+            break;
+        comp_bar_add(cm->bar, 8 + m);
+    }
+    free(out);
+    return err;
+}
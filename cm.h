@@ -0,0 +1,50 @@
+//
+// Created by zr on 23-2-16.
+// 上下文混合(context mixing)压缩：多阶上下文模型逐位预测，混合后由二进制算术编码器编码
+//
+#ifndef COMPRESS_CM_H
+#define COMPRESS_CM_H
+#include "internal/bitstream.h"
+#include "bar.h"
+#include <sys/types.h>
+
+#define CM_ORDERS 7                 // 哈希上下文的个数，阶数见 cm.c 中的 cm_orders
+#define CM_INPUTS (CM_ORDERS + 3)   // 混合器输入：各阶上下文、0阶、匹配模型和偏置
+#define CM_TABLE_BITS 21            // 默认每个上下文表 1 << 21 项
+#define CM_TABLE_BITS_MIN 16
+#define CM_TABLE_BITS_MAX 25
+#define CM_FRAME_SIZE (1024 * 1024)
+#define CM_HISTORY_BITS 22          // 匹配模型的历史数据 4MB
+#define CM_MATCH_BITS 20            // 匹配模型的哈希表 1 << 20 项
+#define CM_MATCH_MIN 6              // 匹配模型按最近6个字节查找
+#define CM_APM_SIZE (65536 * 33)
+#define CM_WEIGHT_SETS (3 * 256)
+
+struct comp_cm_ctx_s;
+typedef int (*comp_cm_encode_f) (struct comp_cm_ctx_s*, comp_bitstream_t*, comp_bitstream_t*);
+typedef int (*comp_cm_decode_f) (struct comp_cm_ctx_s*, comp_bitstream_t*, comp_bitstream_t*);
+
+struct comp_cm_ctx_s
+{
+    int table_bits;                 // 压缩时每个上下文表大小的对数，解压时以数据头部记录的为准
+    int model_bits;                 // 当前已分配的上下文表大小的对数，0表示还未分配
+    u_int32_t* tables[CM_ORDERS];   // 各阶上下文的概率表，每项高22位为概率，低10位为计数
+    u_int32_t order0[256];
+    u_int32_t match_sm[64];         // 匹配模型按 (匹配长度, 预测的位) 的概率
+    int32_t* weights;               // 混合器权重，按匹配状态和当前字节已编码的位选择一组
+    u_int16_t* apm;                 // 按前一个字节和当前字节已编码的位细化最终概率
+    u_char* history;
+    u_int32_t* match_table;
+    int16_t stretch[4096];
+    comp_progress_bar* bar;
+    comp_cm_encode_f cm_encode;
+    comp_cm_decode_f cm_decode;
+};
+
+typedef struct comp_cm_ctx_s comp_cm_ctx_t;
+
+comp_cm_ctx_t* comp_cm_init(comp_progress_bar*, int);
+int comp_cm_table_bits(size_t);
+void comp_cm_free(comp_cm_ctx_t*);
+
+#endif //COMPRESS_CM_H
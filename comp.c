@@ -1,24 +1,69 @@
 //
 // Created by zr on 23-1-13.
 //
+#define _GNU_SOURCE
 #include "comp.h"
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <string.h>
-#include <dirent.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <time.h>
 #include "marker.h"
+#include "pace.h"
+#include "internal/hash.h"
+#include "internal/pipe.h"
+#include "internal/entropy.h"
+#include "internal/run.h"
+#include "internal/threadpool.h"
+#include "internal/cdc.h"
 
 static int comp_codec_encode(comp_codec_t*, comp_bitstream_t*, comp_bitstream_t*);
 static int comp_codec_decode(comp_codec_t*, comp_bitstream_t*, comp_bitstream_t*);
 static void comp_compress(comp_compressor_t*, const char*, const char*);
-static void comp_decompress(comp_compressor_t*, const char*);
+static void comp_decompress(comp_compressor_t*, const char*, const char*);
+static void comp_update(comp_compressor_t*, const char*, const char*, const char*);
 
-static comp_huffman_codec_t* huffman_codec_new(comp_progress_bar* bar)
+/* 压缩级别对应的参数，级别越高压缩率越高、速度越慢，各级别的实测数据见README */
+struct comp_level_s
+{
+    size_t block_size;      // 分块大小
+    int lzw_width;          // LZW码宽，字典大小为 1 << lzw_width
+    int huffman_max_len;    // huffman最长编码
+    int fse_table_log;      // FSE状态表大小的对数
+    size_t bwt_block;       // BWT块大小，实际不超过分块大小
+    int cm_table_bits;      // 上下文混合每个上下文表大小的对数
+};
+
+static const struct comp_level_s comp_levels[COMP_LEVEL_MAX + 1] = {
+        {0, 0, 0, 0, 0, 0},
+        {256 * 1024, 9, 11, 10, 100 * 1024, 18},
+        {256 * 1024, 10, 12, 10, 200 * 1024, 18},
+        {512 * 1024, 11, 13, 11, 300 * 1024, 19},
+        {512 * 1024, 12, 14, 11, 400 * 1024, 19},
+        {512 * 1024, 12, 15, 11, 500 * 1024, 20},
+        {1024 * 1024, 12, 16, 12, 600 * 1024, 21},
+        {1024 * 1024, 13, 16, 12, 700 * 1024, 21},
+        {1024 * 1024, 14, 16, 12, 800 * 1024, 22},
+        {1024 * 1024, 16, 16, 12, 900 * 1024, 22},
+};
+
+static int comp_level_clamp(int level)
+{
+    if(level < COMP_LEVEL_MIN || level > COMP_LEVEL_MAX)
+        return COMP_LEVEL_DEFAULT;
+    return level;
+}
+
+/* order 为1时是一阶上下文模式的huffman(huffman1) */
+static comp_huffman_codec_t* huffman_codec_new(comp_progress_bar* bar, int level, int order)
 {
     comp_huffman_codec_t* codec = (comp_huffman_codec_t*) malloc(sizeof(comp_huffman_codec_t));
     if(!codec) return NULL;
-    CODEC_PARENT_INIT(codec, COMP_CODEC_HUFFMAN, comp_codec_encode, comp_codec_decode);
-    codec->huffman_ctx = comp_huffman_init(bar);
+    CODEC_PARENT_INIT(codec, order == 1 ? COMP_CODEC_HUFFMAN_O1 : COMP_CODEC_HUFFMAN,
+                      comp_codec_encode, comp_codec_decode);
+    codec->huffman_ctx = comp_huffman_init(bar, comp_levels[level].huffman_max_len, order);
     if(!codec->huffman_ctx)
     {
         free(codec);
@@ -27,12 +72,12 @@ static comp_huffman_codec_t* huffman_codec_new(comp_progress_bar* bar)
     return codec;
 }
 
-static comp_lzw_codec_t* lzw_codec_new(comp_progress_bar* bar)
+static comp_lzw_codec_t* lzw_codec_new(comp_progress_bar* bar, int level)
 {
     comp_lzw_codec_t* codec = (comp_lzw_codec_t*) malloc(sizeof(comp_lzw_codec_t));
     if(!codec) return NULL;
     CODEC_PARENT_INIT(codec, COMP_CODEC_LZW, comp_codec_encode, comp_codec_decode);
-    codec->lzw_ctx = comp_lzw_init(bar);
+    codec->lzw_ctx = comp_lzw_init(bar, comp_levels[level].lzw_width);
     if(!codec->lzw_ctx)
     {
         free(codec);
@@ -41,16 +86,72 @@ static comp_lzw_codec_t* lzw_codec_new(comp_progress_bar* bar)
     return codec;
 }
 
-comp_codec_t* comp_codec_init(comp_codec_type type, comp_progress_bar* bar)
+static comp_fse_codec_t* fse_codec_new(comp_progress_bar* bar, int level)
+{
+    comp_fse_codec_t* codec = (comp_fse_codec_t*) malloc(sizeof(comp_fse_codec_t));
+    if(!codec) return NULL;
+    CODEC_PARENT_INIT(codec, COMP_CODEC_FSE, comp_codec_encode, comp_codec_decode);
+    codec->fse_ctx = comp_fse_init(bar, comp_levels[level].fse_table_log);
+    if(!codec->fse_ctx)
+    {
+        free(codec);
+        return NULL;
+    }
+    return codec;
+}
+
+static comp_bwt_codec_t* bwt_codec_new(comp_progress_bar* bar, int level)
+{
+    comp_bwt_codec_t* codec = (comp_bwt_codec_t*) malloc(sizeof(comp_bwt_codec_t));
+    if(!codec) return NULL;
+    CODEC_PARENT_INIT(codec, COMP_CODEC_BWT, comp_codec_encode, comp_codec_decode);
+    codec->bwt_ctx = comp_bwt_init(bar, comp_levels[level].bwt_block);
+    if(!codec->bwt_ctx)
+    {
+        free(codec);
+        return NULL;
+    }
+    return codec;
+}
+
+static comp_cm_codec_t* cm_codec_new(comp_progress_bar* bar, int level)
+{
+    comp_cm_codec_t* codec = (comp_cm_codec_t*) malloc(sizeof(comp_cm_codec_t));
+    if(!codec) return NULL;
+    CODEC_PARENT_INIT(codec, COMP_CODEC_CM, comp_codec_encode, comp_codec_decode);
+    codec->cm_ctx = comp_cm_init(bar, comp_levels[level].cm_table_bits);
+    if(!codec->cm_ctx)
+    {
+        free(codec);
+        return NULL;
+    }
+    return codec;
+}
+
+/* level 为压缩级别(1-9)，只影响压缩，解码所需的参数都记录在编码数据的头部 */
+comp_codec_t* comp_codec_init(comp_codec_type type, int level, comp_progress_bar* bar)
 {
     comp_codec_t* codec = NULL;
+    level = comp_level_clamp(level);
     switch (type)
     {
         case COMP_CODEC_HUFFMAN:
-            codec = (comp_codec_t*) huffman_codec_new(bar);
+            codec = (comp_codec_t*) huffman_codec_new(bar, level, 0);
             break;
         case COMP_CODEC_LZW:
-            codec = (comp_codec_t*) lzw_codec_new(bar);
+            codec = (comp_codec_t*) lzw_codec_new(bar, level);
+            break;
+        case COMP_CODEC_FSE:
+            codec = (comp_codec_t*) fse_codec_new(bar, level);
+            break;
+        case COMP_CODEC_HUFFMAN_O1:
+            codec = (comp_codec_t*) huffman_codec_new(bar, level, 1);
+            break;
+        case COMP_CODEC_BWT:
+            codec = (comp_codec_t*) bwt_codec_new(bar, level);
+            break;
+        case COMP_CODEC_CM:
+            codec = (comp_codec_t*) cm_codec_new(bar, level);
             break;
         default:
             break;
@@ -58,50 +159,215 @@ comp_codec_t* comp_codec_init(comp_codec_type type, comp_progress_bar* bar)
     return codec;
 }
 
+static const char* codec_names[COMP_CODEC_NUM] = {"huffman", "lzw", "fse", "huffman1", "bwt", "cm"};
+
+/* 按名字查找编解码器，"auto"/"max" 返回 COMP_CODEC_AUTO/COMP_CODEC_MAX，找不到返回 COMP_CODEC_NUM */
+int comp_codec_lookup(const char* name)
+{
+    if(!strcmp(name, "auto"))
+        return COMP_CODEC_AUTO;
+    if(!strcmp(name, "max"))
+        return COMP_CODEC_MAX;
+    for(int i = 0; i < COMP_CODEC_NUM; i++)
+        if(!strcmp(name, codec_names[i]))
+            return i;
+    return COMP_CODEC_NUM;
+}
+
 void comp_codec_free(comp_codec_t* codec)
 {
+    if(!codec) return;
     switch (codec->type)
     {
         case COMP_CODEC_HUFFMAN:
+        case COMP_CODEC_HUFFMAN_O1:
             comp_huffman_free(((comp_huffman_codec_t*) codec)->huffman_ctx);
             break;
         case COMP_CODEC_LZW:
             comp_lzw_free(((comp_lzw_codec_t*) codec)->lzw_ctx);
+            break;
+        case COMP_CODEC_FSE:
+            comp_fse_free(((comp_fse_codec_t*) codec)->fse_ctx);
+            break;
+        case COMP_CODEC_BWT:
+            comp_bwt_free(((comp_bwt_codec_t*) codec)->bwt_ctx);
+            break;
+        case COMP_CODEC_CM:
+            comp_cm_free(((comp_cm_codec_t*) codec)->cm_ctx);
+            break;
         default:
             break;
     }
     free(codec);
 }
 
-comp_compressor_t* comp_compressor_init(comp_codec_type type)
+/* max模式中每个编解码器在自己的线程中编码同一个块。编解码器的上下文不能共享，
+ * 所以每个参赛者有独立的编解码器和进度条(不显示) */
+struct comp_race_entry_s
+{
+    comp_codec_t* codec;
+    comp_progress_bar* bar;
+    const char* buf;
+    size_t n;
+    char* enc;
+    size_t enc_len;
+    double decode_ns;
+    int err;
+};
+
+struct comp_race_s
+{
+    comp_threadpool_t* pool;
+    struct comp_race_entry_s entries[COMP_CODEC_NUM];
+};
+
+typedef struct comp_race_entry_s comp_race_entry_t;
+typedef struct comp_race_s comp_race_t;
+
+static void comp_race_free(comp_race_t* race)
+{
+    if(!race) return;
+    comp_threadpool_destroy(race->pool);
+    for(int i = 0; i < COMP_CODEC_NUM; i++)
+    {
+        comp_codec_free(race->entries[i].codec);
+        comp_bar_free(race->entries[i].bar);
+    }
+    free(race);
+}
+
+static comp_race_t* comp_race_init(int level)
 {
-    comp_compressor_t* c = (comp_compressor_t*) malloc(sizeof(comp_compressor_t));
+    comp_race_t* race = (comp_race_t*) calloc(1, sizeof(comp_race_t));
+    if(!race) return NULL;
+    race->pool = comp_threadpool_init(COMP_CODEC_NUM);
+    if(!race->pool)
+    {
+        free(race);
+        return NULL;
+    }
+    for(int i = 0; i < COMP_CODEC_NUM; i++)
+    {
+        race->entries[i].bar = comp_bar_init("", 0);
+        race->entries[i].codec = comp_codec_init(i, level, race->entries[i].bar);
+        if(!race->entries[i].codec)
+        {
+            comp_race_free(race);
+            return NULL;
+        }
+    }
+    return race;
+}
+
+comp_compressor_t* comp_compressor_init(comp_codec_type type, int level)
+{
+    //其余字段默认为0或NULL，只设置非0的默认值；初始化中途失败时 comp_compressor_free 也能安全释放
+    comp_compressor_t* c = (comp_compressor_t*) calloc(1, sizeof(comp_compressor_t));
     if(!c) return NULL;
     c->bar = comp_bar_init("", 0);
-    c->codec = comp_codec_init(type, c->bar);
-    printf("using %s algorithm\n", type == COMP_CODEC_HUFFMAN ? "huffman" : "lzw");
-    if(!c->codec) return NULL;
+    //解压时按每个条目的编码标识选择编解码器，所以全部创建
+    for(int i = 0; i < COMP_CODEC_NUM; i++)
+    {
+        c->codecs[i] = comp_codec_init(i, level, c->bar);
+        if(!c->codecs[i])
+        {
+            while(i-- > 0)
+                comp_codec_free(c->codecs[i]);
+            comp_bar_free(c->bar);
+            free(c);
+            return NULL;
+        }
+    }
+    c->codec = type < 0 ? NULL : c->codecs[type];
+    c->codec_speed_ns = COMP_CODEC_SPEED_NS;
+    c->level = comp_level_clamp(level);
+    c->block_size = comp_levels[c->level].block_size;
+    c->filter = COMP_FILTER_AUTO;
     c->state = COMP_PARSE_STOP;
-    c->cur_decompress_dir = comp_str_empty();
-    c->decompress_dir_stack = comp_vec_init(10);
+    c->cur_dir_fd = -1;
+    c->dir_fd_stack = comp_vec_init(10);
+    c->pipeline = 1;
+    c->cache_limit = COMP_CACHE_LIMIT_DEFAULT;
     c->compress = comp_compress;
     c->decompress = comp_decompress;
+    c->update = comp_update;
+    if(type == COMP_CODEC_MAX && !(c->race = comp_race_init(c->level)))
+    {
+        comp_compressor_free(c);
+        return NULL;
+    }
+    if(c->codec)
+        fprintf(stderr, "using %s algorithm\n", codec_names[type]);
+    else if(c->race)
+        fprintf(stderr, "racing all algorithms per block\n");
+    else
+        fprintf(stderr, "choosing algorithm per file\n");
     return c;
 }
 
+/* 指定BWT块大小(字节)，覆盖压缩级别的默认值，max模式中参赛的BWT编解码器同样设置 */
+void comp_compressor_set_bwt_block(comp_compressor_t* c, size_t size)
+{
+    comp_bwt_set_block_size(((comp_bwt_codec_t*) c->codecs[COMP_CODEC_BWT])->bwt_ctx, size);
+    if(c->race)
+        comp_bwt_set_block_size(((comp_bwt_codec_t*) c->race->entries[COMP_CODEC_BWT].codec)->bwt_ctx, size);
+}
+
+/* 指定上下文混合的模型内存上限(字节)，覆盖压缩级别的默认值。解压时按压缩数据记录的大小分配 */
+void comp_compressor_set_cm_memory(comp_compressor_t* c, size_t memory)
+{
+    int bits = comp_cm_table_bits(memory);
+    ((comp_cm_codec_t*) c->codecs[COMP_CODEC_CM])->cm_ctx->table_bits = bits;
+    if(c->race)
+        ((comp_cm_codec_t*) c->race->entries[COMP_CODEC_CM].codec)->cm_ctx->table_bits = bits;
+}
+
+static void comp_codecs_set_dict(comp_codec_t** codecs, comp_dict_t* dict)
+{
+    comp_huffman_set_dict(((comp_huffman_codec_t*) codecs[COMP_CODEC_HUFFMAN])->huffman_ctx,
+                          dict ? dict->huffman_len : NULL);
+    comp_lzw_set_dict(((comp_lzw_codec_t*) codecs[COMP_CODEC_LZW])->lzw_ctx,
+                      dict ? dict->lzw_prefix : NULL, dict ? dict->lzw_char : NULL, dict ? dict->lzw_num : 0);
+}
+
+/* 使用共享字典，huffman和LZW从字典的编码表和预置串开始，为空时取消。字典由调用者释放 */
+void comp_compressor_set_dict(comp_compressor_t* c, comp_dict_t* dict)
+{
+    c->dict = dict;
+    comp_codecs_set_dict(c->codecs, dict);
+    if(c->race)
+    {
+        comp_codec_t* codecs[COMP_CODEC_NUM];
+        for(int i = 0; i < COMP_CODEC_NUM; i++)
+            codecs[i] = c->race->entries[i].codec;
+        comp_codecs_set_dict(codecs, dict);
+    }
+}
+
+/* 压缩或解压一个压缩包时使用共享huffman编码表，为空时取消。max模式中参赛的huffman编解码器共用同一组表 */
+static void comp_compressor_set_tables(comp_compressor_t* c, comp_huffman_tables_t* tables)
+{
+    c->tables = tables;
+    comp_huffman_set_tables(((comp_huffman_codec_t*) c->codecs[COMP_CODEC_HUFFMAN])->huffman_ctx, tables);
+    if(c->race)
+        comp_huffman_set_tables(((comp_huffman_codec_t*) c->race->entries[COMP_CODEC_HUFFMAN].codec)->huffman_ctx,
+                                tables);
+}
+
 void comp_compressor_free(comp_compressor_t* c)
 {
     if(!c) return;
-    comp_codec_free(c->codec);
-    comp_str_free(c->cur_decompress_dir);
-    comp_vec_free(c->decompress_dir_stack);
+    for(int i = 0; i < COMP_CODEC_NUM; i++)
+        comp_codec_free(c->codecs[i]);
+    comp_race_free(c->race);
+    comp_vec_free(c->dir_fd_stack);
     comp_bar_free(c->bar);
     free(c);
 }
 
 int comp_codec_encode(comp_codec_t* codec, comp_bitstream_t* in, comp_bitstream_t* out)
 {
-    if(codec->type == COMP_CODEC_HUFFMAN)
+    if(codec->type == COMP_CODEC_HUFFMAN || codec->type == COMP_CODEC_HUFFMAN_O1)
     {
         comp_huffman_codec_t* huffman_codec = (comp_huffman_codec_t*) codec;
         comp_huffman_ctx_t* ctx = huffman_codec->huffman_ctx;
@@ -113,12 +379,30 @@ int comp_codec_encode(comp_codec_t* codec, comp_bitstream_t* in, comp_bitstream_
         comp_lzw_ctx_t* ctx = lzw_codec->lzw_ctx;
         return ctx->lzw_encode(ctx, in, out);
     }
+    else if(codec->type == COMP_CODEC_FSE)
+    {
+        comp_fse_codec_t* fse_codec = (comp_fse_codec_t*) codec;
+        comp_fse_ctx_t* ctx = fse_codec->fse_ctx;
+        return ctx->fse_encode(ctx, in, out);
+    }
+    else if(codec->type == COMP_CODEC_BWT)
+    {
+        comp_bwt_codec_t* bwt_codec = (comp_bwt_codec_t*) codec;
+        comp_bwt_ctx_t* ctx = bwt_codec->bwt_ctx;
+        return ctx->bwt_encode(ctx, in, out);
+    }
+    else if(codec->type == COMP_CODEC_CM)
+    {
+        comp_cm_codec_t* cm_codec = (comp_cm_codec_t*) codec;
+        comp_cm_ctx_t* ctx = cm_codec->cm_ctx;
+        return ctx->cm_encode(ctx, in, out);
+    }
     return -1;
 }
 
 int comp_codec_decode(comp_codec_t* codec, comp_bitstream_t* in, comp_bitstream_t* out)
 {
-    if(codec->type == COMP_CODEC_HUFFMAN)
+    if(codec->type == COMP_CODEC_HUFFMAN || codec->type == COMP_CODEC_HUFFMAN_O1)
     {
         comp_huffman_codec_t* huffman_codec = (comp_huffman_codec_t*) codec;
         comp_huffman_ctx_t* ctx = huffman_codec->huffman_ctx;
@@ -130,10 +414,28 @@ int comp_codec_decode(comp_codec_t* codec, comp_bitstream_t* in, comp_bitstream_
         comp_lzw_ctx_t* ctx = lzw_codec->lzw_ctx;
         return ctx->lzw_decode(ctx, in, out);
     }
+    else if(codec->type == COMP_CODEC_FSE)
+    {
+        comp_fse_codec_t* fse_codec = (comp_fse_codec_t*) codec;
+        comp_fse_ctx_t* ctx = fse_codec->fse_ctx;
+        return ctx->fse_decode(ctx, in, out);
+    }
+    else if(codec->type == COMP_CODEC_BWT)
+    {
+        comp_bwt_codec_t* bwt_codec = (comp_bwt_codec_t*) codec;
+        comp_bwt_ctx_t* ctx = bwt_codec->bwt_ctx;
+        return ctx->bwt_decode(ctx, in, out);
+    }
+    else if(codec->type == COMP_CODEC_CM)
+    {
+        comp_cm_codec_t* cm_codec = (comp_cm_codec_t*) codec;
+        comp_cm_ctx_t* ctx = cm_codec->cm_ctx;
+        return ctx->cm_decode(ctx, in, out);
+    }
     return -1;
 }
 
-static comp_str_t basename(const char* path)
+static comp_str_t comp_basename(const char* path)
 {
     const char* ptr = strrchr(path, '/');
     if(!ptr)
@@ -141,240 +443,1354 @@ static comp_str_t basename(const char* path)
     return comp_str_new_len(ptr + 1, strlen(ptr + 1));
 }
 
-/* 计算文件夹总大小 */
-static size_t get_dir_size(comp_str_t path)
+/* 打开fd对应的流。启用流水线并且数据量超过一个数据块时，读写在单独的IO线程中进行，
+ * 与编解码重叠；小文件创建线程不划算，直接使用stdio */
+static FILE* comp_fdopen(comp_compressor_t* c, int fd, const char* mode, u_int64_t size_hint)
 {
-    DIR* dir = opendir(path);
-    struct dirent* entry;
-    size_t sz = 0;
-    struct stat st;
-    while((entry = readdir(dir)) != NULL)
+    if(fd < 0)
+        return NULL;
+    FILE* fp = NULL;
+    if(c->pipeline && size_hint > COMP_PIPE_BLOCK_SIZE)
+        fp = comp_pipe_fopen(fd, mode);
+    if(!fp)
+    {
+        //只有IO线程按对齐的块写出，退回stdio时以O_DIRECT打开的fd要去掉这个标志，否则不对齐的写会失败
+        int fl = fcntl(fd, F_GETFL);
+        if(fl >= 0 && (fl & O_DIRECT))
+            fcntl(fd, F_SETFL, fl & ~O_DIRECT);
+        fp = fdopen(fd, mode);
+    }
+    if(!fp)
+        close(fd);
+    return fp;
+}
+
+/* 创建解压输出文件。已知原始大小时用fallocate预分配磁盘空间，减少碎片；
+ * 开启直接IO并且文件足够大时以O_DIRECT打开，绕过页缓存(文件系统不支持时退回普通写)。
+ * 稀疏文件要留下空洞，既不预分配也不用直接IO。
+ * 大文件的写出在单独的线程中进行，解码不会因为磁盘阻塞 */
+static FILE* comp_create_output(comp_compressor_t* c, int dir_fd, const char* name, u_int64_t size, int sparse)
+{
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    int known = size != COMP_ENTRY_SIZE_UNKNOWN && !sparse;
+    int fd = -1;
+    if(c->direct_io && c->pipeline && known && size >= COMP_DIRECT_IO_MIN)
+        fd = openat(dir_fd, name, flags | O_DIRECT, 0644);
+    if(fd < 0)
+        fd = openat(dir_fd, name, flags, 0644);
+    if(fd >= 0 && known && size > 0)
+        fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t) size);
+    return comp_fdopen(c, fd, "wb", size);
+}
+
+/* 填充待压缩文件的元信息，需要记录哈希时先完整读一遍文件 */
+static int comp_entry_meta_load(comp_compressor_t* c, comp_bitstream_t* in_stream,
+                                u_int64_t size, u_int64_t mtime, comp_entry_meta_t* meta)
+{
+    meta->flags = 0;
+    meta->size = size;
+    meta->mtime = mtime;
+    meta->hash = 0;
+    meta->filter = COMP_FILTER_NONE;
+    meta->filter_param = 0;
+    meta->payload_offset = -1;
+    meta->payload_len = COMP_PAYLOAD_LEN_UNKNOWN;
+    //新条目都分块编码，不可压缩的块可以单独存储。大小未知说明输入是管道，无法读两遍，也就不记录哈希
+    meta->flags |= COMP_ENTRY_FLAG_BLOCKS;
+    if(!c->store_hash || size == COMP_ENTRY_SIZE_UNKNOWN)
+        return 0;
+    char buf[65536];
+    size_t n;
+    u_int64_t h = COMP_HASH_FNV_INIT;
+    while((n = fread(buf, 1, sizeof(buf), in_stream->fp)) > 0)
+        h = comp_hash_fnv1a64(h, buf, n);
+    comp_bitstream_reset(in_stream);
+    meta->flags |= COMP_ENTRY_FLAG_HASH;
+    meta->hash = h;
+    return 0;
+}
+
+static void comp_entry_meta_write(comp_entry_meta_t* meta, comp_bitstream_t* out_stream)
+{
+    comp_bitstream_write_char(out_stream, (char) meta->flags);
+    comp_bitstream_write_long(out_stream, meta->size);
+    comp_bitstream_write_long(out_stream, meta->mtime);
+    if(meta->flags & COMP_ENTRY_FLAG_HASH)
+        comp_bitstream_write_long(out_stream, meta->hash);
+    if(meta->flags & COMP_ENTRY_FLAG_FILTER)
+    {
+        comp_bitstream_write_char(out_stream, (char) meta->filter);
+        comp_bitstream_write_char(out_stream, (char) meta->filter_param);
+    }
+    comp_bitstream_write_long(out_stream, meta->payload_len);
+}
+
+/* 元信息的字节数，压缩数据长度位于最后8字节 */
+static int comp_entry_meta_len(comp_entry_meta_t* meta)
+{
+    return 25 + ((meta->flags & COMP_ENTRY_FLAG_HASH) ? 8 : 0) + ((meta->flags & COMP_ENTRY_FLAG_FILTER) ? 2 : 0);
+}
+
+/* 读取元信息，返回读取的字节数 */
+static int comp_entry_meta_read(comp_entry_meta_t* meta, comp_bitstream_t* in_stream)
+{
+    char flags, filter, filter_param;
+    if(comp_bitstream_read_char(in_stream, &flags) < 0)
+        return -1;
+    meta->flags = (u_char) flags;
+    meta->hash = 0;
+    meta->filter = COMP_FILTER_NONE;
+    meta->filter_param = 0;
+    if(comp_bitstream_read_long(in_stream, &meta->size) < 0 ||
+       comp_bitstream_read_long(in_stream, &meta->mtime) < 0)
+        return -1;
+    if((meta->flags & COMP_ENTRY_FLAG_HASH) && comp_bitstream_read_long(in_stream, &meta->hash) < 0)
+        return -1;
+    if(meta->flags & COMP_ENTRY_FLAG_FILTER)
+    {
+        if(comp_bitstream_read_char(in_stream, &filter) < 0 ||
+           comp_bitstream_read_char(in_stream, &filter_param) < 0)
+            return -1;
+        meta->filter = (u_char) filter;
+        meta->filter_param = (u_char) filter_param;
+    }
+    if(comp_bitstream_read_long(in_stream, &meta->payload_len) < 0)
+        return -1;
+    return comp_entry_meta_len(meta);
+}
+
+/* 增量更新时判断文件相对于旧压缩包中的条目是否没有改变 */
+static int comp_entry_unchanged(comp_compressor_t* c, comp_entry_meta_t* old, comp_entry_meta_t* cur)
+{
+    //引用了其他条目中的块的条目不能单独复制
+    if(old->size != cur->size || old->mtime != cur->mtime || (old->flags & COMP_ENTRY_FLAG_REFS))
+        return 0;
+    if(!c->store_hash)
+        return 1;
+    return (old->flags & COMP_ENTRY_FLAG_HASH) && old->hash == cur->hash;
+}
+
+/* 分块编码：每次读入 c->block_size(不超过 COMP_BLOCK_SIZE) 字节，在内存中独立编码，内存占用与输入大小无关，
+ * 只能读一遍的输入(管道)也可以处理。每个块的格式为
+ +----------+-----------+--------------------------+
+ | 原始长度 | uint32_t  | 0表示结束                |
+ +----------+-----------+--------------------------+
+ | 编码长度 | uint32_t  |                          |
+ +----------+-----------+--------------------------+
+ | 编码数据 |           | 与不分块时的编码格式相同 |
+ +----------+-----------+--------------------------+
+ 不可压缩的块(随机数据、已压缩的媒体文件等)以存储格式写出，编码数据为
+ +----------+------------+------------------------+
+ |  标识符  | 0x4E       |                        |
+ +----------+------------+------------------------+
+ | 内容长度 | uint32_t   |                        |
+ +----------+------------+------------------------+
+ | 原始数据 |            |                        |
+ +----------+------------+------------------------+
+ 每块最多膨胀 13 字节
+*/
+static void comp_write_stored_block(const char* buf, size_t n, comp_bitstream_t* out_stream)
+{
+    comp_bitstream_write_int(out_stream, (int) n);
+    comp_bitstream_write_int(out_stream, (int) n + 5);
+    comp_bitstream_write_char(out_stream, NONE_COMPRESS_MARKER);
+    comp_bitstream_write_int(out_stream, (int) n);
+    comp_bitstream_write(out_stream, buf, n);
+}
+
+/* 在内存中用 codec 编码 buf，编码结果由调用者释放 */
+static int comp_encode_buf(comp_codec_t* codec, const char* buf, size_t n, char** enc, size_t* enc_len)
+{
+    *enc = NULL;
+    *enc_len = 0;
+    int err = -1;
+    comp_bitstream_t* block_in = comp_bitstream_init(fmemopen((void*) buf, n, "rb"));
+    comp_bitstream_t* block_out = comp_bitstream_init(open_memstream(enc, enc_len));
+    if(block_in && block_out)
+        err = codec->encode(codec, block_in, block_out);
+    comp_bitstream_destroy(block_in);
+    comp_bitstream_destroy(block_out);
+    if(err < 0)
     {
-        if(!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+        free(*enc);
+        *enc = NULL;
+    }
+    return err;
+}
+
+/* 自动选择编解码器：取 buf 开头 COMP_TRIAL_SIZE 字节，用每个编解码器试编码，
+ * 代价为 编码长度 * (1 + 每字节耗时 / codec_speed_ns)，取代价最小的。
+ * 样本就是整块时，最优的试编码结果直接作为该块的编码结果返回 */
+static comp_codec_t* comp_codec_select(comp_compressor_t* c, const char* buf, size_t n,
+                                       char** enc, size_t* enc_len)
+{
+    size_t sample_len = n < COMP_TRIAL_SIZE ? n : COMP_TRIAL_SIZE;
+    comp_codec_t* best = NULL;
+    double best_cost = 0;
+    *enc = NULL;
+    *enc_len = 0;
+    //试编码不计入进度
+    size_t complete = c->bar->complete;
+    for(int i = 0; i < COMP_CODEC_NUM; i++)
+    {
+        //上下文混合太慢，每个文件都试编码的开销太大，只能用 -m 指定或在max模式中使用
+        if(i == COMP_CODEC_CM)
             continue;
-        comp_str_t new_path = comp_str_new(path);
-        new_path = comp_str_append_char(new_path, '/');
-        new_path = comp_str_append_str(new_path, entry->d_name);
-        if(entry->d_type == DT_REG)
+        char* trial;
+        size_t trial_len;
+        struct timespec t1, t2;
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        if(comp_encode_buf(c->codecs[i], buf, sample_len, &trial, &trial_len) < 0)
+            continue;
+        clock_gettime(CLOCK_MONOTONIC, &t2);
+        double ns = (double) (t2.tv_sec - t1.tv_sec) * 1e9 + (double) (t2.tv_nsec - t1.tv_nsec);
+        //短样本的耗时主要是每次编码的固定开销，至少按 COMP_TRIAL_TIME_MIN 字节平摊，小文件主要按长度选择
+        double cost = (double) trial_len;
+        if(c->codec_speed_ns > 0)
+            cost *= 1 + ns / (double) (sample_len > COMP_TRIAL_TIME_MIN ? sample_len : COMP_TRIAL_TIME_MIN) /
+                        c->codec_speed_ns;
+        if(!best || cost < best_cost)
         {
-            stat(new_path, &st);
-            sz += st.st_size;
+            best = c->codecs[i];
+            best_cost = cost;
+            free(*enc);
+            *enc = trial;
+            *enc_len = trial_len;
         }
-        else if(entry->d_type == DT_DIR)
-            sz += get_dir_size(new_path);
-        comp_str_free(new_path);
+        else free(trial);
     }
-    return sz;
+    c->bar->complete = complete;
+    if(sample_len < n)
+    {
+        free(*enc);
+        *enc = NULL;
+        *enc_len = 0;
+    }
+#ifdef DEBUG
+    if(best)
+        fprintf(stderr, "choose %s  ", codec_names[best->type]);
+#endif
+    return best;
 }
 
-/* 压缩单个文件 */
-static int comp_compress_file(comp_compressor_t* c, comp_str_t filename,
-                              comp_bitstream_t* in_stream, comp_bitstream_t* out_stream)
+/* 参赛者的任务：编码整块，再解码一遍计时，同时确认能还原 */
+static void comp_race_run(void* arg)
 {
-    comp_bitstream_write_char(out_stream, COMP_FILE_MARKER);
-    comp_bitstream_write_char(out_stream, (char) comp_str_len(filename));
-    comp_bitstream_write(out_stream, filename, comp_str_len(filename));
-    return c->codec->encode(c->codec, in_stream, out_stream);
+    comp_race_entry_t* e = (comp_race_entry_t*) arg;
+    e->err = comp_encode_buf(e->codec, e->buf, e->n, &e->enc, &e->enc_len);
+    if(e->err < 0)
+        return;
+    char* dec = NULL;
+    size_t dec_len = 0;
+    struct timespec t1, t2;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    comp_bitstream_t* dec_in = comp_bitstream_init(fmemopen(e->enc, e->enc_len, "rb"));
+    comp_bitstream_t* dec_out = comp_bitstream_init(open_memstream(&dec, &dec_len));
+    if(!dec_in || !dec_out || e->codec->decode(e->codec, dec_in, dec_out) < 0)
+        e->err = -1;
+    comp_bitstream_destroy(dec_in);
+    comp_bitstream_destroy(dec_out);
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    e->decode_ns = (double) (t2.tv_sec - t1.tv_sec) * 1e9 + (double) (t2.tv_nsec - t1.tv_nsec);
+    if(dec_len != e->n || memcmp(dec, e->buf, e->n) != 0)
+        e->err = -1;
+    free(dec);
+    if(e->err < 0)
+    {
+        free(e->enc);
+        e->enc = NULL;
+    }
 }
 
-/* 递归遍历文件夹，将所有文件以及文件夹信息压缩到一个压缩文件中 */
-static int comp_compress_dir(comp_compressor_t* c, comp_str_t dir_path, comp_bitstream_t* out_stream)
+/* max模式：所有编解码器在线程池中同时编码同一个块，
+ * 代价为 编码长度 * (1 + 每字节解码耗时 / race_decode_ns)，保留代价最小的编码结果 */
+static int comp_race_block(comp_compressor_t* c, const char* buf, size_t n, char** enc, size_t* enc_len)
 {
-    comp_bitstream_write_char(out_stream, COMP_DIR_MARKER);
-    comp_str_t dirname = basename(dir_path);
-    comp_bitstream_write_char(out_stream, (char) comp_str_len(dirname));
-    comp_bitstream_write(out_stream, dirname, comp_str_len(dirname));
-    comp_str_free(dirname);
-    DIR* dir = opendir(dir_path);
-    struct dirent* entry;
-    while((entry = readdir(dir)) != NULL)
-    {
-        if(!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+    comp_race_t* race = c->race;
+    for(int i = 0; i < COMP_CODEC_NUM; i++)
+    {
+        comp_race_entry_t* e = &race->entries[i];
+        e->buf = buf;
+        e->n = n;
+        e->enc = NULL;
+        e->enc_len = 0;
+        e->err = -1;
+        if(comp_threadpool_submit(race->pool, comp_race_run, e) < 0)
+            comp_race_run(e);
+    }
+    comp_threadpool_wait(race->pool);
+    comp_race_entry_t* best = NULL;
+    double best_cost = 0;
+    for(int i = 0; i < COMP_CODEC_NUM; i++)
+    {
+        comp_race_entry_t* e = &race->entries[i];
+        if(e->err < 0)
             continue;
-        if(entry->d_type == DT_REG)
+        double cost = (double) e->enc_len;
+        if(c->race_decode_ns > 0)
+            cost *= 1 + e->decode_ns / (double) n / c->race_decode_ns;
+        if(!best || cost < best_cost)
         {
-            comp_str_t file_path = comp_str_new(dir_path);
-            file_path = comp_str_append_char(file_path, '/');
-            file_path = comp_str_append_str(file_path, entry->d_name);
+            if(best)
+                free(best->enc);
+            best = e;
+            best_cost = cost;
+        }
+        else free(e->enc);
+    }
+    if(!best)
+        return -1;
 #ifdef DEBUG
-            printf("compress %s  ", file_path);
-#else
-            comp_bar_set_title(c->bar, file_path);
+    fprintf(stderr, "block %zu -> %s %zu  ", n, codec_names[best->codec->type], best->enc_len);
 #endif
-            comp_bitstream_t* in_stream = comp_bitstream_init(fopen(file_path, "rb"));
-            comp_str_free(file_path);
-            if(!in_stream)
-                continue;
-            comp_str_t filename = comp_str_new(entry->d_name);
-            if(comp_compress_file(c, filename, in_stream, out_stream) < 0)
+    *enc = best->enc;
+    *enc_len = best->enc_len;
+    best->enc = NULL;
+    return 0;
+}
+
+static double comp_elapsed_ns(struct timespec* since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - since->tv_sec) * 1e9 + (double) (now.tv_nsec - since->tv_nsec);
+}
+
+/* 按编码数据开头的标识选择解码器 */
+static comp_codec_t* comp_codec_for_marker(comp_compressor_t* c, char marker)
+{
+    switch ((u_char) marker)
+    {
+        case HUFFMAN_HEADER_MARKER:
+        case HUFFMAN_DICT_HEADER_MARKER:
+        case HUFFMAN_TABLE_HEADER_MARKER:
+        case HUFFMAN_COMPACT_HEADER_MARKER:
+        case NONE_COMPRESS_MARKER:
+            return c->codecs[COMP_CODEC_HUFFMAN];
+        case LZW_HEADER_MARKER:
+        case LZW_WIDTH_HEADER_MARKER:
+        case LZW_DICT_HEADER_MARKER:
+            return c->codecs[COMP_CODEC_LZW];
+        case FSE_HEADER_MARKER:
+            return c->codecs[COMP_CODEC_FSE];
+        case HUFFMAN_O1_HEADER_MARKER:
+            return c->codecs[COMP_CODEC_HUFFMAN_O1];
+        case BWT_HEADER_MARKER:
+            return c->codecs[COMP_CODEC_BWT];
+        case CM_HEADER_MARKER:
+            return c->codecs[COMP_CODEC_CM];
+        default:
+            return NULL;
+    }
+}
+
+/* 块内容的128位指纹(FNV-1a + 乘法哈希)，用于去重和缓存，fp 至少 COMP_BLOCK_FP_LEN 字节 */
+static void comp_block_fingerprint(const char* buf, size_t n, char* fp)
+{
+    snprintf(fp, COMP_BLOCK_FP_LEN, "%016llx%016llx",
+             (unsigned long long) comp_hash_fnv1a64(COMP_HASH_FNV_INIT, buf, n),
+             (unsigned long long) comp_hash_mul64(0, buf, n));
+}
+
+/* 缓存的key由块指纹、长度以及影响编码结果的设置(编解码器、压缩级别、字典)组成 */
+static void comp_cache_key(comp_compressor_t* c, const char* fp, size_t n, char* key, size_t size)
+{
+    //BWT块大小和上下文混合的模型大小可以单独指定，不完全由级别决定
+    size_t bwt_block = ((comp_bwt_codec_t*) c->codecs[COMP_CODEC_BWT])->bwt_ctx->block_size;
+    int cm_bits = ((comp_cm_codec_t*) c->codecs[COMP_CODEC_CM])->cm_ctx->table_bits;
+    int len;
+    if(c->race)
+        len = snprintf(key, size, "%s-%zx-max-%g-%d-%zx-%d", fp, n, c->race_decode_ns, c->level, bwt_block, cm_bits);
+    else
+        len = snprintf(key, size, "%s-%zx-%s-%d-%zx-%d", fp, n, c->codec ? codec_names[c->codec->type] : "auto",
+                       c->level, bwt_block, cm_bits);
+    if(c->dict && len > 0 && (size_t) len < size)
+        snprintf(key + len, size - len, "-%08x", c->dict->id);
+}
+
+static void comp_write_block(const char* enc, size_t enc_len, size_t n, comp_bitstream_t* out_stream)
+{
+    comp_bitstream_write_int(out_stream, (int) n);
+    comp_bitstream_write_int(out_stream, (int) enc_len);
+    comp_bitstream_write(out_stream, enc, enc_len);
+}
+
+/* 编码一个块并写出。*codec 是当前文件使用的编解码器，为空时在第一个需要编码的块选出。
+ * 开启缓存时先按内容查找以前的编码结果，命中时直接写出，fp 是已经算好的块指纹，可以为空。
+ * 引用了压缩包共享编码表的块只在这个压缩包中有效，不放入缓存，返回1 */
+static int comp_encode_block(comp_compressor_t* c, const char* buf, size_t n, const char* fp,
+                             comp_codec_t** codec, comp_bitstream_t* out_stream)
+{
+    char fp_buf[COMP_BLOCK_FP_LEN], key[COMP_BLOCK_FP_LEN + 64];
+    if(c->cache)
+    {
+        if(!fp)
+        {
+            comp_block_fingerprint(buf, n, fp_buf);
+            fp = fp_buf;
+        }
+        comp_cache_key(c, fp, n, key, sizeof(key));
+        size_t cached_len;
+        char* cached = comp_cache_get(c->cache, key, &cached_len);
+        //缓存文件可能被改坏，只接受能识别的编码数据
+        if(cached && cached_len > 0 && cached_len < n + 5 && comp_codec_for_marker(c, cached[0]) &&
+           (u_char) cached[0] != HUFFMAN_TABLE_HEADER_MARKER)
+        {
+            comp_write_block(cached, cached_len, n, out_stream);
+            comp_bar_add(c->bar, n);
+            if(c->pace)
+                c->pace->done += n;
+            free(cached);
+            return 0;
+        }
+        free(cached);
+    }
+    struct timespec block_start;
+    clock_gettime(CLOCK_MONOTONIC, &block_start);
+    int effort = c->pace ? comp_pace_choose(c->pace, n, c->bar->total, comp_pace_elapsed(c->pace),
+                                             c->codec == c->codecs[COMP_CODEC_HUFFMAN]) : COMP_EFFORT_NORMAL;
+    //先取样估计熵，明显不可压缩的块不必编码。零阶熵看不出长距离的重复，LZW、BWT、CM能利用它，
+    //所以只有零阶的编解码器直接按熵判断，其他的还要确认块中没有多少重复。max模式总是比较所有编解码器，
+    //不可压缩时由编码后没有变小的检查改为存储
+    int order0 = effort == COMP_EFFORT_FAST || (c->codec && (c->codec->type == COMP_CODEC_HUFFMAN ||
+                                                            c->codec->type == COMP_CODEC_FSE));
+    if(effort == COMP_EFFORT_STORED ||
+       (!c->race && comp_entropy_sample(buf, n) >= COMP_STORE_ENTROPY &&
+        (order0 || comp_repeat_ratio(buf, n) < COMP_STORE_REPEAT)))
+    {
+        comp_write_stored_block(buf, n, out_stream);
+        comp_bar_add(c->bar, n);
+        if(c->pace)
+            comp_pace_update(c->pace, effort, n, comp_elapsed_ns(&block_start));
+        return 0;
+    }
+    char* enc = NULL;
+    size_t enc_len = 0;
+    int err = 0;
+    //max模式每块都比较所有编解码器；没有指定编解码器、也没有用样本选好时，用文件第一个需要编码的块选出整个文件使用的编解码器。
+    //重复段之间的小块只为它自己选择，不代表整个文件
+    comp_codec_t* selected = NULL;
+    if(effort == COMP_EFFORT_FAST)
+        err = comp_encode_buf(c->codecs[COMP_CODEC_HUFFMAN], buf, n, &enc, &enc_len);
+    else if(c->race)
+    {
+        if((err = comp_race_block(c, buf, n, &enc, &enc_len)) == 0)
+            comp_bar_add(c->bar, n);
+    }
+    else if(!*codec && !(selected = comp_codec_select(c, buf, n, &enc, &enc_len)))
+        err = -1;
+    else if(enc)
+        comp_bar_add(c->bar, n);
+    else
+        err = comp_encode_buf(selected ? selected : *codec, buf, n, &enc, &enc_len);
+    if(selected && n >= COMP_RUN_MIN)
+        *codec = selected;
+    if(err == 0)
+    {
+        //编码后没有变小的块改为存储
+        if(enc_len >= n + 5)
+            comp_write_stored_block(buf, n, out_stream);
+        else if((u_char) enc[0] == HUFFMAN_TABLE_HEADER_MARKER)
+        {
+            comp_write_block(enc, enc_len, n, out_stream);
+            err = 1;
+        }
+        else
+        {
+            comp_write_block(enc, enc_len, n, out_stream);
+            c->tables_due |= (u_char) enc[0] == HUFFMAN_HEADER_MARKER || (u_char) enc[0] == HUFFMAN_COMPACT_HEADER_MARKER;
+            //限时压缩降级得到的结果不缓存
+            if(c->cache && effort == COMP_EFFORT_NORMAL)
+                comp_cache_put(c->cache, key, enc, enc_len);
+        }
+        if(c->pace)
+            comp_pace_update(c->pace, effort, n, comp_elapsed_ns(&block_start));
+    }
+    free(enc);
+    return err;
+}
+
+/* 去重：块的指纹已经出现过时写引用块，不再编码，
+ * 否则编码，并记录块头在压缩包中的位置。引用块的编码数据为
+ +----------+------------+----------------------------+
+ |  标识符  | 0x52       |                            |
+ +----------+------------+----------------------------+
+ | 块头位置 | uint64_t   | 被引用的块在压缩包中的偏移 |
+ +----------+------------+----------------------------+
+ 输出不可seek时无法得到块的位置，只编码不去重。返回1表示写了引用块或引用了共享编码表的块 */
+static int comp_dedup_block(comp_compressor_t* c, const char* buf, size_t n,
+                            comp_codec_t** codec, comp_bitstream_t* out_stream)
+{
+    char key[COMP_BLOCK_FP_LEN];
+    comp_block_fingerprint(buf, n, key);
+    u_int64_t* offset = comp_map_get(c->chunk_index, key);
+    if(offset)
+    {
+        comp_bitstream_write_int(out_stream, (int) n);
+        comp_bitstream_write_int(out_stream, 9);
+        comp_bitstream_write_char(out_stream, COMP_CHUNK_REF_MARKER);
+        comp_bitstream_write_long(out_stream, *offset);
+        comp_bar_add(c->bar, n);
+        if(c->pace)
+            c->pace->done += n;
+        return 1;
+    }
+    long pos = comp_bitstream_tell(out_stream);
+    int ref = comp_encode_block(c, buf, n, key, codec, out_stream);
+    if(ref < 0)
+        return -1;
+    if(pos >= 0 && (offset = (u_int64_t*) malloc(sizeof(u_int64_t))) != NULL)
+    {
+        *offset = (u_int64_t) pos;
+        if(comp_map_put(c->chunk_index, key, offset) < 0)
+            free(offset);
+    }
+    return ref;
+}
+
+/* 长的单字节重复段(全0的填充、预分配的空间等)写为重复块，不经过编解码器，编码数据为
+ +----------+------------+------------------------+
+ |  标识符  | 0x5A       |                        |
+ +----------+------------+------------------------+
+ |   字节   | u_char     | 重复 原始长度 次       |
+ +----------+------------+------------------------+
+ */
+static void comp_write_run_block(char value, size_t n, comp_bitstream_t* out_stream)
+{
+    comp_bitstream_write_int(out_stream, (int) n);
+    comp_bitstream_write_int(out_stream, 2);
+    comp_bitstream_write_char(out_stream, COMP_RUN_MARKER);
+    comp_bitstream_write_char(out_stream, value);
+}
+
+/* 编码一块：先找出其中不短于 COMP_RUN_MIN 的重复段写为重复块，其余部分照常编码(去重时先查找相同的块)。
+ * 重复段在编解码器之外按内存速度处理，重复块与普通块交错出现在块序列中。
+ * 返回1表示写了引用块或引用了共享编码表的块 */
+static int comp_encode_runs(comp_compressor_t* c, const char* buf, size_t n,
+                            comp_codec_t** codec, comp_bitstream_t* out_stream)
+{
+    int err = 0, ref = 0;
+    size_t pos = 0;
+    while(err >= 0 && pos < n)
+    {
+        size_t run_len;
+        size_t lit_len = comp_run_find(buf + pos, n - pos, COMP_RUN_MIN, &run_len);
+        if(lit_len > 0)
+        {
+            if(c->chunk_index)
+                err = comp_dedup_block(c, buf + pos, lit_len, codec, out_stream);
+            else
+                err = comp_encode_block(c, buf + pos, lit_len, NULL, codec, out_stream);
+            ref |= err == 1;
+        }
+        if(err >= 0 && run_len > 0)
+        {
+            comp_write_run_block(buf[pos + lit_len], run_len, out_stream);
+            comp_bar_add(c->bar, run_len);
+            if(c->pace)
+                c->pace->done += run_len;
+        }
+        pos += lit_len + run_len;
+    }
+    return err < 0 ? -1 : ref;
+}
+
+/* 自动选择过滤器的候选：常见的数值宽度和记录宽度，以及x86代码 */
+static const int comp_filter_candidates[][2] = {
+        {COMP_FILTER_DELTA, 1}, {COMP_FILTER_DELTA, 2}, {COMP_FILTER_DELTA, 3}, {COMP_FILTER_DELTA, 4},
+        {COMP_FILTER_SHUFFLE, 2}, {COMP_FILTER_SHUFFLE, 4}, {COMP_FILTER_SHUFFLE, 8}, {COMP_FILTER_SHUFFLE, 16},
+        {COMP_FILTER_BCJ, 0}
+};
+
+/* 样本中几乎没有控制字符时是文本，过滤器对文本没有帮助，不用试 */
+static int comp_filter_is_text(const char* buf, size_t n)
+{
+    size_t ctrl = 0;
+    for(size_t i = 0; i < n; i++)
+    {
+        u_char b = (u_char) buf[i];
+        ctrl += b == 0x7F || (b < 0x20 && b != '\t' && b != '\n' && b != '\r');
+    }
+    return ctrl * 256 < n;
+}
+
+/* 读取自动选择过滤器用的样本，返回样本长度。大小已知的大文件从均匀分布的 COMP_FILTER_SAMPLES 处
+ * 各取一段再回到开头，可执行文件的头部、表格的标题等开头部分往往不能代表整个文件，
+ * 每段的位置按 COMP_FILTER_WINDOW 对齐，与定长记录的边界一致。
+ * 其他情况样本就是读出的开头，*head 设为1，之后要作为第一块的开头编码 */
+static size_t comp_filter_sample(comp_bitstream_t* in_stream, u_int64_t size, char* sample, int* head)
+{
+    size_t n = 0, r;
+    *head = size == COMP_ENTRY_SIZE_UNKNOWN || size < (u_int64_t) COMP_FILTER_SAMPLES * COMP_FILTER_WINDOW * 2;
+    if(*head)
+    {
+        while(n < COMP_FILTER_TRIAL_SIZE && (r = fread(sample + n, 1, COMP_FILTER_TRIAL_SIZE - n, in_stream->fp)) > 0)
+            n += r;
+        return n;
+    }
+    size_t piece = COMP_FILTER_TRIAL_SIZE / COMP_FILTER_SAMPLES;
+    for(int i = 0; i < COMP_FILTER_SAMPLES; i++)
+    {
+        off_t offset = (off_t) (size / COMP_FILTER_SAMPLES * i / COMP_FILTER_WINDOW * COMP_FILTER_WINDOW);
+        if(fseeko(in_stream->fp, offset, SEEK_SET) != 0)
+            break;
+        n += fread(sample + n, 1, piece, in_stream->fp);
+    }
+    comp_bitstream_reset(in_stream);
+    return n;
+}
+
+/* 为文件选择编码前的过滤器，buf 为样本。自动选择时对样本应用每个候选过滤器后试编码，
+ * 比不过滤时小到 COMP_FILTER_GAIN 以下才使用。过滤的效果与之后的编解码器有关(转置对BWT帮助最大，
+ * 跳转地址转换只对能利用重复串的编解码器有效)，所以用实际使用的编解码器试编码，自动选择时用BWT，
+ * 上下文混合太慢，也用BWT代替。选择结果记录在 meta 中 */
+static void comp_filter_select(comp_compressor_t* c, const char* buf, size_t n, comp_entry_meta_t* meta)
+{
+    int type = c->filter, param = c->filter_param;
+    if(type == COMP_FILTER_AUTO)
+    {
+        type = COMP_FILTER_NONE;
+        param = 0;
+        comp_codec_t* codec = c->codec && c->codec->type != COMP_CODEC_CM ? c->codec : c->codecs[COMP_CODEC_BWT];
+        char* sample = n >= COMP_FILTER_TRIAL_MIN && !comp_filter_is_text(buf, n) ? (char*) malloc(n) : NULL;
+        char* trial;
+        size_t trial_len, best_len;
+        //试编码不计入进度
+        size_t complete = c->bar->complete;
+        if(sample && comp_encode_buf(codec, buf, n, &trial, &best_len) == 0)
+        {
+            free(trial);
+            best_len = (size_t) ((double) best_len * COMP_FILTER_GAIN);
+            for(size_t i = 0; i < sizeof(comp_filter_candidates) / sizeof(comp_filter_candidates[0]); i++)
             {
-#ifdef DEBUG
-                printf("fail.\n");
-#endif
-                comp_bitstream_destroy(in_stream);
-                comp_str_free(filename);
-                return -1;
+                comp_filter_t* f = comp_filter_init(comp_filter_candidates[i][0], comp_filter_candidates[i][1]);
+                if(!f) continue;
+                memcpy(sample, buf, n);
+                comp_filter_encode(f, sample, n, 1);
+                comp_filter_free(f);
+                if(comp_encode_buf(codec, sample, n, &trial, &trial_len) < 0)
+                    continue;
+                free(trial);
+                if(trial_len < best_len)
+                {
+                    best_len = trial_len;
+                    type = comp_filter_candidates[i][0];
+                    param = comp_filter_candidates[i][1];
+                }
             }
+        }
+        c->bar->complete = complete;
+        free(sample);
+    }
+    if(type == COMP_FILTER_NONE)
+        return;
+    meta->flags |= COMP_ENTRY_FLAG_FILTER;
+    meta->filter = (u_char) type;
+    meta->filter_param = (u_char) param;
 #ifdef DEBUG
-            printf("done.\n");
+    fprintf(stderr, "filter %s:%d  ", comp_filter_name(type), param);
 #endif
-            comp_bitstream_destroy(in_stream);
-            comp_str_free(filename);
+}
+
+/* 用文件的样本(与选择过滤器的相同)选出整个文件使用的编解码器，meta 指定了过滤器时样本先经过过滤器 */
+static comp_codec_t* comp_codec_select_sample(comp_compressor_t* c, const char* sample, size_t n,
+                                              comp_entry_meta_t* meta)
+{
+    char* filtered = NULL;
+    if(meta->flags & COMP_ENTRY_FLAG_FILTER)
+    {
+        comp_filter_t* f = comp_filter_init(meta->filter, meta->filter_param);
+        if(f && (filtered = (char*) malloc(n)))
+        {
+            memcpy(filtered, sample, n);
+            comp_filter_encode(f, filtered, n, 1);
         }
-        else if(entry->d_type == DT_DIR)
+        comp_filter_free(f);
+    }
+    char* enc;
+    size_t enc_len;
+    comp_codec_t* codec = comp_codec_select(c, filtered ? filtered : sample, n, &enc, &enc_len);
+    free(enc);
+    free(filtered);
+    return codec;
+}
+
+/* 把稀疏文件的一个空洞写为0的重复块，不读取其中的数据，输入跳到空洞之后 */
+static int comp_encode_hole(comp_compressor_t* c, comp_hole_t* hole,
+                            comp_bitstream_t* in_stream, comp_bitstream_t* out_stream)
+{
+    for(u_int64_t pos = hole->start; pos < hole->end;)
+    {
+        u_int64_t n = hole->end - pos < COMP_HOLE_BLOCK_MAX ? hole->end - pos : COMP_HOLE_BLOCK_MAX;
+        comp_write_run_block(0, (size_t) n, out_stream);
+        comp_bar_add(c->bar, n);
+        if(c->pace)
+            c->pace->done += n;
+        pos += n;
+    }
+    return fseeko(in_stream->fp, (off_t) hole->end, SEEK_SET) == 0 ? 0 : -1;
+}
+
+/* 去重时按内容切分(FastCDC)，相同的内容即使位置偏移也会切出相同的块；否则按 c->block_size 切分。
+ * head 是已经从输入读出的开头部分。meta 指定了过滤器时，数据过滤后再切分编码，
+ * 去重和缓存都以过滤后的内容为准，解码时按同样的顺序还原。
+ * sparse 不为空时只读取数据部分，空洞写为0的重复块。codec 为空时由第一个需要编码的块选择。
+ * 写了引用块或引用了共享编码表的块时在 meta 中设置 COMP_ENTRY_FLAG_REFS */
+static int comp_encode_blocks(comp_compressor_t* c, comp_bitstream_t* in_stream, comp_bitstream_t* out_stream,
+                              comp_entry_meta_t* meta, comp_codec_t* codec, const char* head, size_t head_len,
+                              comp_sparse_t* sparse)
+{
+    comp_filter_t* filter = NULL;
+    if((meta->flags & COMP_ENTRY_FLAG_FILTER) && !(filter = comp_filter_init(meta->filter, meta->filter_param)))
+        return -1;
+    //过滤器可能留下不到一个窗口的数据等待之后的输入，多留出一个窗口，缓冲区满时总能切出完整的块
+    size_t cap = c->block_size + (filter ? COMP_FILTER_WINDOW : 0);
+    char* buf = (char*) malloc(cap);
+    if(!buf)
+    {
+        comp_filter_free(filter);
+        return -1;
+    }
+    int err = 0, eof = 0;
+    size_t len = head_len, ready = 0, hole_i = 0;
+    u_int64_t offset = head_len; // 已经读入的输入长度
+    if(head_len > 0)
+        memcpy(buf, head, head_len);
+    while(err >= 0)
+    {
+        //读满缓冲区或读到结尾，稀疏文件只读到下一个空洞之前
+        u_int64_t limit = sparse && hole_i < sparse->num ? sparse->holes[hole_i].start : UINT64_MAX;
+        while(!eof && len < cap && offset < limit)
         {
-            comp_str_t new_dir_path = comp_str_new(dir_path);
-            new_dir_path = comp_str_append_char(new_dir_path, '/');
-            new_dir_path = comp_str_append_str(new_dir_path, entry->d_name);
-            if(comp_compress_dir(c, new_dir_path, out_stream) < 0)
-            {
-                comp_str_free(new_dir_path);
+            size_t want = limit - offset < cap - len ? (size_t) (limit - offset) : cap - len;
+            size_t r = fread(buf + len, 1, want, in_stream->fp);
+            if(r == 0)
+                eof = 1;
+            len += r;
+            offset += r;
+        }
+        int at_hole = !eof && offset == limit;
+        //ready 之前是已经过滤的部分，读到结尾时过滤器处理全部剩余数据
+        ready += filter ? comp_filter_encode(filter, buf + ready, len - ready, eof) : len - ready;
+        if(ready == 0)
+        {
+            //空洞之前的数据都已写出
+            if(!at_hole)
+                break;
+            err = comp_encode_hole(c, &sparse->holes[hole_i], in_stream, out_stream);
+            offset = sparse->holes[hole_i++].end;
+            continue;
+        }
+        size_t n = ready < c->block_size ? ready : c->block_size;
+        //缓冲区不小于 COMP_CDC_MAX_SIZE，总能切出一块
+        if(c->chunk_index)
+            n = comp_cdc_cut(buf, n, (eof || at_hole) && n == len);
+        if((err = comp_encode_runs(c, buf, n, &codec, out_stream)) == 1)
+            meta->flags |= COMP_ENTRY_FLAG_REFS;
+        memmove(buf, buf + n, len - n);
+        len -= n;
+        ready -= n;
+    }
+    free(buf);
+    comp_filter_free(filter);
+    if(err >= 0)
+        comp_bitstream_write_int(out_stream, 0);
+    return err < 0 ? -1 : 0;
+}
+
+/* 解码一个块头之后的部分。follow_ref 为0时不再跟随引用块(被引用的块本身不会是引用块) */
+static int comp_decode_block(comp_compressor_t* c, comp_bitstream_t* in_stream, comp_bitstream_t* out_stream,
+                             int raw_len, int enc_len, int follow_ref)
+{
+    int stored_len;
+    char marker;
+    if(comp_bitstream_read_char(in_stream, &marker) < 0)
+        return -1;
+    //存储的块直接复制到输出
+    if((u_char) marker == NONE_COMPRESS_MARKER)
+    {
+        if(comp_bitstream_read_int(in_stream, &stored_len) < 0 || stored_len != raw_len ||
+           enc_len != stored_len + 5 || comp_bitstream_copy(in_stream, out_stream, stored_len) < 0)
+            return -1;
+        comp_bar_add(c->bar, 4 + enc_len);
+        return 0;
+    }
+    //重复块直接写出，解压稀疏文件时0的重复块跳过，留下空洞，返回1
+    if((u_char) marker == COMP_RUN_MARKER)
+    {
+        char value, run[65536];
+        if(enc_len != 2 || raw_len <= 0 || comp_bitstream_read_char(in_stream, &value) < 0)
+            return -1;
+        if(value == 0 && out_stream == c->sparse_stream)
+        {
+            long pos = comp_bitstream_tell(out_stream);
+            if(pos < 0 || comp_bitstream_seek(out_stream, pos + raw_len) < 0)
                 return -1;
+            comp_bar_add(c->bar, 4 + enc_len);
+            return 1;
+        }
+        memset(run, value, raw_len < (int) sizeof(run) ? raw_len : (int) sizeof(run));
+        for(int done = 0; done < raw_len;)
+        {
+            int len = raw_len - done < (int) sizeof(run) ? raw_len - done : (int) sizeof(run);
+            if(comp_bitstream_write(out_stream, run, len) < 0)
+                return -1;
+            done += len;
+        }
+        comp_bar_add(c->bar, 4 + enc_len);
+        return 0;
+    }
+    //引用块：跳到被引用的块解码，再回到原来的位置，被引用的块不重复计入进度
+    if((u_char) marker == COMP_CHUNK_REF_MARKER)
+    {
+        u_int64_t offset;
+        int ref_raw_len, ref_enc_len;
+        if(!follow_ref || enc_len != 9 || comp_bitstream_read_long(in_stream, &offset) < 0)
+            return -1;
+        long pos = comp_bitstream_tell(in_stream);
+        if(pos < 0 || comp_bitstream_seek(in_stream, (long) offset) < 0)
+        {
+            fprintf(stderr, "deduplicated archive can't be read from a pipe\n");
+            return -1;
+        }
+        size_t complete = c->bar->complete;
+        int err = 0;
+        if(comp_bitstream_read_int(in_stream, &ref_raw_len) < 0 || ref_raw_len != raw_len ||
+           comp_bitstream_read_int(in_stream, &ref_enc_len) < 0 ||
+           ref_enc_len <= 0 || ref_enc_len > COMP_BLOCK_ENC_MAX ||
+           comp_decode_block(c, in_stream, out_stream, ref_raw_len, ref_enc_len, 0) < 0)
+            err = -1;
+        c->bar->complete = complete;
+        comp_bar_add(c->bar, 4 + enc_len);
+        if(comp_bitstream_seek(in_stream, pos) < 0)
+            return -1;
+        return err;
+    }
+    char* enc = (char*) malloc(enc_len);
+    if(!enc || comp_bitstream_read(in_stream, enc + 1, enc_len - 1) < 0)
+    {
+        free(enc);
+        return -1;
+    }
+    enc[0] = marker;
+    //块内的编码数据由编解码器计入进度
+    comp_bar_add(c->bar, 4);
+    comp_codec_t* codec = comp_codec_for_marker(c, marker);
+    comp_bitstream_t* block_in = codec ? comp_bitstream_init(fmemopen(enc, enc_len, "rb")) : NULL;
+    int err = block_in ? codec->decode(codec, block_in, out_stream) : -1;
+    comp_bitstream_destroy(block_in);
+    free(enc);
+    return err < 0 ? -1 : 0;
+}
+
+/* 有过滤器的条目：块先解码到内存，接在之前没有还原完的数据 pend 之后，还原能还原的部分写到输出，
+ * 剩下的留到下一块。raw_len 为0表示条目结束，还原剩余的全部数据 */
+static int comp_decode_filtered_block(comp_compressor_t* c, comp_bitstream_t* in_stream, comp_bitstream_t* out_stream,
+                                      int raw_len, int enc_len, comp_filter_t* filter, char** pend, size_t* pend_len)
+{
+    if(raw_len > 0)
+    {
+        char* blk = NULL;
+        size_t blk_len = 0;
+        comp_bitstream_t* blk_out = comp_bitstream_init(open_memstream(&blk, &blk_len));
+        int err = blk_out ? comp_decode_block(c, in_stream, blk_out, raw_len, enc_len, 1) : -1;
+        comp_bitstream_destroy(blk_out);
+        char* p = err == 0 && blk_len == (size_t) raw_len ? (char*) realloc(*pend, *pend_len + blk_len) : NULL;
+        if(!p)
+        {
+            free(blk);
+            return -1;
+        }
+        memcpy(p + *pend_len, blk, blk_len);
+        free(blk);
+        *pend = p;
+        *pend_len += blk_len;
+    }
+    size_t done = comp_filter_decode(filter, *pend, *pend_len, raw_len == 0);
+    if(done > 0 && comp_bitstream_write(out_stream, *pend, done) < 0)
+        return -1;
+    memmove(*pend, *pend + done, *pend_len - done);
+    *pend_len -= done;
+    return 0;
+}
+
+static int comp_decode_blocks(comp_compressor_t* c, comp_bitstream_t* in_stream, comp_bitstream_t* out_stream,
+                              comp_entry_meta_t* meta)
+{
+    int raw_len, enc_len, err = -1, hole = 0;
+    comp_filter_t* filter = NULL;
+    char* pend = NULL;
+    size_t pend_len = 0;
+    if((meta->flags & COMP_ENTRY_FLAG_FILTER) && !(filter = comp_filter_init(meta->filter, meta->filter_param)))
+        return -1;
+    while(1)
+    {
+        if(comp_bitstream_read_int(in_stream, &raw_len) < 0)
+            break;
+        comp_bar_add(c->bar, 4);
+        if(raw_len == 0)
+        {
+            err = filter ? comp_decode_filtered_block(c, in_stream, out_stream, 0, 0, filter, &pend, &pend_len) : 0;
+            //以空洞结尾时文件长度还不够，补写最后一个0字节
+            if(hole)
+            {
+                long pos = comp_bitstream_tell(out_stream);
+                if(pos <= 0 || comp_bitstream_seek(out_stream, pos - 1) < 0 ||
+                   comp_bitstream_write_char(out_stream, 0) < 0)
+                    err = -1;
             }
-            comp_str_free(new_dir_path);
+            break;
+        }
+        if(comp_bitstream_read_int(in_stream, &enc_len) < 0 ||
+           enc_len <= 0 || enc_len > COMP_BLOCK_ENC_MAX)
+            break;
+        if(filter)
+        {
+            if(comp_decode_filtered_block(c, in_stream, out_stream, raw_len, enc_len, filter, &pend, &pend_len) < 0)
+                break;
         }
+        else if((hole = comp_decode_block(c, in_stream, out_stream, raw_len, enc_len, 1)) < 0)
+            break;
     }
-    comp_bitstream_write_char(out_stream, COMP_DIR_MARKER);
-    comp_bitstream_write_char(out_stream, 0);
+    free(pend);
+    comp_filter_free(filter);
+    return err;
+}
+
+/* 压缩单个文件，entry_path 是文件在压缩包中的路径。
+ * 增量更新时，如果文件没有改变，直接从旧压缩包中复制压缩数据 */
+static int comp_compress_file(comp_compressor_t* c, comp_str_t filename, comp_str_t entry_path,
+                              u_int64_t size, u_int64_t mtime, comp_sparse_t* sparse,
+                              comp_bitstream_t* in_stream, comp_bitstream_t* out_stream)
+{
+    comp_entry_meta_t meta;
+    if(comp_entry_meta_load(c, in_stream, size, mtime, &meta) < 0)
+        return -1;
+    //待写出的共享编码表写在条目之间，之后的文件才能引用。试编码也会产生候选，
+    //只在huffman确实被选用(写出了自己的编码表)之后才写出，其他编解码器胜出时不必为它们占用空间
+    int table;
+    while(c->tables && c->tables_due && (table = comp_huffman_tables_commit(c->tables)) >= 0)
+    {
+        comp_bitstream_write_char(out_stream, COMP_HUFFMAN_TABLE_MARKER);
+        comp_huffman_tables_write(c->tables, table, out_stream);
+    }
+    c->tables_due = 0;
+    comp_bitstream_write_char(out_stream, COMP_FILE_META_MARKER);
+    comp_bitstream_write_char(out_stream, (char) comp_str_len(filename));
+    comp_bitstream_write(out_stream, filename, comp_str_len(filename));
+    comp_entry_meta_t* old = c->update_index ? comp_map_get(c->update_index, entry_path) : NULL;
+    if(old && comp_entry_unchanged(c, old, &meta))
+    {
+        comp_entry_meta_write(old, out_stream);
+        if(comp_bitstream_seek(c->update_stream, old->payload_offset) < 0 ||
+           comp_bitstream_copy(c->update_stream, out_stream, old->payload_len) < 0)
+            return -1;
+        comp_bar_add(c->bar, meta.size);
+        return 0;
+    }
+    //样本只有读出的开头时，之后作为第一块的开头编码，管道输入也不需要读两遍。
+    //稀疏文件的空洞不经过过滤器，整个文件都不过滤
+    char* sample = NULL;
+    size_t sample_len = 0;
+    int head = 0;
+    if(sparse)
+        meta.flags |= COMP_ENTRY_FLAG_SPARSE;
+    else
+    {
+        if(c->filter == COMP_FILTER_AUTO || (!c->codec && !c->race))
+        {
+            if(!(sample = (char*) malloc(COMP_FILTER_TRIAL_SIZE)))
+                return -1;
+            sample_len = comp_filter_sample(in_stream, size, sample, &head);
+        }
+        comp_filter_select(c, sample, sample_len, &meta);
+    }
+    comp_entry_meta_write(&meta, out_stream);
+    //压缩数据长度在编码完成后回填，输出不可seek时保持 COMP_PAYLOAD_LEN_UNKNOWN
+    long start = comp_bitstream_tell(out_stream);
+    //自动选择编解码器时，大文件用均匀分布的样本选择，只看开头的一块可能不能代表整个文件
+    comp_codec_t* codec = c->codec;
+    if(!codec && !c->race && !head && sample_len > 0)
+        codec = comp_codec_select_sample(c, sample, sample_len, &meta);
+    int err = comp_encode_blocks(c, in_stream, out_stream, &meta, codec, sample, head ? sample_len : 0, sparse);
+    free(sample);
+    if(err < 0)
+        return -1;
+    comp_bitstream_flush(out_stream);
+    long end = comp_bitstream_tell(out_stream);
+    if(start < 0 || end < 0)
+        return 0;
+    if(comp_bitstream_seek(out_stream, start - 8) < 0)
+        return 0;
+    comp_bitstream_write_long(out_stream, (u_int64_t) (end - start));
+    //写了引用块时回填标志，标志位于元信息开头
+    if(meta.flags & COMP_ENTRY_FLAG_REFS)
+    {
+        comp_bitstream_seek(out_stream, start - comp_entry_meta_len(&meta));
+        comp_bitstream_write_char(out_stream, (char) meta.flags);
+    }
+    comp_bitstream_seek(out_stream, end);
     return 0;
 }
 
-/* 压缩函数，完成进度条初始化，打开输入输出流，开始压缩 */
-static void comp_compress(comp_compressor_t* c, const char* in_path, const char* out_path)
+/* 进入清单中的一个文件夹，写出文件夹标识，压缩其中的文件(清单中已按大小从大到小排列)。
+ * 文件相对于所在文件夹的fd打开；path 是文件夹在压缩包中的路径，文件的路径在它后面追加名字得到，
+ * 用于进度条和增量更新的索引，返回前恢复原长度 */
+static int comp_compress_dir_files(comp_compressor_t* c, comp_manifest_t* m, comp_manifest_entry_t* dir_entry,
+                                   comp_str_t* path, comp_bitstream_t* out_stream)
+{
+    comp_manifest_enter(m, dir_entry);
+    comp_bar_set_total(c->bar, comp_manifest_total_size(m));
+    comp_bitstream_write_char(out_stream, COMP_DIR_MARKER);
+    comp_bitstream_write_char(out_stream, (char) comp_str_len(dir_entry->name));
+    comp_bitstream_write(out_stream, dir_entry->name, comp_str_len(dir_entry->name));
+    size_t dir_len = comp_str_len(*path);
+    int err = 0;
+    for(size_t i = 0; i < comp_vec_len(dir_entry->files) && err == 0; i++)
+    {
+        comp_manifest_entry_t* entry = comp_vec_get(dir_entry->files, i);
+        comp_str_truncate(*path, dir_len);
+        *path = comp_str_append_char(*path, '/');
+        *path = comp_str_append_str(*path, entry->name);
+#ifdef DEBUG
+        fprintf(stderr, "compress %s  ", *path);
+#else
+        comp_bar_set_title(c->bar, *path);
+#endif
+        int fd = comp_manifest_open(entry);
+        comp_sparse_t* sparse = fd >= 0 ? comp_sparse_scan(fd, entry->size) : NULL;
+        FILE* in = comp_fdopen(c, fd, "rb", entry->size);
+        comp_bitstream_t* in_stream = comp_bitstream_init(in);
+        if(!in_stream)
+        {
+            if(in)
+                fclose(in);
+            comp_sparse_free(sparse);
+            continue;
+        }
+        err = comp_compress_file(c, entry->name, *path, entry->size, entry->mtime, sparse,
+                                 in_stream, out_stream);
+        comp_sparse_free(sparse);
+#ifdef DEBUG
+        fprintf(stderr, err < 0 ? "fail.\n" : "done.\n");
+#endif
+        comp_bitstream_destroy(in_stream);
+    }
+    comp_str_truncate(*path, dir_len);
+    return err;
+}
+
+/* 按清单压缩文件夹，将所有文件以及文件夹信息压缩到一个压缩文件中。
+ * 同一文件夹中先压缩文件，再依次压缩子文件夹，子文件夹结束时写出长度为0的文件夹标识。
+ * 不递归：next 栈记录每一层下一个要压缩的子文件夹序号，上一层就是清单中的父文件夹，
+ * 栈深度与文件夹深度无关。清单在后台遍历，每个文件夹只需等待它自己扫描完成，压缩与遍历同时进行 */
+static int comp_compress_dir(comp_compressor_t* c, comp_manifest_t* m, comp_bitstream_t* out_stream)
+{
+    comp_manifest_entry_t* dir_entry = m->root;
+    comp_str_t path = comp_str_new(dir_entry->name);
+    comp_vec_t* next = comp_vec_init(16);
+    int err = comp_compress_dir_files(c, m, dir_entry, &path, out_stream);
+    comp_vec_push_back(next, (void*) 0);
+    while(err == 0 && !comp_vec_empty(next))
+    {
+        size_t i = (size_t) (intptr_t) comp_vec_pop_back(next);
+        if(i < comp_vec_len(dir_entry->dirs))
+        {
+            comp_vec_push_back(next, (void*) (intptr_t) (i + 1));
+            dir_entry = comp_vec_get(dir_entry->dirs, i);
+            path = comp_str_append_char(path, '/');
+            path = comp_str_append_str(path, dir_entry->name);
+            err = comp_compress_dir_files(c, m, dir_entry, &path, out_stream);
+            comp_vec_push_back(next, (void*) 0);
+            continue;
+        }
+        comp_bitstream_write_char(out_stream, COMP_DIR_MARKER);
+        comp_bitstream_write_char(out_stream, 0);
+        comp_manifest_leave(m, dir_entry);
+        if(dir_entry->parent)
+            comp_str_truncate(path, comp_str_len(path) - comp_str_len(dir_entry->name) - 1);
+        dir_entry = dir_entry->parent;
+    }
+    comp_vec_free(next);
+    comp_str_free(path);
+    return err;
+}
+
+/* 压缩函数，完成进度条初始化，打开输入输出流，开始压缩。
+ * in_path 为"-"时从标准输入读取(作为名为stdin的单个文件)，out_path 为"-"时写到标准输出 */
+static int comp_compress_path(comp_compressor_t* c, const char* in_path, const char* out_path)
 {
     struct stat st;
-    if(stat(in_path, &st) != 0)
+    int from_stdin = !strcmp(in_path, "-");
+    if(from_stdin)
     {
-        printf("%s isn't a file or directory\n", in_path);
-        return;
+        memset(&st, 0, sizeof(st));
+        st.st_mode = S_IFIFO;
+    }
+    else if(stat(in_path, &st) != 0)
+    {
+        fprintf(stderr, "%s isn't a file or directory\n", in_path);
+        return -1;
     }
-    size_t sz;
-    FILE* out = fopen(out_path, "wb");
+    int err = 0;
+    int out_fd = !strcmp(out_path, "-") ? dup(STDOUT_FILENO) : open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int seekable = out_fd >= 0 && lseek(out_fd, 0, SEEK_CUR) >= 0;
+    FILE* out = comp_fdopen(c, out_fd, "wb", UINT64_MAX);
     comp_bitstream_t* out_stream = comp_bitstream_init(out);
-    if(!out_stream) return;
+    if(!out_stream) return -1;
     comp_bitstream_write_short(out_stream, COMP_START_MARKER);
+    //使用字典时记录字典的ID，解压时确认提供了同一个字典
+    if(c->dict)
+    {
+        comp_bitstream_write_char(out_stream, COMP_DICT_MARKER);
+        comp_bitstream_write_int(out_stream, (int) c->dict->id);
+    }
+    if(c->dedup)
+        c->chunk_index = comp_map_init(1024);
+    //引用共享编码表的条目要回填标志，输出不可seek(管道)时不使用。这些条目在增量更新时不能单独复制，
+    //所以增量更新也不使用，否则每次更新都要重新压缩它们
+    if(seekable && !c->update_index)
+        comp_compressor_set_tables(c, comp_huffman_tables_init());
+    if(c->cache_dir && !(c->cache = comp_cache_open(c->cache_dir, c->cache_limit)))
+        fprintf(stderr, "%s: can't open cache directory, compress without cache\n", c->cache_dir);
+    if(c->pace_rate > 0 || c->pace_deadline > 0)
+        c->pace = comp_pace_init(c->pace_rate, c->pace_deadline);
     if(!S_ISDIR(st.st_mode))
     {
-        sz = st.st_size;
-        comp_bar_set_total(c->bar, sz);
-        FILE* in = fopen(in_path, "rb");
+        u_int64_t sz = from_stdin ? COMP_ENTRY_SIZE_UNKNOWN : (u_int64_t) st.st_size;
+        comp_bar_set_total(c->bar, from_stdin ? 0 : sz);
+        int fd = from_stdin ? dup(STDIN_FILENO) : open(in_path, O_RDONLY);
+        comp_sparse_t* sparse = !from_stdin && fd >= 0 ? comp_sparse_scan(fd, sz) : NULL;
+        FILE* in = comp_fdopen(c, fd, "rb", sz);
         comp_bitstream_t* in_stream = comp_bitstream_init(in);
         if(!in_stream)
         {
+            comp_sparse_free(sparse);
             comp_bitstream_destroy(out_stream);
-            return;
+            return -1;
         }
+        comp_str_t name = from_stdin ? comp_str_new("stdin") : comp_basename(in_path);
 #ifndef DEBUG
-        comp_bar_set_title(c->bar,in_path);
+        comp_bar_set_title(c->bar, name);
 #else
-        printf("compress %s  ", in_path);
+        fprintf(stderr, "compress %s  ", name);
 #endif
-        comp_str_t name = basename(in_path);
-#ifndef DEBUG
-        comp_compress_file(c, name, in_stream, out_stream);
-#else
-        if(comp_compress_file(c, name, in_stream, out_stream) < 0)
-            printf("fail.\n");
-        else printf("done.\n");
+        err = comp_compress_file(c, name, name, sz,
+                                 (u_int64_t) st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec, sparse,
+                                 in_stream, out_stream);
+        comp_sparse_free(sparse);
+#ifdef DEBUG
+        if(err < 0)
+            fprintf(stderr, "fail.\n");
+        else fprintf(stderr, "done.\n");
 #endif
         comp_str_free(name);
         comp_bitstream_destroy(in_stream);
     }
     else
     {
-        comp_str_t path = comp_str_new(in_path);
-        sz = get_dir_size(path);
-        comp_bar_set_total(c->bar, sz);
-        comp_compress_dir(c, path, out_stream);
-        comp_str_free(path);
+        //只遍历一次文件夹，总大小、压缩顺序和压缩过程都使用同一份清单，
+        //进度条的总大小随着遍历的进行不断更新
+        comp_manifest_t* m = comp_manifest_build(in_path, 0);
+        if(!m)
+            err = -1;
+        else
+        {
+            err = comp_compress_dir(c, m, out_stream);
+            comp_manifest_free(m);
+        }
     }
     comp_bitstream_destroy(out_stream);
-    printf("\n");
+    fprintf(stderr, "\n");
+    comp_huffman_tables_free(c->tables);
+    comp_compressor_set_tables(c, NULL);
+    if(c->chunk_index)
+    {
+        comp_map_free(c->chunk_index, free);
+        c->chunk_index = NULL;
+    }
+    if(c->cache)
+    {
+        fprintf(stderr, "cache: %zu hits, %zu misses, %zu stored, %zu evicted, %.1f MB in use\n",
+                c->cache->hits, c->cache->misses, c->cache->stores, c->cache->evictions,
+                c->cache->total / 1048576.0);
+        comp_cache_close(c->cache);
+        c->cache = NULL;
+    }
+    if(c->pace)
+    {
+        fprintf(stderr, "%.2fs, blocks: %zu normal, %zu fast, %zu stored\n",
+                comp_pace_elapsed(c->pace) / 1e9, c->pace->blocks[COMP_EFFORT_NORMAL],
+                c->pace->blocks[COMP_EFFORT_FAST], c->pace->blocks[COMP_EFFORT_STORED]);
+        free(c->pace);
+        c->pace = NULL;
+    }
+    return err;
 }
 
-/* 解压单个文件 */
-static int comp_decompress_file(comp_compressor_t* c, comp_bitstream_t* in_stream)
+static void comp_compress(comp_compressor_t* c, const char* in_path, const char* out_path)
 {
-    char name_len, input;
-    comp_bitstream_read_char(in_stream, &name_len);
-    comp_bar_add(c->bar, 1);
-    comp_str_t filepath = comp_str_new(c->cur_decompress_dir);
-    for(int i = 0; i < (u_char) name_len; i++)
-    {
-        comp_bitstream_read_char(in_stream, &input);
-        filepath = comp_str_append_char(filepath, input);
-    }
-    comp_bar_add(c->bar, name_len);
+    comp_compress_path(c, in_path, out_path);
+}
+
+/* 读取条目名(长度 + 名字)，名字一次读入 name，返回名字长度 */
+static int comp_read_entry_name(comp_compressor_t* c, comp_bitstream_t* in_stream, char* name)
+{
+    char name_len;
+    if(comp_bitstream_read_char(in_stream, &name_len) < 0)
+        return -1;
+    if(comp_bitstream_read(in_stream, name, (u_char) name_len) < 0)
+        return -1;
+    name[(u_char) name_len] = 0;
+    comp_bar_add(c->bar, 1 + (u_char) name_len);
+    return (u_char) name_len;
+}
+
+/* 解压单个文件，with_meta 表示文件名后带有元信息。文件相对当前目录的fd创建 */
+static int comp_decompress_file(comp_compressor_t* c, comp_bitstream_t* in_stream, int with_meta)
+{
+    char name[256];
+    if(comp_read_entry_name(c, in_stream, name) <= 0)
+        return -1;
 #ifdef DEBUG
-    printf("decompress %s  ", filepath);
+    fprintf(stderr, "decompress %s  ", name);
 #else
-    comp_bar_set_title(c->bar, filepath);
+    comp_bar_set_title(c->bar, name);
 #endif
-    FILE* out = fopen(filepath, "wb");
-    comp_bitstream_t* out_stream = comp_bitstream_init(out);
+    comp_bitstream_t* out_stream = NULL;
+    comp_entry_meta_t meta;
+    meta.flags = 0;
+    meta.size = COMP_ENTRY_SIZE_UNKNOWN;
     int err;
+    if(with_meta)
+    {
+        if((err = comp_entry_meta_read(&meta, in_stream)) < 0)
+            goto end;
+        comp_bar_add(c->bar, err);
+    }
+    //解压到标准输出时，所有文件的内容依次写到同一个流中，不留空洞
+    int sparse = (meta.flags & COMP_ENTRY_FLAG_SPARSE) != 0;
+    if(c->extract_stream)
+        out_stream = c->extract_stream;
+    else
+        out_stream = comp_bitstream_init(comp_create_output(c, c->cur_dir_fd, name, meta.size, sparse));
     if(!out_stream)
     {
         err = -1;
         goto end;
     }
-    err = c->codec->decode(c->codec, in_stream, out_stream);
+    if(sparse && out_stream != c->extract_stream)
+        c->sparse_stream = out_stream;
+    if(meta.flags & COMP_ENTRY_FLAG_BLOCKS)
+        err = comp_decode_blocks(c, in_stream, out_stream, &meta);
+    else
+    {
+        //不分块的数据由编解码器自己读取标识，这里只看一眼
+        char marker;
+        comp_codec_t* codec = NULL;
+        if(comp_bitstream_peek_char(in_stream, &marker) == 0)
+            codec = comp_codec_for_marker(c, marker);
+        err = codec ? codec->decode(codec, in_stream, out_stream) : -1;
+    }
 end:
 #ifdef DEBUG
-    printf(err == -1 ? "fail.\n" : "done.\n");
+    fprintf(stderr, err == -1 ? "fail.\n" : "done.\n");
 #endif
-    comp_bitstream_destroy(out_stream);
-    comp_str_free(filepath);
+    c->sparse_stream = NULL;
+    if(out_stream != c->extract_stream)
+        comp_bitstream_destroy(out_stream);
     return err;
 }
 
-/* 从压缩文件中提取一个文件夹以及其中的所有文件 */
+/* 从压缩文件中提取一个文件夹以及其中的所有文件。
+ * 进入文件夹时在当前目录的fd下mkdirat/openat，并把上层目录的fd压栈，名字长度为0时出栈，
+ * 这样每个文件只需相对所在目录解析一次名字，不用每次从根解析完整路径 */
 static int comp_decompress_dir(comp_compressor_t* c, comp_bitstream_t* in_stream)
 {
-    char name_len, input;
-    comp_bitstream_read_char(in_stream, &name_len);
-    comp_bar_add(c->bar, 1);
+    char name[256];
+    int name_len = comp_read_entry_name(c, in_stream, name);
+    if(name_len < 0)
+        return -1;
     if(name_len == 0)
     {
-        comp_str_t parent_dir = comp_vec_pop_back(c->decompress_dir_stack);
-        c->cur_decompress_dir = comp_str_assign(c->cur_decompress_dir, parent_dir);
-        comp_str_free(parent_dir);
+        if(comp_vec_empty(c->dir_fd_stack))
+            return -1;
+        if(c->cur_dir_fd >= 0)
+            close(c->cur_dir_fd);
+        c->cur_dir_fd = (int) (intptr_t) comp_vec_pop_back(c->dir_fd_stack);
+        return 0;
     }
-    else
+    int fd = -1;
+    //解压到标准输出时不创建目录
+    if(!c->extract_stream)
     {
-        comp_str_t dir_path = comp_str_new(c->cur_decompress_dir);
-        for(int i = 0; i < (u_char) name_len; i++)
-        {
-            comp_bitstream_read_char(in_stream, &input);
-            dir_path = comp_str_append_char(dir_path, input);
-        }
-        comp_bar_add(c->bar, name_len);
-        struct stat st;
-        if(stat(dir_path, &st) == 0)
+        if(mkdirat(c->cur_dir_fd, name, S_IRWXU) != 0)
+            return -1;
+        if((fd = openat(c->cur_dir_fd, name, O_RDONLY | O_DIRECTORY)) < 0)
             return -1;
-        mkdir(dir_path, S_IRWXU);
-        dir_path = comp_str_append_char(dir_path, '/');
-        comp_str_t parent_dir = comp_str_new(c->cur_decompress_dir);
-        comp_vec_push_back(c->decompress_dir_stack, parent_dir);
-        c->cur_decompress_dir = comp_str_assign(c->cur_decompress_dir, dir_path);
-        comp_str_free(dir_path);
     }
+    comp_vec_push_back(c->dir_fd_stack, (void*) (intptr_t) c->cur_dir_fd);
+    c->cur_dir_fd = fd;
     return 0;
 }
 
-static void comp_decompress(comp_compressor_t* c, const char* in_path)
+/* 压缩包使用了共享字典，确认提供的字典ID相同 */
+static int comp_check_dict(comp_compressor_t* c, comp_bitstream_t* in_stream)
 {
-    FILE* in = fopen(in_path, "rb");
+    int id;
+    if(comp_bitstream_read_int(in_stream, &id) < 0)
+        return -1;
+    comp_bar_add(c->bar, 4);
+    if(!c->dict || c->dict->id != (u_int32_t) id)
+    {
+        fprintf(stderr, "archive needs dictionary %08x, given with -Z\n", (u_int32_t) id);
+        return -1;
+    }
+    return 0;
+}
+
+/* 解压函数。in_path 为"-"时从标准输入读取压缩包，只需顺序读一遍；
+ * out_path 为空时解压到当前目录，为"-"时把所有文件内容写到标准输出，否则解压到 out_path 目录下 */
+static void comp_decompress(comp_compressor_t* c, const char* in_path, const char* out_path)
+{
+    struct stat st;
+    int from_stdin = !strcmp(in_path, "-");
+    if(from_stdin)
+        st.st_size = 0;
+    else if(stat(in_path, &st) != 0)
+    {
+        fprintf(stderr, "%s: file doesn't exist\n", in_path);
+        return;
+    }
+    FILE* in = comp_fdopen(c, from_stdin ? dup(STDIN_FILENO) : open(in_path, O_RDONLY), "rb",
+                           from_stdin ? UINT64_MAX : (u_int64_t) st.st_size);
     if(!in)
     {
-        printf("%s: file doesn't exist\n", in_path);
+        fprintf(stderr, "%s: can't open file\n", in_path);
         return;
     }
-    struct stat st;
-    stat(in_path, &st);
+    if(out_path && !strcmp(out_path, "-"))
+        c->extract_stream = comp_bitstream_init(comp_fdopen(c, dup(STDOUT_FILENO), "wb", UINT64_MAX));
+    else if((c->cur_dir_fd = open(out_path ? out_path : ".", O_RDONLY | O_DIRECTORY)) < 0)
+    {
+        fprintf(stderr, "%s: can't enter directory\n", out_path ? out_path : ".");
+        fclose(in);
+        return;
+    }
+    //大小未知(管道)时不显示进度
     comp_bar_set_total(c->bar, st.st_size);
     comp_bitstream_t* in_stream = comp_bitstream_init(in);
-    if(!in_stream) return;
+    if(!in_stream)
+    {
+        fclose(in);
+        comp_bitstream_destroy(c->extract_stream);
+        c->extract_stream = NULL;
+        if(c->cur_dir_fd >= 0)
+            close(c->cur_dir_fd);
+        c->cur_dir_fd = -1;
+        return;
+    }
+    comp_compressor_set_tables(c, comp_huffman_tables_init());
     short start_marker; char marker;
     //FSM
     do
@@ -397,12 +1813,27 @@ static void comp_decompress(comp_compressor_t* c, const char* in_path)
                 comp_bar_add(c->bar, 1);
                 if((u_char) marker == COMP_FILE_MARKER)
                     c->state = COMP_PARSE_FILE;
+                else if((u_char) marker == COMP_FILE_META_MARKER)
+                    c->state = COMP_PARSE_FILE_META;
                 else if((u_char) marker == COMP_DIR_MARKER)
                     c->state = COMP_PARSE_DIR;
+                else if((u_char) marker == COMP_DICT_MARKER)
+                {
+                    if(comp_check_dict(c, in_stream) < 0)
+                        c->state = COMP_PARSE_FAIL;
+                }
+                else if((u_char) marker == COMP_HUFFMAN_TABLE_MARKER)
+                {
+                    int n = c->tables ? comp_huffman_tables_read(c->tables, in_stream) : -1;
+                    if(n < 0)
+                        c->state = COMP_PARSE_FAIL;
+                    else comp_bar_add(c->bar, n);
+                }
                 else c->state = COMP_PARSE_FAIL;
                 break;
             case COMP_PARSE_FILE:
-                if(comp_decompress_file(c, in_stream) < 0)
+            case COMP_PARSE_FILE_META:
+                if(comp_decompress_file(c, in_stream, c->state == COMP_PARSE_FILE_META) < 0)
                     c->state = COMP_PARSE_FAIL;
                 else c->state = COMP_PARSE_START;
                 break;
@@ -416,5 +1847,161 @@ static void comp_decompress(comp_compressor_t* c, const char* in_path)
         }
     } while (c->state != COMP_PARSE_STOP && c->state != COMP_PARSE_FAIL);
     comp_bitstream_destroy(in_stream);
-    printf("\n");
-}
\ No newline at end of file
+    comp_bitstream_destroy(c->extract_stream);
+    c->extract_stream = NULL;
+    comp_huffman_tables_free(c->tables);
+    comp_compressor_set_tables(c, NULL);
+    //解析失败时栈中可能还有未关闭的目录
+    while(!comp_vec_empty(c->dir_fd_stack))
+    {
+        int fd = (int) (intptr_t) comp_vec_pop_back(c->dir_fd_stack);
+        if(fd >= 0)
+            close(fd);
+    }
+    if(c->cur_dir_fd >= 0)
+        close(c->cur_dir_fd);
+    c->cur_dir_fd = -1;
+    fprintf(stderr, "\n");
+}
+
+/* 沿着块头跳过分块编码的数据，返回数据总长度 */
+static u_int64_t comp_skip_blocks(comp_bitstream_t* s)
+{
+    long start = comp_bitstream_tell(s);
+    long pos = start;
+    int raw_len, enc_len;
+    while(pos >= 0)
+    {
+        if(comp_bitstream_read_int(s, &raw_len) < 0)
+            break;
+        if(raw_len == 0)
+            return (u_int64_t) (pos + 4 - start);
+        if(comp_bitstream_read_int(s, &enc_len) < 0 || enc_len <= 0)
+            break;
+        pos += 8 + enc_len;
+        if(comp_bitstream_seek(s, pos) < 0)
+            break;
+    }
+    return COMP_PAYLOAD_LEN_UNKNOWN;
+}
+
+/* 扫描旧压缩包，为每个带元信息的文件条目建立 路径 -> 元信息 的索引，并跳过其压缩数据。
+ * 旧格式的文件条目(COMP_FILE_MARKER)没有记录压缩数据长度，无法跳过，遇到时停止扫描，
+ * 之后的文件都会重新压缩 */
+static void comp_index_archive(comp_compressor_t* c)
+{
+    comp_bitstream_t* s = c->update_stream;
+    short start_marker;
+    char marker, name_len;
+    char name[256];
+    if(comp_bitstream_read_short(s, &start_marker) < 0 || (u_int16_t) start_marker != COMP_START_MARKER)
+        return;
+    comp_str_t path = comp_str_empty();
+    comp_vec_t* dir_stack = comp_vec_init(10);
+    while(comp_bitstream_read_char(s, &marker) == 0)
+    {
+        //旧压缩包用了不同的字典时，其中的压缩数据不能复制，全部重新压缩
+        if((u_char) marker == COMP_DICT_MARKER)
+        {
+            int id;
+            if(comp_bitstream_read_int(s, &id) < 0 || !c->dict || (u_int32_t) id != c->dict->id)
+                break;
+            continue;
+        }
+        //共享编码表只对引用它的条目有用，这些条目都会重新压缩
+        if((u_char) marker == COMP_HUFFMAN_TABLE_MARKER)
+        {
+            if(comp_huffman_tables_read(NULL, s) < 0)
+                break;
+            continue;
+        }
+        if(comp_bitstream_read_char(s, &name_len) < 0)
+            break;
+        if(comp_bitstream_read(s, name, (u_char) name_len) < 0)
+            break;
+        name[(u_char) name_len] = 0;
+        if((u_char) marker == COMP_DIR_MARKER)
+        {
+            if(name_len == 0)
+            {
+                if(comp_vec_empty(dir_stack))
+                    break;
+                comp_str_t parent_dir = comp_vec_pop_back(dir_stack);
+                path = comp_str_assign(path, parent_dir);
+                comp_str_free(parent_dir);
+                continue;
+            }
+            comp_vec_push_back(dir_stack, comp_str_new(path));
+            path = comp_str_append_str(path, name);
+            path = comp_str_append_char(path, '/');
+            continue;
+        }
+        if((u_char) marker != COMP_FILE_META_MARKER)
+            break;
+        comp_entry_meta_t* meta = (comp_entry_meta_t*) malloc(sizeof(comp_entry_meta_t));
+        if(!meta || comp_entry_meta_read(meta, s) < 0)
+        {
+            free(meta);
+            break;
+        }
+        meta->payload_offset = comp_bitstream_tell(s);
+        //分块编码的数据即使没有回填长度，也可以沿着块头跳过
+        if(meta->payload_len == COMP_PAYLOAD_LEN_UNKNOWN && (meta->flags & COMP_ENTRY_FLAG_BLOCKS))
+            meta->payload_len = comp_skip_blocks(s);
+        if(meta->payload_len == COMP_PAYLOAD_LEN_UNKNOWN)
+        {
+            free(meta);
+            break;
+        }
+        comp_str_t entry_path = comp_str_new(path);
+        entry_path = comp_str_append_str(entry_path, name);
+        free(comp_map_remove(c->update_index, entry_path));
+        comp_map_put(c->update_index, entry_path, meta);
+        comp_str_free(entry_path);
+        if(meta->payload_offset < 0 ||
+           comp_bitstream_seek(s, meta->payload_offset + (long) meta->payload_len) < 0)
+            break;
+    }
+    while(!comp_vec_empty(dir_stack))
+        comp_str_free(comp_vec_pop_back(dir_stack));
+    comp_vec_free(dir_stack);
+    comp_str_free(path);
+}
+
+/* 增量更新：以旧压缩包为基础压缩 in_path，没有改变的文件直接复制旧的压缩数据，
+ * 修改过的和新增的文件重新压缩，已删除的文件不会出现在新压缩包中。
+ * out_path 为空或与旧压缩包相同时，先写到临时文件，完成后替换旧压缩包 */
+static void comp_update(comp_compressor_t* c, const char* archive_path, const char* in_path, const char* out_path)
+{
+    FILE* old = fopen(archive_path, "rb");
+    if(!old)
+    {
+        fprintf(stderr, "%s: file doesn't exist\n", archive_path);
+        return;
+    }
+    c->update_stream = comp_bitstream_init(old);
+    c->update_index = comp_map_init(64);
+    comp_str_t tmp_path = NULL;
+    if(!c->update_stream || !c->update_index)
+        goto end;
+    comp_index_archive(c);
+    if(!out_path || !strcmp(out_path, archive_path))
+    {
+        tmp_path = comp_str_new(archive_path);
+        tmp_path = comp_str_append_str(tmp_path, ".tmp");
+        out_path = tmp_path;
+    }
+    if(comp_compress_path(c, in_path, out_path) == 0)
+    {
+        if(tmp_path)
+            rename(tmp_path, archive_path);
+    }
+    else if(tmp_path)
+        unlink(tmp_path);
+end:
+    comp_str_free(tmp_path);
+    comp_map_free(c->update_index, free);
+    comp_bitstream_destroy(c->update_stream);
+    c->update_index = NULL;
+    c->update_stream = NULL;
+}
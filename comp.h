@@ -6,6 +6,15 @@
 #include <stdio.h>
 #include "huffman.h"
 #include "lzw.h"
+#include "fse.h"
+#include "bwt.h"
+#include "cm.h"
+#include "dict.h"
+#include "internal/map.h"
+#include "internal/cache.h"
+#include "internal/filter.h"
+#include "internal/sparse.h"
+#include "manifest.h"
 
 
 struct comp_codec_s;
@@ -13,7 +22,7 @@ typedef int (*comp_encode_f) (struct comp_codec_s*, comp_bitstream_t*, comp_bits
 typedef int (*comp_decode_f) (struct comp_codec_s*, comp_bitstream_t*, comp_bitstream_t*);
 
 typedef enum comp_codec_type
-{ COMP_CODEC_HUFFMAN, COMP_CODEC_LZW } comp_codec_type;
+{ COMP_CODEC_MAX = -2, COMP_CODEC_AUTO = -1, COMP_CODEC_HUFFMAN, COMP_CODEC_LZW, COMP_CODEC_FSE, COMP_CODEC_HUFFMAN_O1, COMP_CODEC_BWT, COMP_CODEC_CM, COMP_CODEC_NUM } comp_codec_type;
 
 struct comp_codec_s
 {
@@ -34,24 +43,82 @@ struct comp_lzw_codec_s
     comp_lzw_ctx_t* lzw_ctx;
 };
 
+struct comp_fse_codec_s
+{
+    struct comp_codec_s p;
+    comp_fse_ctx_t* fse_ctx;
+};
+
+struct comp_bwt_codec_s
+{
+    struct comp_codec_s p;
+    comp_bwt_ctx_t* bwt_ctx;
+};
+
+struct comp_cm_codec_s
+{
+    struct comp_codec_s p;
+    comp_cm_ctx_t* cm_ctx;
+};
+
 typedef struct comp_codec_s comp_codec_t;
 typedef struct comp_huffman_codec_s comp_huffman_codec_t;
 typedef struct comp_lzw_codec_s comp_lzw_codec_t;
+typedef struct comp_fse_codec_s comp_fse_codec_t;
+typedef struct comp_bwt_codec_s comp_bwt_codec_t;
+typedef struct comp_cm_codec_s comp_cm_codec_t;
 
 #define CODEC_PARENT_INIT(codec, _type, encode_f, decode_f) \
         (codec)->p.type = (_type);                          \
         (codec)->p.encode = (encode_f);                     \
         (codec)->p.decode = (decode_f)                      \
 
+#define COMP_BLOCK_SIZE (1024 * 1024)   // 最大的分块大小，实际大小由压缩级别决定
+#define COMP_BLOCK_ENC_MAX (4 * COMP_BLOCK_SIZE)
+#define COMP_STORE_ENTROPY 7.9          // 取样熵(bit/字节)不低于该值的块不编码，直接存储
+#define COMP_STORE_REPEAT 0.05          // 高熵的块中重复的比例达到该值时仍交给能利用重复的编解码器
+#define COMP_TRIAL_SIZE (64 * 1024)     // 自动选择编解码器时试编码的样本长度
+#define COMP_TRIAL_TIME_MIN (32 * 1024) // 试编码的耗时至少按该长度平摊到每字节
+#define COMP_CODEC_SPEED_NS 300.0       // 自动选择编解码器时，每字节编码耗时达到该值(纳秒)时代价按编码长度的两倍计
+#define COMP_LEVEL_MIN 1
+#define COMP_LEVEL_MAX 9
+#define COMP_LEVEL_DEFAULT 6
+#define COMP_DIRECT_IO_MIN (64ULL * 1024 * 1024)
+#define COMP_BLOCK_FP_LEN 33            // 块指纹(十六进制字符串)的长度
+#define COMP_FILTER_GAIN 0.97           // 过滤后试编码长度不超过不过滤时的该比例才使用过滤器
+#define COMP_FILTER_TRIAL_MIN 4096      // 样本不足该长度的文件不尝试过滤器
+#define COMP_FILTER_TRIAL_SIZE (32 * 1024) // 自动选择过滤器时试编码的样本长度
+#define COMP_FILTER_SAMPLES 4           // 大文件的样本从均匀分布的几处各取一段
+#define COMP_HOLE_BLOCK_MAX (1 << 30)   // 空洞按该长度分成多个重复块
+
 struct comp_compressor_s;
+struct comp_race_s;
+struct comp_pace_s;
 typedef void (*comp_compress_f) (struct comp_compressor_s*, const char*, const char*);
-typedef void (*comp_decompress_f) (struct comp_compressor_s*, const char*);
+typedef void (*comp_decompress_f) (struct comp_compressor_s*, const char*, const char*);
+typedef void (*comp_update_f) (struct comp_compressor_s*, const char*, const char*, const char*);
+
+/* 压缩包中文件条目的元信息，增量更新时用来判断文件是否改变 */
+struct comp_entry_meta_s
+{
+    u_char flags;
+    u_int64_t size;
+    u_int64_t mtime; // 纳秒
+    u_int64_t hash; // 文件内容哈希，flags 包含 COMP_ENTRY_FLAG_HASH 时有效
+    u_char filter; // 编码前应用的过滤器，flags 包含 COMP_ENTRY_FLAG_FILTER 时有效
+    u_char filter_param;
+    long payload_offset; // 压缩数据在压缩包中的偏移
+    u_int64_t payload_len;
+};
+
+typedef struct comp_entry_meta_s comp_entry_meta_t;
 
 //解压过程的状态机
 typedef enum comp_parse_state
 {
     COMP_PARSE_START,
     COMP_PARSE_FILE, //正在解压文件
+    COMP_PARSE_FILE_META, //正在解压带元信息的文件
     COMP_PARSE_DIR, //正在解压文件夹
     COMP_PARSE_STOP, //解压完成
     COMP_PARSE_FAIL
@@ -59,20 +126,51 @@ typedef enum comp_parse_state
 
 struct comp_compressor_s
 {
-    comp_codec_t* codec;
+    comp_codec_t* codecs[COMP_CODEC_NUM];
+    comp_codec_t* codec;                // 压缩使用的编解码器，为空时对每个文件自动选择
+    struct comp_race_s* race;           // max模式，每个块由所有编解码器并行编码，取代价最小的
+    double race_decode_ns;              // max模式中每字节解码耗时达到该值(纳秒)时代价翻倍，0表示只比较大小
+    double codec_speed_ns;              // 自动选择中每字节编码耗时达到该值(纳秒)时代价翻倍，0表示只比较大小
+    int level;                          // 压缩级别 1-9
+    double pace_rate;                   // 限时压缩的目标吞吐量(MB/s)，0表示不限
+    double pace_deadline;               // 限时压缩的截止时间(秒)，0表示不限
+    struct comp_pace_s* pace;           // 限时压缩的调速状态，只在压缩过程中存在
+    size_t block_size;                  // 分块大小，由压缩级别决定
+    int filter;                         // 编码前的过滤器，COMP_FILTER_AUTO 表示对每个文件自动选择
+    int filter_param;                   // 指定过滤器时的差分距离或记录宽度
+    comp_dict_t* dict;                  // 共享字典，为空表示不使用，解压时必须与压缩时相同
+    comp_huffman_tables_t* tables;      // 压缩包的共享huffman编码表，只在压缩、解压过程中存在
+    int tables_due;                     // 写出过自己建表的huffman块，待写出的共享编码表在下一个条目之前写出
     comp_parse_state state;             // for decompression
-    comp_str_t cur_decompress_dir;      // for decompression
-    comp_vec_t* decompress_dir_stack;   // for decompression
+    int cur_dir_fd;                     // for decompression, 当前解压目录的fd
+    comp_vec_t* dir_fd_stack;           // for decompression, 上层目录的fd
     comp_progress_bar* bar;
+    int store_hash;                     // 是否为每个文件记录内容哈希
+    int pipeline;                       // 读写是否在单独的IO线程中进行
+    int direct_io;                      // 解压大文件时是否使用O_DIRECT
+    int dedup;                          // 是否对所有文件按内容切块去重
+    const char* cache_dir;              // 压缩结果缓存目录，为空表示不使用缓存
+    u_int64_t cache_limit;              // 缓存目录总大小上限
+    comp_cache_t* cache;                // 缓存，只在压缩过程中存在
+    comp_map_t* chunk_index;            // 去重时 块指纹 -> 块在压缩包中的位置，为空表示不去重
+    comp_map_t* update_index;           // for update, 旧压缩包中 路径 -> comp_entry_meta_t
+    comp_bitstream_t* update_stream;    // for update, 旧压缩包
+    comp_bitstream_t* extract_stream;   // for decompression, 解压到标准输出时的输出流
+    comp_bitstream_t* sparse_stream;    // for decompression, 正在解压的稀疏文件，0的重复块在其中留下空洞
     comp_compress_f compress;
     comp_decompress_f decompress;
+    comp_update_f update;
 };
 
 typedef struct comp_compressor_s comp_compressor_t;
 
-comp_codec_t* comp_codec_init(comp_codec_type, comp_progress_bar*);
+comp_codec_t* comp_codec_init(comp_codec_type, int, comp_progress_bar*);
 void comp_codec_free(comp_codec_t*);
-comp_compressor_t* comp_compressor_init(comp_codec_type);
+int comp_codec_lookup(const char*);
+comp_compressor_t* comp_compressor_init(comp_codec_type, int);
+void comp_compressor_set_bwt_block(comp_compressor_t*, size_t);
+void comp_compressor_set_cm_memory(comp_compressor_t*, size_t);
+void comp_compressor_set_dict(comp_compressor_t*, comp_dict_t*);
 void comp_compressor_free(comp_compressor_t*);
 
 #endif //COMPRESS_COMP_H
@@ -0,0 +1,301 @@
+//
+// Created by zr on 23-2-18.
+//
+#include "dict.h"
+#include "marker.h"
+#include "internal/3w_tire.h"
+#include "internal/hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define DICT_CODE_NUM (1U << LZW_CODE_WIDTH_MAX)
+
+/* 训练状态：所有样本依次经过同一个码宽为16位的LZW字典，记录每个串被匹配的次数 */
+struct dict_trainer_s
+{
+    u_int32_t freq[HUFFMAN_MAX_SYMBOL];
+    comp_tire_t* tire;
+    u_int32_t next; // 下一个新串的编码
+    u_int16_t prefix[DICT_CODE_NUM];
+    u_char chr[DICT_CODE_NUM];
+    u_int32_t hits[DICT_CODE_NUM];
+    u_int64_t len;
+    size_t num;
+};
+
+struct dict_rank_s
+{
+    u_int32_t hits;
+    u_int32_t code;
+};
+
+typedef struct dict_trainer_s dict_trainer_t;
+typedef struct dict_rank_s dict_rank_t;
+
+/* 匹配次数从多到少，相同时编码小的在前。前缀的匹配次数不少于由它扩展出的串，
+ * 编码也更小，所以排序后任意前k个串的前缀都在其中 */
+static int dict_rank_cmp(const void* a, const void* b)
+{
+    const dict_rank_t* x = a;
+    const dict_rank_t* y = b;
+    if(x->hits != y->hits)
+        return x->hits > y->hits ? -1 : 1;
+    return x->code < y->code ? -1 : 1;
+}
+
+static dict_trainer_t* dict_trainer_new()
+{
+    dict_trainer_t* t = (dict_trainer_t*) calloc(1, sizeof(dict_trainer_t));
+    if(!t) return NULL;
+    //按位反转的顺序插入单字节的串，三路字典树的第一层接近平衡
+    for(int i = 0; i < LZW_MAX_SYMBOL; i++)
+    {
+        u_char c = 0;
+        for(int b = 0; b < 8; b++)
+            c |= ((i >> b) & 1) << (7 - b);
+        t->tire = comp_tire_put_char(t->tire, c, c);
+    }
+    t->next = LZW_MAX_SYMBOL + 1;
+    return t;
+}
+
+/* 一个样本经过LZW字典，样本之间不延续匹配 */
+static void dict_learn(dict_trainer_t* t, const u_char* p, size_t n)
+{
+    comp_tire_t* node = NULL;
+    for(size_t i = 0; i < n; i++)
+    {
+        t->freq[p[i]]++;
+        comp_tire_t* next = node ? comp_tire_get_char(node->mid, p[i]) : NULL;
+        if(next)
+        {
+            node = next;
+            t->hits[node->value]++;
+            continue;
+        }
+        if(node && t->next < DICT_CODE_NUM)
+        {
+            node->mid = comp_tire_put_char(node->mid, p[i], (TIRE_VALUE_TYPE) t->next);
+            t->prefix[t->next] = node->value;
+            t->chr[t->next] = p[i];
+            t->next++;
+        }
+        node = comp_tire_get_char(t->tire, p[i]);
+    }
+    t->len += n;
+    t->num++;
+}
+
+static void dict_learn_file(dict_trainer_t* t, const char* path, u_int64_t size)
+{
+    if(t->len >= COMP_DICT_TRAIN_MAX || size == 0)
+        return;
+    if(size > COMP_DICT_TRAIN_MAX - t->len)
+        size = COMP_DICT_TRAIN_MAX - t->len;
+    FILE* fp = fopen(path, "rb");
+    char* buf = fp ? (char*) malloc(size) : NULL;
+    size_t n = buf ? fread(buf, 1, size, fp) : 0;
+    if(n > 0)
+        dict_learn(t, (const u_char*) buf, n);
+    free(buf);
+    if(fp)
+        fclose(fp);
+}
+
+/* 样本可以是文件或文件夹，文件夹中的文件全部作为样本 */
+static void dict_learn_path(dict_trainer_t* t, const char* path)
+{
+    struct stat st;
+    if(stat(path, &st) != 0)
+    {
+        fprintf(stderr, "%s isn't a file or directory\n", path);
+        return;
+    }
+    if(!S_ISDIR(st.st_mode))
+    {
+        if(S_ISREG(st.st_mode))
+            dict_learn_file(t, path, st.st_size);
+        return;
+    }
+    DIR* dir = opendir(path);
+    if(!dir)
+        return;
+    struct dirent* ent;
+    comp_str_t child = comp_str_empty();
+    while((ent = readdir(dir)) != NULL && t->len < COMP_DICT_TRAIN_MAX)
+    {
+        if(!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+            continue;
+        child = comp_str_assign(child, path);
+        child = comp_str_append_char(child, '/');
+        child = comp_str_append_str(child, ent->d_name);
+        dict_learn_path(t, child);
+    }
+    comp_str_free(child);
+    closedir(dir);
+}
+
+static u_int32_t dict_hash(comp_dict_t* d)
+{
+    u_int64_t h = comp_hash_fnv1a64(COMP_HASH_FNV_INIT, d->huffman_len, HUFFMAN_MAX_SYMBOL);
+    for(u_int32_t k = 0; k < d->lzw_num; k++)
+    {
+        u_char e[3] = {(u_char) (d->lzw_prefix[k] >> 8), (u_char) d->lzw_prefix[k], d->lzw_char[k]};
+        h = comp_hash_fnv1a64(h, e, 3);
+    }
+    return (u_int32_t) (h ^ (h >> 32));
+}
+
+static comp_dict_t* dict_new(u_int32_t lzw_num)
+{
+    comp_dict_t* d = (comp_dict_t*) calloc(1, sizeof(comp_dict_t));
+    if(!d) return NULL;
+    d->lzw_num = lzw_num;
+    d->lzw_prefix = (u_int16_t*) malloc((lzw_num + 1) * sizeof(u_int16_t));
+    d->lzw_char = (u_char*) malloc(lzw_num + 1);
+    if(!d->lzw_prefix || !d->lzw_char)
+    {
+        comp_dict_free(d);
+        return NULL;
+    }
+    return d;
+}
+
+/* 用 paths 中的样本训练字典：
+ * 1. huffman 每个符号的编码长度由所有样本的字节频数(加1，保证每个符号都有编码)得到
+ * 2. LZW 所有样本经过同一个16位码宽的字典，按匹配次数保留最常用的 LZW_DICT_MAX 个串，重新编号 */
+comp_dict_t* comp_dict_train(char** paths, int n)
+{
+    dict_trainer_t* t = dict_trainer_new();
+    if(!t) return NULL;
+    for(int i = 0; i < n; i++)
+        dict_learn_path(t, paths[i]);
+    comp_dict_t* d = NULL;
+    dict_rank_t* rank = (dict_rank_t*) malloc(DICT_CODE_NUM * sizeof(dict_rank_t));
+    u_int16_t* renum = (u_int16_t*) malloc(DICT_CODE_NUM * sizeof(u_int16_t));
+    if(!rank || !renum || t->len == 0)
+        goto end;
+    u_int32_t m = 0;
+    for(u_int32_t code = LZW_MAX_SYMBOL + 1; code < t->next; code++)
+        if(t->hits[code] >= COMP_DICT_MIN_HITS)
+        {
+            rank[m].hits = t->hits[code];
+            rank[m++].code = code;
+        }
+    qsort(rank, m, sizeof(dict_rank_t), dict_rank_cmp);
+    if(m > LZW_DICT_MAX)
+        m = LZW_DICT_MAX;
+    if(!(d = dict_new(m)))
+        goto end;
+    for(u_int32_t k = 0; k < m; k++)
+    {
+        u_int32_t code = rank[k].code;
+        u_int16_t p = t->prefix[code];
+        renum[code] = (u_int16_t) (LZW_MAX_SYMBOL + 1 + k);
+        d->lzw_prefix[k] = p < LZW_MAX_SYMBOL ? p : renum[p];
+        d->lzw_char[k] = t->chr[code];
+    }
+    u_int32_t freq[HUFFMAN_MAX_SYMBOL];
+    for(int s = 0; s < HUFFMAN_MAX_SYMBOL; s++)
+        freq[s] = t->freq[s] + 1;
+    comp_huffman_code_len(freq, d->huffman_len, HUFFMAN_MAX_CODE_LEN);
+    d->sample_len = t->len;
+    d->sample_num = t->num;
+    d->id = dict_hash(d);
+end:
+    free(rank);
+    free(renum);
+    comp_tire_free(t->tire);
+    free(t);
+    return d;
+}
+
+/* 字典文件格式
+ +----------+---------------+--------------------------------------+
+ |  标识符  | 0x5A44        |                                      |
+ +----------+---------------+--------------------------------------+
+ |    ID    | uint32_t      | 以下内容的哈希                       |
+ +----------+---------------+--------------------------------------+
+ | 编码长度 | u_char[256]   | huffman 每个符号的编码长度(1-16)     |
+ +----------+---------------+--------------------------------------+
+ |  串个数  | uint32_t      | n                                    |
+ +----------+---------------+--------------------------------------+
+ |  预置串  | n * 3字节     | 前缀的编码(u_short) + 最后一个字节   |
+ +----------+---------------+--------------------------------------+
+ */
+int comp_dict_save(comp_dict_t* d, const char* path)
+{
+    comp_bitstream_t* s = comp_bitstream_init(fopen(path, "wb"));
+    if(!s) return -1;
+    comp_bitstream_write_short(s, (short) COMP_DICT_FILE_MARKER);
+    comp_bitstream_write_int(s, (int) d->id);
+    comp_bitstream_write(s, (const char*) d->huffman_len, HUFFMAN_MAX_SYMBOL);
+    comp_bitstream_write_int(s, (int) d->lzw_num);
+    for(u_int32_t k = 0; k < d->lzw_num; k++)
+    {
+        comp_bitstream_write_short(s, (short) d->lzw_prefix[k]);
+        comp_bitstream_write_char(s, (char) d->lzw_char[k]);
+    }
+    int err = comp_bitstream_flush(s);
+    comp_bitstream_destroy(s);
+    return err;
+}
+
+/* 读取字典文件，格式不对、内容与ID不符时返回NULL */
+comp_dict_t* comp_dict_load(const char* path)
+{
+    comp_bitstream_t* s = comp_bitstream_init(fopen(path, "rb"));
+    if(!s) return NULL;
+    comp_dict_t* d = NULL;
+    short marker;
+    int id, num;
+    u_char len[HUFFMAN_MAX_SYMBOL];
+    if(comp_bitstream_read_short(s, &marker) < 0 || (u_int16_t) marker != COMP_DICT_FILE_MARKER ||
+       comp_bitstream_read_int(s, &id) < 0 || comp_bitstream_read(s, (char*) len, HUFFMAN_MAX_SYMBOL) < 0 ||
+       comp_bitstream_read_int(s, &num) < 0 || num < 0 || (u_int32_t) num > LZW_DICT_MAX ||
+       !(d = dict_new((u_int32_t) num)))
+        goto fail;
+    //编码长度必须满足Kraft不等式
+    u_int64_t kraft = 0;
+    for(int i = 0; i < HUFFMAN_MAX_SYMBOL; i++)
+    {
+        if(len[i] < 1 || len[i] > HUFFMAN_MAX_CODE_LEN)
+            goto fail;
+        kraft += 1ULL << (HUFFMAN_MAX_CODE_LEN - len[i]);
+    }
+    if(kraft > (1ULL << HUFFMAN_MAX_CODE_LEN))
+        goto fail;
+    memcpy(d->huffman_len, len, HUFFMAN_MAX_SYMBOL);
+    //前缀只能是单个字节或之前的串
+    for(u_int32_t k = 0; k < d->lzw_num; k++)
+    {
+        short p;
+        char c;
+        if(comp_bitstream_read_short(s, &p) < 0 || comp_bitstream_read_char(s, &c) < 0)
+            goto fail;
+        d->lzw_prefix[k] = (u_int16_t) p;
+        d->lzw_char[k] = (u_char) c;
+        if(d->lzw_prefix[k] == LZW_TERMINATE_CODE || d->lzw_prefix[k] >= LZW_MAX_SYMBOL + 1 + k)
+            goto fail;
+    }
+    d->id = (u_int32_t) id;
+    if(dict_hash(d) != d->id)
+        goto fail;
+    comp_bitstream_destroy(s);
+    return d;
+fail:
+    comp_dict_free(d);
+    comp_bitstream_destroy(s);
+    return NULL;
+}
+
+void comp_dict_free(comp_dict_t* d)
+{
+    if(!d) return;
+    free(d->lzw_prefix);
+    free(d->lzw_char);
+    free(d);
+}
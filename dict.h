@@ -0,0 +1,33 @@
+//
+// Created by zr on 23-2-18.
+// 共享字典：从样本文件训练出LZW的预置串和huffman的默认编码长度，
+// 压缩大量小文件时各编解码器从字典开始，不必为每个输入从空白的状态学习
+//
+#ifndef COMPRESS_DICT_H
+#define COMPRESS_DICT_H
+#include <sys/types.h>
+#include "huffman.h"
+#include "lzw.h"
+
+#define COMP_DICT_TRAIN_MAX (64ULL * 1024 * 1024) // 训练最多读取的样本总长度
+#define COMP_DICT_MIN_HITS 2 // 训练时至少被匹配过这么多次的串才放进字典
+
+struct comp_dict_s
+{
+    u_int32_t id; // 内容的哈希，压缩包中记录它，解压时确认使用的是同一个字典
+    u_char huffman_len[HUFFMAN_MAX_SYMBOL]; // 每个符号的默认编码长度，所有符号都有编码
+    u_int32_t lzw_num; // 预置串的个数，按训练中被匹配的次数从多到少排列
+    u_int16_t* lzw_prefix; // 第k个串是 lzw_prefix[k] 对应的串加一个字节 lzw_char[k]
+    u_char* lzw_char;
+    u_int64_t sample_len; // 训练时读取的样本总长度，只用于显示
+    size_t sample_num;
+};
+
+typedef struct comp_dict_s comp_dict_t;
+
+comp_dict_t* comp_dict_train(char**, int);
+int comp_dict_save(comp_dict_t*, const char*);
+comp_dict_t* comp_dict_load(const char*);
+void comp_dict_free(comp_dict_t*);
+
+#endif //COMPRESS_DICT_H
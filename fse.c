@@ -0,0 +1,464 @@
+//
+// Created by zr on 23-2-14.
+//
+#include "fse.h"
+#include "marker.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define FSE_PAD 8 // 解码时编码数据前面补的0字节，按8字节读取时不会越界
+#define FSE_HEADER_MAX 512
+#define FSE_STREAM_MAX (FSE_FRAME_SIZE / 8 * FSE_TABLE_LOG_MAX + 64)
+
+static int encode(comp_fse_ctx_t*, comp_bitstream_t*, comp_bitstream_t*);
+static int decode(comp_fse_ctx_t*, comp_bitstream_t*, comp_bitstream_t*);
+
+/* 按位写入，低位在前，位缓冲满7字节以上前必须调用 fse_flush_bits */
+struct fse_bit_writer_s
+{
+    u_int64_t container;
+    int nbits;
+    u_char* ptr;
+};
+
+typedef struct fse_bit_writer_s fse_bit_writer_t;
+
+static inline int fse_highbit(u_int32_t x)
+{
+    return 31 - __builtin_clz(x);
+}
+
+static inline void fse_write_le64(u_char* p, u_int64_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(p, &v, 8);
+#else
+    for(int i = 0; i < 8; i++)
+        p[i] = (u_char) (v >> (8 * i));
+#endif
+}
+
+static inline u_int64_t fse_read_le64(const u_char* p)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    u_int64_t v;
+    memcpy(&v, p, 8);
+    return v;
+#else
+    u_int64_t v = 0;
+    for(int i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+#endif
+}
+
+static inline void fse_add_bits(fse_bit_writer_t* w, u_int64_t value, int n)
+{
+    w->container |= (value & ((1ULL << n) - 1)) << w->nbits;
+    w->nbits += n;
+}
+
+static inline void fse_flush_bits(fse_bit_writer_t* w)
+{
+    int nbytes = w->nbits >> 3;
+    fse_write_le64(w->ptr, w->container);
+    w->ptr += nbytes;
+    w->container >>= nbytes * 8;
+    w->nbits &= 7;
+}
+
+/* 写入结束标记(1位)，返回写入的总字节数 */
+static size_t fse_close_bits(fse_bit_writer_t* w, u_char* start)
+{
+    fse_add_bits(w, 1, 1);
+    fse_flush_bits(w);
+    return w->ptr - start + (w->nbits > 0);
+}
+
+comp_fse_ctx_t* comp_fse_init(comp_progress_bar* bar, int table_log)
+{
+    comp_fse_ctx_t* fse = (comp_fse_ctx_t*) malloc(sizeof(comp_fse_ctx_t));
+    if(!fse) return NULL;
+    if(table_log < FSE_TABLE_LOG_MIN || table_log > FSE_TABLE_LOG_MAX)
+        table_log = FSE_TABLE_LOG;
+    fse->table_log = table_log;
+    fse->in_buf = (char*) malloc(FSE_FRAME_SIZE);
+    fse->out_buf = (char*) malloc(FSE_PAD + FSE_STREAM_MAX);
+    if(!fse->in_buf || !fse->out_buf)
+    {
+        comp_fse_free(fse);
+        return NULL;
+    }
+    fse->bar = bar;
+    fse->fse_encode = encode;
+    fse->fse_decode = decode;
+    return fse;
+}
+
+void comp_fse_free(comp_fse_ctx_t* fse)
+{
+    if(!fse) return;
+    free(fse->in_buf);
+    free(fse->out_buf);
+    free(fse);
+}
+
+/* 数据较少时减小状态表，归一化频数的头部和每个符号的平均精度损失都更小。
+ * 状态数至少要能容纳所有出现的符号 */
+static int fse_optimal_table_log(int table_log, size_t n, int max_symbol)
+{
+    if(n <= 1)
+        return FSE_TABLE_LOG_MIN;
+    int max_bits_src = fse_highbit((u_int32_t) (n - 1)) - 2;
+    int min_bits = fse_highbit((u_int32_t) (n - 1)) + 1;
+    if(fse_highbit((u_int32_t) max_symbol + 1) + 2 < min_bits)
+        min_bits = fse_highbit((u_int32_t) max_symbol + 1) + 2;
+    if(max_bits_src < table_log)
+        table_log = max_bits_src;
+    if(table_log < min_bits)
+        table_log = min_bits;
+    if(table_log < FSE_TABLE_LOG_MIN)
+        table_log = FSE_TABLE_LOG_MIN;
+    if(table_log > FSE_TABLE_LOG_MAX)
+        table_log = FSE_TABLE_LOG_MAX;
+    return table_log;
+}
+
+/* 把频数按比例缩放到总和为 1 << table_log，出现过的符号至少为1。
+ * 四舍五入后总和不对时，每次调整使编码长度增加最少的符号 */
+static void fse_normalize(comp_fse_ctx_t* fse, const u_int32_t* count, size_t n, int max_symbol, int table_log)
+{
+    int32_t table_size = 1 << table_log, sum = 0;
+    for(int s = 0; s <= max_symbol; s++)
+    {
+        int32_t v = 0;
+        if(count[s])
+        {
+            v = (int32_t) ((double) count[s] * table_size / (double) n + 0.5);
+            if(v < 1)
+                v = 1;
+        }
+        fse->norm[s] = (int16_t) v;
+        sum += v;
+    }
+    while(sum != table_size)
+    {
+        int step = sum > table_size ? -1 : 1, best = -1;
+        double best_loss = 0;
+        for(int s = 0; s <= max_symbol; s++)
+        {
+            int16_t v = fse->norm[s];
+            if(v == 0 || (step < 0 && v == 1))
+                continue;
+            double loss = step < 0 ? count[s] * log2((double) v / (v - 1))
+                                   : -(count[s] * log2((double) (v + 1) / v));
+            if(best < 0 || loss < best_loss)
+            {
+                best = s;
+                best_loss = loss;
+            }
+        }
+        fse->norm[best] = (int16_t) (fse->norm[best] + step);
+        sum += step;
+    }
+}
+
+/* 把符号分散到状态表中，相同符号的状态尽量分开 */
+static void fse_spread(const int16_t* norm, int max_symbol, int table_log, u_char* table_symbol)
+{
+    u_int32_t table_size = 1U << table_log, mask = table_size - 1;
+    u_int32_t step = (table_size >> 1) + (table_size >> 3) + 3, pos = 0;
+    for(int s = 0; s <= max_symbol; s++)
+        for(int i = 0; i < norm[s]; i++)
+        {
+            table_symbol[pos] = (u_char) s;
+            pos = (pos + step) & mask;
+        }
+}
+
+static void fse_build_encode_table(comp_fse_ctx_t* fse, int max_symbol, int table_log)
+{
+    u_char table_symbol[1 << FSE_TABLE_LOG_MAX];
+    u_int32_t cumul[FSE_MAX_SYMBOL + 1];
+    u_int32_t table_size = 1U << table_log;
+    fse_spread(fse->norm, max_symbol, table_log, table_symbol);
+    cumul[0] = 0;
+    for(int s = 0; s <= max_symbol; s++)
+        cumul[s + 1] = cumul[s] + fse->norm[s];
+    for(int s = 0; s <= max_symbol; s++)
+    {
+        int32_t v = fse->norm[s];
+        if(v == 0)
+            continue;
+        if(v == 1)
+        {
+            fse->symbol_tt[s].delta_nbits = ((u_int32_t) table_log << 16) - table_size;
+            fse->symbol_tt[s].delta_find_state = (int32_t) cumul[s] - 1;
+        }
+        else
+        {
+            u_int32_t max_bits_out = table_log - fse_highbit(v - 1);
+            u_int32_t min_state_plus = (u_int32_t) v << max_bits_out;
+            fse->symbol_tt[s].delta_nbits = (max_bits_out << 16) - min_state_plus;
+            fse->symbol_tt[s].delta_find_state = (int32_t) cumul[s] - v;
+        }
+    }
+    for(u_int32_t u = 0; u < table_size; u++)
+        fse->state_table[cumul[table_symbol[u]]++] = (u_int16_t) (table_size + u);
+}
+
+static void fse_build_decode_table(comp_fse_ctx_t* fse, int max_symbol, int table_log)
+{
+    u_char table_symbol[1 << FSE_TABLE_LOG_MAX];
+    u_int32_t next[FSE_MAX_SYMBOL];
+    u_int32_t table_size = 1U << table_log;
+    fse_spread(fse->norm, max_symbol, table_log, table_symbol);
+    for(int s = 0; s <= max_symbol; s++)
+        next[s] = fse->norm[s];
+    for(u_int32_t u = 0; u < table_size; u++)
+    {
+        u_char s = table_symbol[u];
+        u_int32_t next_state = next[s]++;
+        int nbits = table_log - fse_highbit(next_state);
+        fse->decode_table[u].symbol = s;
+        fse->decode_table[u].nbits = (u_char) nbits;
+        fse->decode_table[u].new_state = (u_int16_t) ((next_state << nbits) - table_size);
+    }
+}
+
+/* 归一化频数的头部：每个符号1位表示是否出现，出现时再用足够表示剩余总数的位数写入 频数-1 */
+static size_t fse_write_header(comp_fse_ctx_t* fse, int max_symbol, int table_log, u_char* buf)
+{
+    fse_bit_writer_t w = {0, 0, buf};
+    int32_t remaining = 1 << table_log;
+    for(int s = 0; s <= max_symbol; s++)
+    {
+        int16_t v = fse->norm[s];
+        fse_add_bits(&w, v > 0, 1);
+        if(v > 0)
+        {
+            fse_add_bits(&w, v - 1, remaining > 1 ? fse_highbit(remaining - 1) + 1 : 0);
+            remaining -= v;
+        }
+        fse_flush_bits(&w);
+    }
+    fse_flush_bits(&w);
+    return w.ptr - buf + (w.nbits > 0);
+}
+
+static int fse_read_header(comp_fse_ctx_t* fse, int max_symbol, int table_log, const u_char* buf, size_t len)
+{
+    int32_t remaining = 1 << table_log;
+    size_t bitpos = 0;
+    for(int s = 0; s < FSE_MAX_SYMBOL; s++)
+        fse->norm[s] = 0;
+    for(int s = 0; s <= max_symbol; s++)
+    {
+        int nbits = 1;
+        u_int32_t v = 0;
+        for(int k = 0; k < 2; k++)
+        {
+            if(bitpos + nbits > len * 8)
+                return -1;
+            u_int32_t x = 0;
+            for(int i = 0; i < nbits; i++, bitpos++)
+                x |= (u_int32_t) ((buf[bitpos >> 3] >> (bitpos & 7)) & 1) << i;
+            if(k == 0 && !x)
+                break;
+            if(k == 1)
+                v = x + 1;
+            nbits = remaining > 1 ? fse_highbit(remaining - 1) + 1 : 0;
+        }
+        if((int32_t) v > remaining)
+            return -1;
+        fse->norm[s] = (int16_t) v;
+        remaining -= (int32_t) v;
+    }
+    return remaining == 0 ? 0 : -1;
+}
+
+/* 编码一帧。符号按逆序编码，第 i 个符号使用第 i % FSE_STATE_NUM 个状态，
+ * 解码时按正序从编码数据的末尾向前读取。返回编码数据长度 */
+static size_t fse_encode_frame(comp_fse_ctx_t* fse, const u_char* in, size_t n, int table_log)
+{
+    fse_bit_writer_t w = {0, 0, (u_char*) fse->out_buf};
+    u_int32_t state[FSE_STATE_NUM];
+    for(int k = 0; k < FSE_STATE_NUM; k++)
+        state[k] = 1U << table_log;
+#define FSE_ENCODE_SYMBOL(k, sym)                                           \
+    do {                                                                    \
+        comp_fse_symbol_t tt = fse->symbol_tt[sym];                         \
+        u_int32_t nb = (state[k] + tt.delta_nbits) >> 16;                   \
+        fse_add_bits(&w, state[k], (int) nb);                               \
+        state[k] = fse->state_table[(state[k] >> nb) + tt.delta_find_state];\
+    } while(0)
+    size_t tail = n % FSE_STATE_NUM, i = n - tail;
+    for(size_t k = tail; k-- > 0;)
+        FSE_ENCODE_SYMBOL(k, in[i + k]);
+    fse_flush_bits(&w);
+    while(i > 0)
+    {
+        FSE_ENCODE_SYMBOL(3, in[i - 1]);
+        FSE_ENCODE_SYMBOL(2, in[i - 2]);
+        FSE_ENCODE_SYMBOL(1, in[i - 3]);
+        FSE_ENCODE_SYMBOL(0, in[i - 4]);
+        fse_flush_bits(&w);
+        i -= 4;
+    }
+#undef FSE_ENCODE_SYMBOL
+    for(int k = FSE_STATE_NUM - 1; k >= 0; k--)
+    {
+        fse_add_bits(&w, state[k], table_log);
+        fse_flush_bits(&w);
+    }
+    return fse_close_bits(&w, (u_char*) fse->out_buf);
+}
+
+/* 解码一帧，编码数据在 buf + FSE_PAD 处，前面是 FSE_PAD 个0字节。
+ * pos 是剩余未读的位数(包括补齐的部分)，每次补充后位缓冲中至少有56位，足够解码4个符号 */
+static int fse_decode_frame(comp_fse_ctx_t* fse, const u_char* buf, size_t len, u_char* out, size_t n, int table_log)
+{
+    if(len == 0 || buf[FSE_PAD + len - 1] == 0)
+        return -1;
+    size_t pos = (FSE_PAD + len - 1) * 8 + fse_highbit(buf[FSE_PAD + len - 1]);
+    const comp_fse_decode_t* dt = fse->decode_table;
+    u_int64_t container;
+    size_t start;
+    int top;
+#define FSE_RELOAD()                                    \
+    do {                                                \
+        if(pos < FSE_PAD * 8)                           \
+            return -1;                                  \
+        start = (pos >> 3) - 7;                         \
+        container = fse_read_le64(buf + start);         \
+        top = (int) (pos - start * 8);                  \
+    } while(0)
+#define FSE_READ_BITS(nb) \
+    ((top -= (nb)), (u_int32_t) ((container >> top) & ((1ULL << (nb)) - 1)))
+#define FSE_DECODE_SYMBOL(k, i)                                             \
+    do {                                                                    \
+        comp_fse_decode_t d = dt[state[k]];                                 \
+        out[i] = d.symbol;                                                  \
+        state[k] = d.new_state + FSE_READ_BITS(d.nbits);                    \
+    } while(0)
+    u_int32_t state[FSE_STATE_NUM];
+    FSE_RELOAD();
+    for(int k = 0; k < FSE_STATE_NUM; k++)
+        state[k] = FSE_READ_BITS(table_log);
+    pos = start * 8 + top;
+    size_t i = 0;
+    for(; i + FSE_STATE_NUM <= n; i += FSE_STATE_NUM)
+    {
+        FSE_RELOAD();
+        FSE_DECODE_SYMBOL(0, i);
+        FSE_DECODE_SYMBOL(1, i + 1);
+        FSE_DECODE_SYMBOL(2, i + 2);
+        FSE_DECODE_SYMBOL(3, i + 3);
+        pos = start * 8 + top;
+    }
+    FSE_RELOAD();
+    for(int k = 0; i < n; i++, k++)
+        FSE_DECODE_SYMBOL(k, i);
+    pos = start * 8 + top;
+#undef FSE_DECODE_SYMBOL
+#undef FSE_READ_BITS
+#undef FSE_RELOAD
+    //所有的位都恰好读完才是完整的数据
+    return pos == FSE_PAD * 8 ? 0 : -1;
+}
+
+/*
+ 编码数据格式
+ +----------+-----------+----------------------------------+
+ |  标识符  |  0x54     |                                  |
+ +----------+-----------+----------------------------------+
+ 之后是若干帧，每帧最多 FSE_FRAME_SIZE 字节原始数据
+ +----------+-----------+----------------------------------+
+ | 原始长度 | uint32_t  | 0表示结束                        |
+ +----------+-----------+----------------------------------+
+ | 表大小   | uint8_t   | 状态表大小的对数                 |
+ +----------+-----------+----------------------------------+
+ | 最大符号 | uint8_t   |                                  |
+ +----------+-----------+----------------------------------+
+ | 头部长度 | uint16_t  |                                  |
+ +----------+-----------+----------------------------------+
+ | 频数表   |           | 见 fse_write_header              |
+ +----------+-----------+----------------------------------+
+ | 数据长度 | uint32_t  |                                  |
+ +----------+-----------+----------------------------------+
+ | 编码数据 |           | 末尾有1位结束标记                |
+ +----------+-----------+----------------------------------+
+ */
+int encode(comp_fse_ctx_t* fse, comp_bitstream_t* in_stream, comp_bitstream_t* out_stream)
+{
+    u_char header[FSE_HEADER_MAX];
+    u_int32_t count[FSE_MAX_SYMBOL];
+    comp_bitstream_write_char(out_stream, FSE_HEADER_MARKER);
+    size_t n;
+    while((n = fread(fse->in_buf, 1, FSE_FRAME_SIZE, in_stream->fp)) > 0)
+    {
+        const u_char* in = (const u_char*) fse->in_buf;
+        memset(count, 0, sizeof(count));
+        for(size_t i = 0; i < n; i++)
+            count[in[i]]++;
+        int max_symbol = FSE_MAX_SYMBOL - 1;
+        while(count[max_symbol] == 0)
+            max_symbol--;
+        int table_log = fse_optimal_table_log(fse->table_log, n, max_symbol);
+        fse_normalize(fse, count, n, max_symbol, table_log);
+        fse_build_encode_table(fse, max_symbol, table_log);
+        size_t header_len = fse_write_header(fse, max_symbol, table_log, header);
+        size_t stream_len = fse_encode_frame(fse, in, n, table_log);
+        comp_bitstream_write_int(out_stream, (int) n);
+        comp_bitstream_write_char(out_stream, (char) table_log);
+        comp_bitstream_write_char(out_stream, (char) max_symbol);
+        comp_bitstream_write_short(out_stream, (short) header_len);
+        comp_bitstream_write(out_stream, (const char*) header, header_len);
+        comp_bitstream_write_int(out_stream, (int) stream_len);
+        if(comp_bitstream_write(out_stream, fse->out_buf, stream_len) < 0)
+            return -1;
+        comp_bar_add(fse->bar, n);
+    }
+    comp_bitstream_write_int(out_stream, 0);
+    return 0;
+}
+
+int decode(comp_fse_ctx_t* fse, comp_bitstream_t* in_stream, comp_bitstream_t* out_stream)
+{
+    u_char header[FSE_HEADER_MAX];
+    char marker, table_log, max_symbol;
+    short header_len;
+    int raw_len, stream_len;
+    if(comp_bitstream_read_char(in_stream, &marker) < 0 || (u_char) marker != FSE_HEADER_MARKER)
+        return -1;
+    comp_bar_add(fse->bar, 1);
+    u_char* buf = (u_char*) fse->out_buf;
+    memset(buf, 0, FSE_PAD);
+    while(1)
+    {
+        if(comp_bitstream_read_int(in_stream, &raw_len) < 0)
+            return -1;
+        comp_bar_add(fse->bar, 4);
+        if(raw_len == 0)
+            return 0;
+        if(raw_len < 0 || raw_len > FSE_FRAME_SIZE ||
+           comp_bitstream_read_char(in_stream, &table_log) < 0 ||
+           table_log < FSE_TABLE_LOG_MIN || table_log > FSE_TABLE_LOG_MAX ||
+           comp_bitstream_read_char(in_stream, &max_symbol) < 0 ||
+           comp_bitstream_read_short(in_stream, &header_len) < 0 ||
+           header_len <= 0 || header_len > FSE_HEADER_MAX ||
+           comp_bitstream_read(in_stream, (char*) header, header_len) < 0 ||
+           comp_bitstream_read_int(in_stream, &stream_len) < 0 ||
+           stream_len <= 0 || stream_len > FSE_STREAM_MAX ||
+           comp_bitstream_read(in_stream, (char*) buf + FSE_PAD, stream_len) < 0)
+            return -1;
+        if(fse_read_header(fse, (u_char) max_symbol, table_log, header, header_len) < 0)
+            return -1;
+        fse_build_decode_table(fse, (u_char) max_symbol, table_log);
+        if(fse_decode_frame(fse, buf, stream_len, (u_char*) fse->in_buf, raw_len, table_log) < 0 ||
+           comp_bitstream_write(out_stream, fse->in_buf, raw_len) < 0)
+            return -1;
+        comp_bar_add(fse->bar, 8 + header_len + stream_len);
+    }
+}
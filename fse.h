@@ -0,0 +1,60 @@
+//
+// Created by zr on 23-2-14.
+// 基于表的非对称数字系统(tANS/FSE)熵编码
+//
+#ifndef COMPRESS_FSE_H
+#define COMPRESS_FSE_H
+#include "internal/bitstream.h"
+#include "bar.h"
+#include <sys/types.h>
+
+#define FSE_MAX_SYMBOL 256
+#define FSE_TABLE_LOG 12        // 默认状态表大小的对数
+#define FSE_TABLE_LOG_MIN 5
+#define FSE_TABLE_LOG_MAX 12    // 4个符号最多48位，每次补充一次位缓冲即可解码4个符号
+#define FSE_STATE_NUM 4         // 交错的状态数，相邻符号的状态更新互不依赖
+#define FSE_FRAME_SIZE (1024 * 1024)
+
+/* 编码表中每个符号的参数，编码时 输出位数 = (state + delta_nbits) >> 16，
+ * 新状态 = state_table[(state >> 输出位数) + delta_find_state] */
+struct comp_fse_symbol_s
+{
+    int32_t delta_find_state;
+    u_int32_t delta_nbits;
+};
+
+/* 解码表的一项，符号 = symbol，新状态 = new_state + 读入的 nbits 位 */
+struct comp_fse_decode_s
+{
+    u_int16_t new_state;
+    u_char symbol;
+    u_char nbits;
+};
+
+typedef struct comp_fse_symbol_s comp_fse_symbol_t;
+typedef struct comp_fse_decode_s comp_fse_decode_t;
+
+struct comp_fse_ctx_s;
+typedef int (*comp_fse_encode_f) (struct comp_fse_ctx_s*, comp_bitstream_t*, comp_bitstream_t*);
+typedef int (*comp_fse_decode_f) (struct comp_fse_ctx_s*, comp_bitstream_t*, comp_bitstream_t*);
+
+struct comp_fse_ctx_s
+{
+    int table_log;      // 压缩时状态表大小的对数，数据较少时自动减小
+    int16_t norm[FSE_MAX_SYMBOL]; // 归一化后的频数，总和为 1 << table_log
+    u_int16_t state_table[1 << FSE_TABLE_LOG_MAX];
+    comp_fse_symbol_t symbol_tt[FSE_MAX_SYMBOL];
+    comp_fse_decode_t decode_table[1 << FSE_TABLE_LOG_MAX];
+    char* in_buf;       // 一帧原始数据
+    char* out_buf;      // 一帧编码数据
+    comp_progress_bar* bar;
+    comp_fse_encode_f fse_encode;
+    comp_fse_decode_f fse_decode;
+};
+
+typedef struct comp_fse_ctx_s comp_fse_ctx_t;
+
+comp_fse_ctx_t* comp_fse_init(comp_progress_bar*, int);
+void comp_fse_free(comp_fse_ctx_t*);
+
+#endif //COMPRESS_FSE_H
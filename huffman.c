@@ -5,11 +5,20 @@
 #include "internal/pqueue.h"
 #include "internal/bitstream.h"
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include "marker.h"
 
 static int encode(comp_huffman_ctx_t* huff, comp_bitstream_t* in, comp_bitstream_t* out);
 static int decode(comp_huffman_ctx_t* huff, comp_bitstream_t* in, comp_bitstream_t* out);
+static int o1_encode(comp_huffman_ctx_t* huff, comp_bitstream_t* in, comp_bitstream_t* out);
+static int o1_decode(comp_huffman_ctx_t* huff, comp_bitstream_t* in, comp_bitstream_t* out);
+static void huffman_len_from_freq(const u_int32_t* freq, u_char* len, int limit);
+static int huffman_canonical_code(const u_char* len, u_int16_t* code);
+
+/* 紧凑头部中编码长度字母表的写出顺序，靠后的很少用到，末尾长度为0的项不写 */
+static const u_char huffman_cl_order[HUFFMAN_CL_SYMBOLS] = {17, 18, 19, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15, 16};
+static const u_char huffman_cl_extra[HUFFMAN_CL_SYMBOLS] = {[17] = 2, [18] = 3, [19] = 7};
 
 /* 优先队列比较函数 */
 static inline int huffman_node_pri_cmp(const void* a, const void* b)
@@ -51,11 +60,13 @@ static comp_huffman_symbol_t* huffman_symbol_new(u_char sym, size_t code_len)
     return huff_symbol;
 }
 
-comp_huffman_ctx_t* comp_huffman_init(comp_progress_bar* bar)
+/* max_code_len 为编码长度上限，超出范围时使用 HUFFMAN_MAX_CODE_LEN。
+ * order 为1时使用一阶上下文模式，编码长度上限不超过 HUFFMAN_O1_MAX_CODE_LEN */
+comp_huffman_ctx_t* comp_huffman_init(comp_progress_bar* bar, int max_code_len, int order)
 {
     comp_huffman_ctx_t* huff = (comp_huffman_ctx_t*) malloc(sizeof(comp_huffman_ctx_t));
     if(!huff) return NULL;
-    memset(huff->freq, 0, HUFFMAN_MAX_SYMBOL);
+    memset(huff->freq, 0, sizeof(huff->freq));
     for(int i = 0; i < HUFFMAN_MAX_SYMBOL; i++)
         huff->symbol_code_table[i] = comp_str_empty();
     huff->symbols = comp_vec_init(64);
@@ -63,8 +74,17 @@ comp_huffman_ctx_t* comp_huffman_init(comp_progress_bar* bar)
     huff->padding = 0;
     huff->content_len = 0;
     huff->disable = 0;
-    huff->huffman_encode = encode;
-    huff->huffman_decode = decode;
+    if(max_code_len < HUFFMAN_MIN_CODE_LEN || max_code_len > HUFFMAN_MAX_CODE_LEN)
+        max_code_len = HUFFMAN_MAX_CODE_LEN;
+    huff->max_code_len = max_code_len;
+    huff->order = order;
+    huff->o1_freq = NULL;
+    huff->o1_table = NULL;
+    huff->dict_len = NULL;
+    huff->dict_root = NULL;
+    huff->tables = NULL;
+    huff->huffman_encode = order == 1 ? o1_encode : encode;
+    huff->huffman_decode = order == 1 ? o1_decode : decode;
     huff->bar = bar;
     return huff;
 }
@@ -112,6 +132,59 @@ static void get_code_len(comp_huffman_ctx_t* huff, comp_huffman_node_t* root, si
     get_code_len(huff, root->right, code_len + 1);
 }
 
+/* 限制编码长度不超过 huff->max_code_len。超长的编码先截断到上限，这时Kraft不等式
+ * sum(2^(L-len)) <= 2^L 可能不再成立，依次把频数最低的、未达到上限的编码加长一位直到成立，
+ * 最后把剩余的编码空间按频数从高到低还给较短的编码 */
+static void huffman_limit_code_len(comp_huffman_ctx_t* huff)
+{
+    size_t n = comp_vec_len(huff->symbols);
+    size_t limit = huff->max_code_len;
+    u_int64_t cap = 1ULL << limit, kraft = 0;
+    int over = 0;
+    comp_huffman_symbol_t* sorted[HUFFMAN_MAX_SYMBOL];
+    for(size_t i = 0; i < n; i++)
+    {
+        comp_huffman_symbol_t* sym = comp_vec_get(huff->symbols, i);
+        if(sym->symbol_code_len > limit)
+        {
+            sym->symbol_code_len = limit;
+            over = 1;
+        }
+        kraft += 1ULL << (limit - sym->symbol_code_len);
+        //按频数从低到高插入排序，符号最多256个
+        size_t j = i;
+        while(j > 0 && huff->freq[sorted[j - 1]->symbol] > huff->freq[sym->symbol])
+        {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = sym;
+    }
+    if(!over)
+        return;
+    while(kraft > cap)
+    {
+        for(size_t i = 0; i < n; i++)
+        {
+            if(sorted[i]->symbol_code_len < limit)
+            {
+                sorted[i]->symbol_code_len++;
+                kraft -= 1ULL << (limit - sorted[i]->symbol_code_len);
+                break;
+            }
+        }
+    }
+    for(size_t i = n; i > 0; i--)
+    {
+        comp_huffman_symbol_t* sym = sorted[i - 1];
+        while(sym->symbol_code_len > 1 && kraft + (1ULL << (limit - sym->symbol_code_len)) <= cap)
+        {
+            kraft += 1ULL << (limit - sym->symbol_code_len);
+            sym->symbol_code_len--;
+        }
+    }
+}
+
 /* 为sym->symbol分配编码，码值是code，码长是sym->symbol_code_len，结合码值，码长可以唯一确定一个编码 */
 static void huffman_assign_code(comp_huffman_ctx_t* huff, int code, comp_huffman_symbol_t* sym)
 {
@@ -131,11 +204,9 @@ static void huffman_assign_code(comp_huffman_ctx_t* huff, int code, comp_huffman
     comp_str_free(code_str);
 }
 
-/* 生成范式huffman编码 */
-static void huffman_build_code(comp_huffman_ctx_t* huff)
+/* 按 huff->symbols 中的编码长度分配范式huffman编码 */
+static void huffman_assign_codes(comp_huffman_ctx_t* huff)
 {
-    //计算每个符号的编码长度
-    get_code_len(huff, huff->root, 0);
     //按照编码长度排序
     comp_vec_sort(huff->symbols, 0, comp_vec_len(huff->symbols) - 1, canonical_symbol_cmp);
     int cnt = 0;
@@ -175,6 +246,179 @@ static void huffman_build_code(comp_huffman_ctx_t* huff)
         huff->padding = 0;
 }
 
+/* 生成范式huffman编码 */
+static void huffman_build_code(comp_huffman_ctx_t* huff)
+{
+    //计算每个符号的编码长度
+    get_code_len(huff, huff->root, 0);
+    huffman_limit_code_len(huff);
+    huffman_assign_codes(huff);
+}
+
+/* 用字典、共享编码表或紧凑头部中的编码长度填充 huff->symbols，按范式huffman编码的顺序排列，与普通头部中的符号表相同 */
+static void huffman_shared_symbols(comp_huffman_ctx_t* huff, const u_char* len)
+{
+    for(int s = 0; s < HUFFMAN_MAX_SYMBOL; s++)
+        if(len[s])
+            comp_vec_push_back(huff->symbols, huffman_symbol_new((u_char) s, len[s]));
+    comp_vec_sort(huff->symbols, 0, comp_vec_len(huff->symbols) - 1, canonical_symbol_cmp);
+}
+
+/* 用编码表 len 编码当前统计的频数的总长度(位)，header_len 是头部的字节数。
+ * 表中缺少出现过的符号时无法使用，返回 UINT64_MAX */
+static u_int64_t huffman_table_bits(const u_int32_t* freq, const u_char* len, size_t header_len)
+{
+    u_int64_t bits = header_len * 8;
+    for(int s = 0; s < HUFFMAN_MAX_SYMBOL; s++)
+    {
+        if(freq[s] && !len[s])
+            return UINT64_MAX;
+        bits += (u_int64_t) freq[s] * len[s];
+    }
+    return bits;
+}
+
+/* 把256个符号的编码长度表示为编码长度字母表中的符号：0-16 是长度本身，17 重复前一个长度3-6次，
+ * 18 连续3-10个0，19 连续11-138个0，附加值(重复次数减去最小值)分别占2、3、7位，与deflate的做法相同。
+ * 返回符号个数 */
+static int huffman_cl_runs(const u_char* len, u_char* sym, u_char* extra)
+{
+    int n = 0;
+    for(int s = 0; s < HUFFMAN_MAX_SYMBOL;)
+    {
+        int run = 1;
+        while(s + run < HUFFMAN_MAX_SYMBOL && len[s + run] == len[s])
+            run++;
+        if(len[s] == 0 && run >= 3)
+        {
+            if(run > 138)
+                run = 138;
+            sym[n] = run >= 11 ? 19 : 18;
+            extra[n++] = (u_char) (run >= 11 ? run - 11 : run - 3);
+            s += run;
+            continue;
+        }
+        sym[n] = len[s];
+        extra[n++] = 0;
+        s++;
+        run--;
+        while(len[s - 1] && run >= 3)
+        {
+            int r = run > 6 ? 6 : run;
+            sym[n] = 17;
+            extra[n++] = (u_char) (r - 3);
+            s += r;
+            run -= r;
+        }
+    }
+    return n;
+}
+
+/* 紧凑头部的编码计划：编码长度的符号序列，以及编码长度字母表自己的huffman编码长度(不超过7位)。
+ * 返回头部的总位数 */
+static u_int64_t huffman_compact_plan(const u_char* len, u_int32_t content_len, u_char* sym, u_char* extra,
+                                      int* n, u_char* cl_len, int* cl_num)
+{
+    u_int32_t freq[HUFFMAN_MAX_SYMBOL] = {0};
+    *n = huffman_cl_runs(len, sym, extra);
+    for(int i = 0; i < *n; i++)
+        freq[sym[i]]++;
+    huffman_len_from_freq(freq, cl_len, HUFFMAN_CL_MAX_LEN);
+    for(*cl_num = HUFFMAN_CL_SYMBOLS; *cl_num > 4 && !cl_len[huffman_cl_order[*cl_num - 1]]; (*cl_num)--);
+    u_int64_t bits = 8 + 5 + 3 * *cl_num;
+    do
+        bits += 8;
+    while(content_len >>= 7);
+    for(int i = 0; i < *n; i++)
+        bits += cl_len[sym[i]] + huffman_cl_extra[sym[i]];
+    return bits;
+}
+
+/* 自己的编码表写为紧凑头部的位数 */
+static u_int64_t huffman_compact_bits(const u_char* len, u_int32_t content_len)
+{
+    u_char sym[HUFFMAN_MAX_SYMBOL], extra[HUFFMAN_MAX_SYMBOL], cl_len[HUFFMAN_MAX_SYMBOL];
+    int n, cl_num;
+    return huffman_compact_plan(len, content_len, sym, extra, &n, cl_len, &cl_num);
+}
+
+/* 自己建表的分布记入候选：与某个候选合并后的表引用起来比写出自己的表更短时合并，候选变为待写出；
+ * 否则替换最早的候选。合并后的表包含两个分布中的所有符号。own_len、own_bits 是自己的编码表和总长度 */
+static void huffman_tables_learn(comp_huffman_ctx_t* huff, const u_char* own_len, u_int64_t own_bits)
+{
+    comp_huffman_tables_t* t = huff->tables;
+    if(t->num >= HUFFMAN_TABLE_MAX)
+        return;
+    u_int32_t merged[HUFFMAN_MAX_SYMBOL];
+    u_char merged_len[HUFFMAN_MAX_SYMBOL];
+    for(int k = 0; k < HUFFMAN_TABLE_CAND; k++)
+    {
+        if(!t->cand_state[k])
+            continue;
+        for(int s = 0; s < HUFFMAN_MAX_SYMBOL; s++)
+            merged[s] = t->cand_freq[k][s] + huff->freq[s];
+        huffman_len_from_freq(merged, merged_len, huff->max_code_len);
+        if(huffman_table_bits(huff->freq, merged_len, HUFFMAN_TABLE_HEADER_LEN) < own_bits)
+        {
+            memcpy(t->cand_freq[k], merged, sizeof(merged));
+            memcpy(t->cand_len[k], merged_len, HUFFMAN_MAX_SYMBOL);
+            t->cand_state[k] = 2;
+            return;
+        }
+    }
+    //待写出的候选不替换
+    for(int i = 0; i < HUFFMAN_TABLE_CAND; i++)
+    {
+        int k = (t->cand_next + i) % HUFFMAN_TABLE_CAND;
+        if(t->cand_state[k] == 2)
+            continue;
+        memcpy(t->cand_freq[k], huff->freq, sizeof(huff->freq));
+        memcpy(t->cand_len[k], own_len, HUFFMAN_MAX_SYMBOL);
+        t->cand_state[k] = 1;
+        t->cand_next = (k + 1) % HUFFMAN_TABLE_CAND;
+        return;
+    }
+}
+
+/* 选择编码表：比较自己的编码表、字典和已写出的共享编码表的总长度(位)。
+ * 自己的编码表用不分配节点的方法估计长度，不建树，也可能不如直接存储。
+ * 返回选中的编码长度，*table 为共享编码表的编号(字典为-1)；自己的编码表更短时返回NULL */
+static const u_char* huffman_select_table(comp_huffman_ctx_t* huff, size_t header_len, int* table)
+{
+    u_char len[HUFFMAN_MAX_SYMBOL];
+    huffman_len_from_freq(huff->freq, len, huff->max_code_len);
+    u_int64_t n = 0;
+    for(int s = 0; s < HUFFMAN_MAX_SYMBOL; s++)
+        n += huff->freq[s];
+    u_int64_t own_header = (header_len + 1) * 8, compact = huffman_compact_bits(len, (u_int32_t) n);
+    if(compact < own_header)
+        own_header = compact;
+    u_int64_t own_bits = huffman_table_bits(huff->freq, len, 0) + own_header, best = own_bits;
+    if(own_bits > (n + 5) * 8)
+        own_bits = best = (n + 5) * 8;
+    const u_char* selected = NULL;
+    u_int64_t bits;
+    if(huff->dict_len && (bits = huffman_table_bits(huff->freq, huff->dict_len, HUFFMAN_DICT_HEADER_LEN)) < best)
+    {
+        selected = huff->dict_len;
+        best = bits;
+        *table = -1;
+    }
+    if(huff->tables && n <= HUFFMAN_TABLE_INPUT_MAX)
+    {
+        for(int k = 0; k < huff->tables->num; k++)
+            if((bits = huffman_table_bits(huff->freq, huff->tables->len[k], HUFFMAN_TABLE_HEADER_LEN)) < best)
+            {
+                selected = huff->tables->len[k];
+                best = bits;
+                *table = k;
+            }
+        if(!selected)
+            huffman_tables_learn(huff, len, own_bits);
+    }
+    return selected;
+}
+
 /* 向输出流中写huffman头
  * 正常的huffman头结构如下
  +----------+------------+------------------------+
@@ -192,6 +436,40 @@ static void huffman_build_code(comp_huffman_ctx_t* huff)
  +----------+------------+------------------------+
  因为最终使用的编码是范式huffman编码，所以解码器根据长度表和符号表就能反推出符号对应编码
 
+ 使用共享字典的编码表时，头部结构如下，编码表由字典中每个符号的编码长度得到
+ +----------+------------+------------------------+
+ |  标识符  | 0x68       |                        |
+ +----------+------------+------------------------+
+ | 内容长度 | uint_32_t  |                        |
+ +----------+------------+------------------------+
+ | 填充长度 | u_char     |                        |
+ +----------+------------+------------------------+
+
+ 引用压缩包的共享编码表时，头部结构如下，编号对应的表已经在压缩包中写出
+ +----------+------------+------------------------+
+ |  标识符  | 0x72       |                        |
+ +----------+------------+------------------------+
+ |   编号   | u_char     |                        |
+ +----------+------------+------------------------+
+ | 内容长度 | uint_32_t  |                        |
+ +----------+------------+------------------------+
+ | 填充长度 | u_char     |                        |
+ +----------+------------+------------------------+
+
+ 紧凑头部：内容长度用变长整数，编码长度按deflate的方法用游程和huffman编码，不写符号表，
+ 标识和内容长度之后按位紧接编码数据，不需要填充。小文件的头部通常只有普通头部的几分之一
+ +----------+------------+------------------------------------------+
+ |  标识符  | 0x63       |                                          |
+ +----------+------------+------------------------------------------+
+ | 内容长度 | 1-5字节    | 每字节7位，低位在前，最高位表示后面还有  |
+ +----------+------------+------------------------------------------+
+ |  项数    | 5位        | 写出的编码长度字母表的项数减4            |
+ +----------+------------+------------------------------------------+
+ | 字母表   | 每项3位    | 按 huffman_cl_order 的顺序，各符号的码长 |
+ +----------+------------+------------------------------------------+
+ | 编码长度 |            | 256个符号的编码长度，见 huffman_cl_runs  |
+ +----------+------------+------------------------------------------+
+
  如果huffman编码被disable, 头部结构如下
  +----------+------------+------------------------+
  |  标识符  | 0x4E       |                无编码               |
@@ -226,6 +504,29 @@ void huffman_write_header(comp_huffman_ctx_t* huff, size_t header_len, comp_bits
     comp_bitstream_write_char(out_stream, (char) huff->padding);
 }
 
+/* 写紧凑头部，len 是每个符号的编码长度 */
+static void huffman_write_compact_header(comp_huffman_ctx_t* huff, const u_char* len, comp_bitstream_t* out_stream)
+{
+    u_char sym[HUFFMAN_MAX_SYMBOL], extra[HUFFMAN_MAX_SYMBOL], cl_len[HUFFMAN_MAX_SYMBOL];
+    u_int16_t cl_code[HUFFMAN_MAX_SYMBOL];
+    int n, cl_num;
+    huffman_compact_plan(len, huff->content_len, sym, extra, &n, cl_len, &cl_num);
+    huffman_canonical_code(cl_len, cl_code);
+    comp_bitstream_write_char(out_stream, HUFFMAN_COMPACT_HEADER_MARKER);
+    u_int32_t v = huff->content_len;
+    for(; v >= 0x80; v >>= 7)
+        comp_bitstream_write_char(out_stream, (char) ((v & 0x7F) | 0x80));
+    comp_bitstream_write_char(out_stream, (char) v);
+    comp_bitstream_write_nbit(out_stream, cl_num - 4, 5);
+    for(int i = 0; i < cl_num; i++)
+        comp_bitstream_write_nbit(out_stream, cl_len[huffman_cl_order[i]], 3);
+    for(int i = 0; i < n; i++)
+    {
+        comp_bitstream_write_nbit(out_stream, cl_code[sym[i]], cl_len[sym[i]]);
+        comp_bitstream_write_nbit(out_stream, extra[i], huffman_cl_extra[sym[i]]);
+    }
+}
+
 /* 释放huffman树 */
 static void huffman_free_tree(comp_huffman_node_t* root)
 {
@@ -283,19 +584,13 @@ static void huffman_encode_content(comp_huffman_ctx_t* huff, comp_bitstream_t* i
 #endif
         }
     }
-    //如果禁用了huffman编码，就把输入原封不动复制到输出
+    //如果禁用了huffman编码，就把输入原封不动复制到输出，两边都是普通文件时在内核中完成
     else
     {
-        while(1)
-        {
-            comp_bitstream_read_char(in_stream, &input);
-            if(comp_bitstream_eof(in_stream))
-                break;
-            comp_bitstream_write_char(out_stream, input);
+        comp_bitstream_copy(in_stream, out_stream, huff->content_len);
 #ifndef DEBUG
-            comp_bar_add(huff->bar, 1);
+        comp_bar_add(huff->bar, huff->content_len);
 #endif
-        }
     }
     //清输出缓冲
     comp_bitstream_flush(out_stream);
@@ -347,6 +642,27 @@ int encode(comp_huffman_ctx_t* huff, comp_bitstream_t* in_stream, comp_bitstream
         huffman_ctx_cleanup(huff);
         return 0;
     }
+    //字典或共享编码表更短时直接使用，不为输入建树
+    int table = -1;
+    const u_char* shared = huff->dict_len || huff->tables ? huffman_select_table(huff, huffman_header_len, &table) : NULL;
+    if(shared)
+    {
+        huffman_shared_symbols(huff, shared);
+        huffman_assign_codes(huff);
+        if(table < 0)
+            comp_bitstream_write_char(out_stream, HUFFMAN_DICT_HEADER_MARKER);
+        else
+        {
+            comp_bitstream_write_char(out_stream, HUFFMAN_TABLE_HEADER_MARKER);
+            comp_bitstream_write_char(out_stream, (char) table);
+        }
+        comp_bitstream_write_int(out_stream, (int) huff->content_len);
+        comp_bitstream_write_char(out_stream, (char) huff->padding);
+        comp_bitstream_reset(in_stream);
+        huffman_encode_content(huff, in_stream, out_stream);
+        huffman_ctx_cleanup(huff);
+        return 0;
+    }
     //建huffman树
     huffman_build_tree(huff);
     //生成范式huffman编码
@@ -364,8 +680,17 @@ int encode(comp_huffman_ctx_t* huff, comp_bitstream_t* in_stream, comp_bitstream
         }
     }
 #endif
-    //写huffman头
-    huffman_write_header(huff, huffman_header_len, out_stream);
+    //写huffman头，紧凑头部更短时使用紧凑头部
+    u_char len[HUFFMAN_MAX_SYMBOL] = {0};
+    for(int i = 0; i < comp_vec_len(huff->symbols); i++)
+        len[HUFFMAN_GET_SYMBOL(i)] = (u_char) HUFFMAN_GET_SYMBOL_LEN(i);
+    if(!huff->disable && huffman_compact_bits(len, huff->content_len) < (huffman_header_len + 1) * 8)
+    {
+        huff->padding = 0;
+        huffman_write_compact_header(huff, len, out_stream);
+    }
+    else
+        huffman_write_header(huff, huffman_header_len, out_stream);
     //统计词频以后文件指针已经到末尾了，要重置到文件头
     comp_bitstream_reset(in_stream);
     huffman_encode_content(huff, in_stream, out_stream);
@@ -373,9 +698,81 @@ int encode(comp_huffman_ctx_t* huff, comp_bitstream_t* in_stream, comp_bitstream
     return 0;
 }
 
+/* 读取编码长度字母表中的一个符号，码长不超过 HUFFMAN_CL_MAX_LEN，逐位比较 */
+static int huffman_read_cl_symbol(comp_bitstream_t* in_stream, const u_char* cl_len, const u_int16_t* cl_code)
+{
+    int code = 0, bit;
+    for(int l = 1; l <= HUFFMAN_CL_MAX_LEN; l++)
+    {
+        if(comp_bitstream_read_bit(in_stream, &bit) < 0)
+            return -1;
+        code = code << 1 | bit;
+        for(int s = 0; s < HUFFMAN_CL_SYMBOLS; s++)
+            if(cl_len[s] == l && cl_code[s] == code)
+                return s;
+    }
+    return -1;
+}
+
+/* 读取紧凑头部(标识之后的部分)，编码长度按范式huffman编码的顺序放入 huff->symbols */
+static int huffman_read_compact_header(comp_huffman_ctx_t* huff, comp_bitstream_t* in_stream)
+{
+    char c;
+    u_int32_t v = 0;
+    int shift = 0;
+    do
+    {
+        if(shift > 28 || comp_bitstream_read_char(in_stream, &c) < 0)
+            return -1;
+        v |= (u_int32_t) ((u_char) c & 0x7F) << shift;
+        shift += 7;
+    } while((u_char) c & 0x80);
+    huff->content_len = v;
+    int cl_num, x;
+    u_char cl_len[HUFFMAN_MAX_SYMBOL] = {0}, len[HUFFMAN_MAX_SYMBOL];
+    u_int16_t cl_code[HUFFMAN_MAX_SYMBOL];
+    if(comp_bitstream_read_nbit(in_stream, &cl_num, 5) < 0 || (cl_num += 4) > HUFFMAN_CL_SYMBOLS)
+        return -1;
+    for(int i = 0; i < cl_num; i++)
+    {
+        if(comp_bitstream_read_nbit(in_stream, &x, 3) < 0)
+            return -1;
+        cl_len[huffman_cl_order[i]] = (u_char) x;
+    }
+    if(huffman_canonical_code(cl_len, cl_code) < 0)
+        return -1;
+    u_int64_t kraft = 0;
+    for(int s = 0; s < HUFFMAN_MAX_SYMBOL;)
+    {
+        int sym = huffman_read_cl_symbol(in_stream, cl_len, cl_code), run = 1, value = sym;
+        if(sym < 0)
+            return -1;
+        if(sym > HUFFMAN_MAX_CODE_LEN)
+        {
+            if(comp_bitstream_read_nbit(in_stream, &x, huffman_cl_extra[sym]) < 0 || (sym == 17 && s == 0))
+                return -1;
+            run = x + (sym == 19 ? 11 : 3);
+            value = sym == 17 ? len[s - 1] : 0;
+        }
+        if(s + run > HUFFMAN_MAX_SYMBOL)
+            return -1;
+        memset(len + s, value, run);
+        if(value)
+            kraft += (u_int64_t) run << (HUFFMAN_MAX_CODE_LEN - value);
+        s += run;
+    }
+    if(kraft == 0 || kraft > (1ULL << HUFFMAN_MAX_CODE_LEN))
+        return -1;
+    huffman_shared_symbols(huff, len);
+    huff->padding = 0;
+    comp_bar_add(huff->bar, shift / 7);
+    return 0;
+}
+
 /* 读取huffman头，最主要工作是建立 symbol->码长 的关系，保存在huff->symbols中，
- * 根据 symbol->码长 的信息就可以还原出范式huffman树 */
-static int huffman_read_header(comp_huffman_ctx_t* huff, comp_bitstream_t* in_stream)
+ * 根据 symbol->码长 的信息就可以还原出范式huffman树。
+ * 使用字典或共享编码表时返回1，*table 为共享编码表的编号(字典为-1) */
+static int huffman_read_header(comp_huffman_ctx_t* huff, comp_bitstream_t* in_stream, int* table)
 {
     char input;
     comp_bitstream_read_char(in_stream, &input);
@@ -387,6 +784,29 @@ static int huffman_read_header(comp_huffman_ctx_t* huff, comp_bitstream_t* in_st
         huff->disable = 1;
         return 0;
     }
+    if((u_char) input == HUFFMAN_DICT_HEADER_MARKER)
+    {
+        if(!huff->dict_len || comp_bitstream_read_int(in_stream, (int*)(&huff->content_len)) < 0 ||
+           comp_bitstream_read_char(in_stream, &input) < 0)
+            return -1;
+        huff->padding = input;
+        comp_bar_add(huff->bar, HUFFMAN_DICT_HEADER_LEN - 1);
+        return 1;
+    }
+    if((u_char) input == HUFFMAN_TABLE_HEADER_MARKER)
+    {
+        char id;
+        if(!huff->tables || comp_bitstream_read_char(in_stream, &id) < 0 || (u_char) id >= huff->tables->num ||
+           comp_bitstream_read_int(in_stream, (int*)(&huff->content_len)) < 0 ||
+           comp_bitstream_read_char(in_stream, &input) < 0)
+            return -1;
+        *table = (u_char) id;
+        huff->padding = input;
+        comp_bar_add(huff->bar, HUFFMAN_TABLE_HEADER_LEN - 1);
+        return 1;
+    }
+    if((u_char) input == HUFFMAN_COMPACT_HEADER_MARKER)
+        return huffman_read_compact_header(huff, in_stream);
     if(input != HUFFMAN_HEADER_MARKER)
         return -1;
     char hdr_high, hdr_low;
@@ -524,8 +944,13 @@ void huffman_print(comp_huffman_ctx_t* huff)
 int decode(comp_huffman_ctx_t* huff, comp_bitstream_t* in_stream, comp_bitstream_t* out_stream)
 {
     if(!in_stream || !out_stream) return -1;
-    int err = 0;
-    if(huffman_read_header(huff, in_stream) < 0)
+    int err = 0, table = -1;
+    int shared = huffman_read_header(huff, in_stream, &table);
+    //字典或共享编码表的huffman树只在第一次用到时建立
+    comp_huffman_node_t** cached = NULL;
+    if(shared == 1)
+        cached = table < 0 ? &huff->dict_root : &huff->tables->root[table];
+    if(shared < 0)
     {
         err = -1;
         goto end;
@@ -535,25 +960,26 @@ int decode(comp_huffman_ctx_t* huff, comp_bitstream_t* in_stream, comp_bitstream
         goto end;
     if(huff->disable)
     {
-        char input;
-        u_int32_t len = 0;
-        while(1)
-        {
-            comp_bitstream_read_char(in_stream, &input);
-            comp_bitstream_write_char(out_stream, input);
-            comp_bar_add(huff->bar, 1);
-            if(++len == huff->content_len)
-                break;
-        }
+        err = comp_bitstream_copy(in_stream, out_stream, huff->content_len);
+        comp_bar_add(huff->bar, huff->content_len);
         goto end;
     }
-    if(huffman_rebuild_tree(huff) < 0)
+    if(cached && *cached)
+        huff->root = *cached;
+    else
     {
+        if(cached)
+            huffman_shared_symbols(huff, table < 0 ? huff->dict_len : huff->tables->len[table]);
+        if(huffman_rebuild_tree(huff) < 0)
+        {
 #ifdef DEBUG
-        HUFFMAN_DEBUG("%s", "rebuild huffman tree fail");
+            HUFFMAN_DEBUG("%s", "rebuild huffman tree fail");
 #endif
-        err = -1;
-        goto end;
+            err = -1;
+            goto end;
+        }
+        if(cached)
+            *cached = huff->root;
     }
 #ifdef DEBUG
     huffman_print(huff);
@@ -561,6 +987,8 @@ int decode(comp_huffman_ctx_t* huff, comp_bitstream_t* in_stream, comp_bitstream
     huffman_decode_content(huff, in_stream, out_stream);
 
 end:
+    if(cached && huff->root == *cached)
+        huff->root = NULL;
     huffman_ctx_cleanup(huff);
     return err;
 }
@@ -570,5 +998,601 @@ void comp_huffman_free(comp_huffman_ctx_t* huff)
     for(int i = 0; i < 256; i++)
         comp_str_free(huff->symbol_code_table[i]);
     comp_vec_free(huff->symbols);
+    free(huff->o1_freq);
+    free(huff->o1_table);
+    huffman_free_tree(huff->dict_root);
     free(huff);
 }
+
+/* 设置共享字典中每个符号的编码长度(256项)，为空时取消。编码时字典的编码表更短就使用它，
+ * 头部只需要6字节；解码时遇到字典编码表的标识就使用它。len 由调用者保持有效 */
+void comp_huffman_set_dict(comp_huffman_ctx_t* huff, const u_char* len)
+{
+    huffman_free_tree(huff->dict_root);
+    huff->dict_root = NULL;
+    huff->dict_len = len;
+}
+
+/* 使用压缩包的共享编码表，为空时取消。tables 由调用者创建和释放，同一压缩包的所有huffman上下文共用 */
+void comp_huffman_set_tables(comp_huffman_ctx_t* huff, comp_huffman_tables_t* tables)
+{
+    huff->tables = tables;
+}
+
+comp_huffman_tables_t* comp_huffman_tables_init()
+{
+    return (comp_huffman_tables_t*) calloc(1, sizeof(comp_huffman_tables_t));
+}
+
+void comp_huffman_tables_free(comp_huffman_tables_t* t)
+{
+    if(!t) return;
+    for(int k = 0; k < t->num; k++)
+        huffman_free_tree(t->root[k]);
+    free(t);
+}
+
+/* 取出一张待写出的候选表，加入已写出的表，返回它的编号，没有时返回-1。
+ * 调用者随后用 comp_huffman_tables_write 把它写入压缩包。
+ * 256个符号编码长度相同的表(长度表的计数放不下)与直接存储没有区别，丢弃 */
+int comp_huffman_tables_commit(comp_huffman_tables_t* t)
+{
+    for(int k = 0; k < HUFFMAN_TABLE_CAND; k++)
+    {
+        if(t->cand_state[k] != 2)
+            continue;
+        t->cand_state[k] = 0;
+        u_int32_t num[HUFFMAN_MAX_CODE_LEN + 1] = {0};
+        for(int s = 0; s < HUFFMAN_MAX_SYMBOL; s++)
+            num[t->cand_len[k][s]]++;
+        if(t->num >= HUFFMAN_TABLE_MAX || num[HUFFMAN_MIN_CODE_LEN] == HUFFMAN_MAX_SYMBOL)
+            continue;
+        memcpy(t->len[t->num], t->cand_len[k], HUFFMAN_MAX_SYMBOL);
+        t->root[t->num] = NULL;
+        return t->num++;
+    }
+    return -1;
+}
+
+/* 共享编码表在压缩包中的格式(标识符由调用者写出)，长度表和符号表与普通头部相同
+ +----------+------------+------------------------+
+ |   编号   | u_char     | 按写出的顺序从0开始    |
+ +----------+------------+------------------------+
+ |  长度表  | u_char[16] | 每个长度编码的符号个数 |
+ +----------+------------+------------------------+
+ |  符号表  | u_char[N]  | 按编码长度从短到长     |
+ +----------+------------+------------------------+
+*/
+void comp_huffman_tables_write(comp_huffman_tables_t* t, int id, comp_bitstream_t* out_stream)
+{
+    const u_char* len = t->len[id];
+    u_char num[HUFFMAN_MAX_CODE_LEN + 1] = {0};
+    for(int s = 0; s < HUFFMAN_MAX_SYMBOL; s++)
+        num[len[s]]++;
+    comp_bitstream_write_char(out_stream, (char) id);
+    comp_bitstream_write(out_stream, (char*) (num + 1), HUFFMAN_MAX_CODE_LEN);
+    for(int l = 1; l <= HUFFMAN_MAX_CODE_LEN; l++)
+        for(int s = 0; s < HUFFMAN_MAX_SYMBOL; s++)
+            if(len[s] == l)
+                comp_bitstream_write_char(out_stream, (char) s);
+}
+
+/* 读取一张共享编码表(标识符之后的部分)加入 t，编号必须是下一个；t 为空时只读取并检查，用于跳过。
+ * 返回读取的字节数，格式不对时返回-1 */
+int comp_huffman_tables_read(comp_huffman_tables_t* t, comp_bitstream_t* in_stream)
+{
+    char id;
+    u_char num[HUFFMAN_MAX_CODE_LEN + 1] = {0}, len[HUFFMAN_MAX_SYMBOL] = {0};
+    if(comp_bitstream_read_char(in_stream, &id) < 0 ||
+       comp_bitstream_read(in_stream, (char*) (num + 1), HUFFMAN_MAX_CODE_LEN) < 0)
+        return -1;
+    if(t && ((u_char) id != t->num || t->num >= HUFFMAN_TABLE_MAX))
+        return -1;
+    int n = 0;
+    u_int64_t kraft = 0;
+    for(int l = 1; l <= HUFFMAN_MAX_CODE_LEN; l++)
+        for(int i = 0; i < num[l]; i++)
+        {
+            char c;
+            if(comp_bitstream_read_char(in_stream, &c) < 0 || len[(u_char) c] || ++n > HUFFMAN_MAX_SYMBOL)
+                return -1;
+            len[(u_char) c] = (u_char) l;
+            kraft += 1ULL << (HUFFMAN_MAX_CODE_LEN - l);
+        }
+    if(n == 0 || kraft > (1ULL << HUFFMAN_MAX_CODE_LEN))
+        return -1;
+    if(t)
+    {
+        memcpy(t->len[t->num], len, HUFFMAN_MAX_SYMBOL);
+        t->root[t->num++] = NULL;
+    }
+    return 1 + HUFFMAN_MAX_CODE_LEN + n;
+}
+
+/* 由频数计算不超过 limit 位的huffman编码长度，供训练字典使用 */
+void comp_huffman_code_len(const u_int32_t* freq, u_char* len, int limit)
+{
+    huffman_len_from_freq(freq, len, limit);
+}
+
+/* 按位写入，高位在前 */
+struct huffman_bit_writer_s
+{
+    u_int64_t acc;
+    int nbits;
+    u_char* ptr;
+};
+
+/* 按位读取，高位在前，acc 的最高位是下一个未读的位。读到数据末尾之后补0，
+ * pos 记录实际取过的字节数，用来检查数据是否被读过头 */
+struct huffman_bit_reader_s
+{
+    u_int64_t acc;
+    int nbits;
+    const u_char* data;
+    size_t pos;
+    size_t len;
+};
+
+typedef struct huffman_bit_writer_s huffman_bit_writer_t;
+typedef struct huffman_bit_reader_s huffman_bit_reader_t;
+
+static inline void huffman_put_bits(huffman_bit_writer_t* w, u_int32_t value, int n)
+{
+    w->acc = (w->acc << n) | value;
+    w->nbits += n;
+    while(w->nbits >= 8)
+    {
+        w->nbits -= 8;
+        *w->ptr++ = (u_char) (w->acc >> w->nbits);
+    }
+}
+
+static size_t huffman_end_bits(huffman_bit_writer_t* w, u_char* start)
+{
+    if(w->nbits > 0)
+        *w->ptr++ = (u_char) (w->acc << (8 - w->nbits));
+    w->nbits = 0;
+    return w->ptr - start;
+}
+
+static inline void huffman_refill(huffman_bit_reader_t* r)
+{
+    while(r->nbits <= 56)
+    {
+        u_char b = r->pos < r->len ? r->data[r->pos] : 0;
+        r->pos++;
+        r->acc |= (u_int64_t) b << (56 - r->nbits);
+        r->nbits += 8;
+    }
+}
+
+static inline u_int32_t huffman_get_bits(huffman_bit_reader_t* r, int n)
+{
+    if(n == 0)
+        return 0;
+    if(r->nbits < n)
+        huffman_refill(r);
+    u_int32_t v = (u_int32_t) (r->acc >> (64 - n));
+    r->acc <<= n;
+    r->nbits -= n;
+    return v;
+}
+
+/* 已读的位数没有超过数据长度 */
+static inline int huffman_reader_ok(huffman_bit_reader_t* r)
+{
+    return r->pos * 8 - r->nbits <= r->len * 8;
+}
+
+/* 由频数计算不超过 limit 的huffman编码长度，len[s] 为0表示符号没有出现。
+ * 叶子按频数排序后用两个队列建树(内部节点的频数按生成顺序递增)，不需要分配节点；
+ * 超长时的修正方法与 huffman_limit_code_len 相同 */
+static void huffman_len_from_freq(const u_int32_t* freq, u_char* len, int limit)
+{
+    u_int64_t node_freq[2 * HUFFMAN_MAX_SYMBOL];
+    int parent[2 * HUFFMAN_MAX_SYMBOL], depth[2 * HUFFMAN_MAX_SYMBOL];
+    u_char leaf[HUFFMAN_MAX_SYMBOL];
+    int n = 0;
+    for(int s = 0; s < HUFFMAN_MAX_SYMBOL; s++)
+    {
+        len[s] = 0;
+        if(!freq[s])
+            continue;
+        int j = n++;
+        while(j > 0 && freq[leaf[j - 1]] > freq[s])
+        {
+            leaf[j] = leaf[j - 1];
+            j--;
+        }
+        leaf[j] = (u_char) s;
+    }
+    if(n == 0)
+        return;
+    if(n == 1)
+    {
+        len[leaf[0]] = 1;
+        return;
+    }
+    for(int i = 0; i < n; i++)
+        node_freq[i] = freq[leaf[i]];
+    int li = 0, ii = n;
+    for(int next = n; next < 2 * n - 1; next++)
+    {
+        int pick[2];
+        for(int k = 0; k < 2; k++)
+            pick[k] = li < n && (ii >= next || node_freq[li] <= node_freq[ii]) ? li++ : ii++;
+        node_freq[next] = node_freq[pick[0]] + node_freq[pick[1]];
+        parent[pick[0]] = parent[pick[1]] = next;
+    }
+    depth[2 * n - 2] = 0;
+    for(int i = 2 * n - 3; i >= 0; i--)
+        depth[i] = depth[parent[i]] + 1;
+    u_int64_t cap = 1ULL << limit, kraft = 0;
+    int over = 0;
+    for(int i = 0; i < n; i++)
+    {
+        if(depth[i] > limit)
+        {
+            depth[i] = limit;
+            over = 1;
+        }
+        kraft += 1ULL << (limit - depth[i]);
+    }
+    if(over)
+    {
+        while(kraft > cap)
+            for(int i = 0; i < n; i++)
+                if(depth[i] < limit)
+                {
+                    depth[i]++;
+                    kraft -= 1ULL << (limit - depth[i]);
+                    break;
+                }
+        for(int i = n - 1; i >= 0; i--)
+            while(depth[i] > 1 && kraft + (1ULL << (limit - depth[i])) <= cap)
+            {
+                kraft += 1ULL << (limit - depth[i]);
+                depth[i]--;
+            }
+    }
+    for(int i = 0; i < n; i++)
+        len[leaf[i]] = (u_char) depth[i];
+}
+
+/* 按 (长度, 符号) 的顺序分配范式huffman码值，长度不满足Kraft不等式时返回-1 */
+static int huffman_canonical_code(const u_char* len, u_int16_t* code)
+{
+    u_int32_t count[HUFFMAN_O1_MAX_CODE_LEN + 1] = {0}, next[HUFFMAN_O1_MAX_CODE_LEN + 1];
+    u_int32_t kraft = 0;
+    for(int s = 0; s < HUFFMAN_MAX_SYMBOL; s++)
+        if(len[s])
+        {
+            count[len[s]]++;
+            kraft += 1U << (HUFFMAN_O1_MAX_CODE_LEN - len[s]);
+        }
+    if(kraft > (1U << HUFFMAN_O1_MAX_CODE_LEN))
+        return -1;
+    u_int32_t c = 0;
+    count[0] = 0;
+    for(int l = 1; l <= HUFFMAN_O1_MAX_CODE_LEN; l++)
+    {
+        c = (c + count[l - 1]) << 1;
+        next[l] = c;
+    }
+    for(int s = 0; s < HUFFMAN_MAX_SYMBOL; s++)
+        if(len[s])
+            code[s] = (u_int16_t) next[len[s]]++;
+    return 0;
+}
+
+/* 上下文使用某张编码表的代价(位数)，表中没有的符号按比最长编码更长计 */
+static u_int64_t huffman_o1_cost(const u_int32_t* freq, const u_char* len)
+{
+    u_int64_t cost = 0;
+    for(int s = 0; s < HUFFMAN_MAX_SYMBOL; s++)
+        if(freq[s])
+            cost += (u_int64_t) freq[s] * (len[s] ? len[s] : HUFFMAN_O1_MAX_CODE_LEN + 4);
+    return cost;
+}
+
+/* 把上下文(前一个字节)聚成最多 HUFFMAN_O1_MAX_TABLES 类，每类一张编码表，控制头部大小。
+ * 先以出现最多的几个上下文作为初始的类，再反复把每个上下文分到编码代价最小的类并重算编码表。
+ * 返回类的个数，ctx_map 为上下文所属的类，len 为每类的编码长度 */
+static int huffman_o1_cluster(comp_huffman_ctx_t* huff, size_t n, int limit,
+                              u_char* ctx_map, u_char len[][HUFFMAN_MAX_SYMBOL])
+{
+    u_int32_t total[HUFFMAN_MAX_SYMBOL], sum[HUFFMAN_MAX_SYMBOL];
+    int order[HUFFMAN_MAX_SYMBOL], active = 0;
+    for(int c = 0; c < HUFFMAN_MAX_SYMBOL; c++)
+    {
+        total[c] = 0;
+        for(int s = 0; s < HUFFMAN_MAX_SYMBOL; s++)
+            total[c] += huff->o1_freq[c * HUFFMAN_MAX_SYMBOL + s];
+        ctx_map[c] = 0;
+        if(!total[c])
+            continue;
+        int j = active++;
+        while(j > 0 && total[order[j - 1]] < total[c])
+        {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = c;
+    }
+    //每张表的头部大约几十字节，数据较少时少用几张表
+    int k = active < HUFFMAN_O1_MAX_TABLES ? active : HUFFMAN_O1_MAX_TABLES;
+    if((size_t) k > n / 2048 + 1)
+        k = (int) (n / 2048 + 1);
+    for(int i = 0; i < k; i++)
+        huffman_len_from_freq(huff->o1_freq + order[i] * HUFFMAN_MAX_SYMBOL, len[i], limit);
+    for(int round = 0; round < 4; round++)
+    {
+        for(int i = 0; i < active; i++)
+        {
+            int c = order[i];
+            u_int64_t best_cost = 0;
+            for(int t = 0; t < k; t++)
+            {
+                u_int64_t cost = huffman_o1_cost(huff->o1_freq + c * HUFFMAN_MAX_SYMBOL, len[t]);
+                if(t == 0 || cost < best_cost)
+                {
+                    best_cost = cost;
+                    ctx_map[c] = (u_char) t;
+                }
+            }
+        }
+        //按新的分类重算编码表，没有上下文的类去掉
+        int used = 0;
+        u_char remap[HUFFMAN_O1_MAX_TABLES];
+        for(int t = 0; t < k; t++)
+        {
+            memset(sum, 0, sizeof(sum));
+            int members = 0;
+            for(int c = 0; c < HUFFMAN_MAX_SYMBOL; c++)
+                if(total[c] && ctx_map[c] == t)
+                {
+                    members++;
+                    for(int s = 0; s < HUFFMAN_MAX_SYMBOL; s++)
+                        sum[s] += huff->o1_freq[c * HUFFMAN_MAX_SYMBOL + s];
+                }
+            if(!members)
+                continue;
+            remap[t] = (u_char) used;
+            huffman_len_from_freq(sum, len[used++], limit);
+        }
+        for(int c = 0; c < HUFFMAN_MAX_SYMBOL; c++)
+            ctx_map[c] = total[c] ? remap[ctx_map[c]] : 0;
+        k = used;
+    }
+    return k;
+}
+
+/* 编码长度表：每个符号4位长度，0后面再跟4位表示连续 1-16 个没有出现的符号 */
+static void huffman_o1_write_len(huffman_bit_writer_t* w, const u_char* len)
+{
+    for(int s = 0; s < HUFFMAN_MAX_SYMBOL;)
+    {
+        if(len[s])
+        {
+            huffman_put_bits(w, len[s], 4);
+            s++;
+            continue;
+        }
+        int run = 1;
+        while(s + run < HUFFMAN_MAX_SYMBOL && run < 16 && !len[s + run])
+            run++;
+        huffman_put_bits(w, 0, 4);
+        huffman_put_bits(w, run - 1, 4);
+        s += run;
+    }
+}
+
+static int huffman_o1_read_len(huffman_bit_reader_t* r, u_char* len)
+{
+    for(int s = 0; s < HUFFMAN_MAX_SYMBOL;)
+    {
+        u_int32_t v = huffman_get_bits(r, 4);
+        if(v > HUFFMAN_O1_MAX_CODE_LEN)
+            return -1;
+        if(v)
+        {
+            len[s++] = (u_char) v;
+            continue;
+        }
+        int run = (int) huffman_get_bits(r, 4) + 1;
+        if(s + run > HUFFMAN_MAX_SYMBOL)
+            return -1;
+        memset(len + s, 0, run);
+        s += run;
+    }
+    return 0;
+}
+
+static int huffman_o1_bits(int k)
+{
+    int bits = 0;
+    while((1 << bits) < k)
+        bits++;
+    return bits;
+}
+
+/* 一阶上下文模式，每个符号用前一个字节(第一个符号用0)所属类的编码表编码
+ +----------+------------+------------------------------------------+
+ |  标识符  | 0x4F       |                                          |
+ +----------+------------+------------------------------------------+
+ | 内容长度 | uint32_t   | 为0时没有后面的部分                      |
+ +----------+------------+------------------------------------------+
+ | 数据长度 | uint32_t   |                                          |
+ +----------+------------+------------------------------------------+
+ | 表的个数 | u_char     | k                                        |
+ +----------+------------+------------------------------------------+
+ | 头部长度 | u_short    |                                          |
+ +----------+------------+------------------------------------------+
+ |  上下文  |            | 256个上下文所属的类，每个 ceil(log2 k) 位 |
+ +----------+------------+------------------------------------------+
+ |  长度表  |            | k张表的编码长度，见 huffman_o1_write_len |
+ +----------+------------+------------------------------------------+
+ | 编码数据 |            |                                          |
+ +----------+------------+------------------------------------------+
+ */
+int o1_encode(comp_huffman_ctx_t* huff, comp_bitstream_t* in_stream, comp_bitstream_t* out_stream)
+{
+    if(!in_stream || !out_stream) return -1;
+    size_t n = 0, cap = 64 * 1024, r;
+    u_char* in = (u_char*) malloc(cap);
+    while(in && (r = fread(in + n, 1, cap - n, in_stream->fp)) > 0)
+    {
+        n += r;
+        if(n == cap)
+        {
+            u_char* bigger = (u_char*) realloc(in, cap *= 2);
+            if(!bigger)
+                free(in);
+            in = bigger;
+        }
+    }
+    if(!in || n > HUFFMAN_O1_MAX_CONTENT ||
+       (!huff->o1_freq && !(huff->o1_freq = (u_int32_t*) malloc(HUFFMAN_MAX_SYMBOL * HUFFMAN_MAX_SYMBOL * 4))))
+    {
+        free(in);
+        return -1;
+    }
+    comp_bitstream_write_char(out_stream, HUFFMAN_O1_HEADER_MARKER);
+    comp_bitstream_write_int(out_stream, (int) n);
+    if(n == 0)
+    {
+        free(in);
+        return 0;
+    }
+    int limit = huff->max_code_len < HUFFMAN_O1_MAX_CODE_LEN ? huff->max_code_len : HUFFMAN_O1_MAX_CODE_LEN;
+    memset(huff->o1_freq, 0, HUFFMAN_MAX_SYMBOL * HUFFMAN_MAX_SYMBOL * 4);
+    u_char prev = 0;
+    for(size_t i = 0; i < n; i++)
+    {
+        huff->o1_freq[prev * HUFFMAN_MAX_SYMBOL + in[i]]++;
+        prev = in[i];
+    }
+    u_char ctx_map[HUFFMAN_MAX_SYMBOL];
+    u_char len[HUFFMAN_O1_MAX_TABLES][HUFFMAN_MAX_SYMBOL];
+    u_int16_t code[HUFFMAN_O1_MAX_TABLES][HUFFMAN_MAX_SYMBOL];
+    int k = huffman_o1_cluster(huff, n, limit, ctx_map, len);
+    for(int t = 0; t < k; t++)
+        huffman_canonical_code(len[t], code[t]);
+    //头部最多 256 * 5 位的上下文表加上每张表 256 * 6 位(出现与不出现的符号交替时，每两个符号 4 + 8 位)
+    u_char header[160 + HUFFMAN_O1_MAX_TABLES * 192 + 8];
+    huffman_bit_writer_t w = {0, 0, header};
+    int map_bits = huffman_o1_bits(k);
+    for(int c = 0; c < HUFFMAN_MAX_SYMBOL; c++)
+        huffman_put_bits(&w, ctx_map[c], map_bits);
+    for(int t = 0; t < k; t++)
+        huffman_o1_write_len(&w, len[t]);
+    size_t header_len = huffman_end_bits(&w, header);
+    u_char* out = (u_char*) malloc(n / 8 * HUFFMAN_O1_MAX_CODE_LEN + 16);
+    if(!out)
+    {
+        free(in);
+        return -1;
+    }
+    w.ptr = out;
+    prev = 0;
+    for(size_t i = 0; i < n; i++)
+    {
+        int t = ctx_map[prev];
+        huffman_put_bits(&w, code[t][in[i]], len[t][in[i]]);
+        prev = in[i];
+    }
+    size_t out_len = huffman_end_bits(&w, out);
+    comp_bitstream_write_int(out_stream, (int) out_len);
+    comp_bitstream_write_char(out_stream, (char) k);
+    comp_bitstream_write_short(out_stream, (short) header_len);
+    comp_bitstream_write(out_stream, (const char*) header, header_len);
+    int err = comp_bitstream_write(out_stream, (const char*) out, out_len);
+    comp_bar_add(huff->bar, n);
+    free(in);
+    free(out);
+    return err;
+}
+
+/* 每张表一个 1 << HUFFMAN_O1_MAX_CODE_LEN 项的查找表，以接下来的 HUFFMAN_O1_MAX_CODE_LEN 位为下标，
+ * 每项是 (编码长度 << 8) | 符号，一次查表解出一个符号，0表示无效编码 */
+int o1_decode(comp_huffman_ctx_t* huff, comp_bitstream_t* in_stream, comp_bitstream_t* out_stream)
+{
+    if(!in_stream || !out_stream) return -1;
+    char marker, k;
+    int content_len, data_len;
+    short header_len;
+    if(comp_bitstream_read_char(in_stream, &marker) < 0 || (u_char) marker != HUFFMAN_O1_HEADER_MARKER ||
+       comp_bitstream_read_int(in_stream, &content_len) < 0)
+        return -1;
+    comp_bar_add(huff->bar, 5);
+    if(content_len == 0)
+        return 0;
+    if(content_len < 0 || (u_int32_t) content_len > HUFFMAN_O1_MAX_CONTENT ||
+       comp_bitstream_read_int(in_stream, &data_len) < 0 ||
+       data_len <= 0 || (size_t) data_len > (size_t) content_len / 8 * HUFFMAN_O1_MAX_CODE_LEN + 16 ||
+       comp_bitstream_read_char(in_stream, &k) < 0 || k <= 0 || k > HUFFMAN_O1_MAX_TABLES ||
+       comp_bitstream_read_short(in_stream, &header_len) < 0 || header_len <= 0)
+        return -1;
+    if(!huff->o1_table &&
+       !(huff->o1_table = (u_int16_t*) malloc(HUFFMAN_O1_MAX_TABLES * sizeof(u_int16_t) << HUFFMAN_O1_MAX_CODE_LEN)))
+        return -1;
+    u_char* header = (u_char*) malloc(header_len);
+    u_char* data = (u_char*) malloc(data_len);
+    u_char* out = (u_char*) malloc(content_len);
+    int err = -1;
+    if(!header || !data || !out ||
+       comp_bitstream_read(in_stream, (char*) header, header_len) < 0 ||
+       comp_bitstream_read(in_stream, (char*) data, data_len) < 0)
+        goto end;
+    huffman_bit_reader_t r = {0, 0, header, 0, (size_t) header_len};
+    u_char ctx_map[HUFFMAN_MAX_SYMBOL], len[HUFFMAN_MAX_SYMBOL];
+    u_int16_t code[HUFFMAN_MAX_SYMBOL];
+    int map_bits = huffman_o1_bits(k);
+    for(int c = 0; c < HUFFMAN_MAX_SYMBOL; c++)
+        if((ctx_map[c] = (u_char) huffman_get_bits(&r, map_bits)) >= k)
+            goto end;
+    for(int t = 0; t < k; t++)
+    {
+        u_int16_t* table = huff->o1_table + ((size_t) t << HUFFMAN_O1_MAX_CODE_LEN);
+        if(huffman_o1_read_len(&r, len) < 0 || huffman_canonical_code(len, code) < 0)
+            goto end;
+        memset(table, 0, sizeof(u_int16_t) << HUFFMAN_O1_MAX_CODE_LEN);
+        for(int s = 0; s < HUFFMAN_MAX_SYMBOL; s++)
+        {
+            if(!len[s])
+                continue;
+            int shift = HUFFMAN_O1_MAX_CODE_LEN - len[s];
+            for(u_int32_t i = (u_int32_t) code[s] << shift; i < (u_int32_t) (code[s] + 1) << shift; i++)
+                table[i] = (u_int16_t) (len[s] << 8 | s);
+        }
+    }
+    if(!huffman_reader_ok(&r))
+        goto end;
+    comp_bar_add(huff->bar, 7 + header_len);
+    r = (huffman_bit_reader_t) {0, 0, data, 0, (size_t) data_len};
+    huffman_refill(&r);
+    const u_int16_t* table = huff->o1_table + ((size_t) ctx_map[0] << HUFFMAN_O1_MAX_CODE_LEN);
+    for(int i = 0; i < content_len; i++)
+    {
+        if(r.nbits < HUFFMAN_O1_MAX_CODE_LEN)
+            huffman_refill(&r);
+        u_int16_t e = table[r.acc >> (64 - HUFFMAN_O1_MAX_CODE_LEN)];
+        int l = e >> 8;
+        if(!l)
+            goto end;
+        r.acc <<= l;
+        r.nbits -= l;
+        out[i] = (u_char) e;
+        table = huff->o1_table + ((size_t) ctx_map[(u_char) e] << HUFFMAN_O1_MAX_CODE_LEN);
+    }
+    if(!huffman_reader_ok(&r))
+        goto end;
+    err = comp_bitstream_write(out_stream, (const char*) out, content_len);
+    comp_bar_add(huff->bar, data_len);
+end:
+    free(header);
+    free(data);
+    free(out);
+    return err;
+}
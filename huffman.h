@@ -12,6 +12,18 @@
 #include <sys/types.h>
 
 #define HUFFMAN_MAX_SYMBOL 256
+#define HUFFMAN_MAX_CODE_LEN 16 // 头部的长度表只能表示16位以内的编码
+#define HUFFMAN_MIN_CODE_LEN 8  // 256个符号至少需要8位
+#define HUFFMAN_O1_MAX_CODE_LEN 12 // 一阶模式的编码长度上限，也是解码查找表的位数
+#define HUFFMAN_O1_MAX_TABLES 32   // 一阶模式最多的编码表数，分布相近的上下文共用一张表
+#define HUFFMAN_O1_MAX_CONTENT (1U << 30)
+#define HUFFMAN_CL_SYMBOLS 20 // 紧凑头部中编码长度字母表的大小: 长度0-16和3种重复
+#define HUFFMAN_CL_MAX_LEN 7  // 编码长度字母表的编码长度上限，每个用3位写出
+#define HUFFMAN_DICT_HEADER_LEN 6 // 使用字典编码表时的头部长度: 标识 + 内容长度 + 填充长度
+#define HUFFMAN_TABLE_HEADER_LEN 7 // 引用共享编码表时的头部长度: 标识 + 编号 + 内容长度 + 填充长度
+#define HUFFMAN_TABLE_MAX 64       // 一个压缩包中共享编码表的个数上限
+#define HUFFMAN_TABLE_CAND 16      // 只出现过一次、等待相近分布的候选编码表个数
+#define HUFFMAN_TABLE_INPUT_MAX (64 * 1024) // 不超过该长度的输入才使用共享编码表，更长的输入中头部可以忽略
 #define HUFFMAN_DEBUG(fmt, ...)             \
     printf("%s:%d ", __FILE__, __LINE__),   \
     printf(fmt, __VA_ARGS__), printf("\n")
@@ -36,6 +48,22 @@ struct comp_huffman_symbol_s
 typedef struct comp_huffman_node_s comp_huffman_node_t;
 typedef struct comp_huffman_symbol_s comp_huffman_symbol_t;
 
+/* 压缩包的共享编码表：分布相近的小文件引用同一张表，不必各自写出头部、建树。
+ * 表写入压缩包之后才能被引用。编码时自己建表的分布先作为候选，再遇到相近的分布时合并进去，
+ * 成为待写出的表，由调用者在两个条目之间写出 */
+struct comp_huffman_tables_s
+{
+    u_char len[HUFFMAN_TABLE_MAX][HUFFMAN_MAX_SYMBOL]; // 已写出的表中每个符号的编码长度
+    comp_huffman_node_t* root[HUFFMAN_TABLE_MAX]; // 解码用的huffman树，第一次用到时建立，之后复用
+    int num;
+    u_int32_t cand_freq[HUFFMAN_TABLE_CAND][HUFFMAN_MAX_SYMBOL]; // 候选表累计的频数
+    u_char cand_len[HUFFMAN_TABLE_CAND][HUFFMAN_MAX_SYMBOL];
+    u_char cand_state[HUFFMAN_TABLE_CAND]; // 0: 空 1: 出现过一次 2: 待写出
+    int cand_next; // 下一个替换的候选
+};
+
+typedef struct comp_huffman_tables_s comp_huffman_tables_t;
+
 struct comp_huffman_ctx_s;
 typedef int (*comp_huffman_encode_f)(struct comp_huffman_ctx_s*, comp_bitstream_t*, comp_bitstream_t*);
 typedef int (*comp_huffman_decode_f)(struct comp_huffman_ctx_s*, comp_bitstream_t*, comp_bitstream_t*);
@@ -49,6 +77,13 @@ struct comp_huffman_ctx_s
     u_char padding;
     u_int32_t content_len;
     int disable; //是否禁用huffman编码
+    int max_code_len; //编码长度上限
+    int order; //0: 所有符号共用一张编码表 1: 按前一个字节选择编码表
+    u_int32_t* o1_freq; //一阶模式 前一个字节 -> 符号 的频数，256 * 256
+    u_int16_t* o1_table; //一阶模式的解码查找表，每张表 1 << HUFFMAN_O1_MAX_CODE_LEN 项
+    const u_char* dict_len; //共享字典中每个符号的编码长度，为空表示没有字典
+    comp_huffman_node_t* dict_root; //字典编码表的huffman树，第一次解码时建立，之后复用
+    comp_huffman_tables_t* tables; //压缩包的共享编码表，为空表示不使用
     comp_progress_bar* bar;
     comp_huffman_encode_f huffman_encode;
     comp_huffman_decode_f huffman_decode;
@@ -61,7 +96,15 @@ struct comp_huffman_ctx_s
 
 typedef struct comp_huffman_ctx_s comp_huffman_ctx_t;
 
-comp_huffman_ctx_t* comp_huffman_init(comp_progress_bar* bar);
+comp_huffman_ctx_t* comp_huffman_init(comp_progress_bar* bar, int max_code_len, int order);
 void comp_huffman_free(comp_huffman_ctx_t*);
+void comp_huffman_set_dict(comp_huffman_ctx_t*, const u_char*);
+void comp_huffman_code_len(const u_int32_t*, u_char*, int);
+void comp_huffman_set_tables(comp_huffman_ctx_t*, comp_huffman_tables_t*);
+comp_huffman_tables_t* comp_huffman_tables_init();
+void comp_huffman_tables_free(comp_huffman_tables_t*);
+int comp_huffman_tables_commit(comp_huffman_tables_t*);
+void comp_huffman_tables_write(comp_huffman_tables_t*, int, comp_bitstream_t*);
+int comp_huffman_tables_read(comp_huffman_tables_t*, comp_bitstream_t*);
 
 #endif //COMPRESS_HUFFMAN_H
@@ -40,6 +40,32 @@ comp_tire_t* comp_tire_put(comp_tire_t* t, comp_str_t s, TIRE_VALUE_TYPE v)
     return put(t, s, v, 0);
 }
 
+/* 只在一层中查找字符 c。t 是这一层的根，第一层是整棵树的根，节点 n 的下一层是 n->mid，
+ * 逐字符扩展前缀时不必每次从根开始匹配整个字符串 */
+comp_tire_t* comp_tire_get_char(comp_tire_t* t, u_char c)
+{
+    while(t && c != t->c)
+        t = c < t->c ? t->left : t->right;
+    return t;
+}
+
+/* 在一层中插入字符 c，返回这一层新的根 */
+comp_tire_t* comp_tire_put_char(comp_tire_t* t, u_char c, TIRE_VALUE_TYPE v)
+{
+    if(!t)
+    {
+        t = (comp_tire_t*) malloc(sizeof(comp_tire_t));
+        t->left = t->right = t->mid = NULL;
+        t->c = c;
+        t->value = v;
+        return t;
+    }
+    if(c < t->c) t->left = comp_tire_put_char(t->left, c, v);
+    else if(c > t->c) t->right = comp_tire_put_char(t->right, c, v);
+    else t->value = v;
+    return t;
+}
+
 void comp_tire_free(comp_tire_t* root)
 {
     if(!root) return;
@@ -22,6 +22,8 @@ typedef struct comp_tire_node_s comp_tire_t;
 
 comp_tire_t* comp_tire_get(comp_tire_t*, comp_str_t);
 comp_tire_t* comp_tire_put(comp_tire_t*, comp_str_t, TIRE_VALUE_TYPE);
+comp_tire_t* comp_tire_get_char(comp_tire_t*, u_char);
+comp_tire_t* comp_tire_put_char(comp_tire_t*, u_char, TIRE_VALUE_TYPE);
 void comp_tire_free(comp_tire_t*);
 
 #endif //COMPRESS_3W_TIRE_H
@@ -1,9 +1,12 @@
 //
 // Created by zr on 23-1-13.
 //
+#define _GNU_SOURCE
 #include "bitstream.h"
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
 
 comp_bitstream_t* comp_bitstream_init(FILE* fp)
 {
@@ -93,6 +96,13 @@ int comp_bitstream_write_int(comp_bitstream_t* s, int i)
     return 0;
 }
 
+int comp_bitstream_write_long(comp_bitstream_t* s, u_int64_t l)
+{
+    if(comp_bitstream_write_int(s, (int) (l >> 32)) < 0) return -1;
+    if(comp_bitstream_write_int(s, (int) (l & 0xFFFFFFFF)) < 0) return -1;
+    return 0;
+}
+
 int comp_bitstream_write_nbit(comp_bitstream_t* s, int i, size_t len)
 {
     int bit;
@@ -107,6 +117,9 @@ int comp_bitstream_write_nbit(comp_bitstream_t* s, int i, size_t len)
 
 int comp_bitstream_write(comp_bitstream_t* s, const char* data, size_t len)
 {
+    //字节对齐时整块写入
+    if(s->out_buf_remain == 0)
+        return fwrite(data, 1, len, s->fp) == len ? 0 : -1;
     for(size_t i = 0; i < len; i++)
         if(comp_bitstream_write_char(s, *(data + i)) < 0)
             return -1;
@@ -174,6 +187,19 @@ int comp_bitstream_read_char(comp_bitstream_t* s, char* ch)
     return 0;
 }
 
+/* 查看下一个字节但不读走，要求字节对齐 */
+int comp_bitstream_peek_char(comp_bitstream_t* s, char* ch)
+{
+    if(s->in_buf_remain != 0 && s->in_buf_remain != 8)
+        return -1;
+    if(s->in_buf_remain == 0 && !s->eof)
+        fill_in_buf(s);
+    if(s->eof)
+        return -1;
+    *ch = (char) s->in_buf;
+    return 0;
+}
+
 int comp_bitstream_read_short(comp_bitstream_t* s, short* st)
 {
     char c1, c2; short x = 0;
@@ -200,6 +226,41 @@ int comp_bitstream_read_int(comp_bitstream_t* s, int* i)
     return 0;
 }
 
+int comp_bitstream_read_long(comp_bitstream_t* s, u_int64_t* l)
+{
+    int high, low;
+    if(comp_bitstream_read_int(s, &high) < 0) return -1;
+    if(comp_bitstream_read_int(s, &low) < 0) return -1;
+    if(l) *l = ((u_int64_t) (u_int32_t) high << 32) | (u_int32_t) low;
+    return 0;
+}
+
+int comp_bitstream_read(comp_bitstream_t* s, char* data, size_t len)
+{
+    //字节对齐时整块读入，已经预读的一个字节先取出
+    if(len > 0 && !s->eof && (s->in_buf_remain == 0 || s->in_buf_remain == 8))
+    {
+        size_t done = 0;
+        int prefetched = s->in_buf_remain == 8;
+        if(prefetched)
+            data[done++] = (char) s->in_buf;
+        done += fread(data + done, 1, len - done, s->fp);
+        if(done < len)
+        {
+            s->eof = 1;
+            s->in_buf = s->in_buf_remain = 0;
+            return -1;
+        }
+        if(prefetched)
+            fill_in_buf(s);
+        return 0;
+    }
+    for(size_t i = 0; i < len; i++)
+        if(comp_bitstream_read_char(s, data + i) < 0)
+            return -1;
+    return 0;
+}
+
 int comp_bitstream_read_nbit(comp_bitstream_t* s, int* i, size_t len)
 {
     int x = 0; int bit;
@@ -233,4 +294,102 @@ void comp_bitstream_reset(comp_bitstream_t* s)
     s->in_buf = s->out_buf = 0;
     s->in_buf_remain = s->out_buf_remain = 0;
     s->eof = 0;
-}
\ No newline at end of file
+}
+
+/* 返回当前读写位置对应的文件偏移，只在字节对齐时有意义。
+ * 读缓冲中可能预读了一个完整字节(in_buf_remain == 8)，要减掉 */
+long comp_bitstream_tell(comp_bitstream_t* s)
+{
+    if(s->out_buf_remain != 0)
+        return -1;
+    long pos = ftell(s->fp);
+    if(pos < 0)
+        return -1;
+    if(s->in_buf_remain == 8)
+        pos--;
+    return pos;
+}
+
+int comp_bitstream_seek(comp_bitstream_t* s, long pos)
+{
+    if(comp_bitstream_flush(s) < 0)
+        return -1;
+    if(fseek(s->fp, pos, SEEK_SET) != 0)
+        return -1;
+    s->in_buf = 0;
+    s->in_buf_remain = 0;
+    s->eof = 0;
+    return 0;
+}
+
+/* 在内核中把in_fd从in_off开始的len个字节复制到out_fd的out_off处，先用copy_file_range，
+ * 不支持时(跨文件系统、旧内核等)改用sendfile，返回实际复制的字节数 */
+static size_t bitstream_copy_fd(int in_fd, off_t in_off, int out_fd, off_t out_off, size_t len)
+{
+    size_t copied = 0;
+    while(copied < len)
+    {
+        ssize_t n = copy_file_range(in_fd, &in_off, out_fd, &out_off, len - copied, 0);
+        if(n <= 0)
+            break;
+        copied += n;
+    }
+    if(copied == len || lseek(out_fd, out_off, SEEK_SET) < 0)
+        return copied;
+    while(copied < len)
+    {
+        ssize_t n = sendfile(out_fd, in_fd, &in_off, len - copied);
+        if(n <= 0)
+            break;
+        copied += n;
+    }
+    return copied;
+}
+
+/* 从in向out原样复制len个字节，要求两个流都是字节对齐的。
+ * 两边都是普通文件时数据不经过用户态，否则(管道、内存流、IO线程)退回分块fread/fwrite */
+int comp_bitstream_copy(comp_bitstream_t* in, comp_bitstream_t* out, size_t len)
+{
+    if((in->in_buf_remain != 0 && in->in_buf_remain != 8) || out->out_buf_remain != 0)
+        return -1;
+    char buf[65536];
+    if(in->in_buf_remain == 8 && len > 0)
+    {
+        if(comp_bitstream_write_char(out, (char) in->in_buf) < 0)
+            return -1;
+        in->in_buf = 0;
+        in->in_buf_remain = 0;
+        len--;
+    }
+    int in_fd = fileno(in->fp), out_fd = fileno(out->fp);
+    if(len > 0 && in_fd >= 0 && out_fd >= 0 && fflush(out->fp) == 0)
+    {
+        //FILE的缓冲区中可能还有数据，按逻辑位置显式指定偏移，复制完再把FILE定位到新位置
+        off_t in_off = ftello(in->fp), out_off = ftello(out->fp);
+        if(in_off >= 0 && out_off >= 0)
+        {
+            size_t copied = bitstream_copy_fd(in_fd, in_off, out_fd, out_off, len);
+            if(copied > 0)
+            {
+                if(fseeko(in->fp, in_off + copied, SEEK_SET) != 0 ||
+                   fseeko(out->fp, out_off + copied, SEEK_SET) != 0)
+                    return -1;
+                len -= copied;
+            }
+        }
+    }
+    while(len > 0)
+    {
+        size_t n = len < sizeof(buf) ? len : sizeof(buf);
+        size_t r = fread(buf, 1, n, in->fp);
+        if(r == 0)
+        {
+            in->eof = 1;
+            return -1;
+        }
+        if(fwrite(buf, 1, r, out->fp) != r)
+            return -1;
+        len -= r;
+    }
+    return 0;
+}
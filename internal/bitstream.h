@@ -26,17 +26,24 @@ int comp_bitstream_write_bit(comp_bitstream_t*, int);
 int comp_bitstream_write_char(comp_bitstream_t*, char);
 int comp_bitstream_write_short(comp_bitstream_t*, short);
 int comp_bitstream_write_int(comp_bitstream_t*, int);
+int comp_bitstream_write_long(comp_bitstream_t*, u_int64_t);
 int comp_bitstream_write(comp_bitstream_t*, const char*, size_t);
 int comp_bitstream_write_nbit(comp_bitstream_t*, int, size_t);
 int comp_bitstream_write_str(comp_bitstream_t*, const char*);
 int comp_bitstream_flush(comp_bitstream_t*);
 int comp_bitstream_read_bit(comp_bitstream_t*, int*);
 int comp_bitstream_read_char(comp_bitstream_t*, char*);
+int comp_bitstream_peek_char(comp_bitstream_t*, char*);
 int comp_bitstream_read_short(comp_bitstream_t*, short*);
 int comp_bitstream_read_int(comp_bitstream_t*, int*);
+int comp_bitstream_read_long(comp_bitstream_t*, u_int64_t*);
+int comp_bitstream_read(comp_bitstream_t*, char*, size_t);
 int comp_bitstream_read_nbit(comp_bitstream_t*, int*, size_t);
 void comp_bitstream_close(comp_bitstream_t*);
 int comp_bitstream_eof(comp_bitstream_t*);
 void comp_bitstream_reset(comp_bitstream_t*);
+long comp_bitstream_tell(comp_bitstream_t*);
+int comp_bitstream_seek(comp_bitstream_t*, long);
+int comp_bitstream_copy(comp_bitstream_t*, comp_bitstream_t*, size_t);
 
 #endif //COMPRESS_BITSTREAM_H
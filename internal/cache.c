@@ -0,0 +1,223 @@
+//
+// Created by zr on 23-2-13.
+//
+#include "cache.h"
+#include "vector.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+
+struct cache_entry_s
+{
+    comp_str_t key;
+    u_int64_t size;
+    u_int64_t used; // 最近使用时间，保存为缓存文件的修改时间，下次运行时仍然有效
+};
+
+typedef struct cache_entry_s cache_entry_t;
+
+static void cache_entry_free(void* e)
+{
+    comp_str_free(((cache_entry_t*) e)->key);
+    free(e);
+}
+
+static int cache_entry_older(const void* a, const void* b)
+{
+    return ((const cache_entry_t*) a)->used < ((const cache_entry_t*) b)->used;
+}
+
+/* 取得一个新的使用时间，同一次运行中严格递增 */
+static u_int64_t cache_tick(comp_cache_t* cache)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    u_int64_t now = (u_int64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    cache->clock = now > cache->clock ? now : cache->clock + 1;
+    return cache->clock;
+}
+
+static void cache_touch(int fd, u_int64_t used)
+{
+    struct timespec times[2];
+    times[0].tv_sec = 0;
+    times[0].tv_nsec = UTIME_OMIT;
+    times[1].tv_sec = (time_t) (used / 1000000000ULL);
+    times[1].tv_nsec = (long) (used % 1000000000ULL);
+    futimens(fd, times);
+}
+
+static cache_entry_t* cache_add(comp_cache_t* cache, const char* key, u_int64_t size, u_int64_t used)
+{
+    cache_entry_t* e = (cache_entry_t*) malloc(sizeof(cache_entry_t));
+    if(!e) return NULL;
+    e->key = comp_str_new(key);
+    e->size = size;
+    e->used = used;
+    if(!e->key || comp_map_put(cache->index, key, e) < 0)
+    {
+        cache_entry_free(e);
+        return NULL;
+    }
+    cache->total += size;
+    return e;
+}
+
+/* 总大小超过上限时，从最久没有使用的开始删除，直到不超过上限的90%，
+ * 避免之后每次写入都要淘汰 */
+static void cache_evict(comp_cache_t* cache)
+{
+    if(cache->total <= cache->limit)
+        return;
+    comp_vec_t* entries = comp_vec_init(comp_map_size(cache->index));
+    if(!entries) return;
+    for(size_t i = 0; i < cache->index->bucket_num; i++)
+        for(comp_map_node_t* node = cache->index->buckets[i]; node; node = node->next)
+            comp_vec_push_back(entries, node->value);
+    comp_vec_sort(entries, 0, (int) comp_vec_len(entries) - 1, cache_entry_older);
+    u_int64_t target = cache->limit / 10 * 9;
+    for(size_t i = 0; i < comp_vec_len(entries) && cache->total > target; i++)
+    {
+        cache_entry_t* e = comp_vec_get(entries, i);
+        if(unlinkat(cache->dir_fd, e->key, 0) != 0 && errno != ENOENT)
+            continue;
+        cache->total -= e->size;
+        cache->evictions++;
+        comp_map_remove(cache->index, e->key);
+        cache_entry_free(e);
+    }
+    comp_vec_free(entries);
+}
+
+/* 打开缓存目录(不存在时创建)，扫描已有的缓存文件，limit 为总大小上限 */
+comp_cache_t* comp_cache_open(const char* dir, u_int64_t limit)
+{
+    if(mkdir(dir, 0755) != 0 && errno != EEXIST)
+        return NULL;
+    comp_cache_t* cache = (comp_cache_t*) calloc(1, sizeof(comp_cache_t));
+    if(!cache) return NULL;
+    cache->limit = limit;
+    cache->index = comp_map_init(1024);
+    if(!cache->index || (cache->dir_fd = open(dir, O_RDONLY | O_DIRECTORY)) < 0)
+    {
+        comp_map_free(cache->index, NULL);
+        free(cache);
+        return NULL;
+    }
+    int fd = dup(cache->dir_fd);
+    DIR* d = fd >= 0 ? fdopendir(fd) : NULL;
+    struct dirent* ent;
+    struct stat st;
+    while(d && (ent = readdir(d)) != NULL)
+    {
+        //以'.'开头的是目录自身和写入中途的临时文件
+        if(ent->d_name[0] == '.' || fstatat(cache->dir_fd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 ||
+           !S_ISREG(st.st_mode))
+            continue;
+        cache_add(cache, ent->d_name, st.st_size,
+                  (u_int64_t) st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec);
+    }
+    if(d)
+        closedir(d);
+    else if(fd >= 0)
+        close(fd);
+    cache_evict(cache);
+    return cache;
+}
+
+void comp_cache_close(comp_cache_t* cache)
+{
+    if(!cache) return;
+    close(cache->dir_fd);
+    comp_map_free(cache->index, cache_entry_free);
+    free(cache);
+}
+
+/* 查找 key 对应的数据，命中时返回malloc的数据并更新使用时间，len 为数据长度 */
+char* comp_cache_get(comp_cache_t* cache, const char* key, size_t* len)
+{
+    cache_entry_t* e = comp_map_get(cache->index, key);
+    int fd = e ? openat(cache->dir_fd, key, O_RDONLY) : -1;
+    struct stat st;
+    char* data = NULL;
+    if(fd >= 0 && fstat(fd, &st) == 0 && (data = (char*) malloc(st.st_size ? st.st_size : 1)) != NULL)
+    {
+        size_t done = 0;
+        while(done < (size_t) st.st_size)
+        {
+            ssize_t r = read(fd, data + done, st.st_size - done);
+            if(r <= 0)
+                break;
+            done += r;
+        }
+        if(done == (size_t) st.st_size)
+        {
+            e->used = cache_tick(cache);
+            cache_touch(fd, e->used);
+            *len = done;
+        }
+        else
+        {
+            free(data);
+            data = NULL;
+        }
+    }
+    if(fd >= 0)
+        close(fd);
+    else if(e && errno == ENOENT)
+    {
+        //缓存文件被其他进程淘汰或手动删除了
+        cache->total -= e->size;
+        comp_map_remove(cache->index, key);
+        cache_entry_free(e);
+    }
+    if(data)
+        cache->hits++;
+    else
+        cache->misses++;
+    return data;
+}
+
+/* 保存 key 对应的数据。先写临时文件再重命名，中途退出不会留下不完整的缓存文件 */
+int comp_cache_put(comp_cache_t* cache, const char* key, const char* data, size_t len)
+{
+    if(len > cache->limit)
+        return -1;
+    if(comp_map_get(cache->index, key))
+        return 0;
+    char tmp[32];
+    snprintf(tmp, sizeof(tmp), ".tmp.%d", (int) getpid());
+    int fd = openat(cache->dir_fd, tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
+        return -1;
+    size_t done = 0;
+    while(done < len)
+    {
+        ssize_t w = write(fd, data + done, len - done);
+        if(w <= 0)
+            break;
+        done += w;
+    }
+    u_int64_t used = cache_tick(cache);
+    cache_touch(fd, used);
+    close(fd);
+    if(done < len || renameat(cache->dir_fd, tmp, cache->dir_fd, key) != 0)
+    {
+        unlinkat(cache->dir_fd, tmp, 0);
+        return -1;
+    }
+    if(!cache_add(cache, key, len, used))
+    {
+        unlinkat(cache->dir_fd, key, 0);
+        return -1;
+    }
+    cache->stores++;
+    cache_evict(cache);
+    return 0;
+}
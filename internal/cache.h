@@ -0,0 +1,33 @@
+//
+// Created by zr on 23-2-13.
+// 磁盘上的压缩结果缓存，按最近使用淘汰
+//
+#ifndef COMPRESS_CACHE_H
+#define COMPRESS_CACHE_H
+#include <stddef.h>
+#include <sys/types.h>
+#include "map.h"
+
+#define COMP_CACHE_LIMIT_DEFAULT (1024ULL * 1024 * 1024)
+
+struct comp_cache_s
+{
+    int dir_fd;
+    u_int64_t limit;      // 缓存文件总大小上限
+    u_int64_t total;      // 当前缓存文件总大小
+    u_int64_t clock;      // 最近一次使用的时间(纳秒)，保证同一次运行中的使用时间递增
+    comp_map_t* index;    // key -> 缓存项
+    size_t hits;
+    size_t misses;
+    size_t stores;
+    size_t evictions;
+};
+
+typedef struct comp_cache_s comp_cache_t;
+
+comp_cache_t* comp_cache_open(const char*, u_int64_t);
+void comp_cache_close(comp_cache_t*);
+char* comp_cache_get(comp_cache_t*, const char*, size_t*);
+int comp_cache_put(comp_cache_t*, const char*, const char*, size_t);
+
+#endif //COMPRESS_CACHE_H
@@ -0,0 +1,51 @@
+//
+// Created by zr on 23-2-12.
+//
+#include "cdc.h"
+#include "hash.h"
+#include <pthread.h>
+
+/* 归一化分块使用的两个掩码：平均长度之前用位数较多的掩码，不容易切分，
+ * 之后用位数较少的掩码，容易切分，块长度集中在平均长度附近 */
+#define CDC_MASK_S 0x924a494929250000ULL // 18位
+#define CDC_MASK_L 0x8891122444890000ULL // 14位
+
+static u_int64_t gear[256];
+static pthread_once_t gear_once = PTHREAD_ONCE_INIT;
+
+static void gear_init()
+{
+    for(int i = 0; i < 256; i++)
+        gear[i] = comp_hash_mix64((u_int64_t) i + 0x9e3779b97f4a7c15ULL);
+}
+
+/* 在 buf 的前 len 字节中找切分点，返回第一个块的长度。
+ * Gear滚动哈希 h = (h << 1) + gear[byte]，满足掩码时切分，块长度在 [MIN, MAX] 之间。
+ * last 表示 buf 之后没有更多数据，这时不足一个块的剩余部分整体作为一个块 */
+size_t comp_cdc_cut(const char* buf, size_t len, int last)
+{
+    pthread_once(&gear_once, gear_init);
+    if(len <= COMP_CDC_MIN_SIZE)
+        return last ? len : 0;
+    size_t n = len < COMP_CDC_MAX_SIZE ? len : COMP_CDC_MAX_SIZE;
+    size_t normal = n < COMP_CDC_AVG_SIZE ? n : COMP_CDC_AVG_SIZE;
+    const unsigned char* p = (const unsigned char*) buf;
+    u_int64_t h = 0;
+    size_t i = COMP_CDC_MIN_SIZE;
+    for(; i < normal; i++)
+    {
+        h = (h << 1) + gear[p[i]];
+        if(!(h & CDC_MASK_S))
+            return i + 1;
+    }
+    for(; i < n; i++)
+    {
+        h = (h << 1) + gear[p[i]];
+        if(!(h & CDC_MASK_L))
+            return i + 1;
+    }
+    //没有找到切分点：达到最大长度时强制切分，否则需要更多数据
+    if(n == COMP_CDC_MAX_SIZE || last)
+        return n;
+    return 0;
+}
@@ -0,0 +1,15 @@
+//
+// Created by zr on 23-2-12.
+// 基于内容的分块(FastCDC)，用于去重
+//
+#ifndef COMPRESS_CDC_H
+#define COMPRESS_CDC_H
+#include <stddef.h>
+
+#define COMP_CDC_MIN_SIZE (16 * 1024)
+#define COMP_CDC_AVG_SIZE (64 * 1024)
+#define COMP_CDC_MAX_SIZE (256 * 1024)
+
+size_t comp_cdc_cut(const char*, size_t, int);
+
+#endif //COMPRESS_CDC_H
@@ -0,0 +1,77 @@
+//
+// Created by zr on 23-2-10.
+//
+#include "entropy.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+static double entropy_of_freq(const size_t* freq, size_t total)
+{
+    if(total == 0)
+        return 0;
+    double h = 0;
+    for(int i = 0; i < 256; i++)
+    {
+        if(freq[i] == 0)
+            continue;
+        double p = (double) freq[i] / (double) total;
+        h -= p * log2(p);
+    }
+    return h;
+}
+
+/* 计算 buf 的零阶熵，单位为 bit/字节 */
+double comp_entropy(const char* buf, size_t len)
+{
+    size_t freq[256] = {0};
+    for(size_t i = 0; i < len; i++)
+        freq[(u_char) buf[i]]++;
+    return entropy_of_freq(freq, len);
+}
+
+/* 取样估计 buf 的零阶熵：在 buf 中均匀取 COMP_ENTROPY_SAMPLE_NUM 段，
+ * 每段 COMP_ENTROPY_SAMPLE_LEN 字节，数据较短时直接统计全部 */
+double comp_entropy_sample(const char* buf, size_t len)
+{
+    if(len <= COMP_ENTROPY_SAMPLE_NUM * COMP_ENTROPY_SAMPLE_LEN)
+        return comp_entropy(buf, len);
+    size_t freq[256] = {0};
+    size_t stride = (len - COMP_ENTROPY_SAMPLE_LEN) / (COMP_ENTROPY_SAMPLE_NUM - 1);
+    for(int i = 0; i < COMP_ENTROPY_SAMPLE_NUM; i++)
+    {
+        const char* p = buf + i * stride;
+        for(int j = 0; j < COMP_ENTROPY_SAMPLE_LEN; j++)
+            freq[(u_char) p[j]]++;
+    }
+    return entropy_of_freq(freq, COMP_ENTROPY_SAMPLE_NUM * COMP_ENTROPY_SAMPLE_LEN);
+}
+
+/* 估计 buf 中长距离重复的比例，零阶熵看不出这种重复(例如一段随机数据重复多次)。
+ * 锚点由窗口内容决定而与位置无关，重复出现的内容在每次出现时都会选出相同的锚点；
+ * 返回与之前某个锚点窗口内容相同的锚点所占的比例 */
+double comp_repeat_ratio(const char* buf, size_t len)
+{
+    if(len < COMP_REPEAT_WINDOW)
+        return 0;
+    u_int64_t* table = (u_int64_t*) calloc(1 << COMP_REPEAT_TABLE_BITS, sizeof(u_int64_t));
+    if(!table)
+        return 0;
+    size_t anchors = 0, hits = 0;
+    for(size_t i = 0; i + COMP_REPEAT_WINDOW <= len; i++)
+    {
+        u_int64_t w;
+        memcpy(&w, buf + i, sizeof(w));
+        u_int64_t h = (w + 1) * 0x9E3779B97F4A7C15ULL;
+        if(h >> (64 - COMP_REPEAT_ANCHOR_BITS))
+            continue;
+        u_int64_t* slot = table + (h >> 32 & ((1 << COMP_REPEAT_TABLE_BITS) - 1));
+        anchors++;
+        if(*slot == h)
+            hits++;
+        *slot = h;
+    }
+    free(table);
+    return anchors ? (double) hits / (double) anchors : 0;
+}
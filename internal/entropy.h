@@ -0,0 +1,19 @@
+//
+// Created by zr on 23-2-10.
+//
+
+#ifndef COMPRESS_ENTROPY_H
+#define COMPRESS_ENTROPY_H
+#include <stddef.h>
+
+#define COMP_ENTROPY_SAMPLE_NUM 16
+#define COMP_ENTROPY_SAMPLE_LEN 4096
+#define COMP_REPEAT_WINDOW 8        // 重复探测比较的窗口长度
+#define COMP_REPEAT_ANCHOR_BITS 5   // 哈希高位全为0的窗口作为锚点，平均每 2^5 字节一个
+#define COMP_REPEAT_TABLE_BITS 14
+
+double comp_entropy(const char*, size_t);
+double comp_entropy_sample(const char*, size_t);
+double comp_repeat_ratio(const char*, size_t);
+
+#endif //COMPRESS_ENTROPY_H
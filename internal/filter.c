@@ -0,0 +1,190 @@
+//
+// Created by zr on 23-2-15.
+//
+#include "filter.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char* filter_names[COMP_FILTER_NUM] = {"none", "delta", "shuffle", "bcj"};
+
+/* type 为过滤器类型，param 为差分距离或记录宽度，参数不合法时返回NULL */
+comp_filter_t* comp_filter_init(int type, int param)
+{
+    if(type < COMP_FILTER_NONE || type >= COMP_FILTER_NUM || param < 0 || param > COMP_FILTER_PARAM_MAX)
+        return NULL;
+    if((type == COMP_FILTER_DELTA && param < 1) || (type == COMP_FILTER_SHUFFLE && param < 2) ||
+       ((type == COMP_FILTER_NONE || type == COMP_FILTER_BCJ) && param != 0))
+        return NULL;
+    comp_filter_t* f = (comp_filter_t*) calloc(1, sizeof(comp_filter_t));
+    if(!f) return NULL;
+    f->type = type;
+    f->param = param;
+    if(type == COMP_FILTER_SHUFFLE)
+    {
+        f->window = COMP_FILTER_WINDOW / param * param;
+        if(!(f->tmp = (u_char*) malloc(f->window)))
+        {
+            free(f);
+            return NULL;
+        }
+    }
+    return f;
+}
+
+void comp_filter_free(comp_filter_t* f)
+{
+    if(!f) return;
+    free(f->tmp);
+    free(f);
+}
+
+/* 差分：编码时每个字节减去 param 字节之前的原始字节，等间距的数值列(音频采样、像素、
+ * 整数数组等)变成集中在0附近的小差值。多字节的字(word)差分取距离为字宽即可，
+ * 低字节的差值精确，高字节只差一个借位 */
+static void filter_delta(comp_filter_t* f, u_char* p, size_t n, int decode)
+{
+    size_t d = f->param, k = f->pos % d;
+    for(size_t i = 0; i < n; i++)
+    {
+        u_char raw = decode ? (u_char) (p[i] + f->hist[k]) : p[i];
+        p[i] = decode ? raw : (u_char) (raw - f->hist[k]);
+        f->hist[k] = raw;
+        if(++k == d)
+            k = 0;
+    }
+}
+
+/* 转置一个窗口：编码时把每条记录的第k个字节集中到第k行，n 不是记录宽度整数倍时剩余的字节不动 */
+static void filter_shuffle_window(comp_filter_t* f, u_char* p, size_t n, int decode)
+{
+    size_t w = f->param, rows = n / w;
+    for(size_t r = 0; r < rows; r++)
+        for(size_t k = 0; k < w; k++)
+        {
+            if(decode)
+                f->tmp[r * w + k] = p[k * rows + r];
+            else
+                f->tmp[k * rows + r] = p[r * w + k];
+        }
+    memcpy(p, f->tmp, rows * w);
+}
+
+/* 窗口从流的开头按 f->window 划分，只处理完整的窗口，流结束时最后不完整的窗口单独转置 */
+static size_t filter_shuffle(comp_filter_t* f, u_char* p, size_t n, int last, int decode)
+{
+    size_t done = 0;
+    while(n - done >= f->window)
+    {
+        filter_shuffle_window(f, p + done, f->window, decode);
+        done += f->window;
+    }
+    if(last && done < n)
+    {
+        filter_shuffle_window(f, p + done, n - done, decode);
+        done = n;
+    }
+    return done;
+}
+
+/* x86跳转地址转换：E8(call)/E9(jmp)之后的4字节小端相对偏移加上下一条指令在流中的位置，
+ * 调用同一个函数的指令得到相同的绝对地址，重复的字节串更多。
+ * 操作码本身不变，解码时按同样的规则扫描，找到的位置与编码时相同，减去位置即可还原。
+ * 操作数不完整时停在操作码处等待更多数据，流结束时剩余的字节不转换 */
+static size_t filter_bcj(comp_filter_t* f, u_char* p, size_t n, int last, int decode)
+{
+    size_t i = 0;
+    while(i < n)
+    {
+        if((p[i] & 0xFE) != 0xE8)
+        {
+            i++;
+            continue;
+        }
+        if(n - i < COMP_FILTER_BCJ_LOOKAHEAD)
+            return last ? n : i;
+        u_int32_t pc = (u_int32_t) (f->pos + i + COMP_FILTER_BCJ_LOOKAHEAD);
+        u_int32_t v = (u_int32_t) p[i + 1] | (u_int32_t) p[i + 2] << 8 |
+                      (u_int32_t) p[i + 3] << 16 | (u_int32_t) p[i + 4] << 24;
+        v = decode ? v - pc : v + pc;
+        p[i + 1] = (u_char) v;
+        p[i + 2] = (u_char) (v >> 8);
+        p[i + 3] = (u_char) (v >> 16);
+        p[i + 4] = (u_char) (v >> 24);
+        i += COMP_FILTER_BCJ_LOOKAHEAD;
+    }
+    return n;
+}
+
+static size_t filter_run(comp_filter_t* f, char* buf, size_t n, int last, int decode)
+{
+    u_char* p = (u_char*) buf;
+    size_t done = n;
+    switch(f->type)
+    {
+        case COMP_FILTER_DELTA:
+            filter_delta(f, p, n, decode);
+            break;
+        case COMP_FILTER_SHUFFLE:
+            done = filter_shuffle(f, p, n, last, decode);
+            break;
+        case COMP_FILTER_BCJ:
+            done = filter_bcj(f, p, n, last, decode);
+            break;
+        default:
+            break;
+    }
+    f->pos += done;
+    return done;
+}
+
+/* 原地过滤 buf 的前 n 字节，返回处理完的字节数。没有处理的尾部需要等更多数据，
+ * 下次调用时放在新数据之前重新送入。last 表示之后没有更多数据，这时总是处理全部 n 字节 */
+size_t comp_filter_encode(comp_filter_t* f, char* buf, size_t n, int last)
+{
+    return filter_run(f, buf, n, last, 0);
+}
+
+/* 还原 comp_filter_encode 的结果，数据按同样的规则分段处理，与编码时送入的方式无关 */
+size_t comp_filter_decode(comp_filter_t* f, char* buf, size_t n, int last)
+{
+    return filter_run(f, buf, n, last, 1);
+}
+
+/* 解析 "none"、"auto"、"bcj"、"delta:距离"、"shuffle:记录宽度"，成功返回0 */
+int comp_filter_parse(const char* spec, int* type, int* param)
+{
+    const char* colon = strchr(spec, ':');
+    size_t name_len = colon ? (size_t) (colon - spec) : strlen(spec);
+    *param = 0;
+    if(name_len == 4 && strncmp(spec, "auto", 4) == 0 && !colon)
+    {
+        *type = COMP_FILTER_AUTO;
+        return 0;
+    }
+    for(int i = 0; i < COMP_FILTER_NUM; i++)
+    {
+        if(strlen(filter_names[i]) != name_len || strncmp(spec, filter_names[i], name_len) != 0)
+            continue;
+        if(colon)
+        {
+            char* end;
+            long v = strtol(colon + 1, &end, 10);
+            if(*end || end == colon + 1 || v < 0 || v > COMP_FILTER_PARAM_MAX)
+                return -1;
+            *param = (int) v;
+        }
+        else if(i == COMP_FILTER_DELTA)
+            *param = 1;
+        *type = i;
+        comp_filter_t* f = comp_filter_init(*type, *param);
+        int err = f ? 0 : -1;
+        comp_filter_free(f);
+        return err;
+    }
+    return -1;
+}
+
+const char* comp_filter_name(int type)
+{
+    return type >= 0 && type < COMP_FILTER_NUM ? filter_names[type] : "auto";
+}
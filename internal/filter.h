@@ -0,0 +1,44 @@
+//
+// Created by zr on 23-2-15.
+// 编码前的预处理过滤器：差分、定长记录转置、x86跳转地址转换
+//
+#ifndef COMPRESS_FILTER_H
+#define COMPRESS_FILTER_H
+#include <stddef.h>
+#include <sys/types.h>
+
+#define COMP_FILTER_WINDOW (64 * 1024)  // 转置的窗口大小上限，窗口为记录宽度的整数倍
+#define COMP_FILTER_PARAM_MAX 255       // 差分距离、记录宽度的上限
+#define COMP_FILTER_BCJ_LOOKAHEAD 5     // 跳转指令的操作码 + 4字节偏移
+
+typedef enum comp_filter_type
+{
+    COMP_FILTER_AUTO = -1,  // 对每个文件自动选择
+    COMP_FILTER_NONE,
+    COMP_FILTER_DELTA,      // 与 param 字节之前的字节相减
+    COMP_FILTER_SHUFFLE,    // 把 param 字节宽的记录按字节位置转置
+    COMP_FILTER_BCJ,        // x86 call/jmp(E8/E9)的相对地址转为绝对地址
+    COMP_FILTER_NUM
+} comp_filter_type;
+
+/* 过滤器在整个文件的数据流上工作，数据可以分多次送入，状态在调用之间保留 */
+struct comp_filter_s
+{
+    int type;
+    int param;
+    u_int64_t pos;                          // 已处理的字节数，即下一个字节在流中的位置
+    u_char hist[COMP_FILTER_PARAM_MAX];     // 差分：最近 param 个原始字节
+    size_t window;                          // 转置：窗口大小
+    u_char* tmp;                            // 转置：一个窗口的临时缓冲区
+};
+
+typedef struct comp_filter_s comp_filter_t;
+
+comp_filter_t* comp_filter_init(int, int);
+void comp_filter_free(comp_filter_t*);
+size_t comp_filter_encode(comp_filter_t*, char*, size_t, int);
+size_t comp_filter_decode(comp_filter_t*, char*, size_t, int);
+int comp_filter_parse(const char*, int*, int*);
+const char* comp_filter_name(int);
+
+#endif //COMPRESS_FILTER_H
@@ -0,0 +1,61 @@
+//
+// Created by zr on 23-2-6.
+//
+#include "hash.h"
+#include <string.h>
+
+#define COMP_HASH_FNV_PRIME 0x100000001b3ULL
+
+/* FNV-1a 64位哈希，h为上一次的哈希值，可以分段计算 */
+u_int64_t comp_hash_fnv1a64(u_int64_t h, const void* data, size_t len)
+{
+    const u_char* p = data;
+    for(size_t i = 0; i < len; i++)
+    {
+        h ^= p[i];
+        h *= COMP_HASH_FNV_PRIME;
+    }
+    return h;
+}
+
+u_int64_t comp_hash_str(const char* s)
+{
+    u_int64_t h = COMP_HASH_FNV_INIT;
+    while(*s)
+    {
+        h ^= (u_char) *s++;
+        h *= COMP_HASH_FNV_PRIME;
+    }
+    return h;
+}
+
+/* splitmix64 的混合函数，使输入的每一位都影响输出的每一位 */
+u_int64_t comp_hash_mix64(u_int64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/* 每次处理8字节的乘法哈希，与FNV-1a互相独立，两者合起来作为数据块的指纹 */
+u_int64_t comp_hash_mul64(u_int64_t seed, const void* data, size_t len)
+{
+    const u_char* p = data;
+    u_int64_t h = seed ^ (len * 0x9e3779b97f4a7c15ULL);
+    u_int64_t w;
+    while(len >= 8)
+    {
+        memcpy(&w, p, 8);
+        h = (h ^ comp_hash_mix64(w)) * 0x9e3779b97f4a7c15ULL;
+        h = (h << 31) | (h >> 33);
+        p += 8;
+        len -= 8;
+    }
+    w = 0;
+    memcpy(&w, p, len);
+    h ^= comp_hash_mix64(w + len);
+    return comp_hash_mix64(h);
+}
@@ -0,0 +1,17 @@
+//
+// Created by zr on 23-2-6.
+// 文件内容/字符串哈希
+//
+#ifndef COMPRESS_HASH_H
+#define COMPRESS_HASH_H
+#include <stddef.h>
+#include <sys/types.h>
+
+#define COMP_HASH_FNV_INIT 0xcbf29ce484222325ULL
+
+u_int64_t comp_hash_fnv1a64(u_int64_t, const void*, size_t);
+u_int64_t comp_hash_str(const char*);
+u_int64_t comp_hash_mix64(u_int64_t);
+u_int64_t comp_hash_mul64(u_int64_t, const void*, size_t);
+
+#endif //COMPRESS_HASH_H
@@ -0,0 +1,125 @@
+//
+// Created by zr on 23-2-6.
+//
+#include "map.h"
+#include "hash.h"
+#include <stdlib.h>
+#include <string.h>
+
+comp_map_t* comp_map_init(size_t bucket_num)
+{
+    comp_map_t* m = (comp_map_t*) malloc(sizeof(comp_map_t));
+    if(!m) return NULL;
+    if(bucket_num == 0)
+        bucket_num = 16;
+    m->buckets = (comp_map_node_t**) calloc(bucket_num, sizeof(comp_map_node_t*));
+    if(!m->buckets)
+    {
+        free(m);
+        return NULL;
+    }
+    m->size = 0;
+    m->bucket_num = bucket_num;
+    return m;
+}
+
+void comp_map_free(comp_map_t* m, comp_map_free_f free_value)
+{
+    if(!m) return;
+    for(size_t i = 0; i < m->bucket_num; i++)
+    {
+        comp_map_node_t* node = m->buckets[i];
+        while(node)
+        {
+            comp_map_node_t* next = node->next;
+            if(free_value)
+                free_value(node->value);
+            comp_str_free(node->key);
+            free(node);
+            node = next;
+        }
+    }
+    free(m->buckets);
+    free(m);
+}
+
+/* 元素个数超过桶数时扩容为两倍，重新分配所有节点 */
+static void map_rehash(comp_map_t* m)
+{
+    size_t new_num = m->bucket_num * 2;
+    comp_map_node_t** new_buckets = (comp_map_node_t**) calloc(new_num, sizeof(comp_map_node_t*));
+    if(!new_buckets)
+        return;
+    for(size_t i = 0; i < m->bucket_num; i++)
+    {
+        comp_map_node_t* node = m->buckets[i];
+        while(node)
+        {
+            comp_map_node_t* next = node->next;
+            size_t idx = comp_hash_str(node->key) % new_num;
+            node->next = new_buckets[idx];
+            new_buckets[idx] = node;
+            node = next;
+        }
+    }
+    free(m->buckets);
+    m->buckets = new_buckets;
+    m->bucket_num = new_num;
+}
+
+/* 插入或覆盖，返回0表示新插入，1表示覆盖了已有的key，-1表示失败 */
+int comp_map_put(comp_map_t* m, const char* key, void* value)
+{
+    size_t idx = comp_hash_str(key) % m->bucket_num;
+    for(comp_map_node_t* node = m->buckets[idx]; node; node = node->next)
+        if(!strcmp(node->key, key))
+        {
+            node->value = value;
+            return 1;
+        }
+    comp_map_node_t* node = (comp_map_node_t*) malloc(sizeof(comp_map_node_t));
+    if(!node) return -1;
+    node->key = comp_str_new(key);
+    node->value = value;
+    node->next = m->buckets[idx];
+    m->buckets[idx] = node;
+    if(++m->size > m->bucket_num)
+        map_rehash(m);
+    return 0;
+}
+
+void* comp_map_get(comp_map_t* m, const char* key)
+{
+    size_t idx = comp_hash_str(key) % m->bucket_num;
+    for(comp_map_node_t* node = m->buckets[idx]; node; node = node->next)
+        if(!strcmp(node->key, key))
+            return node->value;
+    return NULL;
+}
+
+/* 删除key，返回其value，由调用者释放 */
+void* comp_map_remove(comp_map_t* m, const char* key)
+{
+    size_t idx = comp_hash_str(key) % m->bucket_num;
+    comp_map_node_t** link = &m->buckets[idx];
+    while(*link)
+    {
+        comp_map_node_t* node = *link;
+        if(!strcmp(node->key, key))
+        {
+            void* value = node->value;
+            *link = node->next;
+            comp_str_free(node->key);
+            free(node);
+            m->size--;
+            return value;
+        }
+        link = &node->next;
+    }
+    return NULL;
+}
+
+size_t comp_map_size(comp_map_t* m)
+{
+    return m->size;
+}
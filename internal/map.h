@@ -0,0 +1,36 @@
+//
+// Created by zr on 23-2-6.
+// 以字符串为key的哈希表(拉链法)
+//
+#ifndef COMPRESS_MAP_H
+#define COMPRESS_MAP_H
+#include <stddef.h>
+#include "str.h"
+
+struct comp_map_node_s
+{
+    comp_str_t key;
+    void* value;
+    struct comp_map_node_s* next;
+};
+
+typedef struct comp_map_node_s comp_map_node_t;
+typedef void (*comp_map_free_f) (void*);
+
+struct comp_map_s
+{
+    size_t size;
+    size_t bucket_num;
+    comp_map_node_t** buckets;
+};
+
+typedef struct comp_map_s comp_map_t;
+
+comp_map_t* comp_map_init(size_t);
+void comp_map_free(comp_map_t*, comp_map_free_f);
+int comp_map_put(comp_map_t*, const char*, void*);
+void* comp_map_get(comp_map_t*, const char*);
+void* comp_map_remove(comp_map_t*, const char*);
+size_t comp_map_size(comp_map_t*);
+
+#endif //COMPRESS_MAP_H
@@ -0,0 +1,390 @@
+//
+// Created by zr on 23-2-12.
+//
+#define _GNU_SOURCE
+#include "pipe.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#define PIPE_DIRECT_IO_ALIGN 4096
+
+int comp_spsc_queue_init(comp_spsc_queue_t* q, size_t cap)
+{
+    //多留一个空位区分队满和队空
+    q->cap = cap + 1;
+    q->slots = (comp_pipe_block_t**) malloc(sizeof(comp_pipe_block_t*) * q->cap);
+    if(!q->slots) return -1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->waiting, 0);
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    return 0;
+}
+
+void comp_spsc_queue_destroy(comp_spsc_queue_t* q)
+{
+    if(!q->slots) return;
+    free(q->slots);
+    q->slots = NULL;
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->cond);
+}
+
+/* 位置更新之后检查有没有休眠的线程。位置的写入和 waiting 的读取都是顺序一致的，
+ * 与 spsc_queue_sleep 中 waiting 的写入和位置的读取配对：要么这里看到 waiting，要么对方看到新位置 */
+static void spsc_queue_wake(comp_spsc_queue_t* q)
+{
+    if(atomic_load(&q->waiting) == 0)
+        return;
+    pthread_mutex_lock(&q->lock);
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* 只能由生产者线程调用，队满返回-1 */
+int comp_spsc_queue_push(comp_spsc_queue_t* q, comp_pipe_block_t* block)
+{
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    size_t next = (tail + 1) % q->cap;
+    if(next == atomic_load_explicit(&q->head, memory_order_acquire))
+        return -1;
+    q->slots[tail] = block;
+    atomic_store(&q->tail, next);
+    spsc_queue_wake(q);
+    return 0;
+}
+
+/* 只能由消费者线程调用，队空返回NULL */
+comp_pipe_block_t* comp_spsc_queue_pop(comp_spsc_queue_t* q)
+{
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if(head == atomic_load_explicit(&q->tail, memory_order_acquire))
+        return NULL;
+    comp_pipe_block_t* block = q->slots[head];
+    atomic_store(&q->head, (head + 1) % q->cap);
+    spsc_queue_wake(q);
+    return block;
+}
+
+/* 休眠直到队列不再是满的(full为1)或空的(full为0)。加锁后重新检查，
+ * 对方的唤醒要先拿到锁，不会落在检查和 pthread_cond_wait 之间 */
+static void spsc_queue_sleep(comp_spsc_queue_t* q, int full)
+{
+    pthread_mutex_lock(&q->lock);
+    atomic_fetch_add(&q->waiting, 1);
+    while(1)
+    {
+        size_t head = atomic_load(&q->head);
+        size_t tail = atomic_load(&q->tail);
+        if(full ? (tail + 1) % q->cap != head : head != tail)
+            break;
+        pthread_cond_wait(&q->cond, &q->lock);
+    }
+    atomic_fetch_sub(&q->waiting, 1);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* 入队，队满时先短暂重试，之后休眠等待消费者取走数据块，不占用CPU */
+void comp_spsc_queue_push_wait(comp_spsc_queue_t* q, comp_pipe_block_t* block)
+{
+    for(int spin = 0; comp_spsc_queue_push(q, block) < 0; spin++)
+        if(spin >= COMP_SPSC_SPIN)
+            spsc_queue_sleep(q, 1);
+}
+
+/* 出队，队空时先短暂重试，之后休眠等待生产者放入数据块 */
+comp_pipe_block_t* comp_spsc_queue_pop_wait(comp_spsc_queue_t* q)
+{
+    comp_pipe_block_t* block;
+    for(int spin = 0; (block = comp_spsc_queue_pop(q)) == NULL; spin++)
+        if(spin >= COMP_SPSC_SPIN)
+            spsc_queue_sleep(q, 0);
+    return block;
+}
+
+/* filled 队列把装好数据的块从生产者交给消费者，free 队列把用完的块还给生产者。
+ * 读模式下IO线程是生产者，写模式下IO线程是消费者 */
+struct comp_pipe_s
+{
+    int fd;
+    int writing;
+    int seekable; // 管道等不可seek的fd使用read/write
+    int direct; // fd以O_DIRECT打开，写入的地址、偏移和长度都必须对齐
+    comp_pipe_block_t blocks[COMP_PIPE_BLOCK_NUM];
+    comp_spsc_queue_t filled;
+    comp_spsc_queue_t free;
+    comp_pipe_block_t* cur; // 调用线程正在读/写的块
+    size_t cur_pos; // cur 中已读/写的字节数
+    off_t pos; // 调用线程看到的文件位置
+    off_t io_offset; // 读模式下IO线程的起始读取位置
+    atomic_int abort; // 读模式下要求IO线程停止
+    atomic_int error;
+    pthread_t thread;
+    int running;
+};
+
+typedef struct comp_pipe_s comp_pipe_t;
+
+static void* pipe_reader(void* arg)
+{
+    comp_pipe_t* p = arg;
+    off_t offset = p->io_offset;
+    while(1)
+    {
+        comp_pipe_block_t* block = comp_spsc_queue_pop_wait(&p->free);
+        ssize_t n = 0;
+        if(!atomic_load(&p->abort))
+        {
+            do
+                n = p->seekable ? pread(p->fd, block->data, COMP_PIPE_BLOCK_SIZE, offset)
+                                : read(p->fd, block->data, COMP_PIPE_BLOCK_SIZE);
+            while(n < 0 && errno == EINTR);
+        }
+        if(n < 0)
+            atomic_store(&p->error, 1);
+        block->offset = offset;
+        block->len = n > 0 ? (size_t) n : 0;
+        block->eof = n <= 0;
+        offset += block->len;
+        comp_spsc_queue_push_wait(&p->filled, block);
+        if(block->eof)
+            break;
+    }
+    return NULL;
+}
+
+static void* pipe_writer(void* arg)
+{
+    comp_pipe_t* p = arg;
+    while(1)
+    {
+        comp_pipe_block_t* block = comp_spsc_queue_pop_wait(&p->filled);
+        size_t done = 0;
+        //O_DIRECT下遇到不对齐的写(通常是文件末尾的最后一块)，之后改为普通写
+        if(p->direct && (block->offset % PIPE_DIRECT_IO_ALIGN || block->len % PIPE_DIRECT_IO_ALIGN))
+        {
+            fcntl(p->fd, F_SETFL, fcntl(p->fd, F_GETFL) & ~O_DIRECT);
+            p->direct = 0;
+        }
+        while(done < block->len && !atomic_load(&p->error))
+        {
+            ssize_t n = p->seekable ? pwrite(p->fd, block->data + done, block->len - done, block->offset + (off_t) done)
+                                    : write(p->fd, block->data + done, block->len - done);
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n <= 0)
+                atomic_store(&p->error, 1);
+            else
+                done += n;
+        }
+        int eof = block->eof;
+        comp_spsc_queue_push_wait(&p->free, block);
+        if(eof)
+            break;
+    }
+    return NULL;
+}
+
+static int pipe_start(comp_pipe_t* p)
+{
+    p->cur = NULL;
+    p->cur_pos = 0;
+    atomic_store(&p->abort, 0);
+    p->filled.head = p->filled.tail = 0;
+    p->free.head = p->free.tail = 0;
+    for(int i = 0; i < COMP_PIPE_BLOCK_NUM; i++)
+        comp_spsc_queue_push(&p->free, &p->blocks[i]);
+    if(pthread_create(&p->thread, NULL, p->writing ? pipe_writer : pipe_reader, p) != 0)
+        return -1;
+    p->running = 1;
+    return 0;
+}
+
+/* 读模式下停止IO线程：丢弃已读出的块直到遇到结束块 */
+static void pipe_reader_stop(comp_pipe_t* p)
+{
+    if(!p->running) return;
+    atomic_store(&p->abort, 1);
+    comp_pipe_block_t* block = p->cur;
+    while(!block || !block->eof)
+    {
+        if(block)
+            comp_spsc_queue_push_wait(&p->free, block);
+        block = comp_spsc_queue_pop_wait(&p->filled);
+    }
+    pthread_join(p->thread, NULL);
+    p->running = 0;
+    p->cur = NULL;
+}
+
+/* 写模式下把当前块交给IO线程 */
+static void pipe_writer_submit(comp_pipe_t* p, int eof)
+{
+    if(!p->cur)
+    {
+        if(!eof) return;
+        p->cur = comp_spsc_queue_pop_wait(&p->free);
+        p->cur_pos = 0;
+    }
+    p->cur->len = p->cur_pos;
+    p->cur->offset = p->pos - (off_t) p->cur_pos;
+    p->cur->eof = eof;
+    comp_spsc_queue_push_wait(&p->filled, p->cur);
+    p->cur = NULL;
+    p->cur_pos = 0;
+}
+
+static ssize_t pipe_cookie_read(void* cookie, char* buf, size_t size)
+{
+    comp_pipe_t* p = cookie;
+    size_t done = 0;
+    while(done < size)
+    {
+        if(!p->cur)
+        {
+            p->cur = comp_spsc_queue_pop_wait(&p->filled);
+            p->cur_pos = 0;
+        }
+        if(p->cur->eof)
+            break;
+        size_t n = p->cur->len - p->cur_pos;
+        if(n > size - done)
+            n = size - done;
+        memcpy(buf + done, p->cur->data + p->cur_pos, n);
+        done += n;
+        p->cur_pos += n;
+        if(p->cur_pos == p->cur->len)
+        {
+            comp_spsc_queue_push_wait(&p->free, p->cur);
+            p->cur = NULL;
+        }
+    }
+    p->pos += (off_t) done;
+    if(done == 0 && atomic_load(&p->error))
+        return -1;
+    return (ssize_t) done;
+}
+
+static ssize_t pipe_cookie_write(void* cookie, const char* buf, size_t size)
+{
+    comp_pipe_t* p = cookie;
+    if(atomic_load(&p->error))
+        return -1;
+    size_t done = 0;
+    while(done < size)
+    {
+        if(!p->cur)
+        {
+            p->cur = comp_spsc_queue_pop_wait(&p->free);
+            p->cur_pos = 0;
+        }
+        size_t n = COMP_PIPE_BLOCK_SIZE - p->cur_pos;
+        if(n > size - done)
+            n = size - done;
+        memcpy(p->cur->data + p->cur_pos, buf + done, n);
+        done += n;
+        p->cur_pos += n;
+        p->pos += (off_t) n;
+        if(p->cur_pos == COMP_PIPE_BLOCK_SIZE)
+            pipe_writer_submit(p, 0);
+    }
+    return (ssize_t) done;
+}
+
+static int pipe_cookie_seek(void* cookie, off64_t* offset, int whence)
+{
+    comp_pipe_t* p = cookie;
+    off_t target;
+    if(whence == SEEK_SET)
+        target = *offset;
+    else if(whence == SEEK_CUR)
+        target = p->pos + *offset;
+    else
+        return -1;
+    if(target < 0)
+        return -1;
+    if(target != p->pos)
+    {
+        if(!p->seekable)
+            return -1;
+        if(p->writing)
+            pipe_writer_submit(p, 0);
+        else
+        {
+            //读模式下seek(例如huffman编码的第二遍读取)需要从新位置重新启动IO线程
+            pipe_reader_stop(p);
+            p->io_offset = target;
+            if(pipe_start(p) < 0)
+                return -1;
+        }
+        p->pos = target;
+    }
+    *offset = p->pos;
+    return 0;
+}
+
+/* 停止IO线程并释放，不关闭fd */
+static int pipe_destroy(comp_pipe_t* p)
+{
+    if(p->running && p->writing)
+    {
+        pipe_writer_submit(p, 1);
+        pthread_join(p->thread, NULL);
+    }
+    else
+        pipe_reader_stop(p);
+    int err = atomic_load(&p->error) ? -1 : 0;
+    for(int i = 0; i < COMP_PIPE_BLOCK_NUM; i++)
+        free(p->blocks[i].data);
+    comp_spsc_queue_destroy(&p->filled);
+    comp_spsc_queue_destroy(&p->free);
+    free(p);
+    return err;
+}
+
+static int pipe_cookie_close(void* cookie)
+{
+    comp_pipe_t* p = cookie;
+    int fd = p->fd;
+    int err = pipe_destroy(p);
+    if(close(fd) != 0)
+        err = -1;
+    return err;
+}
+
+/* 以流水线方式打开fd，mode为"rb"或"wb"。成功后fd归返回的FILE*所有，fclose时关闭。
+ * 写模式下每次写出一整块，数据块按页对齐，fd可以带O_DIRECT */
+FILE* comp_pipe_fopen(int fd, const char* mode)
+{
+    if(fd < 0) return NULL;
+    comp_pipe_t* p = (comp_pipe_t*) calloc(1, sizeof(comp_pipe_t));
+    if(!p) return NULL;
+    p->fd = fd;
+    p->writing = mode[0] == 'w';
+    atomic_init(&p->abort, 0);
+    atomic_init(&p->error, 0);
+    off_t cur = lseek(fd, 0, SEEK_CUR);
+    p->seekable = cur >= 0;
+    int fl = fcntl(fd, F_GETFL);
+    p->direct = p->writing && fl >= 0 && (fl & O_DIRECT);
+    p->pos = p->io_offset = cur >= 0 ? cur : 0;
+    int ok = comp_spsc_queue_init(&p->filled, COMP_PIPE_BLOCK_NUM) == 0;
+    ok = comp_spsc_queue_init(&p->free, COMP_PIPE_BLOCK_NUM) == 0 && ok;
+    for(int i = 0; i < COMP_PIPE_BLOCK_NUM && ok; i++)
+        ok = posix_memalign((void**) &p->blocks[i].data, PIPE_DIRECT_IO_ALIGN, COMP_PIPE_BLOCK_SIZE) == 0;
+    if(!ok || pipe_start(p) < 0)
+    {
+        pipe_destroy(p);
+        return NULL;
+    }
+    cookie_io_functions_t io = {pipe_cookie_read, pipe_cookie_write, pipe_cookie_seek, pipe_cookie_close};
+    FILE* fp = fopencookie(p, mode, io);
+    if(!fp)
+        pipe_destroy(p);
+    return fp;
+}
@@ -0,0 +1,53 @@
+//
+// Created by zr on 23-2-12.
+// 流水线式的文件读写：读取/写出在单独的IO线程中进行，
+// 与调用线程之间用有界的无锁单生产者单消费者队列传递数据块(默认两块，即双缓冲)。
+// 对外表现为普通的 FILE*，编解码器无需任何改动
+//
+#ifndef COMPRESS_PIPE_H
+#define COMPRESS_PIPE_H
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define COMP_PIPE_BLOCK_SIZE (256 * 1024)
+#define COMP_PIPE_BLOCK_NUM 2
+#define COMP_SPSC_SPIN 64 // 队空/队满时先重试这么多次，仍然不行再休眠
+
+struct comp_pipe_block_s
+{
+    char* data;
+    size_t len;
+    off_t offset; // 数据块在文件中的偏移
+    int eof;
+};
+
+typedef struct comp_pipe_block_s comp_pipe_block_t;
+
+/* 无锁单生产者单消费者环形队列，存放数据块指针。
+ * 入队出队本身不加锁；等待的一方(队满时的生产者、队空时的消费者)在条件变量上休眠，
+ * 另一方只在 waiting 不为0时才加锁唤醒 */
+struct comp_spsc_queue_s
+{
+    size_t cap;
+    comp_pipe_block_t** slots;
+    atomic_size_t head; // 消费者位置
+    atomic_size_t tail; // 生产者位置
+    atomic_int waiting; // 正在休眠的线程数
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+typedef struct comp_spsc_queue_s comp_spsc_queue_t;
+
+int comp_spsc_queue_init(comp_spsc_queue_t*, size_t);
+void comp_spsc_queue_destroy(comp_spsc_queue_t*);
+int comp_spsc_queue_push(comp_spsc_queue_t*, comp_pipe_block_t*);
+comp_pipe_block_t* comp_spsc_queue_pop(comp_spsc_queue_t*);
+void comp_spsc_queue_push_wait(comp_spsc_queue_t*, comp_pipe_block_t*);
+comp_pipe_block_t* comp_spsc_queue_pop_wait(comp_spsc_queue_t*);
+
+FILE* comp_pipe_fopen(int, const char*);
+
+#endif //COMPRESS_PIPE_H
@@ -0,0 +1,96 @@
+//
+// Created by zr on 23-2-16.
+//
+#include "run.h"
+#include <string.h>
+#include <sys/types.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* p 开始的16字节是否都相同 */
+static inline int run_chunk_uniform(const u_char* p)
+{
+#ifdef __SSE2__
+    __m128i v = _mm_loadu_si128((const __m128i*) p);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char) p[0]))) == 0xFFFF;
+#else
+    u_int64_t w = 0x0101010101010101ULL * p[0], a, b;
+    memcpy(&a, p, 8);
+    memcpy(&b, p + 8, 8);
+    return a == w && b == w;
+#endif
+}
+
+/* 从 buf[0] 开始与 buf[0] 相同的字节数，不超过 n */
+size_t comp_run_length(const char* buf, size_t n)
+{
+    if(n == 0)
+        return 0;
+    const u_char* p = (const u_char*) buf;
+    size_t i = 0;
+#ifdef __SSE2__
+    __m128i b = _mm_set1_epi8((char) p[0]);
+    //每次比较64字节，只取一次掩码
+    for(; i + 64 <= n; i += 64)
+    {
+        __m128i e = _mm_and_si128(
+                _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + i)), b),
+                              _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + i + 16)), b)),
+                _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + i + 32)), b),
+                              _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + i + 48)), b)));
+        if(_mm_movemask_epi8(e) != 0xFFFF)
+            break;
+    }
+    for(; i + 16 <= n; i += 16)
+    {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (p + i)), b));
+        if(mask != 0xFFFF)
+            return i + __builtin_ctz(~mask);
+    }
+#else
+    u_int64_t w = 0x0101010101010101ULL * p[0], v;
+    for(; i + 8 <= n; i += 8)
+    {
+        memcpy(&v, p + i, 8);
+        if(v != w)
+            break;
+    }
+#endif
+    while(i < n && p[i] == p[0])
+        i++;
+    return i;
+}
+
+/* 在 buf 的前 n 字节中找第一个长度不小于 min(至少32)的重复段，返回它的开始位置，*run_len 为长度；
+ * 没有时返回 n，*run_len 为0。
+ * 每隔16字节检查一组，长度不小于32的重复段一定完整覆盖某一组，找到相同的一组后再向两边扩展。
+ * 普通数据每16字节只需一次比较，速度接近内存带宽 */
+size_t comp_run_find(const char* buf, size_t n, size_t min, size_t* run_len)
+{
+    const u_char* p = (const u_char*) buf;
+    size_t i = 0;
+    *run_len = 0;
+    if(min < 32)
+        min = 32;
+    while(i + 16 <= n)
+    {
+        if(!run_chunk_uniform(p + i))
+        {
+            i += 16;
+            continue;
+        }
+        //前一组不全相同，或是以另一个字节结尾的短重复段，向前最多扩展15字节
+        size_t start = i;
+        while(start > 0 && i - start < 15 && p[start - 1] == p[i])
+            start--;
+        size_t end = i + comp_run_length(buf + i, n - i);
+        if(end - start >= min)
+        {
+            *run_len = end - start;
+            return start;
+        }
+        i = end;
+    }
+    return n;
+}
@@ -0,0 +1,14 @@
+//
+// Created by zr on 23-2-16.
+// 查找单字节重复段(全0的填充、稀疏区域等)，有SSE2时按16字节一组比较
+//
+#ifndef COMPRESS_RUN_H
+#define COMPRESS_RUN_H
+#include <stddef.h>
+
+#define COMP_RUN_MIN (4 * 1024) // 不短于该长度的重复段不经过编解码器，单独写为重复块
+
+size_t comp_run_length(const char*, size_t);
+size_t comp_run_find(const char*, size_t, size_t, size_t*);
+
+#endif //COMPRESS_RUN_H
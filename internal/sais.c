@@ -0,0 +1,150 @@
+//
+// Created by zr on 23-2-15.
+//
+#include "sais.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SAIS_L 0
+#define SAIS_S 1
+#define sais_is_lms(t, i) ((i) > 0 && (t)[i] == SAIS_S && (t)[(i) - 1] == SAIS_L)
+
+/* 每个字符的桶在sa中的起点(end为0)或终点(end为1) */
+static void sais_buckets(const int* s, int* bkt, int n, int k, int end)
+{
+    memset(bkt, 0, sizeof(int) * k);
+    for(int i = 0; i < n; i++)
+        bkt[s[i]]++;
+    int sum = 0;
+    for(int c = 0; c < k; c++)
+    {
+        sum += bkt[c];
+        bkt[c] = end ? sum : sum - bkt[c];
+    }
+}
+
+/* 由已排好序的LMS后缀诱导出L型和S型后缀的顺序 */
+static void sais_induce(const int* s, int* sa, const u_char* t, int* bkt, int n, int k)
+{
+    sais_buckets(s, bkt, n, k, 0);
+    for(int i = 0; i < n; i++)
+    {
+        int j = sa[i] - 1;
+        if(j >= 0 && t[j] == SAIS_L)
+            sa[bkt[s[j]]++] = j;
+    }
+    sais_buckets(s, bkt, n, k, 1);
+    for(int i = n - 1; i >= 0; i--)
+    {
+        int j = sa[i] - 1;
+        if(j >= 0 && t[j] == SAIS_S)
+            sa[--bkt[s[j]]] = j;
+    }
+}
+
+/* s 的字符取值 0 - k-1，最后一个字符必须是唯一的最小字符0。
+ * 先诱导排序LMS子串并命名，名字不唯一时对缩减后的串递归，最后由LMS后缀的顺序诱导出整个后缀数组 */
+static int sais_core(const int* s, int* sa, int n, int k)
+{
+    u_char* t = (u_char*) malloc(n);
+    int* bkt = (int*) malloc(sizeof(int) * k);
+    if(!t || !bkt)
+    {
+        free(t);
+        free(bkt);
+        return -1;
+    }
+    t[n - 1] = SAIS_S;
+    for(int i = n - 2; i >= 0; i--)
+        t[i] = (u_char) (s[i] < s[i + 1] || (s[i] == s[i + 1] && t[i + 1] == SAIS_S) ? SAIS_S : SAIS_L);
+    sais_buckets(s, bkt, n, k, 1);
+    for(int i = 0; i < n; i++)
+        sa[i] = -1;
+    for(int i = 1; i < n; i++)
+        if(sais_is_lms(t, i))
+            sa[--bkt[s[i]]] = i;
+    sais_induce(s, sa, t, bkt, n, k);
+    //排好序的LMS子串移到sa前部并命名，相邻两个LMS位置至少相差2，名字暂存在 sa[n1 + pos / 2]
+    int n1 = 0;
+    for(int i = 0; i < n; i++)
+        if(sais_is_lms(t, sa[i]))
+            sa[n1++] = sa[i];
+    for(int i = n1; i < n; i++)
+        sa[i] = -1;
+    int name = 0, prev = -1;
+    for(int i = 0; i < n1; i++)
+    {
+        int pos = sa[i], diff = 0;
+        for(int d = 0; d < n; d++)
+        {
+            if(prev < 0 || s[pos + d] != s[prev + d] || t[pos + d] != t[prev + d])
+            {
+                diff = 1;
+                break;
+            }
+            if(d > 0 && (sais_is_lms(t, pos + d) || sais_is_lms(t, prev + d)))
+                break;
+        }
+        if(diff)
+        {
+            name++;
+            prev = pos;
+        }
+        sa[n1 + pos / 2] = name - 1;
+    }
+    for(int i = n - 1, j = n - 1; i >= n1; i--)
+        if(sa[i] >= 0)
+            sa[j--] = sa[i];
+    //缩减后的串在sa末尾，它的后缀数组放在sa前部，n1 不超过 n / 2，两者不重叠
+    int* s1 = sa + n - n1;
+    if(name < n1)
+    {
+        if(sais_core(s1, sa, n1, name) < 0)
+        {
+            free(t);
+            free(bkt);
+            return -1;
+        }
+    }
+    else
+        for(int i = 0; i < n1; i++)
+            sa[s1[i]] = i;
+    for(int i = 1, j = 0; i < n; i++)
+        if(sais_is_lms(t, i))
+            s1[j++] = i;
+    for(int i = 0; i < n1; i++)
+        sa[i] = s1[sa[i]];
+    for(int i = n1; i < n; i++)
+        sa[i] = -1;
+    sais_buckets(s, bkt, n, k, 1);
+    for(int i = n1 - 1; i >= 0; i--)
+    {
+        int j = sa[i];
+        sa[i] = -1;
+        sa[--bkt[s[j]]] = j;
+    }
+    sais_induce(s, sa, t, bkt, n, k);
+    free(t);
+    free(bkt);
+    return 0;
+}
+
+/* 计算 text 的后缀数组，sa 至少 n + 1 项。结果中 sa[0] 为 n，即空后缀(可以看作比所有字符都小的结束符)，
+ * sa[1..n] 为 text 各后缀按字典序的起始位置 */
+int comp_sais(const u_char* text, int* sa, int n)
+{
+    if(n < 0) return -1;
+    if(n == 0)
+    {
+        sa[0] = 0;
+        return 0;
+    }
+    int* s = (int*) malloc(sizeof(int) * (n + 1));
+    if(!s) return -1;
+    for(int i = 0; i < n; i++)
+        s[i] = text[i] + 1;
+    s[n] = 0;
+    int err = sais_core(s, sa, n + 1, 257);
+    free(s);
+    return err;
+}
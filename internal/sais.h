@@ -0,0 +1,11 @@
+//
+// Created by zr on 23-2-15.
+// 线性时间的后缀数组构造(SA-IS)
+//
+#ifndef COMPRESS_SAIS_H
+#define COMPRESS_SAIS_H
+#include <sys/types.h>
+
+int comp_sais(const u_char*, int*, int);
+
+#endif //COMPRESS_SAIS_H
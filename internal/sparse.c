@@ -0,0 +1,70 @@
+//
+// Created by zr on 23-2-17.
+//
+#define _GNU_SOURCE
+#include "sparse.h"
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+static int sparse_add(comp_sparse_t* s, size_t* cap, u_int64_t start, u_int64_t end)
+{
+    if(s->num == *cap)
+    {
+        size_t new_cap = *cap ? *cap * 2 : 16;
+        comp_hole_t* holes = (comp_hole_t*) realloc(s->holes, new_cap * sizeof(comp_hole_t));
+        if(!holes)
+            return -1;
+        s->holes = holes;
+        *cap = new_cap;
+    }
+    s->holes[s->num].start = start;
+    s->holes[s->num].end = end;
+    s->num++;
+    return 0;
+}
+
+/* 找出fd前 size 字节中的空洞，完成后fd的位置回到开头。
+ * 没有空洞、出错时返回NULL，调用者按普通文件顺序读取即可。
+ * 文件系统不支持 SEEK_DATA/SEEK_HOLE 时整个文件都是数据，同样返回NULL */
+comp_sparse_t* comp_sparse_scan(int fd, u_int64_t size)
+{
+    comp_sparse_t* s = (comp_sparse_t*) calloc(1, sizeof(comp_sparse_t));
+    if(!s) return NULL;
+    size_t cap = 0;
+    u_int64_t pos = 0;
+    int err = 0;
+    while(pos < size && !err)
+    {
+        off_t data = lseek(fd, (off_t) pos, SEEK_DATA);
+        if(data < 0)
+        {
+            //ENXIO: pos 之后全是空洞
+            if(errno == ENXIO)
+                err = sparse_add(s, &cap, pos, size);
+            else err = -1;
+            break;
+        }
+        if((u_int64_t) data > size)
+            data = (off_t) size;
+        if((u_int64_t) data > pos)
+            err = sparse_add(s, &cap, pos, (u_int64_t) data);
+        off_t hole = lseek(fd, data, SEEK_HOLE);
+        if(hole < 0)
+            err = -1;
+        pos = (u_int64_t) hole;
+    }
+    if(lseek(fd, 0, SEEK_SET) != 0 || err || s->num == 0)
+    {
+        comp_sparse_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void comp_sparse_free(comp_sparse_t* s)
+{
+    if(!s) return;
+    free(s->holes);
+    free(s);
+}
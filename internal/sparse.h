@@ -0,0 +1,28 @@
+//
+// Created by zr on 23-2-17.
+// 用 SEEK_DATA/SEEK_HOLE 找出稀疏文件中的空洞
+//
+#ifndef COMPRESS_SPARSE_H
+#define COMPRESS_SPARSE_H
+#include <sys/types.h>
+
+struct comp_hole_s
+{
+    u_int64_t start;
+    u_int64_t end;
+};
+
+/* 文件中的空洞，按位置排列，互不相邻 */
+struct comp_sparse_s
+{
+    struct comp_hole_s* holes;
+    size_t num;
+};
+
+typedef struct comp_hole_s comp_hole_t;
+typedef struct comp_sparse_s comp_sparse_t;
+
+comp_sparse_t* comp_sparse_scan(int, u_int64_t);
+void comp_sparse_free(comp_sparse_t*);
+
+#endif //COMPRESS_SPARSE_H
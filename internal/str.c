@@ -116,6 +116,16 @@ void comp_str_clear(comp_str_t s)
     hdr->len = 0;
 }
 
+/* 截断到 len 个字符，不释放空间，用于反复在同一个前缀后追加 */
+void comp_str_truncate(comp_str_t s, size_t len)
+{
+    comp_ds_t* hdr = COMP_DS_HDR(s);
+    if(len >= hdr->len)
+        return;
+    memset(s + len, 0, hdr->len - len);
+    hdr->len = len;
+}
+
 comp_str_t comp_str_assign(comp_str_t s, const char* str)
 {
     comp_str_clear(s);
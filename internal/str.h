@@ -25,6 +25,7 @@ size_t comp_str_len(comp_str_t);
 comp_str_t comp_str_append_char(comp_str_t, char);
 comp_str_t comp_str_append_str(comp_str_t, const char*);
 void comp_str_clear(comp_str_t);
+void comp_str_truncate(comp_str_t, size_t);
 comp_str_t comp_str_assign(comp_str_t, const char*);
 void comp_str_free(comp_str_t);
 void comp_str_debug(comp_str_t);
@@ -2,6 +2,32 @@
 // Created by zr on 23-1-13.
 //
 #include "../bitstream.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define COPY_TEST_LEN 200000
+
+/* in 先读掉一个字节、再 peek 一个字节，然后复制 COPY_TEST_LEN 字节到 out(out 中已写了"X")，
+ * 复制后 in 再读一个字节、out 再写"Y"，确认两边的位置都正确 */
+static int copy_case(comp_bitstream_t* in, comp_bitstream_t* out, const char* data)
+{
+    char skip, peek, next;
+    comp_bitstream_write_char(out, 'X');
+    comp_bitstream_read_char(in, &skip);
+    int ok = comp_bitstream_peek_char(in, &peek) == 0 && peek == data[1];
+    ok = ok && comp_bitstream_copy(in, out, COPY_TEST_LEN) == 0;
+    ok = ok && comp_bitstream_read_char(in, &next) == 0 && next == data[1 + COPY_TEST_LEN];
+    comp_bitstream_write_char(out, 'Y');
+    return comp_bitstream_flush(out) == 0 && ok;
+}
+
+/* out 的内容应为 "X" + 复制的数据 + "Y" */
+static int copy_result(const char* buf, size_t len, const char* data)
+{
+    return len == COPY_TEST_LEN + 2 && buf[0] == 'X' && buf[COPY_TEST_LEN + 1] == 'Y' &&
+           !memcmp(buf + 1, data + 1, COPY_TEST_LEN);
+}
 
 int main() {
 //    FILE* fp = fopen("test", "rb+");
@@ -62,5 +88,37 @@ int main() {
     comp_bitstream_read_short(bs, &x);
     printf("%x", (u_int16_t)x);
 
-    return 0;
-}
\ No newline at end of file
+    
+    //comp_bitstream_copy：文件之间走内核复制，内存流退回fread/fwrite，两种情况下预读的字节都要先写出
+    char* data = (char*) malloc(COPY_TEST_LEN + 2);
+    for(size_t k = 0; k < COPY_TEST_LEN + 2; k++)
+        data[k] = (char) (k * 7 + k / 251);
+    FILE* src = fopen("test_copy_in", "wb+");
+    fwrite(data, 1, COPY_TEST_LEN + 2, src);
+    rewind(src);
+    FILE* dst = fopen("test_copy_out", "wb+");
+    comp_bitstream_t* in = comp_bitstream_init(src);
+    comp_bitstream_t* out = comp_bitstream_init(dst);
+    char* buf = (char*) malloc(COPY_TEST_LEN + 16);
+    int file_ok = copy_case(in, out, data);
+    file_ok = file_ok && copy_result(buf, pread(fileno(dst), buf, COPY_TEST_LEN + 16, 0), data);
+    comp_bitstream_destroy(in);
+    comp_bitstream_destroy(out);
+
+    char* mem = NULL;
+    size_t mem_len = 0;
+    in = comp_bitstream_init(fmemopen(data, COPY_TEST_LEN + 2, "rb"));
+    out = comp_bitstream_init(open_memstream(&mem, &mem_len));
+    int mem_ok = copy_case(in, out, data);
+    comp_bitstream_destroy(in);
+    comp_bitstream_destroy(out);
+    mem_ok = mem_ok && copy_result(mem, mem_len, data);
+    printf("\ncopy with a peeked byte: file -> file %s, memory -> memory %s\n",
+           file_ok ? "ok" : "FAIL", mem_ok ? "ok" : "FAIL");
+    free(mem);
+    free(buf);
+    free(data);
+    unlink("test_copy_in");
+    unlink("test_copy_out");
+    return file_ok && mem_ok ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+//
+// Created by zr on 23-2-13.
+//
+#include "../cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_DIR "/tmp/comp_cache_test"
+
+int main()
+{
+    char data[1000], key[32];
+    memset(data, 'x', sizeof(data));
+    system("rm -rf " TEST_DIR);
+    //上限 4500 字节，写入5项后淘汰到 4050 字节以下
+    comp_cache_t* cache = comp_cache_open(TEST_DIR, 4500);
+    for(int i = 0; i < 4; i++)
+    {
+        sprintf(key, "block_%d", i);
+        comp_cache_put(cache, key, data, sizeof(data));
+    }
+    size_t len;
+    char* v = comp_cache_get(cache, "block_0", &len);
+    if(v) printf("block_0 hit, len = %zu\n", len);
+    free(v);
+    comp_cache_put(cache, "block_4", data, sizeof(data));
+    printf("total = %llu, evictions = %zu\n", (unsigned long long) cache->total, cache->evictions);
+    comp_cache_close(cache);
+    //重新打开后缓存仍然有效，最近使用过的 block_0 没有被淘汰
+    cache = comp_cache_open(TEST_DIR, 4500);
+    for(int i = 0; i < 5; i++)
+    {
+        sprintf(key, "block_%d", i);
+        v = comp_cache_get(cache, key, &len);
+        printf("%s %s\n", key, v ? "hit" : "miss");
+        free(v);
+    }
+    printf("hits = %zu, misses = %zu\n", cache->hits, cache->misses);
+    comp_cache_close(cache);
+    return 0;
+}
@@ -0,0 +1,48 @@
+//
+// Created by zr on 23-2-12.
+//
+#include "../cdc.h"
+#include "../hash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_LEN (4 * 1024 * 1024)
+
+static size_t chunk(const char* buf, size_t len, u_int64_t* fps)
+{
+    size_t num = 0, pos = 0;
+    while(pos < len)
+    {
+        size_t cut = comp_cdc_cut(buf + pos, len - pos, 1);
+        fps[num++] = comp_hash_mul64(0, buf + pos, cut);
+        pos += cut;
+    }
+    return num;
+}
+
+int main()
+{
+    char* buf = (char*) malloc(TEST_LEN + 100);
+    srand(1);
+    for(size_t i = 0; i < TEST_LEN + 100; i++)
+        buf[i] = (char) rand();
+    u_int64_t* a = (u_int64_t*) malloc(sizeof(u_int64_t) * TEST_LEN / COMP_CDC_MIN_SIZE);
+    u_int64_t* b = (u_int64_t*) malloc(sizeof(u_int64_t) * TEST_LEN / COMP_CDC_MIN_SIZE);
+    size_t na = chunk(buf + 100, TEST_LEN, a);
+    //在开头插入100字节，只有前面的少数块会改变
+    size_t nb = chunk(buf, TEST_LEN + 100, b);
+    size_t same = 0;
+    for(size_t i = 0; i < na; i++)
+        for(size_t j = 0; j < nb; j++)
+            if(a[i] == b[j])
+            {
+                same++;
+                break;
+            }
+    printf("chunks = %zu, avg = %zu, shared after shift = %zu\n", na, TEST_LEN / na, same);
+    free(a);
+    free(b);
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,30 @@
+//
+// Created by zr on 23-2-10.
+//
+#include "../entropy.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main()
+{
+    size_t len = 1024 * 1024;
+    char* buf = (char*) malloc(len);
+    memset(buf, 0, len);
+    printf("zeros: %.3f\n", comp_entropy_sample(buf, len));
+    for(size_t i = 0; i < len; i++)
+        buf[i] = "hello world, "[i % 13];
+    printf("text: %.3f / %.3f\n", comp_entropy_sample(buf, len), comp_entropy(buf, len));
+    srand(1);
+    for(size_t i = 0; i < len; i++)
+        buf[i] = (char) rand();
+    printf("random: %.3f / %.3f, repeat %.3f\n", comp_entropy_sample(buf, len), comp_entropy(buf, len),
+           comp_repeat_ratio(buf, len));
+    //8KB随机数据重复128次：零阶熵仍接近8，重复的比例接近1
+    for(size_t i = 8192; i < len; i++)
+        buf[i] = buf[i - 8192];
+    printf("repeated random: %.3f, repeat %.3f\n", comp_entropy_sample(buf, len), comp_repeat_ratio(buf, len));
+    printf("short: %.3f\n", comp_entropy_sample("aabb", 4));
+    free(buf);
+    return 0;
+}
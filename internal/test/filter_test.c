@@ -0,0 +1,73 @@
+//
+// Created by zr on 23-2-15.
+//
+#include "../filter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_LEN (300 * 1024 + 7)
+
+/* 每次送入随机长度的数据，没有处理完的部分放到下次的开头，模拟分块读写 */
+static void run(comp_filter_t* f, char* buf, size_t len, int decode)
+{
+    size_t done = 0, avail = 0;
+    while(done < len)
+    {
+        avail += rand() % 20000;
+        if(avail > len - done)
+            avail = len - done;
+        int last = done + avail == len;
+        size_t n = decode ? comp_filter_decode(f, buf + done, avail, last)
+                          : comp_filter_encode(f, buf + done, avail, last);
+        done += n;
+        avail -= n;
+    }
+}
+
+static int check(int type, int param, const char* data, size_t len)
+{
+    char* once = (char*) malloc(len);
+    char* split = (char*) malloc(len);
+    memcpy(once, data, len);
+    memcpy(split, data, len);
+    comp_filter_t* f = comp_filter_init(type, param);
+    comp_filter_encode(f, once, len, 1);
+    comp_filter_free(f);
+    f = comp_filter_init(type, param);
+    run(f, split, len, 0);
+    comp_filter_free(f);
+    //分段编码的结果与一次编码相同
+    int ok = memcmp(once, split, len) == 0;
+    f = comp_filter_init(type, param);
+    run(f, split, len, 1);
+    comp_filter_free(f);
+    ok = ok && memcmp(split, data, len) == 0;
+    free(once);
+    free(split);
+    return ok;
+}
+
+int main()
+{
+    char* data = (char*) malloc(TEST_LEN);
+    srand(1);
+    //平滑变化的16位采样，夹杂call/jmp操作码
+    for(size_t i = 0; i < TEST_LEN; i++)
+        data[i] = (char) (i % 2 ? (i / 512) : rand() % 8 == 0 ? 0xE8 : rand());
+    int filters[][2] = {
+            {COMP_FILTER_NONE, 0}, {COMP_FILTER_DELTA, 1}, {COMP_FILTER_DELTA, 2}, {COMP_FILTER_DELTA, 255},
+            {COMP_FILTER_SHUFFLE, 2}, {COMP_FILTER_SHUFFLE, 3}, {COMP_FILTER_SHUFFLE, 255}, {COMP_FILTER_BCJ, 0}
+    };
+    for(size_t i = 0; i < sizeof(filters) / sizeof(filters[0]); i++)
+    {
+        int ok = check(filters[i][0], filters[i][1], data, TEST_LEN) && check(filters[i][0], filters[i][1], data, 3);
+        printf("%s:%d %s\n", comp_filter_name(filters[i][0]), filters[i][1], ok ? "ok" : "FAIL");
+    }
+    int type, param;
+    printf("parse: %d %d %d %d\n", comp_filter_parse("delta:4", &type, &param) == 0 && param == 4,
+           comp_filter_parse("shuffle", &type, &param) < 0, comp_filter_parse("bcj:1", &type, &param) < 0,
+           comp_filter_parse("auto", &type, &param) == 0 && type == COMP_FILTER_AUTO);
+    free(data);
+    return 0;
+}
@@ -0,0 +1,28 @@
+//
+// Created by zr on 23-2-6.
+//
+#include "../map.h"
+#include <stdio.h>
+
+int main()
+{
+    comp_map_t* m = comp_map_init(2);
+    int values[100];
+    char key[32];
+    for(int i = 0; i < 100; i++)
+    {
+        values[i] = i * i;
+        sprintf(key, "dir/file_%d", i);
+        comp_map_put(m, key, &values[i]);
+    }
+    printf("size = %zu, buckets = %zu\n", comp_map_size(m), m->bucket_num);
+    int* v = comp_map_get(m, "dir/file_42");
+    if(v) printf("found dir/file_42, value = %d\n", *v);
+    v = comp_map_remove(m, "dir/file_7");
+    if(v) printf("removed dir/file_7, value = %d\n", *v);
+    if(!comp_map_get(m, "dir/file_7")) printf("dir/file_7 not found\n");
+    if(!comp_map_get(m, "none")) printf("none not found\n");
+    printf("size = %zu\n", comp_map_size(m));
+    comp_map_free(m, NULL);
+    return 0;
+}
@@ -0,0 +1,70 @@
+//
+// Created by zr on 23-2-12.
+//
+#include "../pipe.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#define QUEUE_TEST_BLOCKS 5
+
+static double thread_cpu_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* 消费者每隔50ms取一块 */
+static void* slow_consumer(void* arg)
+{
+    comp_spsc_queue_t* q = arg;
+    for(int i = 0; i < QUEUE_TEST_BLOCKS; i++)
+    {
+        usleep(50000);
+        comp_spsc_queue_pop_wait(q);
+    }
+    return NULL;
+}
+
+int main()
+{
+    //写入3MB数据，中途seek回去改写开头，再读出来校验
+    FILE* out = comp_pipe_fopen(open("test_pipe", O_WRONLY | O_CREAT | O_TRUNC, 0644), "wb");
+    for(int i = 0; i < 3 * 1024 * 1024; i++)
+        fputc(i % 251, out);
+    long end = ftell(out);
+    fseek(out, 0, SEEK_SET);
+    fputc(0xFF, out);
+    fseek(out, end, SEEK_SET);
+    fclose(out);
+
+    FILE* in = comp_pipe_fopen(open("test_pipe", O_RDONLY), "rb");
+    int c, i = 0, bad = 0;
+    while((c = fgetc(in)) != EOF)
+    {
+        if(c != (i == 0 ? 0xFF : i % 251))
+            bad++;
+        i++;
+    }
+    printf("read %d bytes, %d mismatched\n", i, bad);
+    rewind(in);
+    printf("first byte after rewind = %x\n", fgetc(in));
+    fclose(in);
+    unlink("test_pipe");
+
+    //队满时生产者应该休眠而不是空转：等待约200ms，生产者线程消耗的CPU时间应该很少
+    comp_spsc_queue_t q;
+    comp_pipe_block_t block;
+    pthread_t consumer;
+    comp_spsc_queue_init(&q, 1);
+    pthread_create(&consumer, NULL, slow_consumer, &q);
+    double cpu = thread_cpu_ms();
+    for(int k = 0; k < QUEUE_TEST_BLOCKS; k++)
+        comp_spsc_queue_push_wait(&q, &block);
+    cpu = thread_cpu_ms() - cpu;
+    pthread_join(consumer, NULL);
+    comp_spsc_queue_destroy(&q);
+    printf("producer blocked on a full queue, used %.2f ms CPU, %s\n", cpu, cpu < 20 ? "ok" : "FAIL");
+    return cpu < 20 ? 0 : 1;
+}
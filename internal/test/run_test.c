@@ -0,0 +1,80 @@
+//
+// Created by zr on 23-2-16.
+//
+#include "../run.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TEST_LEN (64 * 1024 * 1024)
+
+/* 逐字节查找，作为对照 */
+static size_t naive_find(const char* p, size_t n, size_t min, size_t* run_len)
+{
+    for(size_t i = 0; i < n;)
+    {
+        size_t j = i + 1;
+        while(j < n && p[j] == p[i])
+            j++;
+        if(j - i >= min)
+        {
+            *run_len = j - i;
+            return i;
+        }
+        i = j;
+    }
+    *run_len = 0;
+    return n;
+}
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int main()
+{
+    char* buf = (char*) malloc(TEST_LEN);
+    srand(1);
+    int ok = 1;
+    //随机数据中插入长短不一的重复段，逐段比较查找结果
+    for(int round = 0; round < 200 && ok; round++)
+    {
+        size_t n = 1 + rand() % 100000;
+        for(size_t i = 0; i < n; i++)
+            buf[i] = (char) (rand() % 4);
+        for(int k = rand() % 6; k > 0; k--)
+        {
+            size_t start = rand() % n, len = rand() % 9000;
+            memset(buf + start, rand() % 2 ? 0 : rand(), start + len > n ? n - start : len);
+        }
+        size_t min = 32 + rand() % 5000;
+        for(size_t pos = 0; pos < n && ok;)
+        {
+            size_t a_len, b_len;
+            size_t a = comp_run_find(buf + pos, n - pos, min, &a_len);
+            size_t b = naive_find(buf + pos, n - pos, min, &b_len);
+            ok = a == b && a_len == b_len;
+            pos += a + a_len;
+        }
+    }
+    printf("find: %s\n", ok ? "ok" : "FAIL");
+
+    size_t run_len;
+    memset(buf, 0, TEST_LEN);
+    double t1 = now_ms();
+    size_t len = comp_run_length(buf, TEST_LEN);
+    double t2 = now_ms();
+    printf("zeros:  %zu bytes, %.0f MB/s\n", len, TEST_LEN / 1e3 / (t2 - t1));
+    for(size_t i = 0; i < TEST_LEN; i++)
+        buf[i] = (char) rand();
+    t1 = now_ms();
+    size_t pos = comp_run_find(buf, TEST_LEN, COMP_RUN_MIN, &run_len);
+    t2 = now_ms();
+    printf("random: run at %zu, %.0f MB/s\n", pos, TEST_LEN / 1e3 / (t2 - t1));
+    free(buf);
+    return 0;
+}
@@ -0,0 +1,68 @@
+//
+// Created by zr on 23-2-15.
+//
+#include "../sais.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const u_char* text;
+static int text_len;
+
+static int suffix_cmp(const void* a, const void* b)
+{
+    int i = *(const int*) a, j = *(const int*) b;
+    int li = text_len - i, lj = text_len - j;
+    int r = memcmp(text + i, text + j, li < lj ? li : lj);
+    return r ? r : li - lj;
+}
+
+/* 与直接排序的结果比较 */
+static int check(const u_char* buf, int n)
+{
+    int* sa = (int*) malloc(sizeof(int) * (n + 1));
+    int* naive = (int*) malloc(sizeof(int) * (n + 1));
+    int ok = comp_sais(buf, sa, n) == 0 && sa[0] == n;
+    text = buf;
+    text_len = n;
+    for(int i = 0; i < n; i++)
+        naive[i] = i;
+    qsort(naive, n, sizeof(int), suffix_cmp);
+    for(int i = 0; ok && i < n; i++)
+        ok = sa[i + 1] == naive[i];
+    free(sa);
+    free(naive);
+    return ok;
+}
+
+int main()
+{
+    u_char buf[5000];
+    int fail = 0, cases = 0;
+    srand(1);
+    for(int round = 0; round < 2000; round++)
+    {
+        int n = rand() % (round < 1000 ? 40 : 5000);
+        int alphabet = 1 + rand() % (round % 3 == 0 ? 2 : 256);
+        for(int i = 0; i < n; i++)
+            buf[i] = (u_char) (rand() % alphabet);
+        //一部分用重复的片段构造，递归层数更多
+        if(round % 4 == 1 && n > 8)
+            for(int i = n / 8; i < n; i++)
+                buf[i] = buf[i % (n / 8)];
+        cases++;
+        if(!check(buf, n))
+        {
+            fail++;
+            printf("mismatch: n = %d, alphabet = %d\n", n, alphabet);
+        }
+    }
+    memcpy(buf, "mississippi", 11);
+    cases++;
+    fail += !check(buf, 11);
+    memset(buf, 'a', sizeof(buf));
+    cases++;
+    fail += !check(buf, sizeof(buf));
+    printf("%d cases, %d failed\n", cases, fail);
+    return fail != 0;
+}
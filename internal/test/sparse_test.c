@@ -0,0 +1,48 @@
+//
+// Created by zr on 23-2-17.
+//
+#include "../sparse.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define MB (1024 * 1024)
+
+int main()
+{
+    char path[] = "/tmp/sparse_testXXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0)
+        return 1;
+    unlink(path);
+    //文件开头、中间是数据，中间和结尾是空洞
+    char data[4096];
+    memset(data, 'x', sizeof(data));
+    if(ftruncate(fd, 16 * MB) != 0 ||
+       pwrite(fd, data, sizeof(data), 0) != sizeof(data) ||
+       pwrite(fd, data, sizeof(data), 8 * MB) != sizeof(data))
+        return 1;
+    comp_sparse_t* s = comp_sparse_scan(fd, 16 * MB);
+    if(!s)
+    {
+        printf("no holes found (filesystem without SEEK_HOLE?)\n");
+        close(fd);
+        return 0;
+    }
+    u_int64_t hole_bytes = 0;
+    for(size_t i = 0; i < s->num; i++)
+    {
+        printf("hole %zu: [%llu, %llu)\n", i, (unsigned long long) s->holes[i].start,
+               (unsigned long long) s->holes[i].end);
+        hole_bytes += s->holes[i].end - s->holes[i].start;
+    }
+    int ok = s->num == 2 && s->holes[0].start >= 4096 && s->holes[0].end <= 8 * MB &&
+             s->holes[1].start >= 8 * MB + 4096 && s->holes[1].end == 16 * MB &&
+             lseek(fd, 0, SEEK_CUR) == 0;
+    printf("%s, %llu bytes in holes\n", ok ? "ok" : "FAIL", (unsigned long long) hole_bytes);
+    comp_sparse_free(s);
+    close(fd);
+    return ok ? 0 : 1;
+}
@@ -18,6 +18,9 @@ int main()
     str = comp_str_assign(str, "assign");
     comp_str_debug(str);
     printf("%zu\n", comp_str_len(str));
+    comp_str_truncate(str, 3);
+    str = comp_str_append_str(str, "-end");
+    comp_str_debug(str);
     comp_str_free(str);
 
     comp_str_t s = comp_str_parse_int(100, 16);
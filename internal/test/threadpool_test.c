@@ -0,0 +1,33 @@
+//
+// Created by zr on 23-2-10.
+//
+#include "../threadpool.h"
+#include <stdio.h>
+
+static comp_threadpool_t* pool;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static int sum = 0;
+
+/* 模拟文件夹展开：每个任务再提交两个深度+1的子任务 */
+static void task(void* arg)
+{
+    long depth = (long) arg;
+    pthread_mutex_lock(&lock);
+    sum++;
+    pthread_mutex_unlock(&lock);
+    if(depth < 10)
+    {
+        comp_threadpool_submit(pool, task, (void*) (depth + 1));
+        comp_threadpool_submit(pool, task, (void*) (depth + 1));
+    }
+}
+
+int main()
+{
+    pool = comp_threadpool_init(4);
+    comp_threadpool_submit(pool, task, (void*) 0);
+    comp_threadpool_wait(pool);
+    printf("tasks = %d (expect 2047)\n", sum);
+    comp_threadpool_destroy(pool);
+    return 0;
+}
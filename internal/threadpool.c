@@ -0,0 +1,120 @@
+//
+// Created by zr on 23-2-10.
+//
+#include "threadpool.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+static void* threadpool_worker(void* arg)
+{
+    comp_threadpool_t* pool = arg;
+    while(1)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while(!pool->head && !pool->shutdown)
+            pthread_cond_wait(&pool->task_cond, &pool->lock);
+        if(!pool->head)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        comp_task_t* task = pool->head;
+        pool->head = task->next;
+        if(!pool->head)
+            pool->tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+        task->fn(task->arg);
+        free(task);
+        pthread_mutex_lock(&pool->lock);
+        if(--pool->pending == 0)
+            pthread_cond_broadcast(&pool->idle_cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+comp_threadpool_t* comp_threadpool_init(size_t thread_num)
+{
+    comp_threadpool_t* pool = (comp_threadpool_t*) malloc(sizeof(comp_threadpool_t));
+    if(!pool) return NULL;
+    if(thread_num == 0)
+        thread_num = 1;
+    pool->threads = (pthread_t*) malloc(sizeof(pthread_t) * thread_num);
+    if(!pool->threads)
+    {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->task_cond, NULL);
+    pthread_cond_init(&pool->idle_cond, NULL);
+    pool->head = pool->tail = NULL;
+    pool->pending = 0;
+    pool->shutdown = 0;
+    pool->thread_num = 0;
+    for(size_t i = 0; i < thread_num; i++)
+    {
+        if(pthread_create(&pool->threads[i], NULL, threadpool_worker, pool) != 0)
+            break;
+        pool->thread_num++;
+    }
+    if(pool->thread_num == 0)
+    {
+        comp_threadpool_destroy(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+/* 提交任务，任务中可以继续提交新任务 */
+int comp_threadpool_submit(comp_threadpool_t* pool, comp_task_f fn, void* arg)
+{
+    comp_task_t* task = (comp_task_t*) malloc(sizeof(comp_task_t));
+    if(!task) return -1;
+    task->fn = fn;
+    task->arg = arg;
+    task->next = NULL;
+    pthread_mutex_lock(&pool->lock);
+    if(pool->tail)
+        pool->tail->next = task;
+    else
+        pool->head = task;
+    pool->tail = task;
+    pool->pending++;
+    pthread_cond_signal(&pool->task_cond);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+/* 等待所有已提交(包括任务执行中提交)的任务完成 */
+void comp_threadpool_wait(comp_threadpool_t* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while(pool->pending > 0)
+        pthread_cond_wait(&pool->idle_cond, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* 执行完队列中剩余的任务后关闭线程池 */
+void comp_threadpool_destroy(comp_threadpool_t* pool)
+{
+    if(!pool) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->task_cond);
+    pthread_mutex_unlock(&pool->lock);
+    for(size_t i = 0; i < pool->thread_num; i++)
+        pthread_join(pool->threads[i], NULL);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->task_cond);
+    pthread_cond_destroy(&pool->idle_cond);
+    free(pool->threads);
+    free(pool);
+}
+
+/* 默认线程数：CPU核数 */
+size_t comp_threadpool_default_size()
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (size_t) n : 1;
+}
@@ -0,0 +1,42 @@
+//
+// Created by zr on 23-2-10.
+// 简单的固定大小线程池
+//
+#ifndef COMPRESS_THREADPOOL_H
+#define COMPRESS_THREADPOOL_H
+#include <stddef.h>
+#include <pthread.h>
+
+typedef void (*comp_task_f) (void*);
+
+struct comp_task_s
+{
+    comp_task_f fn;
+    void* arg;
+    struct comp_task_s* next;
+};
+
+typedef struct comp_task_s comp_task_t;
+
+struct comp_threadpool_s
+{
+    pthread_t* threads;
+    size_t thread_num;
+    pthread_mutex_t lock;
+    pthread_cond_t task_cond; // 有新任务或线程池关闭
+    pthread_cond_t idle_cond; // 所有任务执行完毕
+    comp_task_t* head;
+    comp_task_t* tail;
+    size_t pending; // 排队中和执行中的任务数
+    int shutdown;
+};
+
+typedef struct comp_threadpool_s comp_threadpool_t;
+
+comp_threadpool_t* comp_threadpool_init(size_t);
+int comp_threadpool_submit(comp_threadpool_t*, comp_task_f, void*);
+void comp_threadpool_wait(comp_threadpool_t*);
+void comp_threadpool_destroy(comp_threadpool_t*);
+size_t comp_threadpool_default_size();
+
+#endif //COMPRESS_THREADPOOL_H
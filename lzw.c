@@ -13,21 +13,40 @@ static int encode(comp_lzw_ctx_t*, comp_bitstream_t*, comp_bitstream_t*);
 static int decode(comp_lzw_ctx_t*, comp_bitstream_t*, comp_bitstream_t*);
 static void lzw_ctx_cleanup(comp_lzw_ctx_t*);
 
-comp_lzw_ctx_t* comp_lzw_init(comp_progress_bar* bar)
+/* width 为压缩时的码宽，超出范围时使用默认码宽 */
+comp_lzw_ctx_t* comp_lzw_init(comp_progress_bar* bar, int width)
 {
     comp_lzw_ctx_t* lzw = (comp_lzw_ctx_t*) malloc(sizeof(comp_lzw_ctx_t));
     if(!lzw) return NULL;
     lzw->tire = NULL;
     lzw->bar = bar;
+    if(width < LZW_CODE_WIDTH_MIN || width > LZW_CODE_WIDTH_MAX)
+        width = LZW_CODE_WIDTH;
+    lzw->width = width;
+    lzw->dict_prefix = NULL;
+    lzw->dict_char = NULL;
+    lzw->dict_num = 0;
+    lzw->dict_str = NULL;
     lzw_ctx_cleanup(lzw);
     lzw->lzw_encode = encode;
     lzw->lzw_decode = decode;
     return lzw;
 }
 
+static void lzw_dict_str_free(comp_lzw_ctx_t* lzw)
+{
+    if(!lzw->dict_str)
+        return;
+    for(u_int32_t k = 0; k < lzw->dict_num; k++)
+        comp_str_free(lzw->dict_str[k]);
+    free(lzw->dict_str);
+    lzw->dict_str = NULL;
+}
+
 void comp_lzw_free(comp_lzw_ctx_t* lzw)
 {
     comp_tire_free(lzw->tire);
+    lzw_dict_str_free(lzw);
     free(lzw);
 }
 
@@ -35,6 +54,7 @@ static void lzw_ctx_cleanup(comp_lzw_ctx_t* lzw)
 {
     comp_tire_free(lzw->tire);
     lzw->tire = NULL;
+    lzw->tire_primed = 0;
     comp_str_t s = comp_str_empty();
     for (int i = 0; i < LZW_MAX_SYMBOL; i++)
     {
@@ -45,84 +65,211 @@ static void lzw_ctx_cleanup(comp_lzw_ctx_t* lzw)
     comp_str_free(s);
 }
 
+/* 设置共享字典中预置的串，num 为0时取消。prefix[k] 是第k个串去掉最后一个字节 chr[k] 后的编码，
+ * 小于256时是单个字节，否则是之前的某个预置串。数组由调用者保持有效 */
+void comp_lzw_set_dict(comp_lzw_ctx_t* lzw, const u_int16_t* prefix, const u_char* chr, u_int32_t num)
+{
+    lzw_dict_str_free(lzw);
+    lzw->dict_prefix = prefix;
+    lzw->dict_char = chr;
+    lzw->dict_num = num;
+    lzw_ctx_cleanup(lzw);
+}
+
+/* 码宽为 width 时使用的预置串个数，最多占一半的编码空间，其余的留给输入中新出现的串 */
+static u_int32_t lzw_dict_primed(comp_lzw_ctx_t* lzw, int width)
+{
+    u_int32_t max = ((1U << width) - LZW_MAX_SYMBOL - 1) / 2;
+    return lzw->dict_num < max ? lzw->dict_num : max;
+}
+
+/* 把前 primed 个预置串插入字典树 */
+static int lzw_dict_prime(comp_lzw_ctx_t* lzw, u_int32_t primed)
+{
+    if(primed == 0)
+        return 0;
+    comp_tire_t** nodes = (comp_tire_t**) malloc(primed * sizeof(comp_tire_t*));
+    if(!nodes)
+        return -1;
+    for(u_int32_t k = 0; k < primed; k++)
+    {
+        u_int16_t p = lzw->dict_prefix[k];
+        comp_tire_t* node = p < LZW_MAX_SYMBOL ? comp_tire_get_char(lzw->tire, (u_char) p)
+                                               : nodes[p - LZW_MAX_SYMBOL - 1];
+        node->mid = comp_tire_put_char(node->mid, lzw->dict_char[k], (TIRE_VALUE_TYPE) (LZW_MAX_SYMBOL + 1 + k));
+        nodes[k] = comp_tire_get_char(node->mid, lzw->dict_char[k]);
+    }
+    free(nodes);
+    return 0;
+}
+
+/* 展开所有预置串的内容 */
+static int lzw_dict_expand(comp_lzw_ctx_t* lzw)
+{
+    if(!(lzw->dict_str = (comp_str_t*) calloc(lzw->dict_num, sizeof(comp_str_t))))
+        return -1;
+    for(u_int32_t k = 0; k < lzw->dict_num; k++)
+    {
+        u_int16_t p = lzw->dict_prefix[k];
+        comp_str_t s;
+        if(p < LZW_MAX_SYMBOL)
+            s = comp_str_append_char(comp_str_empty(), (char) p);
+        else
+        {
+            comp_str_t prefix = lzw->dict_str[p - LZW_MAX_SYMBOL - 1];
+            s = comp_str_new_len(prefix, comp_str_len(prefix));
+        }
+        lzw->dict_str[k] = comp_str_append_char(s, (char) lzw->dict_char[k]);
+    }
+    return 0;
+}
+
+/* 头部为标识 0x4C，码宽不是默认的12位时为标识 0x57 加1字节码宽，
+ * 使用共享字典的预置串时为标识 0x6C 加1字节码宽。
+ * 字典树在各次编码之间保留，编码中新加入的串记下所在的位置，结束时按相反的顺序删除，
+ * 预置串只需插入一次 */
 int encode(comp_lzw_ctx_t* lzw, comp_bitstream_t* in_stream, comp_bitstream_t* out_stream)
 {
-    comp_bitstream_write_char(out_stream, LZW_HEADER_MARKER);
+    int width = lzw->width;
+    u_int32_t code_num = 1U << width;
+    u_int32_t primed = lzw_dict_primed(lzw, width);
+    if(lzw->tire_primed != primed)
+    {
+        lzw_ctx_cleanup(lzw);
+        if(lzw_dict_prime(lzw, primed) < 0)
+            return -1;
+        lzw->tire_primed = primed;
+    }
+    comp_tire_t*** added = (comp_tire_t***) malloc(code_num * sizeof(comp_tire_t**));
+    u_int32_t added_num = 0;
+    if(!added)
+        return -1;
+    if(primed > 0)
+    {
+        comp_bitstream_write_char(out_stream, LZW_DICT_HEADER_MARKER);
+        comp_bitstream_write_char(out_stream, (char) width);
+    }
+    else if(width == LZW_CODE_WIDTH)
+        comp_bitstream_write_char(out_stream, LZW_HEADER_MARKER);
+    else
+    {
+        comp_bitstream_write_char(out_stream, LZW_WIDTH_HEADER_MARKER);
+        comp_bitstream_write_char(out_stream, (char) width);
+    }
     char lookahead;
     comp_bitstream_read_char(in_stream, &lookahead);
     if(comp_bitstream_eof(in_stream))
         goto end;
     comp_bar_add(lzw->bar, 1);
-    comp_str_t lst_prefix = comp_str_empty();
-    lst_prefix = comp_str_append_char(lst_prefix, lookahead);
-    comp_tire_t* node, *root;
-    int flag = 0; int i = LZW_MAX_SYMBOL + 1;
+    //node 是当前已匹配的最长前缀，每读入一个字符只需在它的下一层查找
+    comp_tire_t* node = comp_tire_get_char(lzw->tire, (u_char) lookahead);
+    u_int32_t i = LZW_MAX_SYMBOL + 1 + primed;
     while(1)
     {
-        u_int16_t code;
-        root = lzw->tire;
-        while((node = comp_tire_get(root, lst_prefix)) != NULL)
+        comp_bitstream_read_char(in_stream, &lookahead);
+        if(comp_bitstream_eof(in_stream))
+        {
+            comp_bitstream_write_nbit(out_stream, node->value, width);
+            break;
+        }
+        comp_bar_add(lzw->bar, 1);
+        comp_tire_t* next = comp_tire_get_char(node->mid, (u_char) lookahead);
+        if(next)
+        {
+            node = next;
+            continue;
+        }
+        comp_bitstream_write_nbit(out_stream, node->value, width);
+        //前缀加上lookahead作为新的编码，lookahead不在下一层中，新节点总是叶子
+        if(i < code_num)
         {
-            comp_bitstream_read_char(in_stream, &lookahead);
-            comp_bar_add(lzw->bar, 1);
-            if(comp_bitstream_eof(in_stream))
-            {
-                flag = 1;
-                code = node->value;
-                break;
-            }
-            lst_prefix = comp_str_append_char(lst_prefix, lookahead);
-            code = node->value;
-            root = node;
+            comp_tire_t** slot = &node->mid;
+            while(*slot)
+                slot = (u_char) lookahead < (*slot)->c ? &(*slot)->left : &(*slot)->right;
+            *slot = comp_tire_put_char(NULL, (u_char) lookahead, i++);
+            added[added_num++] = slot;
         }
-        comp_bitstream_write_nbit(out_stream, code, LZW_CODE_WIDTH);
-        if(flag) break;
-        if(i < LZW_CODE_NUM)
-            comp_tire_put(lzw->tire, lst_prefix, i++);
-        comp_str_clear(lst_prefix);
-        comp_str_append_char(lst_prefix, lookahead);
+        node = comp_tire_get_char(lzw->tire, (u_char) lookahead);
     }
-    comp_str_free(lst_prefix);
 end:
-    comp_bitstream_write_nbit(out_stream, LZW_TERMINATE_CODE, LZW_CODE_WIDTH);
+    comp_bitstream_write_nbit(out_stream, LZW_TERMINATE_CODE, width);
     comp_bitstream_flush(out_stream);
-    lzw_ctx_cleanup(lzw);
+    while(added_num > 0)
+    {
+        comp_tire_t** slot = added[--added_num];
+        comp_tire_free(*slot);
+        *slot = NULL;
+    }
+    free(added);
     return 0;
 }
 
 int decode(comp_lzw_ctx_t* lzw, comp_bitstream_t* in_stream, comp_bitstream_t* out_stream)
 {
     char h; int i;
-    size_t remain = 0;
+    int width = LZW_CODE_WIDTH;
+    int err = 0;
     comp_bitstream_read_char(in_stream, &h);
-    if((u_char) h != LZW_HEADER_MARKER)
+    //使用字典的数据在没有字典时无法解码
+    if((u_char) h == LZW_DICT_HEADER_MARKER && !lzw->dict_num)
+        return -1;
+    if((u_char) h == LZW_WIDTH_HEADER_MARKER || (u_char) h == LZW_DICT_HEADER_MARKER)
+    {
+        char w;
+        comp_bitstream_read_char(in_stream, &w);
+        comp_bar_add(lzw->bar, 1);
+        width = w;
+        if(width < LZW_CODE_WIDTH_MIN || width > LZW_CODE_WIDTH_MAX)
+            return -1;
+    }
+    else if((u_char) h != LZW_HEADER_MARKER)
         return -1;
     comp_bar_add(lzw->bar, 1);
+    u_int32_t code_num = 1U << width;
+    u_int32_t primed = (u_char) h == LZW_DICT_HEADER_MARKER ? lzw_dict_primed(lzw, width) : 0;
+    if(primed > 0 && !lzw->dict_str && lzw_dict_expand(lzw) < 0)
+        return -1;
+    //bits 记录已读的位数，每读满一个字节计入进度，最后跳过字节对齐的填充
+    size_t bits = 0;
     int code;
-    comp_bitstream_read_nbit(in_stream, &code, LZW_CODE_WIDTH);
-    remain += LZW_CODE_WIDTH % 8;
-    comp_bar_add(lzw->bar, 1);
+    comp_bitstream_read_nbit(in_stream, &code, width);
+    bits += width;
+    comp_bar_add(lzw->bar, bits / 8);
     if((u_int32_t) code == LZW_TERMINATE_CODE)
         goto end;
-    comp_str_t code_tbl[LZW_CODE_NUM];
-    memset(code_tbl, 0, sizeof(comp_str_t) * LZW_CODE_NUM);
+    if(code < 0 || (u_int32_t) code >= LZW_MAX_SYMBOL + 1 + primed)
+        return -1;
+    comp_str_t* code_tbl = (comp_str_t*) calloc(code_num, sizeof(comp_str_t));
+    if(!code_tbl)
+        return -1;
     for (i = 0; i < LZW_MAX_SYMBOL; i++)
     {
         code_tbl[i] = comp_str_empty();
-        comp_str_append_char(code_tbl[i], (char) i);
+        code_tbl[i] = comp_str_append_char(code_tbl[i], (char) i);
     }
     i++;
+    //预置串与之后的解码共用，不复制
+    for(u_int32_t k = 0; k < primed; k++, i++)
+        code_tbl[i] = lzw->dict_str[k];
     comp_str_t val = code_tbl[code];
     while(1)
     {
         comp_bitstream_write(out_stream, val, comp_str_len(val));
-        comp_bitstream_read_nbit(in_stream, &code, LZW_CODE_WIDTH);
-        comp_bar_add(lzw->bar, 1);
-        remain += LZW_CODE_WIDTH % 8;
-        if(remain % 8 == 0)
-            comp_bar_add(lzw->bar, 1);
+        if(comp_bitstream_read_nbit(in_stream, &code, width) < 0)
+        {
+            err = -1;
+            break;
+        }
+        comp_bar_add(lzw->bar, (bits + width) / 8 - bits / 8);
+        bits += width;
         if((u_int32_t) code == LZW_TERMINATE_CODE)
             break;
+        //损坏的数据可能引用还没有建立的编码
+        if(code < 0 || (u_int32_t) code >= code_num || (code != i && !code_tbl[code]))
+        {
+            err = -1;
+            break;
+        }
         comp_str_t s = code_tbl[code];
         if(i == code)
         {
@@ -134,18 +281,25 @@ int decode(comp_lzw_ctx_t* lzw, comp_bitstream_t* in_stream, comp_bitstream_t* o
             i++;
             continue;
         }
-        if(i < LZW_CODE_NUM)
+        if(i < code_num)
         {
             code_tbl[i] = comp_str_new_len(val, comp_str_len(val));
-            comp_str_append_char(code_tbl[i++], comp_str_at(s, 0));
+            code_tbl[i] = comp_str_append_char(code_tbl[i], comp_str_at(s, 0));
+            i++;
         }
         val = s;
     }
+    for(u_int32_t j = 0; j < code_num; j++)
+        if(j <= LZW_MAX_SYMBOL || j > LZW_MAX_SYMBOL + primed)
+            comp_str_free(code_tbl[j]);
+    free(code_tbl);
+    if(err < 0)
+        return -1;
 end:
-    remain = remain % 8;
-    assert(remain == 0 || remain == 4);
-    comp_bitstream_read_nbit(in_stream, NULL, remain);
-    if(remain == 4)
+    if(bits % 8)
+    {
+        comp_bitstream_read_nbit(in_stream, NULL, 8 - bits % 8);
         comp_bar_add(lzw->bar, 1);
+    }
     return 0;
-}
\ No newline at end of file
+}
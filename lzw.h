@@ -8,9 +8,11 @@
 #include "bar.h"
 
 #define LZW_MAX_SYMBOL 256
-#define LZW_CODE_WIDTH 12
-#define LZW_CODE_NUM (1 << LZW_CODE_WIDTH)
+#define LZW_CODE_WIDTH 12 // 默认码宽，使用该码宽时头部与旧格式相同
+#define LZW_CODE_WIDTH_MIN 9
+#define LZW_CODE_WIDTH_MAX 16
 #define LZW_TERMINATE_CODE 256
+#define LZW_DICT_MAX (((1U << LZW_CODE_WIDTH_MAX) - LZW_MAX_SYMBOL - 1) / 2) // 字典中预置串的最大个数
 
 struct comp_lzw_ctx_s;
 typedef int (*comp_lzw_encode_f) (struct comp_lzw_ctx_s*, comp_bitstream_t*, comp_bitstream_t*);
@@ -18,7 +20,13 @@ typedef int (*comp_lzw_decode_f) (struct comp_lzw_ctx_s*, comp_bitstream_t*, com
 
 struct comp_lzw_ctx_s
 {
-    comp_tire_t* tire; // 三路字典树，压缩过程使用
+    comp_tire_t* tire; // 三路字典树，压缩过程使用，只含单字节的串和预置串
+    u_int32_t tire_primed; // 字典树中预置串的个数
+    int width; // 压缩时的码宽，字典大小为 1 << width
+    const u_int16_t* dict_prefix; // 共享字典中预置的串，第k个串的编码为 257 + k，由前缀的编码加一个字节组成
+    const u_char* dict_char;
+    u_int32_t dict_num;
+    comp_str_t* dict_str; // 预置串的内容，第一次解码时建立，之后各次解码共用
     comp_progress_bar* bar;
     comp_lzw_encode_f lzw_encode;
     comp_lzw_decode_f lzw_decode;
@@ -26,7 +34,8 @@ struct comp_lzw_ctx_s
 
 typedef struct comp_lzw_ctx_s comp_lzw_ctx_t;
 
-comp_lzw_ctx_t* comp_lzw_init(comp_progress_bar*);
+comp_lzw_ctx_t* comp_lzw_init(comp_progress_bar*, int);
 void comp_lzw_free(comp_lzw_ctx_t*);
+void comp_lzw_set_dict(comp_lzw_ctx_t*, const u_int16_t*, const u_char*, u_int32_t);
 
 #endif //COMPRESS_LZW_H
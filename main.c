@@ -1,58 +1,219 @@
 #include "comp.h"
 #include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 void usage()
 {
-    printf("Usage: compress [-c compress] [-d decompress] input_file [output_file]\n");
+    printf("Usage: compress [-HSD1-9] [-m codec] [-F filter] [-Z dict] [-w ns] [-e ns] [-t MB/s] [-T sec] [-C dir [-L MB]] -c input_file [output_file | -o output_file]\n"
+           "       compress [-SO] [-Z dict] -d input_file [-o output_dir]\n"
+           "       compress [-HSD1-9] [-m codec] [-F filter] [-Z dict] [-w ns] [-e ns] [-t MB/s] [-T sec] [-C dir [-L MB]] -u archive input_file [output_file | -o output_file]\n"
+           "       compress train dict sample_file_or_dir...\n"
+           "  -c  compress\n"
+           "  -d  decompress\n"
+           "  -u  update archive, only recompress new or modified files\n"
+           "  train  build a shared dictionary from samples, for archives of many small similar files\n"
+           "  -o  output file (directory when decompressing), '-' for stdout\n"
+           "  -H  store content hash of each file (update mode also compares it)\n"
+           "  -S  do file I/O on the calling thread instead of separate I/O threads\n"
+           "  -O  write large extracted files with O_DIRECT\n"
+           "  -D  split files into content-defined chunks and store repeated chunks once\n"
+           "  -C  cache directory for compressed blocks, reused by later runs on unchanged data\n"
+           "  -L  cache size limit in MB, least recently used blocks are evicted (default 1024)\n"
+           "  -m  codec: huffman, huffman1 (order-1 context), lzw, fse, bwt (block sorting),\n"
+           "      cm (context mixing, slow, for archival),\n"
+           "      auto (default, chosen per file by a trial on a sample)\n"
+           "      or max (every codec compresses each block in parallel, the smallest wins)\n"
+           "  -b  bwt block size in KB (16-1024, default 100 * level), capped by the level's block size\n"
+           "  -M  cm model memory in MB (default by level, 19-124), decompression needs the same\n"
+           "  -F  filter applied before the codec: delta:N (byte delta, N bytes apart), shuffle:N\n"
+           "      (transpose N-byte records), bcj (x86 call/jump addresses), none,\n"
+           "      or auto (default, chosen per file by a trial on a sample)\n"
+           "  -Z  shared dictionary made by train, huffman and lzw start from it; needed again to decompress\n"
+           "  -1..-9  compression level, faster to smaller (default 6)\n"
+           "  -t  target throughput in MB/s, falls back to cheaper coding or storing when behind\n"
+           "  -T  deadline in seconds for the whole input, same adaptation as -t\n"
+           "  -w  in max mode, decode time (ns/byte) that doubles a result's cost, 0 compares size only\n"
+           "  -e  in auto mode, encode time (ns/byte) that doubles a codec's cost (default 300), 0 compares size only\n"
+           "input_file '-' reads from stdin, e.g. tar c dir | compress -c - -o - | compress -d - -o - | tar x\n");
 }
 
-void default_output_filename(const char* input, char* output)
+/* 默认输出文件名：去掉扩展名后加上.tz，从标准输入读取时默认写到标准输出 */
+comp_str_t default_output_filename(const char* input)
 {
+    if(!strcmp(input, "-"))
+        return comp_str_new("-");
     const char* ptr = strrchr(input, '.');
-    size_t n = ptr ? ptr - input : strlen(input);
-    memcpy(output, input, n);
-    strcat(output, ".tz");
+    const char* slash = strrchr(input, '/');
+    if(ptr && slash && ptr < slash)
+        ptr = NULL;
+    size_t n = ptr ? (size_t) (ptr - input) : strlen(input);
+    comp_str_t output = comp_str_new_len(input, n);
+    return comp_str_append_str(output, ".tz");
 }
 
-int main(int argc, char* argv[]) {
-    //comp_compressor_t* c = comp_compressor_init(COMP_CODEC_HUFFMAN);
-    comp_compressor_t* c = comp_compressor_init(COMP_CODEC_LZW);
-    if(!c) return 0;
-    if(argc < 2)
+/* 从样本训练共享字典并保存到 dict_path */
+int train(const char* dict_path, char** samples, int n)
+{
+    comp_dict_t* dict = comp_dict_train(samples, n);
+    if(!dict)
     {
-        usage();
-        comp_compressor_free(c);
+        fprintf(stderr, "no samples to train from\n");
         return 0;
     }
-    if(!strcmp(argv[1], "-c"))
+    if(comp_dict_save(dict, dict_path) < 0)
+        fprintf(stderr, "%s: can't write dictionary\n", dict_path);
+    else
+        fprintf(stderr, "dictionary %08x: %u lzw strings, trained on %llu bytes in %zu files\n", dict->id,
+                dict->lzw_num, (unsigned long long) dict->sample_len, dict->sample_num);
+    comp_dict_free(dict);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    int mode = 0, store_hash = 0, pipeline = 1, direct_io = 0, dedup = 0, codec = COMP_CODEC_AUTO, opt;
+    int level = COMP_LEVEL_DEFAULT, filter = COMP_FILTER_AUTO, filter_param = 0;
+    const char* cache_dir = NULL;
+    double cache_limit_mb = 0, bwt_block_kb = 0, cm_memory_mb = 0;
+    double race_decode_ns = 0, codec_speed_ns = COMP_CODEC_SPEED_NS, pace_rate = 0, pace_deadline = 0;
+    const char* output = NULL;
+    const char* dict_path = NULL;
+    //训练字典是子命令，之后的参数与其他模式一样解析
+    if(argc > 1 && !strcmp(argv[1], "train"))
     {
-        if(argc < 3)
-        {
-            usage();
-            comp_compressor_free(c);
-            return 0;
-        }
-        if(argc == 3)
-        {
-            char output[100] = {0};
-            default_output_filename(argv[2], output);
-            c->compress(c, argv[2], output);
-        }
-        else
-            c->compress(c, argv[2], argv[3]);
+        mode = 'z';
+        optind = 2;
     }
-    else if(!strcmp(argv[1], "-d"))
+    while((opt = getopt(argc, argv, "cduHSODC:L:m:b:M:F:Z:w:e:t:T:o:123456789")) != -1)
     {
-        if(argc < 3)
+        switch (opt)
         {
-            usage();
-            comp_compressor_free(c);
-            return 0;
+            case 'c':
+            case 'd':
+            case 'u':
+                if(mode != 'z')
+                    mode = opt;
+                break;
+            case 'H':
+                store_hash = 1;
+                break;
+            case 'S':
+                pipeline = 0;
+                break;
+            case 'O':
+                direct_io = 1;
+                break;
+            case 'D':
+                dedup = 1;
+                break;
+            case 'C':
+                cache_dir = optarg;
+                break;
+            case 'L':
+                cache_limit_mb = atof(optarg);
+                break;
+            case 'm':
+                codec = comp_codec_lookup(optarg);
+                if(codec == COMP_CODEC_NUM)
+                {
+                    fprintf(stderr, "%s: unknown codec\n", optarg);
+                    return 0;
+                }
+                break;
+            case 'b':
+                bwt_block_kb = atof(optarg);
+                break;
+            case 'M':
+                cm_memory_mb = atof(optarg);
+                break;
+            case 'F':
+                if(comp_filter_parse(optarg, &filter, &filter_param) < 0)
+                {
+                    fprintf(stderr, "%s: unknown filter\n", optarg);
+                    return 0;
+                }
+                break;
+            case 'Z':
+                dict_path = optarg;
+                break;
+            case 'w':
+                race_decode_ns = atof(optarg);
+                break;
+            case 'e':
+                codec_speed_ns = atof(optarg);
+                break;
+            case 't':
+                pace_rate = atof(optarg);
+                break;
+            case 'T':
+                pace_deadline = atof(optarg);
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            case '1': case '2': case '3':
+            case '4': case '5': case '6':
+            case '7': case '8': case '9':
+                level = opt - '0';
+                break;
+            default:
+                usage();
+                return 0;
         }
-        c->decompress(c, argv[2]);
     }
-    else
+    int nargs = argc - optind;
+    char** args = argv + optind;
+    if(!mode || nargs < 1 || ((mode == 'u' || mode == 'z') && nargs < 2))
+    {
         usage();
+        return 0;
+    }
+    if(mode == 'z')
+        return train(args[0], args + 1, nargs - 1);
+    comp_dict_t* dict = NULL;
+    if(dict_path && !(dict = comp_dict_load(dict_path)))
+    {
+        fprintf(stderr, "%s: not a dictionary\n", dict_path);
+        return 0;
+    }
+    comp_compressor_t* c = comp_compressor_init((comp_codec_type) codec, level);
+    if(!c)
+    {
+        comp_dict_free(dict);
+        return 0;
+    }
+    if(dict)
+        comp_compressor_set_dict(c, dict);
+    c->store_hash = store_hash;
+    c->pipeline = pipeline;
+    c->direct_io = direct_io;
+    c->dedup = dedup;
+    c->cache_dir = cache_dir;
+    if(cache_limit_mb > 0)
+        c->cache_limit = (u_int64_t) (cache_limit_mb * 1024 * 1024);
+    if(bwt_block_kb > 0)
+        comp_compressor_set_bwt_block(c, (size_t) (bwt_block_kb * 1024));
+    if(cm_memory_mb > 0)
+        comp_compressor_set_cm_memory(c, (size_t) (cm_memory_mb * 1024 * 1024));
+    c->filter = filter;
+    c->filter_param = filter_param;
+    c->race_decode_ns = race_decode_ns;
+    c->codec_speed_ns = codec_speed_ns;
+    c->pace_rate = pace_rate;
+    c->pace_deadline = pace_deadline;
+    if(mode == 'c')
+    {
+        if(!output && nargs > 1)
+            output = args[1];
+        comp_str_t default_output = output ? NULL : default_output_filename(args[0]);
+        c->compress(c, args[0], output ? output : default_output);
+        comp_str_free(default_output);
+    }
+    else if(mode == 'd')
+        c->decompress(c, args[0], output);
+    else
+        c->update(c, args[0], args[1], output ? output : (nargs > 2 ? args[2] : NULL));
     comp_compressor_free(c);
+    comp_dict_free(dict);
     return 0;
 }
@@ -0,0 +1,324 @@
+//
+// Created by zr on 23-2-8.
+//
+#include "manifest.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define MANIFEST_MAX_THREADS 16
+
+struct manifest_scan_task_s
+{
+    comp_manifest_t* m;
+    comp_manifest_entry_t* dir_entry;
+};
+
+typedef struct manifest_scan_task_s manifest_scan_task_t;
+
+static comp_manifest_entry_t* manifest_entry_new(const char* name, comp_manifest_entry_t* parent, const struct stat* st)
+{
+    comp_manifest_entry_t* entry = (comp_manifest_entry_t*) malloc(sizeof(comp_manifest_entry_t));
+    if(!entry) return NULL;
+    entry->name = comp_str_new(name);
+    entry->parent = parent;
+    entry->fd = -1;
+    entry->is_dir = S_ISDIR(st->st_mode);
+    entry->ready = !entry->is_dir;
+    entry->size = entry->is_dir ? 0 : st->st_size;
+    entry->mtime = (u_int64_t) st->st_mtim.tv_sec * 1000000000ULL + st->st_mtim.tv_nsec;
+    entry->ino = st->st_ino;
+    entry->files = entry->is_dir ? comp_vec_init(16) : NULL;
+    entry->dirs = entry->is_dir ? comp_vec_init(4) : NULL;
+    return entry;
+}
+
+/* 释放整棵树，待释放的文件夹放在栈中，不递归 */
+static void manifest_entry_free(comp_manifest_entry_t* root)
+{
+    if(!root) return;
+    comp_vec_t* stack = comp_vec_init(16);
+    comp_vec_push_back(stack, root);
+    while(!comp_vec_empty(stack))
+    {
+        comp_manifest_entry_t* entry = comp_vec_pop_back(stack);
+        if(entry->is_dir)
+        {
+            for(size_t i = 0; i < comp_vec_len(entry->files); i++)
+                comp_vec_push_back(stack, comp_vec_get(entry->files, i));
+            for(size_t i = 0; i < comp_vec_len(entry->dirs); i++)
+                comp_vec_push_back(stack, comp_vec_get(entry->dirs, i));
+            comp_vec_free(entry->files);
+            comp_vec_free(entry->dirs);
+        }
+        //根目录的fd是 root_fd，由清单关闭
+        if(entry->parent && entry->fd >= 0)
+            close(entry->fd);
+        comp_str_free(entry->name);
+        free(entry);
+    }
+    comp_vec_free(stack);
+}
+
+/* 大文件排在前面，大小相同时按inode排列，减少磁头移动 */
+static int manifest_file_cmp(const void* a, const void* b)
+{
+    const comp_manifest_entry_t* e1 = a;
+    const comp_manifest_entry_t* e2 = b;
+    if(e1->size != e2->size)
+        return e1->size > e2->size;
+    return e1->ino < e2->ino;
+}
+
+static void manifest_scan_task(void* arg);
+
+static int manifest_submit_scan(comp_manifest_t* m, comp_manifest_entry_t* dir_entry)
+{
+    manifest_scan_task_t* task = (manifest_scan_task_t*) malloc(sizeof(manifest_scan_task_t));
+    if(!task) return -1;
+    task->m = m;
+    task->dir_entry = dir_entry;
+    if(comp_threadpool_submit(m->pool, manifest_scan_task, task) < 0)
+    {
+        free(task);
+        return -1;
+    }
+    return 0;
+}
+
+/* 打开文件夹，返回新的fd，由调用者关闭。通常父文件夹的fd还开着，只需解析一个名字；
+ * 父文件夹的fd因为超出上限没有保留时，从最近一个开着fd的上层文件夹逐级打开。
+ * 调用者保证这些上层文件夹在此期间不会离开(comp_manifest_leave) */
+static int manifest_dir_open(comp_manifest_t* m, comp_manifest_entry_t* dir_entry)
+{
+    if(!dir_entry->parent)
+        return openat(m->root_fd, ".", O_RDONLY | O_DIRECTORY);
+    //n 是需要逐级打开的文件夹数，第k级是 dir_entry 向上第 n-1-k 个文件夹
+    size_t n = 1;
+    comp_manifest_entry_t* p = dir_entry;
+    pthread_mutex_lock(&m->lock);
+    while(p->parent->parent && p->parent->fd < 0)
+    {
+        p = p->parent;
+        n++;
+    }
+    int fd = -1, base = p->parent->fd;
+    pthread_mutex_unlock(&m->lock);
+    while(n-- > 0 && base >= 0)
+    {
+        p = dir_entry;
+        for(size_t k = 0; k < n; k++)
+            p = p->parent;
+        int next = openat(base, p->name, O_RDONLY | O_DIRECTORY);
+        if(fd >= 0)
+            close(fd);
+        base = fd = next;
+    }
+    return fd;
+}
+
+/* 扫描一个文件夹。文件夹相对于父文件夹的fd打开，其中的条目都相对于文件夹fd解析。
+ * 保持打开的文件夹fd不超过 MANIFEST_MAX_DIR_FDS 个，子文件夹的扫描和压缩时打开文件都直接使用，
+ * 超出上限的文件夹扫描结束前关闭。
+ * 子文件夹不递归扫描，而是作为新任务提交给线程池，栈深度与文件夹深度无关 */
+static void manifest_scan_dir(comp_manifest_t* m, comp_manifest_entry_t* dir_entry)
+{
+    comp_vec_t* files = dir_entry->files;
+    comp_vec_t* dirs = dir_entry->dirs;
+    u_int64_t size = 0;
+    int dir_fd = atomic_load(&m->stop) ? -1 : manifest_dir_open(m, dir_entry);
+    //fdopendir 接管 dir_fd，保留的是它的副本。副本要在提交子文件夹之前设置好
+    if(dir_fd >= 0 && dir_entry->parent)
+    {
+        pthread_mutex_lock(&m->lock);
+        int keep = m->open_dirs < MANIFEST_MAX_DIR_FDS;
+        m->open_dirs += keep;
+        pthread_mutex_unlock(&m->lock);
+        int fd = keep ? dup(dir_fd) : -1;
+        if(keep)
+        {
+            pthread_mutex_lock(&m->lock);
+            dir_entry->fd = fd;
+            m->open_dirs -= fd < 0;
+            pthread_mutex_unlock(&m->lock);
+        }
+    }
+    DIR* dir = dir_fd < 0 ? NULL : fdopendir(dir_fd);
+    if(!dir && dir_fd >= 0)
+        close(dir_fd);
+    struct dirent* d;
+    struct stat st;
+    while(dir && (d = readdir(dir)) != NULL)
+    {
+        if(!strcmp(d->d_name, ".") || !strcmp(d->d_name, ".."))
+            continue;
+        if(d->d_type != DT_REG && d->d_type != DT_DIR && d->d_type != DT_UNKNOWN)
+            continue;
+        if(fstatat(dir_fd, d->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+            continue;
+        if(!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode))
+            continue;
+        comp_manifest_entry_t* entry = manifest_entry_new(d->d_name, dir_entry, &st);
+        if(!entry)
+            break;
+        if(entry->is_dir)
+            comp_vec_push_back(dirs, entry);
+        else
+        {
+            comp_vec_push_back(files, entry);
+            size += entry->size;
+        }
+    }
+    if(dir)
+        closedir(dir);
+    if(comp_vec_len(files) > 1)
+        comp_vec_sort(files, 0, (int) comp_vec_len(files) - 1, manifest_file_cmp);
+    //先提交子文件夹，再发布本文件夹，保证等待子文件夹的消费者最终能被唤醒
+    for(size_t i = 0; i < comp_vec_len(dirs); i++)
+    {
+        comp_manifest_entry_t* sub = comp_vec_get(dirs, i);
+        if(manifest_submit_scan(m, sub) < 0)
+            manifest_scan_dir(m, sub);
+    }
+    pthread_mutex_lock(&m->lock);
+    m->total_size += size;
+    m->file_num += comp_vec_len(files);
+    m->dir_num += comp_vec_len(dirs);
+    dir_entry->ready = 1;
+    pthread_cond_broadcast(&m->ready_cond);
+    pthread_mutex_unlock(&m->lock);
+}
+
+static void manifest_scan_task(void* arg)
+{
+    manifest_scan_task_t* task = arg;
+    manifest_scan_dir(task->m, task->dir_entry);
+    free(task);
+}
+
+/* 开始建立path文件夹的清单，函数返回时遍历仍在后台进行，
+ * 访问某个文件夹的内容前需要调用 comp_manifest_wait。
+ * 根节点的fd是 root_fd，名字是去掉结尾'/'后的basename。thread_num为0时使用默认线程数 */
+comp_manifest_t* comp_manifest_build(const char* path, size_t thread_num)
+{
+    comp_manifest_t* m = (comp_manifest_t*) malloc(sizeof(comp_manifest_t));
+    if(!m) return NULL;
+    m->total_size = 0;
+    m->file_num = m->dir_num = 0;
+    m->open_dirs = 0;
+    atomic_init(&m->stop, 0);
+    m->root = NULL;
+    m->pool = NULL;
+    pthread_mutex_init(&m->lock, NULL);
+    pthread_cond_init(&m->ready_cond, NULL);
+    m->root_fd = open(path, O_RDONLY | O_DIRECTORY);
+    struct stat st;
+    if(m->root_fd < 0 || fstat(m->root_fd, &st) != 0)
+    {
+        comp_manifest_free(m);
+        return NULL;
+    }
+    comp_str_t name = comp_str_new(path);
+    size_t len = comp_str_len(name);
+    while(len > 1 && name[len - 1] == '/')
+        name[--len] = 0;
+    const char* ptr = strrchr(name, '/');
+    m->root = manifest_entry_new(ptr && ptr[1] ? ptr + 1 : name, NULL, &st);
+    comp_str_free(name);
+    if(m->root)
+        m->root->fd = m->root_fd;
+    if(thread_num == 0)
+    {
+        //遍历主要是IO等待，线程数取CPU核数的两倍
+        thread_num = 2 * comp_threadpool_default_size();
+        if(thread_num > MANIFEST_MAX_THREADS)
+            thread_num = MANIFEST_MAX_THREADS;
+    }
+    if(m->root)
+        m->pool = comp_threadpool_init(thread_num);
+    if(!m->pool || manifest_submit_scan(m, m->root) < 0)
+    {
+        comp_manifest_free(m);
+        return NULL;
+    }
+    return m;
+}
+
+/* 等待文件夹扫描完成 */
+void comp_manifest_wait(comp_manifest_t* m, comp_manifest_entry_t* dir_entry)
+{
+    pthread_mutex_lock(&m->lock);
+    while(!dir_entry->ready)
+        pthread_cond_wait(&m->ready_cond, &m->lock);
+    pthread_mutex_unlock(&m->lock);
+}
+
+/* 等待整棵树遍历结束 */
+void comp_manifest_wait_all(comp_manifest_t* m)
+{
+    comp_threadpool_wait(m->pool);
+}
+
+u_int64_t comp_manifest_total_size(comp_manifest_t* m)
+{
+    pthread_mutex_lock(&m->lock);
+    u_int64_t sz = m->total_size;
+    pthread_mutex_unlock(&m->lock);
+    return sz;
+}
+
+/* 进入文件夹：等待它扫描完成，并确保它的fd是打开的，之后其中的文件用 comp_manifest_open 打开。
+ * 压缩时沿着一条路径进入文件夹，超出上限后在这里打开的fd数不超过文件夹深度 */
+int comp_manifest_enter(comp_manifest_t* m, comp_manifest_entry_t* dir_entry)
+{
+    comp_manifest_wait(m, dir_entry);
+    pthread_mutex_lock(&m->lock);
+    int fd = dir_entry->fd;
+    pthread_mutex_unlock(&m->lock);
+    if(fd >= 0)
+        return 0;
+    if((fd = manifest_dir_open(m, dir_entry)) < 0)
+        return -1;
+    pthread_mutex_lock(&m->lock);
+    dir_entry->fd = fd;
+    m->open_dirs++;
+    pthread_mutex_unlock(&m->lock);
+    return 0;
+}
+
+/* 文件夹中的文件和子文件夹都处理完后关闭它的fd，此时它的子文件夹都已扫描完成，不再需要这个fd */
+void comp_manifest_leave(comp_manifest_t* m, comp_manifest_entry_t* dir_entry)
+{
+    if(!dir_entry->parent)
+        return;
+    pthread_mutex_lock(&m->lock);
+    int fd = dir_entry->fd;
+    dir_entry->fd = -1;
+    m->open_dirs -= fd >= 0;
+    pthread_mutex_unlock(&m->lock);
+    if(fd >= 0)
+        close(fd);
+}
+
+/* 打开清单中的文件，返回文件描述符。文件所在的文件夹需要已经进入(comp_manifest_enter) */
+int comp_manifest_open(comp_manifest_entry_t* entry)
+{
+    return openat(entry->parent->fd, entry->name, O_RDONLY);
+}
+
+/* 停止遍历并释放清单，还没开始扫描的文件夹会被直接标记为完成 */
+void comp_manifest_free(comp_manifest_t* m)
+{
+    if(!m) return;
+    atomic_store(&m->stop, 1);
+    comp_threadpool_destroy(m->pool);
+    manifest_entry_free(m->root);
+    if(m->root_fd >= 0)
+        close(m->root_fd);
+    pthread_mutex_destroy(&m->lock);
+    pthread_cond_destroy(&m->ready_cond);
+    free(m);
+}
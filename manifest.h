@@ -0,0 +1,59 @@
+//
+// Created by zr on 23-2-8.
+// 文件清单：遍历待压缩的文件夹，记录所有文件和子文件夹的信息，
+// 统计总大小、安排压缩顺序以及压缩本身都复用这份清单。
+// 遍历在线程池中并发进行，每个文件夹扫描完成后即可被压缩，不必等待整棵树遍历结束
+//
+#ifndef COMPRESS_MANIFEST_H
+#define COMPRESS_MANIFEST_H
+#include <sys/types.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "internal/str.h"
+#include "internal/vector.h"
+#include "internal/threadpool.h"
+
+#define MANIFEST_MAX_DIR_FDS 64 // 扫描后保持打开的文件夹fd的上限
+
+struct comp_manifest_entry_s
+{
+    comp_str_t name; // 文件名
+    struct comp_manifest_entry_s* parent; // 所在的文件夹，根节点为NULL
+    int fd; // 文件夹的fd，其中的条目用 openat(fd, name) 打开。超出 MANIFEST_MAX_DIR_FDS 时为-1，用到时再打开
+    int is_dir;
+    int ready; // 文件夹是否已经扫描完成，完成后 files 和 dirs 不再改变
+    u_int64_t size;
+    u_int64_t mtime; // 纳秒
+    ino_t ino;
+    comp_vec_t* files; // 文件夹中的文件，按大小从大到小排列，只对文件夹有效
+    comp_vec_t* dirs; // 子文件夹，只对文件夹有效
+};
+
+typedef struct comp_manifest_entry_s comp_manifest_entry_t;
+
+struct comp_manifest_s
+{
+    int root_fd;
+    comp_manifest_entry_t* root;
+    u_int64_t total_size; // 目前已发现的所有普通文件的大小之和
+    size_t file_num;
+    size_t dir_num;
+    size_t open_dirs; // 保持打开的文件夹fd数，不含根目录
+    atomic_int stop; // 放弃遍历，由释放清单的线程设置，扫描线程读取
+    comp_threadpool_t* pool;
+    pthread_mutex_t lock;
+    pthread_cond_t ready_cond;
+};
+
+typedef struct comp_manifest_s comp_manifest_t;
+
+comp_manifest_t* comp_manifest_build(const char*, size_t);
+void comp_manifest_wait(comp_manifest_t*, comp_manifest_entry_t*);
+void comp_manifest_wait_all(comp_manifest_t*);
+int comp_manifest_enter(comp_manifest_t*, comp_manifest_entry_t*);
+void comp_manifest_leave(comp_manifest_t*, comp_manifest_entry_t*);
+u_int64_t comp_manifest_total_size(comp_manifest_t*);
+int comp_manifest_open(comp_manifest_entry_t*);
+void comp_manifest_free(comp_manifest_t*);
+
+#endif //COMPRESS_MANIFEST_H
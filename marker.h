@@ -8,9 +8,32 @@
 #define COMP_START_MARKER 0x5A52
 #define COMP_FILE_MARKER 0x46
 #define COMP_DIR_MARKER 0x44
+#define COMP_FILE_META_MARKER 0x4D
+#define COMP_DICT_MARKER 0x49
+#define COMP_DICT_FILE_MARKER 0x5A44
+#define COMP_HUFFMAN_TABLE_MARKER 0x74
+
+#define COMP_ENTRY_FLAG_HASH 0x01
+#define COMP_ENTRY_FLAG_BLOCKS 0x02
+#define COMP_ENTRY_FLAG_REFS 0x04
+#define COMP_ENTRY_FLAG_FILTER 0x08
+#define COMP_ENTRY_FLAG_SPARSE 0x10
+#define COMP_PAYLOAD_LEN_UNKNOWN 0xFFFFFFFFFFFFFFFFULL
+#define COMP_ENTRY_SIZE_UNKNOWN 0xFFFFFFFFFFFFFFFFULL
 
 #define NONE_COMPRESS_MARKER 0x4E
 #define HUFFMAN_HEADER_MARKER 0x48
 #define LZW_HEADER_MARKER 0x4C
+#define LZW_WIDTH_HEADER_MARKER 0x57
+#define COMP_CHUNK_REF_MARKER 0x52
+#define FSE_HEADER_MARKER 0x54
+#define HUFFMAN_O1_HEADER_MARKER 0x4F
+#define BWT_HEADER_MARKER 0x42
+#define CM_HEADER_MARKER 0x43
+#define COMP_RUN_MARKER 0x5A
+#define HUFFMAN_DICT_HEADER_MARKER 0x68
+#define LZW_DICT_HEADER_MARKER 0x6C
+#define HUFFMAN_TABLE_HEADER_MARKER 0x72
+#define HUFFMAN_COMPACT_HEADER_MARKER 0x63
 
 #endif //COMPRESS_MARKER_H
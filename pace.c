@@ -0,0 +1,61 @@
+//
+// Created by zr on 23-2-19.
+//
+#include "pace.h"
+#include <stdlib.h>
+
+/* rate_mb 为目标吞吐量(MB/s)，deadline_s 为截止时间(秒)，0表示不限 */
+comp_pace_t* comp_pace_init(double rate_mb, double deadline_s)
+{
+    comp_pace_t* pace = (comp_pace_t*) calloc(1, sizeof(comp_pace_t));
+    if(!pace) return NULL;
+    clock_gettime(CLOCK_MONOTONIC, &pace->start);
+    pace->rate = rate_mb * 1024 * 1024 / 1e9;
+    pace->deadline = deadline_s * 1e9;
+    pace->effort = COMP_EFFORT_NORMAL;
+    return pace;
+}
+
+/* 从开始到现在经过的纳秒数 */
+double comp_pace_elapsed(comp_pace_t* pace)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double) (now.tv_sec - pace->start.tv_sec) * 1e9 + (double) (now.tv_nsec - pace->start.tv_nsec);
+}
+
+/* 选择下一个 n 字节的块使用的档位。total 为输入总大小(未知时为0)，now 为已用的纳秒数，
+ * no_fast 非0时跳过快速档位(正常档位本来就是huffman时，快速档位没有意义) */
+int comp_pace_choose(comp_pace_t* pace, size_t n, u_int64_t total, double now, int no_fast)
+{
+    double budget = -1;
+    if(pace->rate > 0)
+        budget = (double) (pace->done + n) / pace->rate - now;
+    if(pace->deadline > 0)
+    {
+        //总大小未知(管道)或已超出时按这是最后一块计算
+        u_int64_t remain = total > pace->done + n ? total - pace->done : n;
+        double b = (pace->deadline - now) * (double) n / (double) remain;
+        if(budget < 0 || b < budget)
+            budget = b;
+    }
+    int e = pace->effort;
+    //没有测过的档位按不耗时计，这样降档后还能试着升回去
+    while(e < COMP_EFFORT_STORED && pace->cost[e] * (double) n > budget)
+        e++;
+    if(e == pace->effort && e > COMP_EFFORT_NORMAL && pace->cost[e - 1] * (double) n <= budget * 0.75)
+        e--;
+    if(e == COMP_EFFORT_FAST && no_fast)
+        e = pace->effort == COMP_EFFORT_STORED ? COMP_EFFORT_NORMAL : COMP_EFFORT_STORED;
+    pace->effort = e;
+    return e;
+}
+
+/* 以 effort 档位处理 n 字节耗时 ns 纳秒 */
+void comp_pace_update(comp_pace_t* pace, int effort, size_t n, double ns)
+{
+    double cost = ns / (double) n;
+    pace->cost[effort] = pace->cost[effort] == 0 ? cost : 0.7 * pace->cost[effort] + 0.3 * cost;
+    pace->done += n;
+    pace->blocks[effort]++;
+}
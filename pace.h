@@ -0,0 +1,33 @@
+//
+// Created by zr on 23-2-19.
+// 限时压缩：按目标吞吐量或截止时间调节每个块的压缩力度。
+// 档位从强到弱依次为 正常(按 -m 和级别的设置)、快速(huffman)、存储。
+// 每个块开始前根据已用时间算出这个块可用的时间，当前档位的预计耗时超出时降档，
+// 更强的档位预计耗时有富余时升档。每个档位的每字节耗时在压缩过程中实测，取指数平均
+//
+#ifndef COMPRESS_PACE_H
+#define COMPRESS_PACE_H
+#include <sys/types.h>
+#include <time.h>
+
+enum { COMP_EFFORT_NORMAL, COMP_EFFORT_FAST, COMP_EFFORT_STORED, COMP_EFFORT_NUM };
+
+struct comp_pace_s
+{
+    struct timespec start;
+    double rate;                    // 目标吞吐量，字节/纳秒，0表示不限
+    double deadline;                // 从开始算起的截止时间，纳秒，0表示不限
+    u_int64_t done;                 // 已处理的字节数
+    int effort;                     // 当前档位
+    double cost[COMP_EFFORT_NUM];   // 每个档位的每字节耗时(纳秒)，0表示还没有测过
+    size_t blocks[COMP_EFFORT_NUM]; // 每个档位压缩的块数
+};
+
+typedef struct comp_pace_s comp_pace_t;
+
+comp_pace_t* comp_pace_init(double, double);
+double comp_pace_elapsed(comp_pace_t*);
+int comp_pace_choose(comp_pace_t*, size_t, u_int64_t, double, int);
+void comp_pace_update(comp_pace_t*, int, size_t, double);
+
+#endif //COMPRESS_PACE_H
@@ -0,0 +1,89 @@
+//
+// Created by zr on 23-2-15.
+// BWT编解码的往返测试，并比较不同块大小和线程数：bwt_test [file]
+//
+#include "../bwt.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int roundtrip(comp_bwt_ctx_t* bwt, char* data, size_t len, const char* name)
+{
+    char* enc = NULL, * dec = NULL;
+    size_t enc_len = 0, dec_len = 0;
+    comp_bitstream_t* in = comp_bitstream_init(len ? fmemopen(data, len, "rb") : fopen("/dev/null", "rb"));
+    comp_bitstream_t* out = comp_bitstream_init(open_memstream(&enc, &enc_len));
+    double t1 = now_ms();
+    int err = bwt->bwt_encode(bwt, in, out);
+    comp_bitstream_destroy(in);
+    comp_bitstream_destroy(out);
+    double t2 = now_ms();
+    in = comp_bitstream_init(fmemopen(enc, enc_len, "rb"));
+    out = comp_bitstream_init(open_memstream(&dec, &dec_len));
+    if(err == 0)
+        err = bwt->bwt_decode(bwt, in, out);
+    comp_bitstream_destroy(in);
+    comp_bitstream_destroy(out);
+    double t3 = now_ms();
+    int ok = err == 0 && dec_len == len && !memcmp(dec, data, len);
+    printf("%-28s %zu -> %zu (%.3f), encode %.1f MB/s, decode %.1f MB/s, %s\n", name, len, enc_len,
+           len ? (double) enc_len / len : 0, len / 1e3 / (t2 - t1), len / 1e3 / (t3 - t2), ok ? "ok" : "FAIL");
+    free(enc);
+    free(dec);
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t len = 3 * 1024 * 1024 + 12345;
+    char* data;
+    if(argc > 1)
+    {
+        FILE* fp = fopen(argv[1], "rb");
+        if(!fp) return 1;
+        fseek(fp, 0, SEEK_END);
+        len = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        data = (char*) malloc(len);
+        if(fread(data, 1, len, fp) != len) return 1;
+        fclose(fp);
+    }
+    else
+    {
+        //没有指定文件时用重复较多的随机单词
+        data = (char*) malloc(len);
+        srand(1);
+        for(size_t i = 0; i < len; i++)
+            data[i] = (char) (rand() % 7 == 0 ? ' ' : 'a' + rand() % 3 + (i / 4096) % 5);
+    }
+    comp_progress_bar* bar = comp_bar_init("", 0);
+    comp_bwt_ctx_t* bwt = comp_bwt_init(bar, BWT_BLOCK_SIZE);
+    int ok = 1;
+    char name[64];
+    size_t sizes[] = {BWT_BLOCK_MIN, 100 * 1024, BWT_BLOCK_SIZE, BWT_BLOCK_MAX};
+    for(int t = 1; t <= 4; t *= 4)
+        for(int i = 0; i < 4; i++)
+        {
+            comp_bwt_set_block_size(bwt, sizes[i]);
+            bwt->threads = t;
+            snprintf(name, sizeof(name), "block %zuK, %d thread(s):", sizes[i] / 1024, t);
+            ok &= roundtrip(bwt, data, len, name);
+        }
+    //边界情况：空数据、单字节、全部相同
+    ok &= roundtrip(bwt, data, 0, "empty:");
+    ok &= roundtrip(bwt, data, 1, "one byte:");
+    memset(data, 'x', len);
+    ok &= roundtrip(bwt, data, len, "same byte:");
+    comp_bwt_free(bwt);
+    comp_bar_free(bar);
+    free(data);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+//
+// Created by zr on 23-2-16.
+// 上下文混合的往返测试和模型内存到表大小的换算，并比较它与其他编解码器的压缩率和速度：cm_test [file] [model memory MB]
+//
+#include "../cm.h"
+#include "../bwt.h"
+#include "../fse.h"
+#include "../huffman.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef int (*codec_f) (void*, comp_bitstream_t*, comp_bitstream_t*);
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int bench(const char* name, void* ctx, codec_f enc_f, codec_f dec_f, char* data, size_t len)
+{
+    char* enc = NULL, * dec = NULL;
+    size_t enc_len = 0, dec_len = 0;
+    comp_bitstream_t* in = comp_bitstream_init(len ? fmemopen(data, len, "rb") : fopen("/dev/null", "rb"));
+    comp_bitstream_t* out = comp_bitstream_init(open_memstream(&enc, &enc_len));
+    double t1 = now_ms();
+    int err = enc_f(ctx, in, out);
+    comp_bitstream_destroy(in);
+    comp_bitstream_destroy(out);
+    double t2 = now_ms();
+    in = comp_bitstream_init(fmemopen(enc, enc_len, "rb"));
+    out = comp_bitstream_init(open_memstream(&dec, &dec_len));
+    if(err == 0)
+        err = dec_f(ctx, in, out);
+    comp_bitstream_destroy(in);
+    comp_bitstream_destroy(out);
+    double t3 = now_ms();
+    int ok = err == 0 && dec_len == len && !memcmp(dec, data, len);
+    printf("%-11s %zu -> %zu (%.3f), encode %.2f MB/s, decode %.2f MB/s, %s\n", name, len, enc_len,
+           len ? (double) enc_len / len : 0, len / 1e3 / (t2 - t1), len / 1e3 / (t3 - t2), ok ? "ok" : "FAIL");
+    free(enc);
+    free(dec);
+    return ok;
+}
+
+/* -M 指定的模型内存换算成上下文表大小：不超过上限的最大值，超出范围时取边界 */
+static int check_table_bits()
+{
+    size_t fixed = ((size_t) 1 << CM_HISTORY_BITS) + (sizeof(u_int32_t) << CM_MATCH_BITS) +
+                   sizeof(u_int16_t) * CM_APM_SIZE;
+    int ok = comp_cm_table_bits(0) == CM_TABLE_BITS_MIN && comp_cm_table_bits((size_t) 1 << 40) == CM_TABLE_BITS_MAX;
+    for(int bits = CM_TABLE_BITS_MIN + 1; bits <= CM_TABLE_BITS_MAX; bits++)
+    {
+        size_t need = fixed + CM_ORDERS * (sizeof(u_int32_t) << bits);
+        ok &= comp_cm_table_bits(need) == bits && comp_cm_table_bits(need - 1) == bits - 1;
+    }
+    //README中各级别的模型内存：-M 124 差一点不够 1 << 22 项，-M 125 够
+    ok &= comp_cm_table_bits(19 * 1024 * 1024) == 17 && comp_cm_table_bits(20 * 1024 * 1024) == 18 &&
+          comp_cm_table_bits(124 * 1024 * 1024) == 21 && comp_cm_table_bits(125 * 1024 * 1024) == 22;
+    printf("model memory to table bits: %s\n", ok ? "ok" : "FAIL");
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    //比一帧多一些，最后一帧只有几个字节
+    size_t len = CM_FRAME_SIZE + 3;
+    char* data;
+    if(argc > 1)
+    {
+        FILE* fp = fopen(argv[1], "rb");
+        if(!fp) return 1;
+        fseek(fp, 0, SEEK_END);
+        len = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        data = (char*) malloc(len);
+        if(fread(data, 1, len, fp) != len) return 1;
+        fclose(fp);
+    }
+    else
+    {
+        //没有指定文件时用重复较多的随机单词
+        static const char* words[] = {"context ", "mixing ", "model ", "the ", "of ", "\n", "predict ", "bit "};
+        data = (char*) malloc(len);
+        srand(1);
+        for(size_t i = 0; i < len;)
+            for(const char* w = words[rand() % 8]; *w && i < len; w++)
+                data[i++] = *w;
+    }
+
+    comp_progress_bar* bar = comp_bar_init("", 0);
+    int ok = check_table_bits();
+    comp_cm_ctx_t* cm = comp_cm_init(bar, argc > 2 ? comp_cm_table_bits(atoi(argv[2]) * 1024 * 1024) : CM_TABLE_BITS);
+    ok &= bench(argc > 1 ? "cm:" : "cm frames:", cm, (codec_f) cm->cm_encode, (codec_f) cm->cm_decode, data, len);
+    //边界情况：空数据、单字节
+    ok &= bench("cm empty:", cm, (codec_f) cm->cm_encode, (codec_f) cm->cm_decode, data, 0);
+    ok &= bench("cm 1 byte:", cm, (codec_f) cm->cm_encode, (codec_f) cm->cm_decode, data, 1);
+    comp_cm_free(cm);
+    comp_bwt_ctx_t* bwt = comp_bwt_init(bar, BWT_BLOCK_SIZE);
+    ok &= bench("bwt:", bwt, (codec_f) bwt->bwt_encode, (codec_f) bwt->bwt_decode, data, len);
+    comp_bwt_free(bwt);
+    comp_huffman_ctx_t* huff = comp_huffman_init(bar, HUFFMAN_MAX_CODE_LEN, 1);
+    ok &= bench("huffman1:", huff, (codec_f) huff->huffman_encode, (codec_f) huff->huffman_decode, data, len);
+    comp_huffman_free(huff);
+    comp_fse_ctx_t* fse = comp_fse_init(bar, FSE_TABLE_LOG);
+    ok &= bench("fse:", fse, (codec_f) fse->fse_encode, (codec_f) fse->fse_decode, data, len);
+    comp_fse_free(fse);
+    comp_bar_free(bar);
+    free(data);
+    printf("%s\n", ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
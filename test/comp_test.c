@@ -0,0 +1,540 @@
+//
+// Created by zr on 23-2-21.
+//
+#define _GNU_SOURCE
+#include "../comp.h"
+#include "../marker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+static char dir[] = "/tmp/comp_testXXXXXX";
+
+struct pipe_pump_s
+{
+    int fd;
+    char* data; // 写入端：要写入的数据；读出端：读出的数据
+    size_t len;
+};
+
+typedef struct pipe_pump_s pipe_pump_t;
+
+/* 生成n字节的类文本数据 */
+static char* make_text(size_t n, unsigned seed)
+{
+    static const char* words[] = {"compress ", "block ", "huffman ", "stream ", "the ", "of ", "\n", "data "};
+    char* buf = (char*) malloc(n);
+    srand(seed);
+    for(size_t i = 0; i < n;)
+    {
+        const char* w = words[rand() % 8];
+        for(size_t k = 0; w[k] && i < n; k++)
+            buf[i++] = w[k];
+    }
+    return buf;
+}
+
+static int write_file(const char* path, const char* data, size_t n)
+{
+    FILE* fp = fopen(path, "wb");
+    if(!fp) return -1;
+    size_t w = fwrite(data, 1, n, fp);
+    return fclose(fp) == 0 && w == n ? 0 : -1;
+}
+
+/* 文件内容与 data 相同返回1 */
+static int same_file(const char* path, const char* data, size_t n)
+{
+    FILE* fp = fopen(path, "rb");
+    if(!fp) return 0;
+    char* buf = (char*) malloc(n + 1);
+    size_t r = fread(buf, 1, n + 1, fp);
+    fclose(fp);
+    int same = r == n && !memcmp(buf, data, n);
+    free(buf);
+    return same;
+}
+
+static void* pump_in(void* arg)
+{
+    pipe_pump_t* p = arg;
+    for(size_t done = 0; done < p->len;)
+    {
+        ssize_t w = write(p->fd, p->data + done, p->len - done);
+        if(w <= 0) break;
+        done += w;
+    }
+    close(p->fd);
+    return NULL;
+}
+
+static void* pump_out(void* arg)
+{
+    pipe_pump_t* p = arg;
+    size_t cap = 0;
+    char buf[65536];
+    ssize_t r;
+    while((r = read(p->fd, buf, sizeof(buf))) > 0)
+    {
+        if(p->len + r > cap)
+        {
+            cap = 2 * (p->len + r);
+            p->data = (char*) realloc(p->data, cap);
+        }
+        memcpy(p->data + p->len, buf, r);
+        p->len += r;
+    }
+    close(p->fd);
+    return NULL;
+}
+
+/* 以 "-" 为输入输出运行压缩或解压，标准输入输出都换成管道(不可seek)，
+ * in 写入标准输入，标准输出的内容放在 *out */
+static void run_piped(comp_compressor_t* c, int decompress, char* in, size_t in_len, char** out, size_t* out_len)
+{
+    int in_pipe[2], out_pipe[2];
+    if(pipe(in_pipe) != 0 || pipe(out_pipe) != 0)
+        return;
+    int saved_in = dup(STDIN_FILENO), saved_out = dup(STDOUT_FILENO);
+    pipe_pump_t src = {in_pipe[1], in, in_len}, dst = {out_pipe[0], NULL, 0};
+    pthread_t t1, t2;
+    fflush(stdout);
+    dup2(in_pipe[0], STDIN_FILENO);
+    dup2(out_pipe[1], STDOUT_FILENO);
+    close(in_pipe[0]);
+    close(out_pipe[1]);
+    pthread_create(&t1, NULL, pump_in, &src);
+    pthread_create(&t2, NULL, pump_out, &dst);
+    if(decompress)
+        c->decompress(c, "-", "-");
+    else
+        c->compress(c, "-", "-");
+    //换回原来的标准输入输出，管道的另一端才会看到结束
+    dup2(saved_in, STDIN_FILENO);
+    dup2(saved_out, STDOUT_FILENO);
+    close(saved_in);
+    close(saved_out);
+    pthread_join(t1, NULL);
+    pthread_join(t2, NULL);
+    *out = dst.data;
+    *out_len = dst.len;
+}
+
+/* 标准输入 -> 压缩 -> 标准输出 -> 解压 -> 标准输出，数据经过的都是管道。
+ * 输入比一个分块和IO块都大，覆盖多块、未知大小的流式路径 */
+static int test_stream()
+{
+    size_t n = 3 * 1024 * 1024 + 1234;
+    char* data = make_text(n, 1);
+    char* archive = NULL, * back = NULL;
+    size_t archive_len = 0, back_len = 0;
+    comp_compressor_t* c = comp_compressor_init(COMP_CODEC_HUFFMAN, COMP_LEVEL_DEFAULT);
+    run_piped(c, 0, data, n, &archive, &archive_len);
+    comp_compressor_free(c);
+    c = comp_compressor_init(COMP_CODEC_HUFFMAN, COMP_LEVEL_DEFAULT);
+    run_piped(c, 1, archive, archive_len, &back, &back_len);
+    comp_compressor_free(c);
+    int ok = archive_len > 0 && archive_len < n && back_len == n && !memcmp(back, data, n);
+    printf("stream: %zu bytes through stdin/stdout -> %zu -> %zu, %s\n", n, archive_len, back_len,
+           ok ? "ok" : "FAIL");
+    free(data);
+    free(archive);
+    free(back);
+    return ok;
+}
+
+/* 解压大于 COMP_DIRECT_IO_MIN 的文件时预分配并以O_DIRECT写出。
+ * 长度不是4K的整数倍，最后一块不对齐，IO线程在写它之前退回普通写 */
+static int test_direct_io()
+{
+    size_t n = COMP_DIRECT_IO_MIN + 1000;
+    char* data = (char*) calloc(1, n);
+    char* text = make_text(64 * 1024, 2);
+    memcpy(data, text, 64 * 1024);
+    memcpy(data + n - 64 * 1024, text, 64 * 1024);
+    free(text);
+    char src[64], archive[64], out[64], back[96];
+    snprintf(src, sizeof(src), "%s/big", dir);
+    snprintf(archive, sizeof(archive), "%s/big.tz", dir);
+    snprintf(out, sizeof(out), "%s/direct", dir);
+    snprintf(back, sizeof(back), "%s/big", out);
+    int ok = write_file(src, data, n) == 0 && mkdir(out, 0755) == 0;
+    comp_compressor_t* c = comp_compressor_init(COMP_CODEC_HUFFMAN, COMP_LEVEL_DEFAULT);
+    c->compress(c, src, archive);
+    comp_compressor_free(c);
+    c = comp_compressor_init(COMP_CODEC_HUFFMAN, COMP_LEVEL_DEFAULT);
+    c->direct_io = 1;
+    c->decompress(c, archive, out);
+    comp_compressor_free(c);
+    struct stat st;
+    ok = ok && stat(back, &st) == 0 && (size_t) st.st_size == n && (size_t) st.st_blocks * 512 >= n &&
+         same_file(back, data, n);
+    printf("direct io: %zu bytes extracted with O_DIRECT and an unaligned tail, %s\n", n, ok ? "ok" : "FAIL");
+    unlink(src);
+    unlink(back);
+    free(data);
+    return ok;
+}
+
+/* 嵌套的文件夹树：深处的文件夹之后还有同级的文件夹和文件，解压时每层的fd都要正确出栈 */
+static int test_nested_tree()
+{
+    static const char* dirs[] = {"tree", "tree/a", "tree/a/b", "tree/a/b/c", "tree/a/b/c/d", "tree/a/e",
+                                 "tree/f", "tree/f/empty", "tree/g"};
+    static const char* files[] = {"tree/top", "tree/a/b/c/d/deep", "tree/a/b/c/mid", "tree/a/e/after_deep",
+                                  "tree/a/x", "tree/f/y", "tree/g/zero", "tree/z"};
+    char path[128], archive[64], out[64], cmd[256];
+    int ok = 1;
+    for(size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]) && ok; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%s", dir, dirs[i]);
+        ok = mkdir(path, 0755) == 0;
+    }
+    for(size_t i = 0; i < sizeof(files) / sizeof(files[0]) && ok; i++)
+    {
+        size_t n = i == 6 ? 0 : 100 + i * 3000;
+        char* data = make_text(n, 10 + i);
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+        ok = write_file(path, data, n) == 0;
+        free(data);
+    }
+    snprintf(path, sizeof(path), "%s/tree", dir);
+    snprintf(archive, sizeof(archive), "%s/tree.tz", dir);
+    snprintf(out, sizeof(out), "%s/tree_out", dir);
+    ok = ok && mkdir(out, 0755) == 0;
+    comp_compressor_t* c = comp_compressor_init(COMP_CODEC_AUTO, COMP_LEVEL_DEFAULT);
+    c->compress(c, path, archive);
+    comp_compressor_free(c);
+    c = comp_compressor_init(COMP_CODEC_AUTO, COMP_LEVEL_DEFAULT);
+    c->decompress(c, archive, out);
+    comp_compressor_free(c);
+    snprintf(cmd, sizeof(cmd), "diff -r %s %s/tree > /dev/null", path, out);
+    ok = ok && system(cmd) == 0;
+    printf("nested tree: %zu dirs, %zu files extracted relative to dir fds, %s\n",
+           sizeof(dirs) / sizeof(dirs[0]), sizeof(files) / sizeof(files[0]), ok ? "ok" : "FAIL");
+    return ok;
+}
+
+/* 逐次加入文件并以不同的编码器更新压缩包，未改动的文件直接复制旧的块，
+ * 最后的压缩包里每个文件都带着不同编码器的标记，解压时按标记分派 */
+static int test_mixed_markers()
+{
+    char path[128], archive[2][64], out[64], cmd[256];
+    snprintf(path, sizeof(path), "%s/mixed", dir);
+    snprintf(out, sizeof(out), "%s/mixed_out", dir);
+    int ok = mkdir(path, 0755) == 0 && mkdir(out, 0755) == 0;
+    for(int k = 0; k < COMP_CODEC_NUM && ok; k++)
+    {
+        char file[160];
+        size_t n = 20000 + k * 5000;
+        char* data = make_text(n, 20 + k);
+        snprintf(file, sizeof(file), "%s/codec%d", path, k);
+        ok = write_file(file, data, n) == 0;
+        free(data);
+        snprintf(archive[k % 2], sizeof(archive[0]), "%s/mixed%d.tz", dir, k % 2);
+        comp_compressor_t* c = comp_compressor_init(k, COMP_LEVEL_DEFAULT);
+        if(k == 0)
+            c->compress(c, path, archive[0]);
+        else
+            c->update(c, archive[(k + 1) % 2], path, archive[k % 2]);
+        comp_compressor_free(c);
+    }
+    comp_compressor_t* c = comp_compressor_init(COMP_CODEC_HUFFMAN, COMP_LEVEL_DEFAULT);
+    c->decompress(c, archive[(COMP_CODEC_NUM - 1) % 2], out);
+    comp_compressor_free(c);
+    snprintf(cmd, sizeof(cmd), "diff -r %s %s/mixed > /dev/null", path, out);
+    ok = ok && system(cmd) == 0;
+    printf("mixed markers: %d files each coded by a different codec, %s\n", COMP_CODEC_NUM, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+/* max模式每块取所有编码器中代价最小的结果(解码耗时不计入代价)，压缩包不应大于任一单独编码器的压缩包 */
+static int test_race()
+{
+    size_t n = 300000;
+    char* data = make_text(n, 30);
+    char src[64], archive[64], out[64], back[96];
+    snprintf(src, sizeof(src), "%s/race", dir);
+    snprintf(archive, sizeof(archive), "%s/race.tz", dir);
+    snprintf(out, sizeof(out), "%s/race_out", dir);
+    snprintf(back, sizeof(back), "%s/race", out);
+    int ok = write_file(src, data, n) == 0 && mkdir(out, 0755) == 0;
+    struct stat st;
+    off_t single[COMP_CODEC_NUM], max_len = 0;
+    for(int k = COMP_CODEC_MAX; k < COMP_CODEC_NUM && ok; k++)
+    {
+        if(k == COMP_CODEC_AUTO)
+            continue;
+        comp_compressor_t* c = comp_compressor_init(k, COMP_LEVEL_DEFAULT);
+        c->filter = COMP_FILTER_NONE;
+        c->compress(c, src, archive);
+        comp_compressor_free(c);
+        ok = stat(archive, &st) == 0;
+        if(k == COMP_CODEC_MAX)
+        {
+            //max的压缩包解压校验
+            max_len = st.st_size;
+            c = comp_compressor_init(COMP_CODEC_HUFFMAN, COMP_LEVEL_DEFAULT);
+            c->decompress(c, archive, out);
+            comp_compressor_free(c);
+            ok = ok && same_file(back, data, n);
+        }
+        else
+            single[k] = st.st_size;
+        unlink(archive);
+    }
+    for(int k = 0; k < COMP_CODEC_NUM && ok; k++)
+        ok = max_len <= single[k];
+    printf("race: max %lld bytes, huffman %lld, lzw %lld, fse %lld, huffman_o1 %lld, bwt %lld, cm %lld, %s\n",
+           (long long) max_len, (long long) single[0], (long long) single[1], (long long) single[2],
+           (long long) single[3], (long long) single[4], (long long) single[5], ok ? "ok" : "FAIL");
+    unlink(src);
+    unlink(back);
+    free(data);
+    return ok;
+}
+
+/* 级别对应的参数与README中的表格一致，超出范围的级别按默认级别处理；
+ * 再分别以级别1和9压缩解压同一个文件，级别1的分块更小，文件被分成多块 */
+static int test_levels()
+{
+    static const struct
+    {
+        int level, expect;
+        size_t block_size;
+        int lzw_width, huffman_max_len, fse_table_log;
+        size_t bwt_block;
+        int cm_table_bits;
+    } cases[] = {
+            {1, 1, 256 * 1024, 9, 11, 10, 100 * 1024, 18},
+            {6, 6, 1024 * 1024, 12, 16, 12, 600 * 1024, 21},
+            {9, 9, 1024 * 1024, 16, 16, 12, 900 * 1024, 22},
+            {0, 6, 1024 * 1024, 12, 16, 12, 600 * 1024, 21},
+            {10, 6, 1024 * 1024, 12, 16, 12, 600 * 1024, 21},
+    };
+    int ok = 1;
+    for(size_t i = 0; i < sizeof(cases) / sizeof(cases[0]) && ok; i++)
+    {
+        comp_compressor_t* c = comp_compressor_init(COMP_CODEC_AUTO, cases[i].level);
+        ok = c->level == cases[i].expect && c->block_size == cases[i].block_size &&
+             ((comp_lzw_codec_t*) c->codecs[COMP_CODEC_LZW])->lzw_ctx->width == cases[i].lzw_width &&
+             ((comp_huffman_codec_t*) c->codecs[COMP_CODEC_HUFFMAN])->huffman_ctx->max_code_len ==
+             cases[i].huffman_max_len &&
+             ((comp_huffman_codec_t*) c->codecs[COMP_CODEC_HUFFMAN_O1])->huffman_ctx->max_code_len ==
+             cases[i].huffman_max_len &&
+             ((comp_fse_codec_t*) c->codecs[COMP_CODEC_FSE])->fse_ctx->table_log == cases[i].fse_table_log &&
+             ((comp_bwt_codec_t*) c->codecs[COMP_CODEC_BWT])->bwt_ctx->block_size == cases[i].bwt_block &&
+             ((comp_cm_codec_t*) c->codecs[COMP_CODEC_CM])->cm_ctx->table_bits == cases[i].cm_table_bits;
+        comp_compressor_free(c);
+    }
+    size_t n = 700000;
+    char* data = make_text(n, 40);
+    char src[64], archive[64], out[64], back[96];
+    snprintf(src, sizeof(src), "%s/level", dir);
+    snprintf(archive, sizeof(archive), "%s/level.tz", dir);
+    snprintf(out, sizeof(out), "%s/level_out", dir);
+    snprintf(back, sizeof(back), "%s/level", out);
+    ok = ok && write_file(src, data, n) == 0 && mkdir(out, 0755) == 0;
+    off_t len[2] = {0, 0};
+    for(int k = 0; k < 2 && ok; k++)
+    {
+        struct stat st;
+        comp_compressor_t* c = comp_compressor_init(COMP_CODEC_BWT, k ? COMP_LEVEL_MAX : COMP_LEVEL_MIN);
+        c->compress(c, src, archive);
+        comp_compressor_free(c);
+        c = comp_compressor_init(COMP_CODEC_HUFFMAN, COMP_LEVEL_DEFAULT);
+        c->decompress(c, archive, out);
+        comp_compressor_free(c);
+        ok = stat(archive, &st) == 0 && same_file(back, data, n);
+        len[k] = st.st_size;
+        unlink(archive);
+        unlink(back);
+    }
+    //同样的数据，级别9的BWT块更大，压缩率更高
+    ok = ok && len[1] < len[0];
+    printf("levels: parameters of levels 1, 6, 9 and out of range, bwt -1 %lld bytes, -9 %lld bytes, %s\n",
+           (long long) len[0], (long long) len[1], ok ? "ok" : "FAIL");
+    unlink(src);
+    free(data);
+    return ok;
+}
+
+/* 8KB随机数据重复128次：零阶熵接近8，但能利用重复的编解码器和max模式不应把它存储 */
+static int test_repeated_random()
+{
+    static const comp_codec_type types[] = {COMP_CODEC_MAX, COMP_CODEC_AUTO, COMP_CODEC_BWT, COMP_CODEC_CM};
+    size_t n = 1024 * 1024, period = 8192;
+    char* data = (char*) malloc(n);
+    srand(50);
+    for(size_t i = 0; i < n; i++)
+        data[i] = (char) (i < period ? rand() : data[i - period]);
+    char src[64], archive[64], out[64], back[96];
+    snprintf(src, sizeof(src), "%s/repeat", dir);
+    snprintf(archive, sizeof(archive), "%s/repeat.tz", dir);
+    snprintf(out, sizeof(out), "%s/repeat_out", dir);
+    snprintf(back, sizeof(back), "%s/repeat", out);
+    int ok = write_file(src, data, n) == 0 && mkdir(out, 0755) == 0;
+    printf("repeated random:");
+    for(size_t k = 0; k < sizeof(types) / sizeof(types[0]) && ok; k++)
+    {
+        struct stat st;
+        comp_compressor_t* c = comp_compressor_init(types[k], COMP_LEVEL_DEFAULT);
+        c->compress(c, src, archive);
+        comp_compressor_free(c);
+        c = comp_compressor_init(COMP_CODEC_HUFFMAN, COMP_LEVEL_DEFAULT);
+        c->decompress(c, archive, out);
+        comp_compressor_free(c);
+        ok = stat(archive, &st) == 0 && (size_t) st.st_size < 4 * period && same_file(back, data, n);
+        printf(" %lld", (long long) st.st_size);
+        unlink(archive);
+        unlink(back);
+    }
+    printf(" bytes, %s\n", ok ? "ok" : "FAIL");
+    unlink(src);
+    free(data);
+    return ok;
+}
+
+/* 读出整个文件，长度放在 *n */
+static char* read_file(const char* path, size_t* n)
+{
+    FILE* fp = fopen(path, "rb");
+    if(!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    *n = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char* buf = (char*) malloc(*n + 1);
+    if(fread(buf, 1, *n, fp) != *n)
+    {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(fp);
+    return buf;
+}
+
+/* 在压缩包 archive 中找名为 name 的文件条目，返回压缩数据的位置，长度和标志放在 *len、*flags，没有时返回NULL */
+static const char* find_payload(const char* archive, size_t n, const char* name, u_int64_t* len, int* flags)
+{
+    char pattern[64];
+    size_t name_len = strlen(name);
+    pattern[0] = (char) COMP_FILE_META_MARKER;
+    pattern[1] = (char) name_len;
+    memcpy(pattern + 2, name, name_len);
+    const char* p = memmem(archive, n, pattern, name_len + 2);
+    if(!p) return NULL;
+    //元信息：标志、大小、修改时间、[哈希]、[过滤器]、压缩数据长度
+    size_t meta = name_len + 2;
+    *flags = (u_char) p[meta];
+    meta += 17 + ((*flags & COMP_ENTRY_FLAG_HASH) ? 8 : 0) + ((*flags & COMP_ENTRY_FLAG_FILTER) ? 2 : 0);
+    comp_bitstream_t* s = comp_bitstream_init(fmemopen((void*) (p + meta), 8, "rb"));
+    int err = comp_bitstream_read_long(s, len);
+    comp_bitstream_destroy(s);
+    return err < 0 ? NULL : p + meta + 8;
+}
+
+/* 两个压缩包中名为 name 的条目的压缩数据完全相同返回1 */
+static int same_payload(const char* a, size_t a_len, const char* b, size_t b_len, const char* name)
+{
+    u_int64_t la, lb;
+    int fa, fb;
+    const char* pa = find_payload(a, a_len, name, &la, &fa);
+    const char* pb = find_payload(b, b_len, name, &lb, &fb);
+    return pa && pb && la == lb && !memcmp(pa, pb, la);
+}
+
+/* 增量更新：用LZW压缩后修改一个文件、删除一个、新增一个，再用huffman更新。
+ * 没有改变的条目(包括子文件夹中的)直接复制，压缩数据与旧压缩包中的逐字节相同(huffman重新压缩的结果会不同)；
+ * 修改的文件重新压缩，删除的文件不再出现。引用了其他条目中的块的条目不能单独复制，也要重新压缩 */
+static int test_update()
+{
+    static const char* names[] = {"alpha", "bravo", "charlie", "delta", "sub/echo", "sub/golf"};
+    char path[160], root[64], old_archive[64], new_archive[64], out[64], cmd[256];
+    snprintf(root, sizeof(root), "%s/upd", dir);
+    snprintf(path, sizeof(path), "%s/sub", root);
+    snprintf(old_archive, sizeof(old_archive), "%s/upd_old.tz", dir);
+    snprintf(new_archive, sizeof(new_archive), "%s/upd_new.tz", dir);
+    snprintf(out, sizeof(out), "%s/upd_out", dir);
+    int ok = mkdir(root, 0755) == 0 && mkdir(path, 0755) == 0 && mkdir(out, 0755) == 0;
+    //golf与echo内容相同，去重后golf引用echo的块
+    char* data = NULL;
+    for(size_t i = 0; i < sizeof(names) / sizeof(names[0]) && ok; i++)
+    {
+        size_t n = 20000 + (i < 5 ? i : 4) * 7000;
+        if(i < 5)
+        {
+            free(data);
+            data = make_text(n, 60 + i);
+        }
+        snprintf(path, sizeof(path), "%s/%s", root, names[i]);
+        ok = write_file(path, data, n) == 0;
+    }
+    free(data);
+    comp_compressor_t* c = comp_compressor_init(COMP_CODEC_LZW, COMP_LEVEL_DEFAULT);
+    c->dedup = 1;
+    c->compress(c, root, old_archive);
+    comp_compressor_free(c);
+
+    char* changed = make_text(12345, 70);
+    snprintf(path, sizeof(path), "%s/charlie", root);
+    ok = ok && write_file(path, changed, 12345) == 0;
+    snprintf(path, sizeof(path), "%s/delta", root);
+    ok = ok && unlink(path) == 0;
+    snprintf(path, sizeof(path), "%s/foxtrot", root);
+    ok = ok && write_file(path, changed, 12345) == 0;
+    free(changed);
+    c = comp_compressor_init(COMP_CODEC_HUFFMAN, COMP_LEVEL_DEFAULT);
+    c->update(c, old_archive, root, new_archive);
+    comp_compressor_free(c);
+
+    size_t old_len = 0, new_len = 0;
+    char* old_buf = read_file(old_archive, &old_len);
+    char* new_buf = read_file(new_archive, &new_len);
+    u_int64_t len;
+    int flags;
+    ok = ok && old_buf && new_buf;
+    ok = ok && same_payload(old_buf, old_len, new_buf, new_len, "alpha") &&
+         same_payload(old_buf, old_len, new_buf, new_len, "bravo") &&
+         same_payload(old_buf, old_len, new_buf, new_len, "echo");
+    ok = ok && !same_payload(old_buf, old_len, new_buf, new_len, "charlie") &&
+         find_payload(new_buf, new_len, "charlie", &len, &flags);
+    ok = ok && find_payload(old_buf, old_len, "delta", &len, &flags) && !find_payload(new_buf, new_len, "delta", &len, &flags);
+    ok = ok && find_payload(new_buf, new_len, "foxtrot", &len, &flags);
+    //golf在旧压缩包中引用了echo的块，更新时重新压缩
+    ok = ok && find_payload(old_buf, old_len, "golf", &len, &flags) && (flags & COMP_ENTRY_FLAG_REFS) &&
+         !same_payload(old_buf, old_len, new_buf, new_len, "golf");
+    free(old_buf);
+    free(new_buf);
+
+    c = comp_compressor_init(COMP_CODEC_HUFFMAN, COMP_LEVEL_DEFAULT);
+    c->decompress(c, new_archive, out);
+    comp_compressor_free(c);
+    snprintf(cmd, sizeof(cmd), "diff -r %s %s/upd > /dev/null", root, out);
+    snprintf(path, sizeof(path), "%s/upd/delta", out);
+    ok = ok && system(cmd) == 0 && access(path, F_OK) != 0;
+    printf("update: unchanged entries copied byte for byte, changed and referencing entries recompressed, "
+           "deleted entry dropped, %s\n", ok ? "ok" : "FAIL");
+    return ok;
+}
+
+int main()
+{
+    if(!mkdtemp(dir))
+        return 1;
+    int ok = test_stream();
+    ok = test_direct_io() && ok;
+    ok = test_nested_tree() && ok;
+    ok = test_mixed_markers() && ok;
+    ok = test_race() && ok;
+    ok = test_levels() && ok;
+    ok = test_repeated_random() && ok;
+    ok = test_update() && ok;
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    system(cmd);
+    return ok ? 0 : 1;
+}
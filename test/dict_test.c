@@ -0,0 +1,104 @@
+//
+// Created by zr on 23-2-18.
+//
+#include "../dict.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define SAMPLE_NUM 200
+
+static const char* words[] = {"\"status\": ", "\"active\"", "\"user\": ", "\"id\": ", "\"email\": ",
+                              "\"created_at\": ", "\"tags\": [", "\"admin\"", "\"pending\"", "},\n  {"};
+
+/* 生成一条结构相同、内容随机的记录 */
+static size_t make_sample(char* buf, size_t cap)
+{
+    size_t n = 0;
+    while(n + 64 < cap && rand() % 40)
+        n += snprintf(buf + n, cap - n, "%s%d, ", words[rand() % 10], rand() % 1000);
+    return n;
+}
+
+/* 用 encode/decode 编解码一段数据，返回编码长度，解码结果不同时返回0 */
+static size_t roundtrip(void* ctx, int (*enc)(void*, comp_bitstream_t*, comp_bitstream_t*),
+                        int (*dec)(void*, comp_bitstream_t*, comp_bitstream_t*), char* buf, size_t n)
+{
+    char* out = NULL, * back = NULL;
+    size_t out_len = 0, back_len = 0;
+    comp_bitstream_t* in = comp_bitstream_init(fmemopen(buf, n, "rb"));
+    comp_bitstream_t* o = comp_bitstream_init(open_memstream(&out, &out_len));
+    enc(ctx, in, o);
+    comp_bitstream_destroy(in);
+    comp_bitstream_destroy(o);
+    in = comp_bitstream_init(fmemopen(out, out_len, "rb"));
+    o = comp_bitstream_init(open_memstream(&back, &back_len));
+    int err = dec(ctx, in, o);
+    comp_bitstream_destroy(in);
+    comp_bitstream_destroy(o);
+    size_t len = err == 0 && back_len == n && !memcmp(back, buf, n) ? out_len : 0;
+    free(out);
+    free(back);
+    return len;
+}
+
+int main()
+{
+    char dir[] = "/tmp/dict_testXXXXXX", path[64], buf[4096];
+    if(!mkdtemp(dir))
+        return 1;
+    srand(1);
+    for(int i = 0; i < SAMPLE_NUM; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%d", dir, i);
+        FILE* fp = fopen(path, "wb");
+        fwrite(buf, 1, make_sample(buf, sizeof(buf)), fp);
+        fclose(fp);
+    }
+    char* paths[] = {dir};
+    comp_dict_t* dict = comp_dict_train(paths, 1);
+    snprintf(path, sizeof(path), "%s/dict", dir);
+    comp_dict_t* loaded = dict && comp_dict_save(dict, path) == 0 ? comp_dict_load(path) : NULL;
+    int ok = loaded && loaded->id == dict->id && loaded->lzw_num == dict->lzw_num;
+    printf("train: %u strings from %zu files, save/load %s\n", dict ? dict->lzw_num : 0,
+           dict ? dict->sample_num : 0, ok ? "ok" : "FAIL");
+
+    comp_progress_bar* bar = comp_bar_init("", 0);
+    comp_huffman_ctx_t* huff = comp_huffman_init(bar, HUFFMAN_MAX_CODE_LEN, 0);
+    comp_lzw_ctx_t* lzw = comp_lzw_init(bar, LZW_CODE_WIDTH);
+    size_t raw = 0, huff_len[2] = {0}, lzw_len[2] = {0};
+    for(int i = 0; i < 50 && ok; i++)
+    {
+        size_t n = make_sample(buf, 1024);
+        raw += n;
+        for(int d = 0; d < 2 && ok; d++)
+        {
+            comp_huffman_set_dict(huff, d ? loaded->huffman_len : NULL);
+            comp_lzw_set_dict(lzw, d ? loaded->lzw_prefix : NULL, d ? loaded->lzw_char : NULL,
+                              d ? loaded->lzw_num : 0);
+            size_t h = roundtrip(huff, (void*) huff->huffman_encode, (void*) huff->huffman_decode, buf, n);
+            size_t l = roundtrip(lzw, (void*) lzw->lzw_encode, (void*) lzw->lzw_decode, buf, n);
+            ok = h > 0 && l > 0;
+            huff_len[d] += h;
+            lzw_len[d] += l;
+        }
+    }
+    printf("small inputs (%zu bytes): huffman %zu -> %zu, lzw %zu -> %zu with dictionary, %s\n",
+           raw, huff_len[0], huff_len[1], lzw_len[0], lzw_len[1], ok ? "ok" : "FAIL");
+    comp_huffman_free(huff);
+    comp_lzw_free(lzw);
+    comp_bar_free(bar);
+    comp_dict_free(dict);
+    comp_dict_free(loaded);
+    for(int i = 0; i < SAMPLE_NUM; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%d", dir, i);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/dict", dir);
+    unlink(path);
+    rmdir(dir);
+    return ok ? 0 : 1;
+}
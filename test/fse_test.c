@@ -0,0 +1,128 @@
+//
+// Created by zr on 23-2-14.
+// FSE编解码的往返测试，并比较FSE与huffman(含一阶上下文模式)的压缩率和速度：fse_test [file]
+//
+#include "../fse.h"
+#include "../huffman.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static comp_bitstream_t* mem_in(char* buf, size_t len)
+{
+    return comp_bitstream_init(len ? fmemopen(buf, len, "rb") : fopen("/dev/null", "rb"));
+}
+
+static int fse_roundtrip(comp_fse_ctx_t* fse, char* data, size_t len, const char* name)
+{
+    char* enc = NULL, * dec = NULL;
+    size_t enc_len = 0, dec_len = 0;
+    comp_bitstream_t* in = mem_in(data, len);
+    comp_bitstream_t* out = comp_bitstream_init(open_memstream(&enc, &enc_len));
+    double t1 = now_ms();
+    int err = fse->fse_encode(fse, in, out);
+    comp_bitstream_destroy(in);
+    comp_bitstream_destroy(out);
+    double t2 = now_ms();
+    in = mem_in(enc, enc_len);
+    out = comp_bitstream_init(open_memstream(&dec, &dec_len));
+    if(err == 0)
+        err = fse->fse_decode(fse, in, out);
+    comp_bitstream_destroy(in);
+    comp_bitstream_destroy(out);
+    double t3 = now_ms();
+    int ok = err == 0 && dec_len == len && !memcmp(dec, data, len);
+    printf("fse %-20s %zu -> %zu (%.3f), encode %.1f MB/s, decode %.1f MB/s, %s\n", name, len, enc_len,
+           len ? (double) enc_len / len : 0, len / 1e3 / (t2 - t1), len / 1e3 / (t3 - t2), ok ? "ok" : "FAIL");
+    free(enc);
+    free(dec);
+    return ok;
+}
+
+/* order 0 为普通huffman，order 1 为一阶上下文模式 */
+static int huffman_roundtrip(comp_progress_bar* bar, int order, char* data, size_t len)
+{
+    char* enc = NULL, * dec = NULL;
+    size_t enc_len = 0, dec_len = 0;
+    comp_huffman_ctx_t* huff = comp_huffman_init(bar, HUFFMAN_MAX_CODE_LEN, order);
+    comp_bitstream_t* in = mem_in(data, len);
+    comp_bitstream_t* out = comp_bitstream_init(open_memstream(&enc, &enc_len));
+    double t1 = now_ms();
+    huff->huffman_encode(huff, in, out);
+    comp_bitstream_destroy(in);
+    comp_bitstream_destroy(out);
+    double t2 = now_ms();
+    in = mem_in(enc, enc_len);
+    out = comp_bitstream_init(open_memstream(&dec, &dec_len));
+    int err = huff->huffman_decode(huff, in, out);
+    comp_bitstream_destroy(in);
+    comp_bitstream_destroy(out);
+    double t3 = now_ms();
+    int ok = err == 0 && dec_len == len && !memcmp(dec, data, len);
+    printf("%-24s %zu -> %zu (%.3f), encode %.1f MB/s, decode %.1f MB/s, %s\n", order ? "huffman1:" : "huffman:",
+           len, enc_len, (double) enc_len / len, len / 1e3 / (t2 - t1), len / 1e3 / (t3 - t2), ok ? "ok" : "FAIL");
+    free(enc);
+    free(dec);
+    comp_huffman_free(huff);
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    //比一帧多一些，最后一帧只有几个字节
+    size_t len = FSE_FRAME_SIZE + 3;
+    char* data;
+    if(argc > 1)
+    {
+        FILE* fp = fopen(argv[1], "rb");
+        if(!fp) return 1;
+        fseek(fp, 0, SEEK_END);
+        len = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        data = (char*) malloc(len);
+        if(fread(data, 1, len, fp) != len) return 1;
+        fclose(fp);
+    }
+    else
+    {
+        //没有指定文件时用分布不均匀的随机字母
+        data = (char*) malloc(len);
+        srand(1);
+        for(size_t i = 0; i < len; i++)
+            data[i] = (char) (rand() % 5 == 0 ? ' ' : 'a' + rand() % (1 + rand() % 26));
+    }
+    //总大小为0时进度条不显示
+    comp_progress_bar* bar = comp_bar_init("", 0);
+    comp_fse_ctx_t* fse = comp_fse_init(bar, FSE_TABLE_LOG);
+    int ok = fse_roundtrip(fse, data, len, argc > 1 ? "file:" : "over one frame:");
+    for(int order = 0; order <= 1; order++)
+        ok &= huffman_roundtrip(bar, order, data, len);
+    //边界情况：空数据、单字节、只有一种符号(归一化频数等于表大小)、全部256种符号
+    ok &= fse_roundtrip(fse, data, 0, "empty:");
+    ok &= fse_roundtrip(fse, data, 1, "one byte:");
+    memset(data, 'x', len);
+    ok &= fse_roundtrip(fse, data, 4096, "single symbol:");
+    //帧的表大小按数据量缩小，不一定是 1 << table_log，唯一的符号占满整个表
+    int table_size = 0;
+    for(int s = 0; s < FSE_MAX_SYMBOL; s++)
+        table_size += fse->norm[s];
+    ok &= fse->norm['x'] == table_size && (table_size & (table_size - 1)) == 0;
+    for(size_t i = 0; i < len; i++)
+        data[i] = (char) (i * 7 + i / 256);
+    ok &= fse_roundtrip(fse, data, 256 * 64, "all 256 symbols:");
+    for(int s = 0; s < FSE_MAX_SYMBOL; s++)
+        ok &= fse->norm[s] > 0;
+    comp_fse_free(fse);
+    comp_bar_free(bar);
+    free(data);
+    printf("%s\n", ok ? "ok" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+//
+// Created by zr on 23-2-19.
+//
+#include "../huffman.h"
+#include "../marker.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* words[] = {"the ", "of ", "and ", "to ", "in ", "is ", "for ", "on ", "that ", "with "};
+
+/* 生成一段由常用词组成的短文本，分布相近 */
+static size_t make_text(char* buf, size_t cap)
+{
+    size_t n = 0;
+    while(n + 8 < cap && rand() % 200)
+        n += snprintf(buf + n, cap - n, "%s", words[rand() % 10]);
+    return n;
+}
+
+/* 编码 buf，返回编码长度，编码结果放在 *out，由调用者释放 */
+static size_t encode_buf(comp_huffman_ctx_t* huff, char* buf, size_t n, char** out)
+{
+    size_t out_len = 0;
+    comp_bitstream_t* in = comp_bitstream_init(fmemopen(buf, n, "rb"));
+    comp_bitstream_t* o = comp_bitstream_init(open_memstream(out, &out_len));
+    huff->huffman_encode(huff, in, o);
+    comp_bitstream_destroy(in);
+    comp_bitstream_destroy(o);
+    return out_len;
+}
+
+static int decode_buf(comp_huffman_ctx_t* huff, char* enc, size_t enc_len, char* buf, size_t n)
+{
+    char* back = NULL;
+    size_t back_len = 0;
+    comp_bitstream_t* in = comp_bitstream_init(fmemopen(enc, enc_len, "rb"));
+    comp_bitstream_t* o = comp_bitstream_init(open_memstream(&back, &back_len));
+    int err = huff->huffman_decode(huff, in, o);
+    comp_bitstream_destroy(in);
+    comp_bitstream_destroy(o);
+    int ok = err == 0 && back_len == n && !memcmp(back, buf, n);
+    free(back);
+    return ok;
+}
+
+int main()
+{
+    comp_progress_bar* bar = comp_bar_init("", 0);
+    comp_huffman_ctx_t* enc = comp_huffman_init(bar, HUFFMAN_MAX_CODE_LEN, 0);
+    comp_huffman_ctx_t* dec = comp_huffman_init(bar, HUFFMAN_MAX_CODE_LEN, 0);
+    comp_huffman_tables_t* enc_tables = comp_huffman_tables_init();
+    comp_huffman_tables_t* dec_tables = comp_huffman_tables_init();
+    comp_huffman_set_tables(enc, enc_tables);
+    comp_huffman_set_tables(dec, dec_tables);
+    //编码端在输入之间写出待写出的表，解码端按同样的顺序读入，模拟压缩包中的记录
+    char* records = NULL;
+    size_t records_len = 0;
+    comp_bitstream_t* rec_out = comp_bitstream_init(open_memstream(&records, &records_len));
+    char buf[2048];
+    size_t raw = 0, total = 0, refs = 0;
+    int ok = 1, id;
+    srand(1);
+    for(int i = 0; i < 100 && ok; i++)
+    {
+        while((id = comp_huffman_tables_commit(enc_tables)) >= 0)
+        {
+            comp_huffman_tables_write(enc_tables, id, rec_out);
+            comp_bitstream_flush(rec_out);
+            comp_bitstream_t* rec_in = comp_bitstream_init(fmemopen(records, records_len, "rb"));
+            ok = comp_huffman_tables_read(dec_tables, rec_in) > 0;
+            comp_bitstream_destroy(rec_in);
+            comp_bitstream_destroy(rec_out);
+            free(records);
+            records = NULL;
+            rec_out = comp_bitstream_init(open_memstream(&records, &records_len));
+        }
+        size_t n = make_text(buf, sizeof(buf));
+        char* out = NULL;
+        size_t out_len = encode_buf(enc, buf, n, &out);
+        refs += (u_char) out[0] == HUFFMAN_TABLE_HEADER_MARKER;
+        ok = ok && decode_buf(dec, out, out_len, buf, n);
+        raw += n;
+        total += out_len;
+        free(out);
+    }
+    printf("%zu bytes -> %zu, %d tables, %zu of 100 inputs use a shared table, %s\n",
+           raw, total, enc_tables->num, refs, ok && refs > 0 && dec_tables->num == enc_tables->num ? "ok" : "FAIL");
+    comp_bitstream_destroy(rec_out);
+    free(records);
+    comp_huffman_free(enc);
+    comp_huffman_free(dec);
+    comp_huffman_tables_free(enc_tables);
+    comp_huffman_tables_free(dec_tables);
+    comp_bar_free(bar);
+    return ok && refs > 0 ? 0 : 1;
+}
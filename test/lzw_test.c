@@ -8,14 +8,14 @@ int main()
 {
     comp_bitstream_t* in = comp_bitstream_init(fopen("test", "rb"));
     comp_bitstream_t* out = comp_bitstream_init(fopen("test_out", "wb"));
-    comp_lzw_ctx_t* lzw = comp_lzw_init(NULL);
+    comp_lzw_ctx_t* lzw = comp_lzw_init(NULL, LZW_CODE_WIDTH);
     lzw->lzw_encode(lzw, in, out);
     comp_bitstream_destroy(in);
     comp_bitstream_destroy(out);
 
 //    comp_bitstream_t* in = comp_bitstream_init(fopen("test_out", "rb"));
 //    comp_bitstream_t* out = comp_bitstream_init(fopen("test_dec", "wb"));
-//    comp_lzw_ctx_t* lzw = comp_lzw_init(NULL);
+//    comp_lzw_ctx_t* lzw = comp_lzw_init(NULL, LZW_CODE_WIDTH);
 //    lzw->lzw_decode(lzw, in, out);
 //    comp_bitstream_destroy(in);
 //    comp_bitstream_destroy(out);
@@ -0,0 +1,125 @@
+//
+// Created by zr on 23-2-20.
+//
+#include "../manifest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define DIR_NUM 100 // 子文件夹多于 MANIFEST_MAX_DIR_FDS，一部分文件夹的fd要在进入时重新打开
+#define FILE_NUM 5
+
+static size_t file_size(int d, int f)
+{
+    return (size_t) ((d * 7 + f * 13) % 50) * 10 + f;
+}
+
+/* 生成 root/dD/sub/fF 以及 root/fF，文件内容是长度为 file_size 的重复字节 */
+static int make_tree(const char* root, u_int64_t* total)
+{
+    char path[256], buf[512];
+    *total = 0;
+    for(int d = -1; d < DIR_NUM; d++)
+    {
+        if(d >= 0)
+        {
+            snprintf(path, sizeof(path), "%s/d%d", root, d);
+            if(mkdir(path, 0755) != 0)
+                return -1;
+            snprintf(path, sizeof(path), "%s/d%d/sub", root, d);
+            if(mkdir(path, 0755) != 0)
+                return -1;
+        }
+        for(int f = 0; f < FILE_NUM; f++)
+        {
+            if(d >= 0)
+                snprintf(path, sizeof(path), "%s/d%d/sub/f%d", root, d, f);
+            else
+                snprintf(path, sizeof(path), "%s/f%d", root, f);
+            size_t n = file_size(d + 1, f);
+            memset(buf, 'a' + f, n);
+            FILE* fp = fopen(path, "wb");
+            if(!fp)
+                return -1;
+            fwrite(buf, 1, n, fp);
+            fclose(fp);
+            *total += n;
+        }
+    }
+    return 0;
+}
+
+/* 按压缩的顺序遍历清单：文件从大到小排列，并且能相对于文件夹fd打开，内容与大小一致 */
+static int walk(comp_manifest_t* m, comp_manifest_entry_t* dir, size_t* files, size_t* dirs)
+{
+    char buf[512];
+    int ok = comp_manifest_enter(m, dir) == 0;
+    for(size_t i = 0; i < comp_vec_len(dir->files) && ok; i++)
+    {
+        comp_manifest_entry_t* e = comp_vec_get(dir->files, i);
+        comp_manifest_entry_t* prev = i > 0 ? comp_vec_get(dir->files, i - 1) : NULL;
+        int fd = comp_manifest_open(e);
+        ssize_t n = fd >= 0 ? read(fd, buf, sizeof(buf)) : -1;
+        ok = (!prev || prev->size >= e->size) && e->parent == dir && n == (ssize_t) e->size &&
+             (n == 0 || buf[0] == 'a' + e->name[1] - '0');
+        if(fd >= 0)
+            close(fd);
+        (*files)++;
+    }
+    for(size_t i = 0; i < comp_vec_len(dir->dirs) && ok; i++)
+    {
+        (*dirs)++;
+        ok = walk(m, comp_vec_get(dir->dirs, i), files, dirs);
+    }
+    comp_manifest_leave(m, dir);
+    return ok;
+}
+
+static void remove_tree(const char* root)
+{
+    char path[256];
+    for(int d = -1; d < DIR_NUM; d++)
+    {
+        for(int f = 0; f < FILE_NUM; f++)
+        {
+            if(d >= 0)
+                snprintf(path, sizeof(path), "%s/d%d/sub/f%d", root, d, f);
+            else
+                snprintf(path, sizeof(path), "%s/f%d", root, f);
+            unlink(path);
+        }
+        if(d >= 0)
+        {
+            snprintf(path, sizeof(path), "%s/d%d/sub", root, d);
+            rmdir(path);
+            snprintf(path, sizeof(path), "%s/d%d", root, d);
+            rmdir(path);
+        }
+    }
+    rmdir(root);
+}
+
+int main()
+{
+    char root[] = "/tmp/manifest_testXXXXXX";
+    u_int64_t total;
+    if(!mkdtemp(root) || make_tree(root, &total) < 0)
+        return 1;
+    comp_manifest_t* m = comp_manifest_build(root, 0);
+    size_t files = 0, dirs = 0;
+    int ok = m && walk(m, m->root, &files, &dirs);
+    if(ok)
+    {
+        comp_manifest_wait_all(m);
+        ok = comp_manifest_total_size(m) == total && m->file_num == files && m->dir_num == dirs &&
+             files == (DIR_NUM + 1) * FILE_NUM && dirs == 2 * DIR_NUM && m->open_dirs == 0;
+    }
+    printf("%zu files, %zu dirs, %llu bytes, largest first, opened relative to dir fds, %s\n",
+           files, dirs, (unsigned long long) total, ok ? "ok" : "FAIL");
+    comp_manifest_free(m);
+    remove_tree(root);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+//
+// Created by zr on 23-2-19.
+//
+#include "../pace.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BLOCK (1024 * 1024)
+#define BLOCK_NUM 40
+
+/* 模拟压缩：每个档位每字节的耗时固定，时间由各块耗时累加得出，不依赖真实时钟。
+ * 记录每块的档位，返回模拟的总耗时(纳秒) */
+static double simulate(comp_pace_t* pace, u_int64_t total, int no_fast, const double* cost, int* efforts)
+{
+    double now = 0;
+    for(int i = 0; i < BLOCK_NUM; i++)
+    {
+        int e = comp_pace_choose(pace, BLOCK, total, now, no_fast);
+        double ns = cost[e] * BLOCK;
+        comp_pace_update(pace, e, BLOCK, ns);
+        now += ns;
+        efforts[i] = e;
+    }
+    return now;
+}
+
+/* 档位序列中依次出现了 seq 中的各档位 */
+static int has_sequence(const int* efforts, const int* seq, int len)
+{
+    int k = 0;
+    for(int i = 0; i < BLOCK_NUM && k < len; i++)
+        if(efforts[i] == seq[k])
+            k++;
+    return k == len;
+}
+
+static void print_efforts(const char* name, const int* efforts)
+{
+    printf("%s: ", name);
+    for(int i = 0; i < BLOCK_NUM; i++)
+        putchar("NFS"[efforts[i]]);
+}
+
+int main()
+{
+    //正常档位50ns/B，快速2ns/B，存储0.1ns/B，目标100MB/s(约9.5ns/B)：
+    //正常档位太慢，落后于进度时降到存储，追上进度后升回快速，富余时再升回正常，如此往复
+    const double cost[COMP_EFFORT_NUM] = {50, 2, 0.1};
+    int efforts[BLOCK_NUM];
+    comp_pace_t* pace = comp_pace_init(100, 0);
+    double ns = simulate(pace, 0, 0, cost, efforts);
+    double target = (double) BLOCK * BLOCK_NUM / pace->rate;
+    static const int down_up[] = {COMP_EFFORT_NORMAL, COMP_EFFORT_STORED, COMP_EFFORT_FAST, COMP_EFFORT_NORMAL,
+                                  COMP_EFFORT_FAST, COMP_EFFORT_NORMAL};
+    int rate_ok = has_sequence(efforts, down_up, 6) && pace->blocks[COMP_EFFORT_NORMAL] > 0 &&
+                  ns <= target + cost[COMP_EFFORT_NORMAL] * BLOCK;
+    print_efforts("rate", efforts);
+    printf(" %.0fms for a %.0fms target, %s\n", ns / 1e6, target / 1e6, rate_ok ? "ok" : "FAIL");
+    free(pace);
+
+    //正常档位本来就是huffman时不用快速档位，直接在正常和存储之间切换
+    pace = comp_pace_init(100, 0);
+    simulate(pace, 0, 1, cost, efforts);
+    static const int no_fast[] = {COMP_EFFORT_NORMAL, COMP_EFFORT_STORED, COMP_EFFORT_NORMAL};
+    int no_fast_ok = has_sequence(efforts, no_fast, 3) && pace->blocks[COMP_EFFORT_FAST] == 0;
+    print_efforts("no fast", efforts);
+    printf(" %s\n", no_fast_ok ? "ok" : "FAIL");
+    free(pace);
+
+    //截止时间宽裕时全部用正常档位，截止时间紧时不超时太多
+    pace = comp_pace_init(0, 3);
+    ns = simulate(pace, (u_int64_t) BLOCK * BLOCK_NUM, 0, cost, efforts);
+    int loose_ok = pace->blocks[COMP_EFFORT_NORMAL] == BLOCK_NUM && ns <= 3e9;
+    print_efforts("deadline 3s", efforts);
+    printf(" %.0fms, %s\n", ns / 1e6, loose_ok ? "ok" : "FAIL");
+    free(pace);
+    pace = comp_pace_init(0, 0.5);
+    ns = simulate(pace, (u_int64_t) BLOCK * BLOCK_NUM, 0, cost, efforts);
+    int tight_ok = pace->blocks[COMP_EFFORT_NORMAL] < BLOCK_NUM && ns <= 0.5e9 + cost[COMP_EFFORT_NORMAL] * BLOCK;
+    print_efforts("deadline 0.5s", efforts);
+    printf(" %.0fms, %s\n", ns / 1e6, tight_ok ? "ok" : "FAIL");
+    free(pace);
+    return rate_ok && no_fast_ok && loose_ok && tight_ok ? 0 : 1;
+}